@@ -7,11 +7,52 @@
 #include <vector>
 #include <map>
 #include <string>
-#include <functional>
 #include <random>
 #include <cmath>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <charconv>
+#include <string_view>
+#include <type_traits>
+#include <iterator>
+#include <filesystem>
+#include <unordered_set>
+#include <iomanip>
+#include <limits>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <array>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
 
 // Constants
 const int WINDOW_WIDTH = 800;
@@ -37,6 +78,17 @@ class ResourceManager;
 class QuestManager;
 class UIManager;
 class SoundManager;
+class ParticleSystem;
+class FrameProfiler;
+class DrawList;
+class RenderThread;
+class LightMap;
+class TimerWheel;
+class StatusEffects;
+class SpatialGrid;
+class TileCollider;
+class PathFinder;
+class SpellSystem;
 
 // Utility functions
 namespace GameUtils {
@@ -66,2147 +118,13431 @@ namespace GameUtils {
         return dist(rng);
     }
    
+    // Uniform float in [0, 1) from the top 24 bits of a single draw
+    float randomUnit(std::mt19937& generator) {
+        return static_cast<float>(generator() >> 8) * (1.0f / 16777216.0f);
+    }
+   
     // Calculate distance between two points
     float distance(float x1, float y1, float x2, float y2) {
         return std::sqrt(std::pow(x2 - x1, 2) + std::pow(y2 - y1, 2));
     }
+   
+    // The world rectangle a view can see; a rotated view sees its bounding box
+    sf::FloatRect viewBounds(const sf::View& view) {
+        sf::Vector2f center = view.getCenter();
+        sf::Vector2f half = view.getSize() / 2.0f;
+        if (view.getRotation() != 0.0f) {
+            float angle = view.getRotation() * 3.14159265f / 180.0f;
+            float cosine = std::abs(std::cos(angle));
+            float sine = std::abs(std::sin(angle));
+            half = sf::Vector2f(half.x * cosine + half.y * sine, half.x * sine + half.y * cosine);
+        }
+        return sf::FloatRect(center.x - half.x, center.y - half.y, half.x * 2.0f, half.y * 2.0f);
+    }
+
+    // Shared storage for names, so entities hold a pointer instead of their own copy.
+    // Returned pointers stay valid for the life of the program.
+    const char* intern(const std::string& text) {
+        static std::unordered_set<std::string> pool;
+        return pool.insert(text).first->c_str();
+    }
 }
 
-// Resource Manager
-class ResourceManager {
-private:
-    std::map<std::string, sf::Texture> textures;
-    std::map<std::string, sf::Font> fonts;
-    std::map<std::string, sf::SoundBuffer> soundBuffers;
-   
-public:
-    ResourceManager() {
-        // Load default resources
-        loadTexture("player", "assets/sprites/player.png");
-        loadTexture("skeleton", "assets/sprites/skeleton.png");
-        loadTexture("goblin", "assets/sprites/goblin.png");
-        loadTexture("dragon", "assets/sprites/dragon.png");
-        loadTexture("floor", "assets/tiles/floor.png");
-        loadTexture("wall", "assets/tiles/wall.png");
-        loadTexture("door", "assets/tiles/door.png");
-        loadTexture("chest", "assets/tiles/chest.png");
-        loadTexture("fireball", "assets/spells/fireball.png");
-        loadTexture("healing", "assets/spells/healing.png");
-        loadTexture("items", "assets/sprites/items.png");
-        loadTexture("ui", "assets/ui/ui_elements.png");
-       
-        loadFont("main", "assets/fonts/main.ttf");
-       
-        loadSoundBuffer("attack", "assets/sounds/attack.wav");
-        loadSoundBuffer("spell", "assets/sounds/spell.wav");
-        loadSoundBuffer("hurt", "assets/sounds/hurt.wav");
-        loadSoundBuffer("death", "assets/sounds/death.wav");
-        loadSoundBuffer("item", "assets/sounds/item.wav");
-        loadSoundBuffer("level_up", "assets/sounds/level_up.wav");
+// Memory tracking - every heap allocation is charged to the tag of the scope it
+// was made in, per thread. Build with -DLANCE_MEMORY_TRACKING to turn it on;
+// without it Scope is empty, the report functions do nothing and operator new
+// is left alone, so tagged code costs nothing.
+namespace MemoryTracker {
+    enum Tag {
+        TAG_GENERAL,
+        TAG_DUNGEON,
+        TAG_ENTITY,
+        TAG_UI,
+        TAG_AUDIO,
+        TAG_RESOURCES,
+        TAG_COUNT
+    };
+   
+    const char* const TAG_NAMES[TAG_COUNT] = {"General", "Dungeon", "Entity", "UI", "Audio", "Resources"};
+   
+    // Live bytes past which a warning is printed; 0 means no budget
+    const int64_t DEFAULT_BUDGETS[TAG_COUNT] = {
+        0,
+        64LL * 1024 * 1024,   // Dungeon
+        16LL * 1024 * 1024,   // Entity
+        4LL * 1024 * 1024,    // UI
+        32LL * 1024 * 1024,   // Audio: the effect cache plus stream windows
+        256LL * 1024 * 1024   // Resources
+    };
+   
+    struct TagReport {
+        int64_t liveBytes = 0;
+        int64_t peakBytes = 0;
+        int64_t liveAllocations = 0;
+        float allocationsPerFrame = 0.0f;  // Smoothed
+        float bytesPerFrame = 0.0f;        // Smoothed
+        int64_t budget = 0;
+    };
+   
+#ifdef LANCE_MEMORY_TRACKING
+    const bool ENABLED = true;
+   
+    // Blocks start with this much header so user data keeps malloc's alignment
+    const size_t HEADER_SIZE = alignof(std::max_align_t);
+   
+    // A cache line per tag, so threads working under different tags don't contend
+    struct alignas(64) Counters {
+        std::atomic<int64_t> live;
+        std::atomic<int64_t> peak;
+        std::atomic<int64_t> count;
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> allocatedBytes;
+    };
+   
+    // Game thread only: per-frame rates and budget state
+    struct FrameState {
+        uint64_t lastAllocations;
+        uint64_t lastBytes;
+        float allocationsPerFrame;
+        float bytesPerFrame;
+        int64_t budget;
+        bool warned;
+    };
+   
+    // Zero-initialised statics, usable by operator new before main() runs
+    Counters counters[TAG_COUNT];
+    FrameState frames[TAG_COUNT];
+    bool budgetsSet = false;
+    thread_local int currentTag = TAG_GENERAL;
+    thread_local uint64_t threadAllocations = 0;  // Every tag, this thread only
+    uint64_t frameStartAllocations = 0;           // Game thread's count when the frame began
+    int64_t lastFrameAllocations = 0;
+   
+    inline void recordAllocation(int tag, size_t size) {
+        Counters& c = counters[tag];
+        int64_t live = c.live.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed) + static_cast<int64_t>(size);
+        int64_t peak = c.peak.load(std::memory_order_relaxed);
+        while (live > peak && !c.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+        c.count.fetch_add(1, std::memory_order_relaxed);
+        c.allocations.fetch_add(1, std::memory_order_relaxed);
+        c.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+        threadAllocations++;
     }
    
-    bool loadTexture(const std::string& id, const std::string& filepath) {
-        sf::Texture texture;
-        if (!texture.loadFromFile(filepath)) {
-            std::cerr << "Failed to load texture: " << filepath << std::endl;
-            // Use fallback texture instead of returning false
-            sf::Image fallback;
-            fallback.create(32, 32, sf::Color::Magenta);
-            texture.loadFromImage(fallback);
-        }
-        textures[id] = texture;
-        return true;
+    inline void recordFree(int tag, size_t size) {
+        counters[tag].live.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+        counters[tag].count.fetch_sub(1, std::memory_order_relaxed);
     }
+#else
+    const bool ENABLED = false;
+#endif
+   
+    // Charge allocations on this thread to a tag until the scope ends
+    class Scope {
+#ifdef LANCE_MEMORY_TRACKING
+        int previous;
+       
+    public:
+        explicit Scope(Tag tag) : previous(currentTag) { currentTag = tag; }
+        ~Scope() { currentTag = previous; }
+#else
+    public:
+        explicit Scope(Tag) {}
+#endif
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
    
-    bool loadFont(const std::string& id, const std::string& filepath) {
-        sf::Font font;
-        if (!font.loadFromFile(filepath)) {
-            std::cerr << "Failed to load font: " << filepath << std::endl;
-            return false;
-        }
-        fonts[id] = font;
-        return true;
+#ifdef LANCE_MEMORY_TRACKING
+    inline void initBudgets() {
+        if (budgetsSet) return;
+        for (int t = 0; t < TAG_COUNT; t++) frames[t].budget = DEFAULT_BUDGETS[t];
+        budgetsSet = true;
+    }
+#endif
+   
+    void setBudget(Tag tag, int64_t bytes) {
+#ifdef LANCE_MEMORY_TRACKING
+        initBudgets();
+        frames[tag].budget = bytes;
+#else
+        (void)tag;
+        (void)bytes;
+#endif
     }
    
-    bool loadSoundBuffer(const std::string& id, const std::string& filepath) {
-        sf::SoundBuffer buffer;
-        if (!buffer.loadFromFile(filepath)) {
-            std::cerr << "Failed to load sound: " << filepath << std::endl;
-            return false;
+    // Once per frame on the game thread: fold in allocation rates and check budgets
+    void endFrame() {
+#ifdef LANCE_MEMORY_TRACKING
+        initBudgets();
+        lastFrameAllocations = static_cast<int64_t>(threadAllocations - frameStartAllocations);
+        frameStartAllocations = threadAllocations;
+        for (int t = 0; t < TAG_COUNT; t++) {
+            FrameState& frame = frames[t];
+            uint64_t allocations = counters[t].allocations.load(std::memory_order_relaxed);
+            uint64_t bytes = counters[t].allocatedBytes.load(std::memory_order_relaxed);
+            frame.allocationsPerFrame = frame.allocationsPerFrame * 0.95f + (allocations - frame.lastAllocations) * 0.05f;
+            frame.bytesPerFrame = frame.bytesPerFrame * 0.95f + (bytes - frame.lastBytes) * 0.05f;
+            frame.lastAllocations = allocations;
+            frame.lastBytes = bytes;
+           
+            int64_t live = counters[t].live.load(std::memory_order_relaxed);
+            if (frame.budget > 0 && live > frame.budget && !frame.warned) {
+                std::cerr << "Memory budget exceeded: " << TAG_NAMES[t] << " has " << live / 1024 << " KB live, budget "
+                          << frame.budget / 1024 << " KB" << std::endl;
+                frame.warned = true;
+            } else if (live < frame.budget - frame.budget / 10) {
+                frame.warned = false;  // Warn again only after dropping well below
+            }
         }
-        soundBuffers[id] = buffer;
-        return true;
+#endif
     }
    
-    sf::Texture& getTexture(const std::string& id) {
-        return textures[id];
+    // Heap allocations the calling thread has made, under any tag
+    uint64_t getThreadAllocations() {
+#ifdef LANCE_MEMORY_TRACKING
+        return threadAllocations;
+#else
+        return 0;
+#endif
     }
    
-    sf::Font& getFont(const std::string& id) {
-        return fonts[id];
+    // Heap allocations the game thread made during the last frame
+    int64_t getFrameAllocations() {
+#ifdef LANCE_MEMORY_TRACKING
+        return lastFrameAllocations;
+#else
+        return 0;
+#endif
     }
    
-    sf::SoundBuffer& getSoundBuffer(const std::string& id) {
-        return soundBuffers[id];
+    TagReport getReport(Tag tag) {
+        TagReport report;
+#ifdef LANCE_MEMORY_TRACKING
+        report.liveBytes = counters[tag].live.load(std::memory_order_relaxed);
+        report.peakBytes = counters[tag].peak.load(std::memory_order_relaxed);
+        report.liveAllocations = counters[tag].count.load(std::memory_order_relaxed);
+        report.allocationsPerFrame = frames[tag].allocationsPerFrame;
+        report.bytesPerFrame = frames[tag].bytesPerFrame;
+        initBudgets();
+        report.budget = frames[tag].budget;
+#else
+        (void)tag;
+#endif
+        return report;
     }
-};
+   
+    void writeJson(std::ostream& out) {
+        out << "{\n  \"tracking\": " << (ENABLED ? "true" : "false") << ",\n  \"frame_allocations\": "
+            << getFrameAllocations() << ",\n  \"tags\": {";
+        for (int t = 0; t < TAG_COUNT; t++) {
+            TagReport report = getReport(static_cast<Tag>(t));
+            out << (t ? "," : "") << "\n    \"" << TAG_NAMES[t] << "\": {\"live_bytes\": " << report.liveBytes
+                << ", \"peak_bytes\": " << report.peakBytes << ", \"live_allocations\": " << report.liveAllocations
+                << ", \"allocations_per_frame\": " << report.allocationsPerFrame
+                << ", \"bytes_per_frame\": " << report.bytesPerFrame << ", \"budget_bytes\": " << report.budget
+                << ", \"over_budget\": " << (report.budget > 0 && report.liveBytes > report.budget ? "true" : "false") << "}";
+        }
+        out << "\n  }\n}\n";
+    }
+   
+    // Lines for the profiler overlay; any stream or a TextBuilder
+    template <typename Out>
+    void appendOverlay(Out& out) {
+        if (!ENABLED) return;
+        out << "Heap allocs last frame: " << getFrameAllocations() << "\n";
+        for (int t = 0; t < TAG_COUNT; t++) {
+            TagReport report = getReport(static_cast<Tag>(t));
+            out << "Mem " << TAG_NAMES[t] << ": " << report.liveBytes / 1024 << " KB (peak " << report.peakBytes / 1024
+                << "), " << report.allocationsPerFrame << " allocs/frame"
+                << (report.budget > 0 && report.liveBytes > report.budget ? " OVER BUDGET" : "") << "\n";
+        }
+    }
+}
 
-// Sound Manager
-class SoundManager {
+#ifdef LANCE_MEMORY_TRACKING
+// Each block records its size and tag in a header, so a free is charged to the
+// tag that allocated it even when another scope or thread releases it. The
+// array, nothrow and sized forms all route through these two by default.
+void* operator new(std::size_t size) {
+    void* block = std::malloc(size + MemoryTracker::HEADER_SIZE);
+    if (!block) throw std::bad_alloc();
+    int tag = MemoryTracker::currentTag;
+    static_cast<size_t*>(block)[0] = size;
+    static_cast<size_t*>(block)[1] = static_cast<size_t>(tag);
+    MemoryTracker::recordAllocation(tag, size);
+    return static_cast<char*>(block) + MemoryTracker::HEADER_SIZE;
+}
+
+void operator delete(void* pointer) noexcept {
+    if (!pointer) return;
+    size_t* block = reinterpret_cast<size_t*>(static_cast<char*>(pointer) - MemoryTracker::HEADER_SIZE);
+    MemoryTracker::recordFree(static_cast<int>(block[1]), block[0]);
+    std::free(block);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    operator delete(pointer);
+}
+#endif
+
+// Frame arena - bump allocator for data that only lives until the end of the
+// frame, such as UI text being rebuilt. Each thread has its own (local()); the
+// game thread resets its arena once per frame, and another thread that uses one
+// resets it when it finishes a unit of work. Freeing does nothing except hand
+// back the newest allocation, so a growing string or vector reuses its space. A
+// frame that outgrows the arena chains another block, and the next reset merges
+// the chain into one block, so in steady state it never touches the heap.
+class FrameArena {
+public:
+    static const size_t DEFAULT_CAPACITY = 64 * 1024;
+   
 private:
-    ResourceManager& resources;
-    std::vector<sf::Sound> sounds;
-    sf::Music backgroundMusic;
-    float volume;
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+   
+    std::vector<Block> blocks;
+    size_t capacity;        // Size of the first block
+    size_t offset;          // Bump position in the newest block
+    size_t frameBytes;      // In use now
+    size_t framePeak;       // Most in use at once since the last reset
+    size_t lastFrameBytes;  // framePeak of the frame before
+    size_t peakBytes;
+    uint32_t frame;         // Counts resets, so stale containers can't give memory back
    
 public:
-    SoundManager(ResourceManager& resources) : resources(resources), volume(100.0f) {
-        // Preload background music
-        if (!backgroundMusic.openFromFile("assets/music/main_theme.ogg")) {
-            std::cerr << "Failed to load background music" << std::endl;
+    explicit FrameArena(size_t capacity = DEFAULT_CAPACITY)
+        : capacity(capacity), offset(0), frameBytes(0), framePeak(0), lastFrameBytes(0), peakBytes(0), frame(0) {}
+   
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+   
+    // Alignment up to alignof(std::max_align_t), which new char[] guarantees for each block
+    void* allocate(size_t size, size_t alignment) {
+        if (!blocks.empty()) {
+            size_t start = (offset + alignment - 1) & ~(alignment - 1);
+            if (start + size <= blocks.back().size) {
+                frameBytes += start + size - offset;
+                framePeak = std::max(framePeak, frameBytes);
+                offset = start + size;
+                return blocks.back().data.get() + start;
+            }
         }
-        backgroundMusic.setLoop(true);
-        backgroundMusic.setVolume(volume * 0.5f);
+        return grow(size, alignment);
     }
    
-    void playSound(const std::string& id) {
-        // Find an available sound slot or create a new one
-        sf::Sound* sound = nullptr;
-        for (auto& s : sounds) {
-            if (s.getStatus() == sf::Sound::Stopped) {
-                sound = &s;
-                break;
-            }
+    // Only the newest allocation of the current frame is really given back
+    void deallocate(void* pointer, size_t size, uint32_t fromFrame) {
+        if (fromFrame != frame || blocks.empty()) return;
+        if (static_cast<char*>(pointer) + size == blocks.back().data.get() + offset) {
+            offset -= size;
+            frameBytes -= size;
         }
-       
-        if (!sound) {
-            sounds.emplace_back();
-            sound = &sounds.back();
+    }
+   
+    // Everything handed out since the last reset is dead after this
+    void reset() {
+        lastFrameBytes = framePeak;
+        peakBytes = std::max(peakBytes, framePeak);
+        if (blocks.size() > 1) {
+            size_t total = 0;
+            for (const Block& block : blocks) total += block.size;
+            blocks.clear();
+            capacity = total;
+            blocks.push_back({std::unique_ptr<char[]>(new char[capacity]), capacity});
         }
-       
-        sound->setBuffer(resources.getSoundBuffer(id));
-        sound->setVolume(volume);
-        sound->play();
+        offset = 0;
+        frameBytes = 0;
+        framePeak = 0;
+        frame++;
     }
    
-    void playMusic() {
-        backgroundMusic.play();
+    size_t getLastFrameBytes() const { return lastFrameBytes; }
+    size_t getPeakBytes() const { return peakBytes; }
+    uint32_t getFrame() const { return frame; }
+   
+    size_t getCapacity() const {
+        size_t total = 0;
+        for (const Block& block : blocks) total += block.size;
+        return total;
     }
    
-    void stopMusic() {
-        backgroundMusic.stop();
+    static FrameArena& local() {
+        thread_local FrameArena arena;
+        return arena;
     }
    
-    void setVolume(float newVolume) {
-        volume = std::max(0.0f, std::min(100.0f, newVolume));
-        backgroundMusic.setVolume(volume * 0.5f);
-        for (auto& sound : sounds) {
-            sound.setVolume(volume);
-        }
+private:
+    void* grow(size_t size, size_t alignment) {
+        size_t blockSize = std::max(blocks.empty() ? capacity : blocks.back().size * 2, size + alignment);
+        blocks.push_back({std::unique_ptr<char[]>(new char[blockSize]), blockSize});
+        offset = 0;
+        return allocate(size, alignment);
     }
 };
 
-// Entity class - base for all game objects
-class Entity {
-protected:
-    sf::Sprite sprite;
-    sf::Vector2f position;
-    bool active;
-    std::string name;
-    std::string type;
+// Standard allocator over the calling thread's frame arena. Containers using it
+// must be gone by the end of the frame they were made in.
+template <typename T>
+class FrameAllocator {
+    template <typename U> friend class FrameAllocator;
+   
+    FrameArena* arena;
+    uint32_t frame;
    
 public:
-    Entity(const std::string& name, const std::string& type, ResourceManager& resources, const std::string& textureId)
-        : name(name), type(type), active(true) {
-        sprite.setTexture(resources.getTexture(textureId));
-        sprite.setOrigin(sprite.getLocalBounds().width / 2, sprite.getLocalBounds().height / 2);
-    }
+    using value_type = T;
    
-    virtual ~Entity() = default;
+    FrameAllocator() : arena(&FrameArena::local()), frame(arena->getFrame()) {}
    
-    virtual void update(float deltaTime) {
-        sprite.setPosition(position);
-    }
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other) : arena(other.arena), frame(other.frame) {}
    
-    virtual void draw(sf::RenderWindow& window) {
-        window.draw(sprite);
+    T* allocate(size_t count) {
+        return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
     }
    
-    void setPosition(float x, float y) {
-        position.x = x;
-        position.y = y;
-        sprite.setPosition(position);
+    void deallocate(T* pointer, size_t count) {
+        arena->deallocate(pointer, count * sizeof(T), frame);
     }
    
-    sf::Vector2f getPosition() const {
-        return position;
-    }
+    template <typename U>
+    bool operator==(const FrameAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const FrameAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+using FrameString = std::basic_string<char, std::char_traits<char>, FrameAllocator<char>>;
+
+// Text built in the frame arena, for strings remade every frame. Takes the same
+// << chains as a stream, without the locale or the heap; floats are fixed-point.
+class TextBuilder {
+private:
+    FrameString text;
+    int precision;
    
-    std::string getName() const {
-        return name;
+public:
+    explicit TextBuilder(size_t reserve = 256) : precision(2) {
+        text.reserve(reserve);
     }
    
-    std::string getType() const {
-        return type;
+    TextBuilder& operator<<(const char* value) {
+        text.append(value);
+        return *this;
     }
    
-    bool isActive() const {
-        return active;
+    TextBuilder& operator<<(const std::string& value) {
+        text.append(value.data(), value.size());
+        return *this;
     }
    
-    void setActive(bool value) {
-        active = value;
+    TextBuilder& operator<<(char value) {
+        text.push_back(value);
+        return *this;
     }
    
-    sf::FloatRect getBounds() const {
-        return sprite.getGlobalBounds();
+    template <typename Integer, typename std::enable_if<std::is_integral<Integer>::value, int>::type = 0>
+    TextBuilder& operator<<(Integer value) {
+        char digits[24];
+        text.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+        return *this;
     }
    
-    bool intersects(const Entity& other) const {
-        return getBounds().intersects(other.getBounds());
+    TextBuilder& operator<<(double value) {
+        char digits[48];
+        int length = std::snprintf(digits, sizeof(digits), "%.*f", precision, value);
+        text.append(digits, std::min(std::max(length, 0), static_cast<int>(sizeof(digits)) - 1));
+        return *this;
     }
    
-    float distanceTo(const Entity& other) const {
-        return GameUtils::distance(position.x, position.y,
-                                 other.position.x, other.position.y);
+    void setPrecision(int digits) { precision = digits; }
+    void clear() { text.clear(); }
+   
+    std::string_view view() const { return std::string_view(text.data(), text.size()); }
+    const char* c_str() const { return text.c_str(); }
+    size_t size() const { return text.size(); }
+   
+    // Hand ASCII text to an sf::String the caller keeps. sf::String's own
+    // conversions build a new string on the heap; this reuses out's storage.
+    static void copy(std::string_view value, sf::String& out) {
+        out.clear();
+        for (char c : value) out += sf::String(static_cast<sf::Uint32>(static_cast<unsigned char>(c)));
     }
 };
 
-// Character class - base for player and enemies
-class Character : public Entity {
-protected:
-    // D&D stats
-    int strength;
-    int dexterity;
-    int constitution;
-    int intelligence;
-    int wisdom;
-    int charisma;
-   
-    // Derived stats
-    int health;
-    int maxHealth;
-    int mana;
-    int maxMana;
-    int armorClass;
-    int attackBonus;
-    int level;
-   
-    // Equipment
-    std::shared_ptr<Weapon> equippedWeapon;
-    std::shared_ptr<Armor> equippedArmor;
-   
-    // Animation
-    int animationFrame;
-    float animationTimer;
-    std::string currentAnimation;
-    bool facingRight;
-   
-    // Visual effects
-    float damageFlashTimer;
-   
-    // Resources
-    ResourceManager& resources;
-    SoundManager& sounds;
+// Read-only memory mapping of a whole file
+class MappedFile {
+private:
+    const char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
    
 public:
-    Character(const std::string& name, const std::string& type,
-              ResourceManager& resources, SoundManager& sounds,
-              const std::string& textureId, int strength, int dexterity,
-              int constitution, int intelligence, int wisdom, int charisma)
-        : Entity(name, type, resources, textureId),
-          resources(resources), sounds(sounds),
-          strength(strength), dexterity(dexterity), constitution(constitution),
-          intelligence(intelligence), wisdom(wisdom), charisma(charisma),
-          animationFrame(0), animationTimer(0), damageFlashTimer(0),
-          facingRight(true), level(1) {
-       
-        // Calculate derived stats
-        maxHealth = 10 + constitution + GameUtils::rollDice(1, 8);
-        health = maxHealth;
-        maxMana = 10 + intelligence;
-        mana = maxMana;
-        armorClass = 10 + (dexterity - 10) / 2; // AC = 10 + DEX modifier
-        attackBonus = (strength - 10) / 2; // Attack bonus = STR modifier
+    MappedFile() : data(nullptr), size(0) {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#endif
     }
    
-    virtual void update(float deltaTime) override {
-        Entity::update(deltaTime);
-       
-        // Update animation
-        animationTimer += deltaTime;
-        if (animationTimer >= 0.15f) {  // Animation speed
-            animationTimer = 0;
-            animationFrame = (animationFrame + 1) % 4;  // 4 frames per animation
-            updateAnimation();
-        }
-       
-        // Update damage flash effect
-        if (damageFlashTimer > 0) {
-            damageFlashTimer -= deltaTime;
-            if (damageFlashTimer <= 0) {
-                sprite.setColor(sf::Color::White);
-            } else {
-                // Pulsing red effect
-                int alpha = static_cast<int>(255 * (0.5f + 0.5f * std::sin(damageFlashTimer * 30)));
-                sprite.setColor(sf::Color(255, 100, 100, 255 - alpha));
-            }
-        }
+    ~MappedFile() {
+        close();
     }
    
-    virtual void updateAnimation() {
-        // Base animation frame setup
-        int frameWidth = sprite.getTexture()->getSize().x / 4;  // 4 frames horizontally
-        int frameHeight = sprite.getTexture()->getSize().y / 4; // 4 animations vertically
-       
-        int row = 0; // Default animation row (idle)
-        if (currentAnimation == "walk") row = 1;
-        else if (currentAnimation == "attack") row = 2;
-        else if (currentAnimation == "hurt") row = 3;
-       
-        // Set the texture rect based on animation frame and row
-        sprite.setTextureRect(sf::IntRect(
-            animationFrame * frameWidth,
-            row * frameHeight,
-            frameWidth,
-            frameHeight
-        ));
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+   
+    bool open(const std::string& filepath) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
        
-        // Flip sprite based on facing direction
-        if (facingRight) {
-            sprite.setScale(1.0f, 1.0f);
-        } else {
-            sprite.setScale(-1.0f, 1.0f);
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
         }
-    }
-   
-    void setAnimation(const std::string& animation) {
-        if (currentAnimation != animation) {
-            currentAnimation = animation;
-            animationFrame = 0;
-            animationTimer = 0;
-            updateAnimation();
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            close();
+            return false;
         }
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data) {
+            close();
+            return false;
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fd = ::open(filepath.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+       
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);  // The mapping stays valid after the descriptor is closed
+        if (mapped == MAP_FAILED) return false;
+       
+        data = static_cast<const char*>(mapped);
+        size = static_cast<size_t>(info.st_size);
+#endif
+        return true;
     }
    
-    void setFacingDirection(bool right) {
-        facingRight = right;
+    void close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap(const_cast<char*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
     }
    
-    int rollAttack() const {
-        int roll = GameUtils::rollDice(20);
-        return roll + attackBonus + (equippedWeapon ? equippedWeapon->getAttackBonus() : 0);
+    void swap(MappedFile& other) {
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+#ifdef _WIN32
+        std::swap(file, other.file);
+        std::swap(mapping, other.mapping);
+#endif
     }
    
-    int rollDamage() const {
-        if (equippedWeapon) {
-            return equippedWeapon->rollDamage() + std::max(0, (strength - 10) / 2);
-        }
-        return GameUtils::rollDice(1, 4) + std::max(0, (strength - 10) / 2); // Unarmed damage
+    bool isOpen() const { return data != nullptr; }
+    const char* getData() const { return data; }
+    size_t getSize() const { return size; }
+};
+
+// LZ4 block format: runs of literal bytes, each followed by a copy of earlier
+// output. Compression is a plain greedy matcher, fine for a build step;
+// decompression checks every length and offset against both buffers, so a
+// corrupt pack fails to load instead of scribbling over memory.
+namespace LZ4 {
+    const size_t MIN_MATCH = 4;
+    const size_t LAST_LITERALS = 5;   // The format ends every block with at least this many literals
+    const size_t MATCH_LIMIT = 12;    // No match may start closer than this to the end
+   
+    size_t maxCompressedSize(size_t size) {
+        return size + size / 255 + 16;
     }
    
-    void takeDamage(int amount) {
-        if (amount <= 0) return;
-       
-        health -= amount;
-        if (health < 0) health = 0;
-       
-        // Visual and audio feedback
-        damageFlashTimer = 0.5f;
-        sounds.playSound("hurt");
-        setAnimation("hurt");
+    // Compress into dst, which must hold maxCompressedSize(size) bytes; returns the bytes written
+    size_t compress(const uint8_t* src, size_t size, uint8_t* dst) {
+        const int HASH_BITS = 16;
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);  // Last position + 1 of each hashed sequence
+        auto read32 = [src](size_t at) {
+            uint32_t value;
+            std::memcpy(&value, src + at, 4);
+            return value;
+        };
+        auto writeLength = [&dst](size_t& out, size_t length) {
+            for (; length >= 255; length -= 255) dst[out++] = 255;
+            dst[out++] = static_cast<uint8_t>(length);
+        };
        
-        if (health <= 0) {
-            sounds.playSound("death");
-            setActive(false);
+        size_t out = 0;
+        size_t anchor = 0;
+        if (size >= MATCH_LIMIT) {
+            for (size_t at = 0; at <= size - MATCH_LIMIT;) {
+                uint32_t sequence = read32(at);
+                uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+                size_t candidate = table[hash];
+                table[hash] = static_cast<uint32_t>(at + 1);
+                if (candidate == 0 || at - (candidate - 1) > 65535 || read32(candidate - 1) != sequence) {
+                    at++;
+                    continue;
+                }
+               
+                size_t match = candidate - 1;
+                size_t length = MIN_MATCH;
+                while (at + length < size - LAST_LITERALS && src[match + length] == src[at + length]) length++;
+               
+                size_t literals = at - anchor;
+                size_t extra = length - MIN_MATCH;
+                dst[out++] = static_cast<uint8_t>((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(extra, 15));
+                if (literals >= 15) writeLength(out, literals - 15);
+                std::memcpy(dst + out, src + anchor, literals);
+                out += literals;
+                size_t offset = at - match;
+                dst[out++] = static_cast<uint8_t>(offset & 0xFF);
+                dst[out++] = static_cast<uint8_t>(offset >> 8);
+                if (extra >= 15) writeLength(out, extra - 15);
+               
+                at += length;
+                anchor = at;
+            }
         }
+       
+        size_t literals = size - anchor;
+        dst[out++] = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+        if (literals >= 15) writeLength(out, literals - 15);
+        std::memcpy(dst + out, src + anchor, literals);
+        return out + literals;
     }
    
-    void heal(int amount) {
-        if (amount <= 0) return;
+    // Decompress exactly dstSize bytes; false if the block is malformed
+    bool decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+        size_t in = 0;
+        size_t out = 0;
+        auto readLength = [&](size_t& length) {
+            uint8_t byte;
+            do {
+                if (in >= srcSize) return false;
+                byte = src[in++];
+                length += byte;
+            } while (byte == 255);
+            return true;
+        };
        
-        health += amount;
-        if (health > maxHealth) health = maxHealth;
+        while (in < srcSize) {
+            uint8_t token = src[in++];
+            size_t literals = token >> 4;
+            if (literals == 15 && !readLength(literals)) return false;
+            if (literals > srcSize - in || literals > dstSize - out) return false;
+            std::memcpy(dst + out, src + in, literals);
+            in += literals;
+            out += literals;
+            if (in == srcSize) break;  // The last sequence has no match
+           
+            if (srcSize - in < 2) return false;
+            size_t offset = src[in] | (static_cast<size_t>(src[in + 1]) << 8);
+            in += 2;
+            size_t length = token & 15;
+            if (length == 15 && !readLength(length)) return false;
+            length += MIN_MATCH;
+            if (offset == 0 || offset > out || length > dstSize - out) return false;
+           
+            // Overlapping copies repeat the last offset bytes, so go byte by byte then
+            const uint8_t* match = dst + out - offset;
+            if (offset >= length) {
+                std::memcpy(dst + out, match, length);
+            } else {
+                for (size_t i = 0; i < length; i++) dst[out + i] = match[i];
+            }
+            out += length;
+        }
+        return out == dstSize;
     }
+}
+
+// Binary archetype records. The layout is the on-disk format, so every field is
+// fixed-width and naturally aligned (little-endian, as on every platform we ship).
+// Strings are byte offsets into the blob's string table.
+namespace GameData {
+    const uint32_t MAGIC = 0x5441444C;  // "LDAT"
+    const uint32_t VERSION = 6;
+    const int MAX_LOOT_LEVEL = 99;
+    const uint16_t NO_ANIMATION = 0xFFFF;
+    const int PALETTE_SIZE = 8;
+   
+    enum Flags : uint16_t {
+        FLAG_BOSS = 1,     // Monster: exactly one placed in the far half of a level
+        FLAG_STARTER = 2,  // Item: placed next to the player's start
+        FLAG_LOOT = 4      // Item: can be referenced by loot tables
+    };
    
-    int getHealth() const { return health; }
-    int getMaxHealth() const { return maxHealth; }
-    int getMana() const { return mana; }
-    int getMaxMana() const { return maxMana; }
-    int getStrength() const { return strength; }
-    int getDexterity() const { return dexterity; }
-    int getConstitution() const { return constitution; }
-    int getIntelligence() const { return intelligence; }
-    int getWisdom() const { return wisdom; }
-    int getCharisma() const { return charisma; }
-    int getArmorClass() const {
-        int ac = 10 + (dexterity - 10) / 2;
-        if (equippedArmor) ac += equippedArmor->getDefense();
-        return ac;
-    }
-    int getLevel() const { return level; }
+    enum ItemKind : uint8_t {
+        KIND_WEAPON = 0,
+        KIND_ARMOR = 1,
+        KIND_POTION = 2,
+        KIND_COUNT = 3
+    };
    
-    bool isAlive() const { return health > 0; }
+    enum AffixPosition : uint8_t {
+        AFFIX_PREFIX = 0,
+        AFFIX_SUFFIX = 1
+    };
    
-    // Attack another character
-    bool attack(Character& target) {
-        setAnimation("attack");
-        sounds.playSound("attack");
-       
-        int attackRoll = rollAttack();
-        if (attackRoll >= target.getArmorClass()) {
-            int damage = rollDamage();
-            target.takeDamage(damage);
-            return true;
-        }
-        return false;
-    }
+    // Status effects; the rules for each live in StatusEffects
+    enum EffectId : uint8_t {
+        EFFECT_NONE = 0,
+        EFFECT_POISON = 1,
+        EFFECT_SLEEP = 2,
+        EFFECT_BLESS = 3,
+        EFFECT_REGENERATION = 4,
+        EFFECT_COUNT = 5
+    };
    
-    // Equip weapon
-    void equipWeapon(std::shared_ptr<Weapon> weapon) {
-        equippedWeapon = weapon;
+    // What a spell acts on
+    enum Targeting : uint8_t {
+        TARGET_SELF = 0,
+        TARGET_SINGLE = 1,    // The enemy nearest the aim point, or the first one a projectile touches
+        TARGET_RADIUS = 2,    // Everything within area pixels of the aim point
+        TARGET_CONE = 3,      // From the caster, area degrees either side of the aim
+        TARGET_LINE = 4,      // From the caster to full range, area pixels either side
+        TARGET_COUNT = 5
+    };
+   
+    // The clips every animation set has; one a set leaves out plays its idle clip
+    enum ClipId : uint8_t {
+        CLIP_IDLE = 0,
+        CLIP_WALK = 1,
+        CLIP_ATTACK = 2,
+        CLIP_HURT = 3,
+        CLIP_COUNT = 4
+    };
+   
+    enum ClipFlags : uint8_t {
+        CLIP_LOOP = 1      // Otherwise the clip plays once and returns to idle
+    };
+   
+    // Raised by Animator when a clip enters its event frame
+    enum AnimationEvent : uint8_t {
+        ANIMATION_EVENT_NONE = 0,
+        ANIMATION_EVENT_HIT = 1,     // The blow lands: the swing sound plays
+        ANIMATION_EVENT_COUNT = 2
+    };
+   
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t totalSize;
+        uint32_t monsterCount, monsterOffset;
+        uint32_t weaponCount, weaponOffset;
+        uint32_t armorCount, armorOffset;
+        uint32_t potionCount, potionOffset;
+        uint32_t rarityCount, rarityOffset;
+        uint32_t affixCount, affixOffset;
+        uint32_t lootTableCount, lootTableOffset;
+        uint32_t lootEntryCount, lootEntryOffset;
+        uint32_t spellCount, spellOffset;
+        uint32_t animationSetCount, animationSetOffset;
+        uint32_t clipCount, clipOffset;
+        uint32_t frameCount, frameOffset;
+        uint32_t paletteCount, paletteOffset;
+        uint32_t stringOffset, stringSize;
+    };
+   
+    struct MonsterRecord {
+        uint32_t name;
+        uint32_t texture;
+        int16_t stats[6];       // STR, DEX, CON, INT, WIS, CHA
+        int16_t experience;
+        int16_t gold;
+        uint16_t density;       // One spawn per this many tiles, 0 = none
+        uint16_t flags;
+        uint8_t onHitEffect;    // EffectId its melee hits may inflict
+        uint8_t onHitChance;    // Percent
+        uint16_t animationSet;  // Index into the animation set table, NO_ANIMATION for a still sprite
+        uint8_t palette;        // Palette table index + 1, 0 for the texture's own colours
+        uint8_t padding[3];
+    };
+   
+    struct WeaponRecord {
+        uint32_t name;
+        uint32_t description;
+        uint32_t weaponType;
+        float minDamage, maxDamage;
+        float minDamagePerLevel, maxDamagePerLevel;
+        float value, valuePerLevel;
+        int16_t attackBonus;
+        uint16_t flags;
+        int16_t rect[4];        // Sprite rect in the items sheet
+        uint16_t density;
+        uint16_t padding;
+    };
+   
+    struct ArmorRecord {
+        uint32_t name;
+        uint32_t description;
+        uint32_t armorType;
+        float defense, defensePerLevel;
+        float value, valuePerLevel;
+        int16_t rect[4];
+        uint16_t density;
+        uint16_t flags;
+    };
+   
+    struct PotionRecord {
+        uint32_t name;
+        uint32_t description;
+        float heal, healPerLevel;
+        float value, valuePerLevel;
+        int16_t rect[4];
+        uint16_t density;
+        uint16_t flags;
+    };
+   
+    struct RarityRecord {
+        uint32_t name;
+        float weight;
+        uint8_t prefixes;       // Affixes rolled per position, 0 or 1
+        uint8_t suffixes;
+        uint16_t padding;
+    };
+   
+    struct AffixRecord {
+        uint32_t name;          // Name fragment, e.g. "Sharp" or "of Power"
+        float weight;
+        uint8_t position;       // AffixPosition
+        uint8_t kinds;          // Bit (1 << ItemKind) for each kind it can roll on
+        int16_t damage;         // Added to weapon min and max damage
+        int16_t attack;
+        int16_t defense;
+        int16_t heal;
+        int16_t valuePercent;
+    };
+   
+    struct LootTableRecord {
+        uint32_t monster;       // Monster name, empty matches any monster
+        uint16_t minLevel, maxLevel;
+        float dropChance;
+        uint32_t firstEntry;
+        uint32_t entryCount;
+    };
+   
+    struct LootEntryRecord {
+        uint8_t kind;           // ItemKind
+        uint8_t padding;
+        uint16_t archetype;     // Index into the weapon, armor or potion table
+        float weight;
+    };
+   
+    struct SpellRecord {
+        uint32_t name;
+        uint32_t description;
+        uint32_t projectileTexture;  // Texture id, used when projectileSpeed > 0
+        int16_t manaCost;
+        int16_t minimumLevel;
+        uint8_t targeting;           // Targeting
+        uint8_t effect;              // EffectId applied to everything hit, 0 for none
+        uint8_t effectStacks;
+        uint8_t damageDice;          // damageDice d damageFaces + damageBonus, rolled once per cast
+        uint8_t damageFaces;
+        uint8_t padding;
+        int16_t damageBonus;
+        float range;                 // Pixels from the caster
+        float area;                  // Radius, cone half-angle in degrees or line half-width
+        float projectileSpeed;       // Pixels per second, 0 acts instantly
+    };
+   
+    struct AnimationSetRecord {
+        uint32_t name;
+        uint16_t clips[CLIP_COUNT];  // Index into the clip table for each ClipId
+    };
+   
+    struct ClipRecord {
+        uint32_t firstFrame;         // Index into the frame table
+        uint16_t frameCount;
+        uint8_t flags;               // ClipFlags
+        uint8_t event;               // AnimationEvent
+        uint16_t eventFrame;         // Raised on entering this frame; never the first
+        uint16_t padding;
+    };
+   
+    struct FrameRecord {
+        int16_t rect[4];             // Rect in the character's sprite sheet
+        float duration;              // Seconds, always positive
+    };
+   
+    // A colour ramp, dark to light, that a sprite's brightness is mapped onto
+    struct PaletteRecord {
+        uint32_t name;
+        uint32_t colors[PALETTE_SIZE];  // RGBA
+    };
+   
+    static_assert(sizeof(Header) == 124, "Header layout changed");
+    static_assert(sizeof(MonsterRecord) == 36, "MonsterRecord layout changed");
+    static_assert(sizeof(WeaponRecord) == 52, "WeaponRecord layout changed");
+    static_assert(sizeof(ArmorRecord) == 40, "ArmorRecord layout changed");
+    static_assert(sizeof(PotionRecord) == 36, "PotionRecord layout changed");
+    static_assert(sizeof(RarityRecord) == 12, "RarityRecord layout changed");
+    static_assert(sizeof(AffixRecord) == 20, "AffixRecord layout changed");
+    static_assert(sizeof(LootTableRecord) == 20, "LootTableRecord layout changed");
+    static_assert(sizeof(LootEntryRecord) == 8, "LootEntryRecord layout changed");
+    static_assert(sizeof(SpellRecord) == 36, "SpellRecord layout changed");
+    static_assert(sizeof(AnimationSetRecord) == 12, "AnimationSetRecord layout changed");
+    static_assert(sizeof(ClipRecord) == 12, "ClipRecord layout changed");
+    static_assert(sizeof(FrameRecord) == 12, "FrameRecord layout changed");
+    static_assert(sizeof(PaletteRecord) == 36, "PaletteRecord layout changed");
+   
+    // Scale a base stat by character level
+    inline int scaled(float base, float perLevel, int level) {
+        return static_cast<int>(base + perLevel * level);
     }
    
-    // Equip armor
-    void equipArmor(std::shared_ptr<Armor> armor) {
-        equippedArmor = armor;
+    inline sf::IntRect toRect(const int16_t rect[4]) {
+        return sf::IntRect(rect[0], rect[1], rect[2], rect[3]);
     }
-};
+}
 
-// Player class
-class Player : public Character {
+// Archetype table - monster and item definitions compiled from the text files in
+// assets/data into one binary blob, memory-mapped and used in place
+class ArchetypeTable {
 private:
-    int experience;
-    int gold;
-    std::vector<std::shared_ptr<Item>> inventory;
-    std::vector<std::shared_ptr<Spell>> spells;
-    std::map<std::string, bool> questFlags;
-   
-    // Movement
-    float moveSpeed;
-    sf::Vector2f velocity;
-   
-    // Camera
-    sf::View& gameView;
-   
-    // UI
-    sf::RectangleShape healthBar;
-    sf::RectangleShape manaBar;
-    sf::Text nameText;
+    MappedFile file;
+    const GameData::Header* header;
+    const GameData::MonsterRecord* monsters;
+    const GameData::WeaponRecord* weapons;
+    const GameData::ArmorRecord* armors;
+    const GameData::PotionRecord* potions;
+    const GameData::RarityRecord* rarities;
+    const GameData::AffixRecord* affixes;
+    const GameData::LootTableRecord* lootTables;
+    const GameData::LootEntryRecord* lootEntries;
+    const GameData::SpellRecord* spells;
+    const GameData::AnimationSetRecord* animationSets;
+    const GameData::ClipRecord* clips;
+    const GameData::FrameRecord* frames;
+    const GameData::PaletteRecord* palettes;
+    const char* strings;
+    float loadTimeMs;
    
 public:
-    Player(const std::string& name, ResourceManager& resources, SoundManager& sounds, sf::View& gameView,
-           int strength = 12, int dexterity = 12, int constitution = 12,
-           int intelligence = 12, int wisdom = 12, int charisma = 12)
-        : Character(name, "player", resources, sounds, "player",
-                   strength, dexterity, constitution, intelligence, wisdom, charisma),
-          experience(0), gold(50), moveSpeed(PLAYER_SPEED), gameView(gameView) {
+    ArchetypeTable()
+        : header(nullptr), monsters(nullptr), weapons(nullptr), armors(nullptr),
+          potions(nullptr), rarities(nullptr), affixes(nullptr), lootTables(nullptr),
+          lootEntries(nullptr), spells(nullptr), animationSets(nullptr), clips(nullptr),
+          frames(nullptr), palettes(nullptr), strings(nullptr), loadTimeMs(0.0f) {}
+   
+    // Map a compiled blob and validate every offset in it
+    bool load(const std::string& filepath) {
+        sf::Clock clock;
+        unload();
+       
+        if (!file.open(filepath)) {
+            std::cerr << "Failed to map archetype data: " << filepath << std::endl;
+            return false;
+        }
        
-        // Initialize UI elements
-        healthBar.setSize(sf::Vector2f(50, 6));
-        healthBar.setFillColor(sf::Color::Red);
-        healthBar.setOutlineColor(sf::Color::Black);
-        healthBar.setOutlineThickness(1);
+        const char* base = file.getData();
+        size_t size = file.getSize();
+        const GameData::Header* h = reinterpret_cast<const GameData::Header*>(base);
        
-        manaBar.setSize(sf::Vector2f(50, 4));
-        manaBar.setFillColor(sf::Color::Blue);
-        manaBar.setOutlineColor(sf::Color::Black);
-        manaBar.setOutlineThickness(1);
+        auto tableFits = [size](uint32_t offset, uint32_t count, size_t recordSize) {
+            return offset % 4 == 0 && offset <= size && count <= (size - offset) / recordSize;
+        };
        
-        nameText.setFont(resources.getFont("main"));
-        nameText.setString(name);
-        nameText.setCharacterSize(12);
-        nameText.setFillColor(sf::Color::White);
-        nameText.setOutlineColor(sf::Color::Black);
-        nameText.setOutlineThickness(1);
-    }
-   
-    void update(float deltaTime) override {
-        // Update base character
-        Character::update(deltaTime);
+        if (size < sizeof(GameData::Header) || h->magic != GameData::MAGIC ||
+            h->version != GameData::VERSION || h->totalSize != size ||
+            !tableFits(h->monsterOffset, h->monsterCount, sizeof(GameData::MonsterRecord)) ||
+            !tableFits(h->weaponOffset, h->weaponCount, sizeof(GameData::WeaponRecord)) ||
+            !tableFits(h->armorOffset, h->armorCount, sizeof(GameData::ArmorRecord)) ||
+            !tableFits(h->potionOffset, h->potionCount, sizeof(GameData::PotionRecord)) ||
+            !tableFits(h->rarityOffset, h->rarityCount, sizeof(GameData::RarityRecord)) ||
+            !tableFits(h->affixOffset, h->affixCount, sizeof(GameData::AffixRecord)) ||
+            !tableFits(h->lootTableOffset, h->lootTableCount, sizeof(GameData::LootTableRecord)) ||
+            !tableFits(h->lootEntryOffset, h->lootEntryCount, sizeof(GameData::LootEntryRecord)) ||
+            !tableFits(h->spellOffset, h->spellCount, sizeof(GameData::SpellRecord)) ||
+            !tableFits(h->animationSetOffset, h->animationSetCount, sizeof(GameData::AnimationSetRecord)) ||
+            !tableFits(h->clipOffset, h->clipCount, sizeof(GameData::ClipRecord)) ||
+            !tableFits(h->frameOffset, h->frameCount, sizeof(GameData::FrameRecord)) ||
+            !tableFits(h->paletteOffset, h->paletteCount, sizeof(GameData::PaletteRecord)) ||
+            h->stringSize == 0 || !tableFits(h->stringOffset, h->stringSize, 1) ||
+            base[h->stringOffset + h->stringSize - 1] != '\0') {
+            std::cerr << "Invalid archetype data: " << filepath << std::endl;
+            file.close();
+            return false;
+        }
        
-        // Apply movement
-        position += velocity * deltaTime;
-        velocity = sf::Vector2f(0, 0);
+        header = h;
+        monsters = reinterpret_cast<const GameData::MonsterRecord*>(base + h->monsterOffset);
+        weapons = reinterpret_cast<const GameData::WeaponRecord*>(base + h->weaponOffset);
+        armors = reinterpret_cast<const GameData::ArmorRecord*>(base + h->armorOffset);
+        potions = reinterpret_cast<const GameData::PotionRecord*>(base + h->potionOffset);
+        rarities = reinterpret_cast<const GameData::RarityRecord*>(base + h->rarityOffset);
+        affixes = reinterpret_cast<const GameData::AffixRecord*>(base + h->affixOffset);
+        lootTables = reinterpret_cast<const GameData::LootTableRecord*>(base + h->lootTableOffset);
+        lootEntries = reinterpret_cast<const GameData::LootEntryRecord*>(base + h->lootEntryOffset);
+        spells = reinterpret_cast<const GameData::SpellRecord*>(base + h->spellOffset);
+        animationSets = reinterpret_cast<const GameData::AnimationSetRecord*>(base + h->animationSetOffset);
+        clips = reinterpret_cast<const GameData::ClipRecord*>(base + h->clipOffset);
+        frames = reinterpret_cast<const GameData::FrameRecord*>(base + h->frameOffset);
+        palettes = reinterpret_cast<const GameData::PaletteRecord*>(base + h->paletteOffset);
+        strings = base + h->stringOffset;
+       
+        bool stringsValid = true;
+        auto checkString = [&](uint32_t offset) { stringsValid = stringsValid && offset < h->stringSize; };
+        for (uint32_t i = 0; i < h->monsterCount; i++) {
+            checkString(monsters[i].name);
+            checkString(monsters[i].texture);
+        }
+        for (uint32_t i = 0; i < h->weaponCount; i++) {
+            checkString(weapons[i].name);
+            checkString(weapons[i].description);
+            checkString(weapons[i].weaponType);
+        }
+        for (uint32_t i = 0; i < h->armorCount; i++) {
+            checkString(armors[i].name);
+            checkString(armors[i].description);
+            checkString(armors[i].armorType);
+        }
+        for (uint32_t i = 0; i < h->potionCount; i++) {
+            checkString(potions[i].name);
+            checkString(potions[i].description);
+        }
+        for (uint32_t i = 0; i < h->rarityCount; i++) {
+            checkString(rarities[i].name);
+        }
+        for (uint32_t i = 0; i < h->affixCount; i++) {
+            checkString(affixes[i].name);
+        }
+        for (uint32_t i = 0; i < h->lootTableCount; i++) {
+            checkString(lootTables[i].monster);
+        }
+        for (uint32_t i = 0; i < h->spellCount; i++) {
+            checkString(spells[i].name);
+            checkString(spells[i].description);
+            checkString(spells[i].projectileTexture);
+        }
+        for (uint32_t i = 0; i < h->animationSetCount; i++) {
+            checkString(animationSets[i].name);
+        }
+        for (uint32_t i = 0; i < h->paletteCount; i++) {
+            checkString(palettes[i].name);
+        }
        
-        // Update camera to follow player
-        gameView.setCenter(position);
+        // Loot entries must stay inside the entry table and point at real archetypes
+        bool lootValid = true;
+        for (uint32_t i = 0; i < h->lootTableCount; i++) {
+            lootValid = lootValid && lootTables[i].firstEntry <= h->lootEntryCount &&
+                        lootTables[i].entryCount <= h->lootEntryCount - lootTables[i].firstEntry;
+        }
+        const uint32_t kindCounts[GameData::KIND_COUNT] = {h->weaponCount, h->armorCount, h->potionCount};
+        for (uint32_t i = 0; i < h->lootEntryCount; i++) {
+            const GameData::LootEntryRecord& entry = lootEntries[i];
+            lootValid = lootValid && entry.kind < GameData::KIND_COUNT && entry.archetype < kindCounts[entry.kind];
+        }
        
-        // Update UI elements
-        healthBar.setPosition(position.x - 25, position.y - 40);
-        healthBar.setSize(sf::Vector2f(50.0f * health / maxHealth, 6));
+        // On-hit and spell effects index the status effect rules; palettes index their table
+        bool effectsValid = true;
+        for (uint32_t i = 0; i < h->monsterCount; i++) {
+            effectsValid = effectsValid && monsters[i].onHitEffect < GameData::EFFECT_COUNT &&
+                           monsters[i].palette <= h->paletteCount;
+        }
+        for (uint32_t i = 0; i < h->spellCount; i++) {
+            effectsValid = effectsValid && spells[i].effect < GameData::EFFECT_COUNT &&
+                           spells[i].targeting < GameData::TARGET_COUNT;
+        }
        
-        manaBar.setPosition(position.x - 25, position.y - 32);
-        manaBar.setSize(sf::Vector2f(50.0f * mana / maxMana, 4));
+        // Animator indexes sets, clips and frames without checking them again
+        bool animationValid = true;
+        for (uint32_t i = 0; i < h->monsterCount; i++) {
+            animationValid = animationValid && (monsters[i].animationSet == GameData::NO_ANIMATION ||
+                                                monsters[i].animationSet < h->animationSetCount);
+        }
+        for (uint32_t i = 0; i < h->animationSetCount; i++) {
+            for (uint16_t clip : animationSets[i].clips) animationValid = animationValid && clip < h->clipCount;
+        }
+        for (uint32_t i = 0; i < h->clipCount; i++) {
+            const GameData::ClipRecord& clip = clips[i];
+            animationValid = animationValid && clip.frameCount > 0 && clip.firstFrame <= h->frameCount &&
+                             clip.frameCount <= h->frameCount - clip.firstFrame &&
+                             clip.event < GameData::ANIMATION_EVENT_COUNT &&
+                             (clip.event == GameData::ANIMATION_EVENT_NONE ||
+                              (clip.eventFrame > 0 && clip.eventFrame < clip.frameCount));
+        }
+        for (uint32_t i = 0; i < h->frameCount; i++) {
+            animationValid = animationValid && frames[i].duration > 0.0f;
+        }
        
-        nameText.setPosition(position.x - nameText.getLocalBounds().width / 2, position.y - 55);
+        if (!stringsValid || !lootValid || !effectsValid || !animationValid) {
+            std::cerr << "Invalid string or table index in archetype data: " << filepath << std::endl;
+            unload();
+            return false;
+        }
+       
+        loadTimeMs = clock.getElapsedTime().asSeconds() * 1000.0f;
+        return true;
     }
    
-    void draw(sf::RenderWindow& window) override {
-        // Draw character
-        Character::draw(window);
-       
-        // Draw UI elements
-        window.draw(healthBar);
-        window.draw(manaBar);
-        window.draw(nameText);
+    void unload() {
+        file.close();
+        header = nullptr;
+        monsters = nullptr;
+        weapons = nullptr;
+        armors = nullptr;
+        potions = nullptr;
+        rarities = nullptr;
+        affixes = nullptr;
+        lootTables = nullptr;
+        lootEntries = nullptr;
+        spells = nullptr;
+        animationSets = nullptr;
+        clips = nullptr;
+        frames = nullptr;
+        palettes = nullptr;
+        strings = nullptr;
     }
    
-    void move(float dx, float dy) {
-        if (dx != 0 || dy != 0) {
-            velocity = sf::Vector2f(dx, dy);
-           
-            // Normalize velocity for diagonal movement
-            float length = std::sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
-            if (length > 0) {
-                velocity /= length;
-            }
-           
-            velocity *= moveSpeed;
-           
-            // Set facing direction
-            if (dx != 0) {
-                setFacingDirection(dx > 0);
-            }
-           
-            setAnimation("walk");
-        } else {
-            setAnimation("idle");
-        }
+    // Exchange mappings; pointers into either stay valid, only their owner changes
+    void swap(ArchetypeTable& other) {
+        file.swap(other.file);
+        std::swap(header, other.header);
+        std::swap(monsters, other.monsters);
+        std::swap(weapons, other.weapons);
+        std::swap(armors, other.armors);
+        std::swap(potions, other.potions);
+        std::swap(rarities, other.rarities);
+        std::swap(affixes, other.affixes);
+        std::swap(lootTables, other.lootTables);
+        std::swap(lootEntries, other.lootEntries);
+        std::swap(spells, other.spells);
+        std::swap(animationSets, other.animationSets);
+        std::swap(clips, other.clips);
+        std::swap(frames, other.frames);
+        std::swap(palettes, other.palettes);
+        std::swap(strings, other.strings);
+        std::swap(loadTimeMs, other.loadTimeMs);
     }
    
-    void gainExperience(int exp) {
-        experience += exp;
-       
-        // Check for level up
-        int requiredExp = level * 1000;
-        if (experience >= requiredExp) {
-            levelUp();
+    int getMonsterCount() const { return header ? static_cast<int>(header->monsterCount) : 0; }
+    int getWeaponCount() const { return header ? static_cast<int>(header->weaponCount) : 0; }
+    int getArmorCount() const { return header ? static_cast<int>(header->armorCount) : 0; }
+    int getPotionCount() const { return header ? static_cast<int>(header->potionCount) : 0; }
+    int getRarityCount() const { return header ? static_cast<int>(header->rarityCount) : 0; }
+    int getAffixCount() const { return header ? static_cast<int>(header->affixCount) : 0; }
+    int getLootTableCount() const { return header ? static_cast<int>(header->lootTableCount) : 0; }
+    int getSpellCount() const { return header ? static_cast<int>(header->spellCount) : 0; }
+    int getAnimationSetCount() const { return header ? static_cast<int>(header->animationSetCount) : 0; }
+    int getClipCount() const { return header ? static_cast<int>(header->clipCount) : 0; }
+    int getFrameCount() const { return header ? static_cast<int>(header->frameCount) : 0; }
+    int getPaletteCount() const { return header ? static_cast<int>(header->paletteCount) : 0; }
+   
+    const GameData::MonsterRecord& getMonster(int index) const { return monsters[index]; }
+    const GameData::WeaponRecord& getWeapon(int index) const { return weapons[index]; }
+    const GameData::ArmorRecord& getArmor(int index) const { return armors[index]; }
+    const GameData::PotionRecord& getPotion(int index) const { return potions[index]; }
+    const GameData::RarityRecord& getRarity(int index) const { return rarities[index]; }
+    const GameData::AffixRecord& getAffix(int index) const { return affixes[index]; }
+    const GameData::LootTableRecord& getLootTable(int index) const { return lootTables[index]; }
+    const GameData::LootEntryRecord& getLootEntry(int index) const { return lootEntries[index]; }
+    const GameData::SpellRecord& getSpell(int index) const { return spells[index]; }
+    const GameData::AnimationSetRecord& getAnimationSet(int index) const { return animationSets[index]; }
+    const GameData::ClipRecord& getClip(int index) const { return clips[index]; }
+    const GameData::FrameRecord& getFrame(int index) const { return frames[index]; }
+    const GameData::PaletteRecord& getPalette(int index) const { return palettes[index]; }
+   
+    // For characters without an archetype, such as the player; -1 if there is no such set
+    int findAnimationSet(const std::string& name) const {
+        for (int i = 0; i < getAnimationSetCount(); i++) {
+            if (name == getString(animationSets[i].name)) return i;
         }
+        return -1;
     }
    
-    void levelUp() {
-        level++;
-        experience -= level * 1000;
+    // Strings live in the mapped blob for as long as the table is loaded
+    const char* getString(uint32_t offset) const { return strings + offset; }
+   
+    float getLoadTimeMs() const { return loadTimeMs; }
+    size_t getBlobSize() const { return file.getSize(); }
+   
+    // Parse assets/data/*.txt and write the binary blob. Each file holds blocks of
+    // "key = value" lines that start with a [monster], [weapon], [armor], [potion],
+    // [rarity], [affix], [loot], [spell], [animation] or [palette] header.
+    static bool compile(const std::string& dataDir, const std::string& outputPath) {
+        std::vector<GameData::MonsterRecord> monsterRecords;
+        std::vector<GameData::WeaponRecord> weaponRecords;
+        std::vector<GameData::ArmorRecord> armorRecords;
+        std::vector<GameData::PotionRecord> potionRecords;
+        std::vector<GameData::RarityRecord> rarityRecords;
+        std::vector<GameData::AffixRecord> affixRecords;
+        std::vector<GameData::LootTableRecord> lootTableRecords;
+        std::vector<GameData::LootEntryRecord> lootEntryRecords;
+        std::vector<GameData::SpellRecord> spellRecords;
+       
+        // Loot entries name their item; resolved once every file has been read
+        struct PendingEntry {
+            std::string item;
+            std::string location;
+        };
+        std::vector<PendingEntry> pendingEntries;
+       
+        // Animation sets are baked into clip and frame records once every key is
+        // known, since frame_size may follow the clips; monsters name their set
+        struct PendingClip {
+            bool defined;
+            int row, frameCount, column;
+            float seconds;
+            bool loop;
+            int event, eventFrame;
+            std::vector<float> durations;  // Overrides seconds frame by frame
+        };
+        struct PendingSet {
+            std::string location;
+            int width, height;
+            PendingClip clips[GameData::CLIP_COUNT];
+        };
+        std::vector<GameData::AnimationSetRecord> animationSetRecords;
+        std::vector<GameData::ClipRecord> clipRecords;
+        std::vector<GameData::FrameRecord> frameRecords;
+        std::vector<PendingSet> pendingSets;
+        std::vector<std::string> monsterAnimations;
+        std::vector<GameData::PaletteRecord> paletteRecords;
+        std::vector<std::string> monsterPalettes;
+       
+        // Deduplicated string table; offset 0 is the empty string
+        std::string stringTable(1, '\0');
+        std::map<std::string, uint32_t> stringOffsets = {{"", 0}};
+        auto addString = [&](const std::string& s) {
+            auto it = stringOffsets.find(s);
+            if (it != stringOffsets.end()) return it->second;
+            uint32_t offset = static_cast<uint32_t>(stringTable.size());
+            stringTable += s;
+            stringTable += '\0';
+            stringOffsets[s] = offset;
+            return offset;
+        };
        
-        // Increase stats based on D&D rules
-        maxHealth += GameUtils::rollDice(1, 8) + (constitution - 10) / 2;
-        health = maxHealth;
+        for (const char* name : DATA_FILES) {
+            std::string filepath = dataDir + "/" + name;
+            std::ifstream in(filepath);
+            if (!in) {
+                std::cerr << "Failed to open data file: " << filepath << std::endl;
+                return false;
+            }
+           
+            std::string section;
+            std::string line;
+            int lineNumber = 0;
+            while (std::getline(in, line)) {
+                lineNumber++;
+                line = trim(line.substr(0, line.find('#')));
+                if (line.empty()) continue;
+               
+                if (line.front() == '[' && line.back() == ']') {
+                    section = line.substr(1, line.size() - 2);
+                    if (section == "monster") {
+                        monsterRecords.push_back(GameData::MonsterRecord());
+                        monsterAnimations.push_back("");
+                        monsterPalettes.push_back("");
+                    }
+                    else if (section == "weapon") weaponRecords.push_back(GameData::WeaponRecord());
+                    else if (section == "armor") armorRecords.push_back(GameData::ArmorRecord());
+                    else if (section == "potion") potionRecords.push_back(GameData::PotionRecord());
+                    else if (section == "rarity") rarityRecords.push_back(GameData::RarityRecord());
+                    else if (section == "affix") affixRecords.push_back(GameData::AffixRecord());
+                    else if (section == "spell") {
+                        GameData::SpellRecord spell = {};
+                        spell.projectileTexture = addString("fireball");
+                        spell.minimumLevel = 1;
+                        spell.targeting = GameData::TARGET_SINGLE;
+                        spell.damageFaces = 1;
+                        spellRecords.push_back(spell);
+                    }
+                    else if (section == "animation") {
+                        animationSetRecords.push_back(GameData::AnimationSetRecord());
+                        pendingSets.push_back(PendingSet());
+                        pendingSets.back().location = filepath + ":" + std::to_string(lineNumber);
+                    }
+                    else if (section == "palette") paletteRecords.push_back(GameData::PaletteRecord());
+                    else if (section == "loot") {
+                        GameData::LootTableRecord table = {};
+                        table.minLevel = 1;
+                        table.maxLevel = GameData::MAX_LOOT_LEVEL;
+                        table.firstEntry = static_cast<uint32_t>(lootEntryRecords.size());
+                        lootTableRecords.push_back(table);
+                    }
+                    else {
+                        std::cerr << filepath << ":" << lineNumber << ": unknown section [" << section << "]" << std::endl;
+                        return false;
+                    }
+                    continue;
+                }
+               
+                size_t equals = line.find('=');
+                if (equals == std::string::npos || section.empty()) {
+                    std::cerr << filepath << ":" << lineNumber << ": expected 'key = value'" << std::endl;
+                    return false;
+                }
+                std::string key = trim(line.substr(0, equals));
+                std::string value = trim(line.substr(equals + 1));
+                std::istringstream values(value);
+               
+                bool known = true;
+                if (section == "monster") {
+                    auto& r = monsterRecords.back();
+                    if (key == "name") r.name = addString(value);
+                    else if (key == "texture") r.texture = addString(value);
+                    else if (key == "stats") for (auto& s : r.stats) values >> s;
+                    else if (key == "experience") values >> r.experience;
+                    else if (key == "gold") values >> r.gold;
+                    else if (key == "density") values >> r.density;
+                    else if (key == "boss") r.flags |= readFlag(values, GameData::FLAG_BOSS);
+                    else if (key == "animation") monsterAnimations.back() = value;
+                    else if (key == "palette") monsterPalettes.back() = value;
+                    else if (key == "on_hit") {
+                        // "<effect> <percent chance>"
+                        std::string effect;
+                        int chance = 0;
+                        values >> effect >> chance;
+                        int id = parseEffect(effect);
+                        if (id <= GameData::EFFECT_NONE || chance < 0 || chance > 100) known = false;
+                        else {
+                            r.onHitEffect = static_cast<uint8_t>(id);
+                            r.onHitChance = static_cast<uint8_t>(chance);
+                        }
+                    }
+                    else known = false;
+                } else if (section == "weapon") {
+                    auto& r = weaponRecords.back();
+                    if (key == "name") r.name = addString(value);
+                    else if (key == "type") r.weaponType = addString(value);
+                    else if (key == "description") r.description = addString(value);
+                    else if (key == "damage") values >> r.minDamage >> r.maxDamage;
+                    else if (key == "damage_per_level") values >> r.minDamagePerLevel >> r.maxDamagePerLevel;
+                    else if (key == "attack_bonus") values >> r.attackBonus;
+                    else if (key == "value") values >> r.value;
+                    else if (key == "value_per_level") values >> r.valuePerLevel;
+                    else if (key == "rect") for (auto& v : r.rect) values >> v;
+                    else if (key == "density") values >> r.density;
+                    else if (key == "starter") r.flags |= readFlag(values, GameData::FLAG_STARTER);
+                    else if (key == "loot") r.flags |= readFlag(values, GameData::FLAG_LOOT);
+                    else known = false;
+                } else if (section == "armor") {
+                    auto& r = armorRecords.back();
+                    if (key == "name") r.name = addString(value);
+                    else if (key == "type") r.armorType = addString(value);
+                    else if (key == "description") r.description = addString(value);
+                    else if (key == "defense") values >> r.defense;
+                    else if (key == "defense_per_level") values >> r.defensePerLevel;
+                    else if (key == "value") values >> r.value;
+                    else if (key == "value_per_level") values >> r.valuePerLevel;
+                    else if (key == "rect") for (auto& v : r.rect) values >> v;
+                    else if (key == "density") values >> r.density;
+                    else if (key == "starter") r.flags |= readFlag(values, GameData::FLAG_STARTER);
+                    else if (key == "loot") r.flags |= readFlag(values, GameData::FLAG_LOOT);
+                    else known = false;
+                } else if (section == "potion") {
+                    auto& r = potionRecords.back();
+                    if (key == "name") r.name = addString(value);
+                    else if (key == "description") r.description = addString(value);
+                    else if (key == "heal") values >> r.heal;
+                    else if (key == "heal_per_level") values >> r.healPerLevel;
+                    else if (key == "value") values >> r.value;
+                    else if (key == "value_per_level") values >> r.valuePerLevel;
+                    else if (key == "rect") for (auto& v : r.rect) values >> v;
+                    else if (key == "density") values >> r.density;
+                    else if (key == "starter") r.flags |= readFlag(values, GameData::FLAG_STARTER);
+                    else if (key == "loot") r.flags |= readFlag(values, GameData::FLAG_LOOT);
+                    else known = false;
+                } else if (section == "rarity") {
+                    auto& r = rarityRecords.back();
+                    int count = 0;
+                    if (key == "name") r.name = addString(value);
+                    else if (key == "weight") values >> r.weight;
+                    else if (key == "prefixes") { values >> count; r.prefixes = count > 0 ? 1 : 0; }
+                    else if (key == "suffixes") { values >> count; r.suffixes = count > 0 ? 1 : 0; }
+                    else known = false;
+                } else if (section == "affix") {
+                    auto& r = affixRecords.back();
+                    if (key == "name") r.name = addString(value);
+                    else if (key == "weight") values >> r.weight;
+                    else if (key == "position") {
+                        if (value == "prefix") r.position = GameData::AFFIX_PREFIX;
+                        else if (value == "suffix") r.position = GameData::AFFIX_SUFFIX;
+                        else known = false;
+                    }
+                    else if (key == "applies") {
+                        std::string kind;
+                        while (values >> kind) {
+                            int k = parseKind(kind);
+                            if (k < 0) known = false;
+                            else r.kinds |= static_cast<uint8_t>(1 << k);
+                        }
+                        values.clear();
+                    }
+                    else if (key == "damage") values >> r.damage;
+                    else if (key == "attack") values >> r.attack;
+                    else if (key == "defense") values >> r.defense;
+                    else if (key == "heal") values >> r.heal;
+                    else if (key == "value_percent") values >> r.valuePercent;
+                    else known = false;
+                } else if (section == "spell") {
+                    auto& r = spellRecords.back();
+                    int first = 0, second = 0, bonus = 0;
+                    std::string word;
+                    if (key == "name") r.name = addString(value);
+                    else if (key == "description") r.description = addString(value);
+                    else if (key == "mana") values >> r.manaCost;
+                    else if (key == "level") values >> r.minimumLevel;
+                    else if (key == "target") {
+                        int targeting = parseTargeting(value);
+                        if (targeting < 0) known = false;
+                        else r.targeting = static_cast<uint8_t>(targeting);
+                    }
+                    else if (key == "range") values >> r.range;
+                    else if (key == "area") values >> r.area;
+                    else if (key == "damage") {
+                        // "<dice> <faces> [bonus]"
+                        values >> first >> second;
+                        if (values && !(values >> bonus)) {
+                            values.clear();
+                            bonus = 0;
+                        }
+                        if (first < 0 || first > 255 || second < 1 || second > 255) known = false;
+                        else {
+                            r.damageDice = static_cast<uint8_t>(first);
+                            r.damageFaces = static_cast<uint8_t>(second);
+                            r.damageBonus = static_cast<int16_t>(bonus);
+                        }
+                    }
+                    else if (key == "effect") {
+                        // "<effect> [stacks]"
+                        values >> word;
+                        if (values && !(values >> first)) {
+                            values.clear();
+                            first = 1;
+                        }
+                        int id = parseEffect(word);
+                        if (id <= GameData::EFFECT_NONE || first < 1 || first > 255) known = false;
+                        else {
+                            r.effect = static_cast<uint8_t>(id);
+                            r.effectStacks = static_cast<uint8_t>(first);
+                        }
+                    }
+                    else if (key == "projectile") {
+                        // "<texture> <speed>"
+                        values >> word >> r.projectileSpeed;
+                        r.projectileTexture = addString(word);
+                    }
+                    else known = false;
+                } else if (section == "animation") {
+                    PendingSet& set = pendingSets.back();
+                    size_t suffix = key.find('_');
+                    int clip = parseClip(key.substr(0, suffix));
+                    std::string field = suffix == std::string::npos ? "" : key.substr(suffix + 1);
+                    std::string word;
+                    if (key == "name") animationSetRecords.back().name = addString(value);
+                    else if (key == "frame_size") values >> set.width >> set.height;
+                    else if (clip < 0) known = false;
+                    else if (field.empty()) {
+                        // "<row> <frames> <seconds per frame> <loop|once> [first column]"
+                        PendingClip& c = set.clips[clip];
+                        c.column = 0;
+                        values >> c.row >> c.frameCount >> c.seconds >> word;
+                        if (values && !(values >> c.column)) values.clear();
+                        c.loop = word == "loop";
+                        c.defined = true;
+                        if ((word != "loop" && word != "once") || c.row < 0 || c.column < 0 ||
+                            c.frameCount < 1 || c.frameCount > 255 || c.seconds <= 0.0f) known = false;
+                    }
+                    else if (field == "event") {
+                        // "<event> <frame>", counted from 0
+                        PendingClip& c = set.clips[clip];
+                        values >> word >> c.eventFrame;
+                        c.event = parseAnimationEvent(word);
+                        if (c.event <= GameData::ANIMATION_EVENT_NONE) known = false;
+                    }
+                    else if (field == "durations") {
+                        PendingClip& c = set.clips[clip];
+                        float seconds = 0.0f;
+                        c.durations.clear();
+                        while (values >> seconds) c.durations.push_back(seconds);
+                        values.clear();
+                    }
+                    else known = false;
+                } else if (section == "palette") {
+                    auto& r = paletteRecords.back();
+                    if (key == "name") r.name = addString(value);
+                    else if (key == "ramp") {
+                        // PALETTE_SIZE colours as RRGGBB hex, dark to light
+                        std::string color;
+                        int count = 0;
+                        while (values >> color) {
+                            char* end = nullptr;
+                            unsigned long rgb = std::strtoul(color.c_str(), &end, 16);
+                            if (color.size() != 6 || *end != '\0' || count == GameData::PALETTE_SIZE) {
+                                known = false;
+                                break;
+                            }
+                            r.colors[count++] = sf::Color(static_cast<uint32_t>(rgb << 8 | 0xFF)).toInteger();
+                        }
+                        values.clear();
+                        if (count != GameData::PALETTE_SIZE) known = false;
+                    }
+                    else known = false;
+                } else {
+                    auto& r = lootTableRecords.back();
+                    int kind = parseKind(key);
+                    if (key == "monster") r.monster = addString(value == "*" ? "" : value);
+                    else if (key == "levels") values >> r.minLevel >> r.maxLevel;
+                    else if (key == "drop_chance") values >> r.dropChance;
+                    else if (kind >= 0) {
+                        // "<item name> <weight>"; the name may contain spaces
+                        size_t split = value.find_last_of(" \t");
+                        GameData::LootEntryRecord entry = {};
+                        entry.kind = static_cast<uint8_t>(kind);
+                        if (split == std::string::npos) known = false;
+                        else {
+                            std::istringstream weight(value.substr(split + 1));
+                            weight >> entry.weight;
+                            if (weight.fail()) known = false;
+                        }
+                        if (known) {
+                            lootEntryRecords.push_back(entry);
+                            pendingEntries.push_back({trim(value.substr(0, split)),
+                                                      filepath + ":" + std::to_string(lineNumber)});
+                            r.entryCount++;
+                        }
+                    }
+                    else known = false;
+                }
+               
+                if (!known || values.fail()) {
+                    std::cerr << filepath << ":" << lineNumber << ": bad value for '" << key << "'" << std::endl;
+                    return false;
+                }
+            }
+        }
        
-        maxMana += GameUtils::rollDice(1, 4) + (intelligence - 10) / 2;
-        mana = maxMana;
+        // Loot entries may only name archetypes marked loot = 1, which keeps a starter
+        // item and its loot variant apart even when they share a display name
+        for (size_t i = 0; i < pendingEntries.size(); i++) {
+            GameData::LootEntryRecord& entry = lootEntryRecords[i];
+            uint32_t name = addString(pendingEntries[i].item);
+            int found = -1;
+            auto search = [&](const auto& records) {
+                for (size_t j = 0; j < records.size() && found < 0; j++) {
+                    if (records[j].name == name && (records[j].flags & GameData::FLAG_LOOT)) found = static_cast<int>(j);
+                }
+            };
+            if (entry.kind == GameData::KIND_WEAPON) search(weaponRecords);
+            else if (entry.kind == GameData::KIND_ARMOR) search(armorRecords);
+            else search(potionRecords);
+           
+            if (found < 0 || entry.weight <= 0.0f) {
+                std::cerr << pendingEntries[i].location << ": no loot item '" << pendingEntries[i].item
+                          << "' with a positive weight" << std::endl;
+                return false;
+            }
+            entry.archetype = static_cast<uint16_t>(found);
+        }
+        for (const auto& table : lootTableRecords) {
+            bool monsterKnown = table.monster == 0;
+            for (const auto& monster : monsterRecords) monsterKnown = monsterKnown || monster.name == table.monster;
+            if (!monsterKnown || table.minLevel > table.maxLevel) {
+                std::cerr << "Loot table for '" << stringTable.c_str() + table.monster
+                          << "' names an unknown monster or an empty level range" << std::endl;
+                return false;
+            }
+        }
        
-        // Increase a random attribute
-        int statChoice = GameUtils::getRandomInt(1, 6);
-        switch (statChoice) {
-            case 1: strength++; break;
-            case 2: dexterity++; break;
-            case 3: constitution++; break;
-            case 4: intelligence++; break;
-            case 5: wisdom++; break;
-            case 6: charisma++; break;
+        // Bake each set's clips into frame rects from its grid; a clip the set leaves
+        // out plays its idle clip
+        for (size_t i = 0; i < pendingSets.size(); i++) {
+            const PendingSet& set = pendingSets[i];
+            const PendingClip& idle = set.clips[GameData::CLIP_IDLE];
+            if (animationSetRecords[i].name == 0 || set.width <= 0 || set.height <= 0 || !idle.defined) {
+                std::cerr << set.location << ": animation needs a name, a frame_size and an idle clip" << std::endl;
+                return false;
+            }
+            for (int id = 0; id < GameData::CLIP_COUNT; id++) {
+                const PendingClip& c = set.clips[id];
+                if (!c.defined) {
+                    animationSetRecords[i].clips[id] = animationSetRecords[i].clips[GameData::CLIP_IDLE];
+                    continue;
+                }
+                if ((!c.durations.empty() && static_cast<int>(c.durations.size()) != c.frameCount) ||
+                    (c.event != GameData::ANIMATION_EVENT_NONE && (c.eventFrame < 1 || c.eventFrame >= c.frameCount))) {
+                    std::cerr << set.location << ": a clip's durations or event frame don't fit its frame count" << std::endl;
+                    return false;
+                }
+               
+                GameData::ClipRecord clip = {};
+                clip.firstFrame = static_cast<uint32_t>(frameRecords.size());
+                clip.frameCount = static_cast<uint16_t>(c.frameCount);
+                clip.flags = c.loop ? GameData::CLIP_LOOP : 0;
+                clip.event = static_cast<uint8_t>(c.event);
+                clip.eventFrame = static_cast<uint16_t>(c.eventFrame);
+                for (int f = 0; f < c.frameCount; f++) {
+                    GameData::FrameRecord frame = {};
+                    frame.rect[0] = static_cast<int16_t>((c.column + f) * set.width);
+                    frame.rect[1] = static_cast<int16_t>(c.row * set.height);
+                    frame.rect[2] = static_cast<int16_t>(set.width);
+                    frame.rect[3] = static_cast<int16_t>(set.height);
+                    frame.duration = c.durations.empty() ? c.seconds : c.durations[f];
+                    if (frame.duration <= 0.0f) {
+                        std::cerr << set.location << ": frame durations must be positive" << std::endl;
+                        return false;
+                    }
+                    frameRecords.push_back(frame);
+                }
+                animationSetRecords[i].clips[id] = static_cast<uint16_t>(clipRecords.size());
+                clipRecords.push_back(clip);
+            }
+        }
+        for (size_t i = 0; i < monsterRecords.size(); i++) {
+            monsterRecords[i].animationSet = GameData::NO_ANIMATION;
+            if (monsterAnimations[i].empty()) continue;
+            uint32_t name = addString(monsterAnimations[i]);
+            for (size_t j = 0; j < animationSetRecords.size(); j++) {
+                if (animationSetRecords[j].name == name) monsterRecords[i].animationSet = static_cast<uint16_t>(j);
+            }
+            if (monsterRecords[i].animationSet == GameData::NO_ANIMATION) {
+                std::cerr << "Monster '" << stringTable.c_str() + monsterRecords[i].name
+                          << "' names an unknown animation '" << monsterAnimations[i] << "'" << std::endl;
+                return false;
+            }
+        }
+        if (paletteRecords.size() > 255) {
+            std::cerr << "At most 255 palettes" << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < monsterRecords.size(); i++) {
+            if (monsterPalettes[i].empty()) continue;
+            uint32_t name = addString(monsterPalettes[i]);
+            for (size_t j = 0; j < paletteRecords.size(); j++) {
+                if (paletteRecords[j].name == name) monsterRecords[i].palette = static_cast<uint8_t>(j + 1);
+            }
+            if (monsterRecords[i].palette == 0) {
+                std::cerr << "Monster '" << stringTable.c_str() + monsterRecords[i].name
+                          << "' names an unknown palette '" << monsterPalettes[i] << "'" << std::endl;
+                return false;
+            }
         }
        
-        // Recalculate derived stats
-        armorClass = 10 + (dexterity - 10) / 2;
-        attackBonus = (strength - 10) / 2;
+        // Lay out header, tables and strings, keeping every table 4-byte aligned
+        GameData::Header h = {};
+        h.magic = GameData::MAGIC;
+        h.version = GameData::VERSION;
+        uint32_t offset = sizeof(GameData::Header);
+        auto place = [&offset](uint32_t& tableOffset, uint32_t& tableCount, size_t count, size_t recordSize) {
+            tableOffset = offset;
+            tableCount = static_cast<uint32_t>(count);
+            offset += static_cast<uint32_t>(count * recordSize);
+        };
+        place(h.monsterOffset, h.monsterCount, monsterRecords.size(), sizeof(GameData::MonsterRecord));
+        place(h.weaponOffset, h.weaponCount, weaponRecords.size(), sizeof(GameData::WeaponRecord));
+        place(h.armorOffset, h.armorCount, armorRecords.size(), sizeof(GameData::ArmorRecord));
+        place(h.potionOffset, h.potionCount, potionRecords.size(), sizeof(GameData::PotionRecord));
+        place(h.rarityOffset, h.rarityCount, rarityRecords.size(), sizeof(GameData::RarityRecord));
+        place(h.affixOffset, h.affixCount, affixRecords.size(), sizeof(GameData::AffixRecord));
+        place(h.lootTableOffset, h.lootTableCount, lootTableRecords.size(), sizeof(GameData::LootTableRecord));
+        place(h.lootEntryOffset, h.lootEntryCount, lootEntryRecords.size(), sizeof(GameData::LootEntryRecord));
+        place(h.spellOffset, h.spellCount, spellRecords.size(), sizeof(GameData::SpellRecord));
+        place(h.animationSetOffset, h.animationSetCount, animationSetRecords.size(), sizeof(GameData::AnimationSetRecord));
+        place(h.clipOffset, h.clipCount, clipRecords.size(), sizeof(GameData::ClipRecord));
+        place(h.frameOffset, h.frameCount, frameRecords.size(), sizeof(GameData::FrameRecord));
+        place(h.paletteOffset, h.paletteCount, paletteRecords.size(), sizeof(GameData::PaletteRecord));
+        h.stringOffset = offset;
+        h.stringSize = static_cast<uint32_t>(stringTable.size());
+        h.totalSize = offset + h.stringSize;
+       
+        std::ofstream out(outputPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Failed to write archetype data: " << outputPath << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(monsterRecords.data()), monsterRecords.size() * sizeof(GameData::MonsterRecord));
+        out.write(reinterpret_cast<const char*>(weaponRecords.data()), weaponRecords.size() * sizeof(GameData::WeaponRecord));
+        out.write(reinterpret_cast<const char*>(armorRecords.data()), armorRecords.size() * sizeof(GameData::ArmorRecord));
+        out.write(reinterpret_cast<const char*>(potionRecords.data()), potionRecords.size() * sizeof(GameData::PotionRecord));
+        out.write(reinterpret_cast<const char*>(rarityRecords.data()), rarityRecords.size() * sizeof(GameData::RarityRecord));
+        out.write(reinterpret_cast<const char*>(affixRecords.data()), affixRecords.size() * sizeof(GameData::AffixRecord));
+        out.write(reinterpret_cast<const char*>(lootTableRecords.data()), lootTableRecords.size() * sizeof(GameData::LootTableRecord));
+        out.write(reinterpret_cast<const char*>(lootEntryRecords.data()), lootEntryRecords.size() * sizeof(GameData::LootEntryRecord));
+        out.write(reinterpret_cast<const char*>(spellRecords.data()), spellRecords.size() * sizeof(GameData::SpellRecord));
+        out.write(reinterpret_cast<const char*>(animationSetRecords.data()), animationSetRecords.size() * sizeof(GameData::AnimationSetRecord));
+        out.write(reinterpret_cast<const char*>(clipRecords.data()), clipRecords.size() * sizeof(GameData::ClipRecord));
+        out.write(reinterpret_cast<const char*>(frameRecords.data()), frameRecords.size() * sizeof(GameData::FrameRecord));
+        out.write(reinterpret_cast<const char*>(paletteRecords.data()), paletteRecords.size() * sizeof(GameData::PaletteRecord));
+        out.write(stringTable.data(), stringTable.size());
+        return static_cast<bool>(out);
+    }
+   
+    // Recompile when the blob is missing or older than any of its sources
+    static bool isStale(const std::string& dataDir, const std::string& outputPath) {
+        std::error_code error;
+        auto built = std::filesystem::last_write_time(outputPath, error);
+        if (error) return true;
        
-        sounds.playSound("level_up");
+        for (const char* name : DATA_FILES) {
+            auto source = std::filesystem::last_write_time(dataDir + "/" + name, error);
+            if (!error && source > built) return true;
+        }
+        return false;
     }
    
-    // Inventory management
-    void addItem(std::shared_ptr<Item> item) {
-        inventory.push_back(item);
-        sounds.playSound("item");
+private:
+    static constexpr const char* DATA_FILES[] = {
+        "monsters.txt", "weapons.txt", "armor.txt", "potions.txt", "loot.txt", "spells.txt",
+        "animations.txt", "palettes.txt"
+    };
+   
+    static std::string trim(const std::string& s) {
+        size_t start = s.find_first_not_of(" \t\r");
+        if (start == std::string::npos) return "";
+        size_t end = s.find_last_not_of(" \t\r");
+        return s.substr(start, end - start + 1);
     }
    
-    void removeItem(int index) {
-        if (index >= 0 && index < inventory.size()) {
-            inventory.erase(inventory.begin() + index);
-        }
+    static uint16_t readFlag(std::istringstream& values, uint16_t flag) {
+        int enabled = 0;
+        values >> enabled;
+        return enabled ? flag : 0;
     }
    
-    void addGold(int amount) {
-        gold += amount;
-        sounds.playSound("item");
+    static int parseKind(const std::string& kind) {
+        if (kind == "weapon") return GameData::KIND_WEAPON;
+        if (kind == "armor") return GameData::KIND_ARMOR;
+        if (kind == "potion") return GameData::KIND_POTION;
+        return -1;
     }
    
-    // Quest management
-    void setQuestFlag(const std::string& quest, bool completed) {
-        questFlags[quest] = completed;
+    static int parseEffect(const std::string& effect) {
+        if (effect == "poison") return GameData::EFFECT_POISON;
+        if (effect == "sleep") return GameData::EFFECT_SLEEP;
+        if (effect == "bless") return GameData::EFFECT_BLESS;
+        if (effect == "regeneration") return GameData::EFFECT_REGENERATION;
+        return -1;
     }
    
-    bool hasQuestFlag(const std::string& quest) const {
-        auto it = questFlags.find(quest);
-        return it != questFlags.end() && it->second;
+    static int parseTargeting(const std::string& targeting) {
+        if (targeting == "self") return GameData::TARGET_SELF;
+        if (targeting == "single") return GameData::TARGET_SINGLE;
+        if (targeting == "radius") return GameData::TARGET_RADIUS;
+        if (targeting == "cone") return GameData::TARGET_CONE;
+        if (targeting == "line") return GameData::TARGET_LINE;
+        return -1;
     }
    
-    // Spell management
-    void learnSpell(std::shared_ptr<Spell> spell) {
-        spells.push_back(spell);
+    static int parseClip(const std::string& clip) {
+        if (clip == "idle") return GameData::CLIP_IDLE;
+        if (clip == "walk") return GameData::CLIP_WALK;
+        if (clip == "attack") return GameData::CLIP_ATTACK;
+        if (clip == "hurt") return GameData::CLIP_HURT;
+        return -1;
     }
    
-    bool castSpell(int spellIndex, Character& target) {
-        if (spellIndex < 0 || spellIndex >= spells.size()) return false;
-       
-        auto spell = spells[spellIndex];
-        if (mana < spell->getManaCost()) return false;
-       
-        mana -= spell->getManaCost();
-        return spell->cast(*this, target);
+    static int parseAnimationEvent(const std::string& event) {
+        if (event == "hit") return GameData::ANIMATION_EVENT_HIT;
+        return -1;
     }
-   
-    // Getters
-    int getExperience() const { return experience; }
-    int getGold() const { return gold; }
-    const std::vector<std::shared_ptr<Item>>& getInventory() const { return inventory; }
-    const std::vector<std::shared_ptr<Spell>>& getSpells() const { return spells; }
 };
 
-// Enemy class
-class Enemy : public Character {
+// Alias table - Vose's alias method. Building is O(n); each sample is one column
+// pick plus one biased coin flip, whatever the number of outcomes.
+class AliasTable {
 private:
-    int experienceValue;
-    int goldValue;
-    float detectionRange;
-    float attackRange;
-    Player* target;
-    float actionTimer;
-    float wanderTimer;
-    sf::Vector2f wanderTarget;
-    bool aggravated;
-   
-    // AI states
-    enum class State { Idle, Wander, Chase, Attack };
-    State currentState;
+    std::vector<float> probability;
+    std::vector<uint32_t> alias;
    
 public:
-    Enemy(const std::string& name, const std::string& type, ResourceManager& resources, SoundManager& sounds,
-          int strength, int dexterity, int constitution, int intelligence, int wisdom, int charisma,
-          int experienceValue, int goldValue)
-        : Character(name, type, resources, sounds, type,
-                   strength, dexterity, constitution, intelligence, wisdom, charisma),
-          experienceValue(experienceValue), goldValue(goldValue),
-          detectionRange(200.0f), attackRange(50.0f), target(nullptr),
-          actionTimer(0.0f), wanderTimer(0.0f), aggravated(false),
-          currentState(State::Idle) {
+    void build(const std::vector<float>& weights) {
+        size_t n = weights.size();
+        probability.assign(n, 1.0f);
+        alias.resize(n);
+        for (size_t i = 0; i < n; i++) alias[i] = static_cast<uint32_t>(i);
+       
+        double total = 0.0;
+        for (float w : weights) total += std::max(w, 0.0f);
+        if (total <= 0.0) {
+            probability.clear();
+            alias.clear();
+            return;
+        }
        
-        // Set random wander target
-        updateWanderTarget();
+        // Scale weights so the average column holds exactly 1, then pair each
+        // under-full column with an over-full one that tops it up
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; i++) {
+            scaled[i] = std::max(weights[i], 0.0f) * n / total;
+            (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+        }
+        while (!small.empty() && !large.empty()) {
+            uint32_t less = small.back();
+            small.pop_back();
+            uint32_t more = large.back();
+            large.pop_back();
+           
+            probability[less] = static_cast<float>(scaled[less]);
+            alias[less] = more;
+            scaled[more] = (scaled[more] + scaled[less]) - 1.0;
+            (scaled[more] < 1.0 ? small : large).push_back(more);
+        }
+        // Whatever is left is full up to rounding error and keeps probability 1
     }
    
-    void update(float deltaTime) override {
-        Character::update(deltaTime);
-       
-        if (!isAlive() || !target) return;
-       
-        actionTimer += deltaTime;
-       
-        // Update AI state based on distance to target
-        float distanceToTarget = GameUtils::distance(position.x, position.y,
-                                                   target->getPosition().x, target->getPosition().y);
-       
-        if (aggravated || distanceToTarget < detectionRange) {
-            if (distanceToTarget <= attackRange) {
-                currentState = State::Attack;
-            } else {
-                currentState = State::Chase;
-                aggravated = true;
-            }
-        } else {
-            wanderTimer += deltaTime;
-            if (wanderTimer >= 3.0f) {
-                updateWanderTarget();
-                wanderTimer = 0.0f;
-                currentState = State::Wander;
+    int sample(std::mt19937& generator) const {
+        uint32_t column = static_cast<uint32_t>((static_cast<uint64_t>(generator() & 0xFFFFFFFFu) * probability.size()) >> 32);
+        return GameUtils::randomUnit(generator) < probability[column] ? static_cast<int>(column) : static_cast<int>(alias[column]);
+    }
+   
+    bool empty() const { return probability.empty(); }
+    size_t size() const { return probability.size(); }
+};
+
+// One rolled drop; affix and rarity fields are indices into the archetype table, -1 for none
+struct LootDrop {
+    int kind;
+    int archetype;
+    int rarity;
+    int prefix;
+    int suffix;
+};
+
+// Loot tables - alias tables for every loot table, for rarity and for each
+// item kind's prefixes and suffixes, built once from the archetype data. A drop
+// is a table lookup plus a few O(1) samples and never touches a string.
+class LootTables {
+private:
+    const ArchetypeTable* archetypes;
+    std::vector<AliasTable> entryTables;
+    AliasTable rarityTable;
+    AliasTable affixTables[GameData::KIND_COUNT][2];
+    std::vector<int> affixIndices[GameData::KIND_COUNT][2];  // Alias column -> affix record
+    std::vector<int16_t> tableLookup;                        // [monster][level] -> loot table
+   
+    static const int LEVEL_SLOTS = GameData::MAX_LOOT_LEVEL + 1;
+   
+    int rollAffix(int kind, int position, std::mt19937& generator) const {
+        const AliasTable& affixes = affixTables[kind][position];
+        return affixes.empty() ? -1 : affixIndices[kind][position][affixes.sample(generator)];
+    }
+   
+public:
+    LootTables() : archetypes(nullptr) {}
+   
+    void build(const ArchetypeTable& table) {
+        archetypes = &table;
+        std::vector<float> weights;
+       
+        entryTables.assign(table.getLootTableCount(), AliasTable());
+        for (int t = 0; t < table.getLootTableCount(); t++) {
+            const GameData::LootTableRecord& loot = table.getLootTable(t);
+            weights.clear();
+            for (uint32_t e = 0; e < loot.entryCount; e++) {
+                weights.push_back(table.getLootEntry(loot.firstEntry + e).weight);
             }
+            entryTables[t].build(weights);
         }
        
-        // Execute behavior based on state
-        switch (currentState) {
-            case State::Idle:
-                setAnimation("idle");
-                break;
-               
-            case State::Wander:
-                moveTowardsPoint(wanderTarget.x, wanderTarget.y, deltaTime, 50.0f);
-                if (GameUtils::distance(position.x, position.y, wanderTarget.x, wanderTarget.y) < 10.0f) {
-                    currentState = State::Idle;
-                }
-                break;
-               
-            case State::Chase:
-                moveTowardsPoint(target->getPosition().x, target->getPosition().y, deltaTime, 100.0f);
-                break;
-               
-            case State::Attack:
-                if (actionTimer >= 1.0f) {  // Attack every second
-                    attack(*target);
-                    actionTimer = 0.0f;
+        weights.clear();
+        for (int r = 0; r < table.getRarityCount(); r++) weights.push_back(table.getRarity(r).weight);
+        rarityTable.build(weights);
+       
+        for (int kind = 0; kind < GameData::KIND_COUNT; kind++) {
+            for (int position = 0; position < 2; position++) {
+                weights.clear();
+                affixIndices[kind][position].clear();
+                for (int a = 0; a < table.getAffixCount(); a++) {
+                    const GameData::AffixRecord& affix = table.getAffix(a);
+                    if (affix.position == position && (affix.kinds & (1 << kind))) {
+                        weights.push_back(affix.weight);
+                        affixIndices[kind][position].push_back(a);
+                    }
                 }
-                break;
+                affixTables[kind][position].build(weights);
+            }
         }
-    }
-   
-    void moveTowardsPoint(float x, float y, float deltaTime, float speed) {
-        sf::Vector2f direction(x - position.x, y - position.y);
-        float length = std::sqrt(direction.x * direction.x + direction.y * direction.y);
        
-        if (length > 0) {
-            direction /= length;
-            position += direction * speed * deltaTime;
-           
-            // Update facing direction
-            setFacingDirection(direction.x > 0);
-            setAnimation("walk");
+        // Resolve tables per monster and level up front: a table naming the monster
+        // wins over a catch-all one, and earlier tables win over later ones
+        tableLookup.assign(table.getMonsterCount() * LEVEL_SLOTS, -1);
+        for (int m = 0; m < table.getMonsterCount(); m++) {
+            for (int pass = 0; pass < 2; pass++) {
+                for (int t = 0; t < table.getLootTableCount(); t++) {
+                    const GameData::LootTableRecord& loot = table.getLootTable(t);
+                    bool matches = pass == 0 ? loot.monster == table.getMonster(m).name : loot.monster == 0;
+                    if (!matches) continue;
+                    for (int level = loot.minLevel; level <= std::min<int>(loot.maxLevel, GameData::MAX_LOOT_LEVEL); level++) {
+                        int16_t& slot = tableLookup[m * LEVEL_SLOTS + level];
+                        if (slot < 0) slot = static_cast<int16_t>(t);
+                    }
+                }
+            }
         }
     }
    
-    void updateWanderTarget() {
-        // Set a random point within reasonable distance
-        float angle = GameUtils::getRandomFloat(0, 2 * 3.14159f);
-        float distance = GameUtils::getRandomFloat(50, 150);
-        wanderTarget.x = position.x + std::cos(angle) * distance;
-        wanderTarget.y = position.y + std::sin(angle) * distance;
+    // Loot table used for a monster archetype at a player level, or -1
+    int findTable(int monster, int level) const {
+        if (!archetypes || monster < 0 || monster >= archetypes->getMonsterCount()) return -1;
+        level = std::max(1, std::min(level, GameData::MAX_LOOT_LEVEL));
+        return tableLookup[monster * LEVEL_SLOTS + level];
     }
    
-    void setTarget(Player* player) {
-        target = player;
+    // Roll the drop for one kill; false when the table says nothing drops
+    bool roll(int monster, int level, std::mt19937& generator, LootDrop& drop) const {
+        int t = findTable(monster, level);
+        if (t < 0 || entryTables[t].empty()) return false;
+       
+        const GameData::LootTableRecord& loot = archetypes->getLootTable(t);
+        if (GameUtils::randomUnit(generator) >= loot.dropChance) return false;
+       
+        const GameData::LootEntryRecord& entry = archetypes->getLootEntry(loot.firstEntry + entryTables[t].sample(generator));
+        drop.kind = entry.kind;
+        drop.archetype = entry.archetype;
+        drop.rarity = rarityTable.empty() ? -1 : rarityTable.sample(generator);
+        drop.prefix = -1;
+        drop.suffix = -1;
+        if (drop.rarity >= 0) {
+            const GameData::RarityRecord& rarity = archetypes->getRarity(drop.rarity);
+            if (rarity.prefixes) drop.prefix = rollAffix(entry.kind, GameData::AFFIX_PREFIX, generator);
+            if (rarity.suffixes) drop.suffix = rollAffix(entry.kind, GameData::AFFIX_SUFFIX, generator);
+        }
+        return true;
     }
+};
+
+// Asset pack layout: a header, the table of contents sorted by kind and id, the
+// id strings, then the entries. Every entry starts on an ENTRY_ALIGNMENT
+// boundary, so pixels and samples can go to SFML straight from the mapping.
+// Each entry remembers the loose file it was packed from, so a pack older than
+// its sources is caught.
+namespace PackData {
+    const uint32_t MAGIC = 0x4B41504C;  // "LPAK"
+    const uint32_t VERSION = 2;
+    const uint32_t ENTRY_ALIGNMENT = 64;
+   
+    enum EntryKind : uint8_t {
+        ENTRY_TEXTURE = 0,  // RGBA8 pixels, decoded when packing
+        ENTRY_FONT = 1,     // The font file as is
+        ENTRY_SOUND = 2,    // Interleaved 16-bit samples, decoded when packing
+        ENTRY_MUSIC = 3,    // The compressed music file as is; sf::Music streams it
+        ENTRY_KIND_COUNT = 4
+    };
    
-    void aggravate() {
-        aggravated = true;
-    }
+    enum Compression : uint8_t {
+        COMPRESSION_NONE = 0,
+        COMPRESSION_LZ4 = 1
+    };
    
-    int getExperienceValue() const { return experienceValue; }
-    int getGoldValue() const { return goldValue; }
-};
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t stringOffset, stringSize;
+        uint32_t padding;
+        uint64_t totalSize;
+    };
+   
+    struct Entry {
+        uint64_t offset;      // From the start of the pack
+        uint64_t storedSize;  // Bytes in the pack
+        uint64_t size;        // Bytes once decompressed
+        uint32_t id;          // Offset into the string table
+        uint32_t width;       // Texture width, or sound sample rate
+        uint32_t height;      // Texture height, or sound channel count
+        uint8_t kind;
+        uint8_t compression;
+        uint16_t padding;
+        uint64_t sourceSize;  // The loose file's size and modification time when packed
+        int64_t sourceTime;
+    };
+   
+    static_assert(sizeof(Header) == 32, "Header layout changed");
+    static_assert(sizeof(Entry) == 56, "Entry layout changed");
+}
 
-// Item classes
-class Item : public Entity {
-protected:
-    int value;
-    std::string description;
-    bool onGround;
+// Asset pack - every texture, font, sound and music track in one mapped file, so
+// startup is a single open instead of one per asset plus an image decode each.
+// build() is the packer: it decodes what the manifest lists and writes the pack.
+class AssetPack {
+public:
+    struct AssetFile {
+        PackData::EntryKind kind;
+        const char* id;
+        const char* path;
+    };
+   
+    // Everything the game loads at startup
+    static constexpr AssetFile MANIFEST[] = {
+        {PackData::ENTRY_TEXTURE, "player", "assets/sprites/player.png"},
+        {PackData::ENTRY_TEXTURE, "skeleton", "assets/sprites/skeleton.png"},
+        {PackData::ENTRY_TEXTURE, "goblin", "assets/sprites/goblin.png"},
+        {PackData::ENTRY_TEXTURE, "dragon", "assets/sprites/dragon.png"},
+        {PackData::ENTRY_TEXTURE, "floor", "assets/tiles/floor.png"},
+        {PackData::ENTRY_TEXTURE, "wall", "assets/tiles/wall.png"},    // 47 blob pieces, 8 to a row (Autotiler)
+        {PackData::ENTRY_TEXTURE, "door", "assets/tiles/door.png"},
+        {PackData::ENTRY_TEXTURE, "chest", "assets/tiles/chest.png"},
+        {PackData::ENTRY_TEXTURE, "water", "assets/tiles/water.png"},  // Animated: TILE_SIZE frames side by side
+        {PackData::ENTRY_TEXTURE, "lava", "assets/tiles/lava.png"},
+        {PackData::ENTRY_TEXTURE, "torch", "assets/tiles/torch.png"},
+        {PackData::ENTRY_TEXTURE, "fireball", "assets/spells/fireball.png"},
+        {PackData::ENTRY_TEXTURE, "healing", "assets/spells/healing.png"},
+        {PackData::ENTRY_TEXTURE, "items", "assets/sprites/items.png"},
+        {PackData::ENTRY_TEXTURE, "decals", "assets/sprites/decals.png"},  // Blood, scorch: a column each, variants down
+        {PackData::ENTRY_TEXTURE, "ui", "assets/ui/ui_elements.png"},
+        {PackData::ENTRY_FONT, "main", "assets/fonts/main.ttf"},
+        {PackData::ENTRY_SOUND, "attack", "assets/sounds/attack.wav"},
+        {PackData::ENTRY_SOUND, "spell", "assets/sounds/spell.wav"},
+        {PackData::ENTRY_SOUND, "hurt", "assets/sounds/hurt.wav"},
+        {PackData::ENTRY_SOUND, "death", "assets/sounds/death.wav"},
+        {PackData::ENTRY_SOUND, "item", "assets/sounds/item.wav"},
+        {PackData::ENTRY_SOUND, "level_up", "assets/sounds/level_up.wav"},
+        {PackData::ENTRY_MUSIC, "main_theme", "assets/music/main_theme.ogg"},
+    };
+   
+private:
+    MappedFile file;
+    const PackData::Header* header;
+    const PackData::Entry* entries;
+    const char* strings;
    
 public:
-    Item(const std::string& name, const std::string& type, ResourceManager& resources,
-         const std::string& description, int value)
-        : Entity(name, type, resources, "items"),
-          description(description), value(value), onGround(true) {
-       
-        // Set texture rect based on item type (for sprite sheet)
-        if (type == "weapon") {
-            sprite.setTextureRect(sf::IntRect(0, 0, 32, 32));
-        } else if (type == "armor") {
-            sprite.setTextureRect(sf::IntRect(32, 0, 32, 32));
-        } else if (type == "potion") {
-            sprite.setTextureRect(sf::IntRect(64, 0, 32, 32));
-        } else {
-            sprite.setTextureRect(sf::IntRect(96, 0, 32, 32));
+    AssetPack() : header(nullptr), entries(nullptr), strings(nullptr) {}
+   
+    // Map a pack and validate its table of contents
+    bool open(const std::string& filepath) {
+        close();
+        if (!file.open(filepath)) return false;
+       
+        const char* base = file.getData();
+        size_t size = file.getSize();
+        const PackData::Header* h = reinterpret_cast<const PackData::Header*>(base);
+        if (size < sizeof(PackData::Header) || h->magic != PackData::MAGIC ||
+            h->version != PackData::VERSION || h->totalSize != size ||
+            h->entryCount > (size - sizeof(PackData::Header)) / sizeof(PackData::Entry) ||
+            h->stringSize == 0 || h->stringOffset > size || h->stringSize > size - h->stringOffset ||
+            base[h->stringOffset + h->stringSize - 1] != '\0') {
+            std::cerr << "Invalid asset pack: " << filepath << std::endl;
+            file.close();
+            return false;
+        }
+       
+        // An LZ4 byte expands to at most 255 more, so a bigger decoded size is a
+        // corrupt entry; otherwise extract() would allocate whatever it claims
+        const PackData::Entry* table = reinterpret_cast<const PackData::Entry*>(base + sizeof(PackData::Header));
+        for (uint32_t i = 0; i < h->entryCount; i++) {
+            const PackData::Entry& entry = table[i];
+            bool shapeValid = entry.kind != PackData::ENTRY_TEXTURE ||
+                              static_cast<uint64_t>(entry.width) * entry.height * 4 == entry.size;
+            if (entry.id >= h->stringSize || entry.kind >= PackData::ENTRY_KIND_COUNT ||
+                entry.compression > PackData::COMPRESSION_LZ4 || entry.offset % PackData::ENTRY_ALIGNMENT != 0 ||
+                entry.offset > size || entry.storedSize > size - entry.offset || !shapeValid ||
+                (entry.compression == PackData::COMPRESSION_NONE && entry.storedSize != entry.size) ||
+                (entry.compression == PackData::COMPRESSION_LZ4 && entry.size > entry.storedSize * 255 + 16)) {
+                std::cerr << "Invalid asset pack entry " << i << ": " << filepath << std::endl;
+                file.close();
+                return false;
+            }
         }
+       
+        header = h;
+        entries = table;
+        strings = base + h->stringOffset;
+        return true;
     }
    
-    virtual ~Item() = default;
+    void close() {
+        file.close();
+        header = nullptr;
+        entries = nullptr;
+        strings = nullptr;
+    }
    
-    virtual bool use(Player& player) {
-        return false;  // Base items can't be used
+    // Binary search of the table of contents
+    const PackData::Entry* find(PackData::EntryKind kind, const std::string& id) const {
+        if (!header) return nullptr;
+        const PackData::Entry* first = entries;
+        const PackData::Entry* last = entries + header->entryCount;
+        auto before = [this](const PackData::Entry& entry, const std::pair<int, const char*>& key) {
+            return entry.kind != key.first ? entry.kind < key.first : std::strcmp(strings + entry.id, key.second) < 0;
+        };
+        std::pair<int, const char*> key(kind, id.c_str());
+        const PackData::Entry* found = std::lower_bound(first, last, key, before);
+        if (found == last || found->kind != kind || id != strings + found->id) return nullptr;
+        return found;
     }
    
-    void draw(sf::RenderWindow& window) override {
-        if (onGround) {
-            Entity::draw(window);
-           
-            // Add a subtle pulsing effect
-            static float pulseTimer = 0.0f;
-            pulseTimer += 0.05f;
-            float scale = 1.0f + 0.1f * std::sin(pulseTimer);
-            sprite.setScale(scale, scale);
+    // find(), unless the asset's loose file has changed since it was packed: then
+    // the caller loads the loose file, and the pack wants rebuilding. Without a
+    // loose file, as in a shipped build, the pack's copy stands.
+    const PackData::Entry* findCurrent(PackData::EntryKind kind, const std::string& id) const {
+        const PackData::Entry* entry = find(kind, id);
+        if (!entry) return nullptr;
+        for (const AssetFile& asset : MANIFEST) {
+            if (asset.kind != kind || id != asset.id) continue;
+            uint64_t size;
+            int64_t time;
+            if (stamp(asset.path, size, time) && (size != entry->sourceSize || time != entry->sourceTime)) {
+                std::cerr << "Asset pack is older than " << asset.path
+                          << "; loading the loose file (rebuild it with --pack-assets)" << std::endl;
+                return nullptr;
+            }
+            break;
         }
+        return entry;
     }
    
-    void pickUp() {
-        onGround = false;
+    // The entry's bytes in the mapping; only usable as is when it isn't compressed
+    const uint8_t* getStored(const PackData::Entry& entry) const {
+        return reinterpret_cast<const uint8_t*>(file.getData()) + entry.offset;
     }
    
-    bool isOnGround() const {
-        return onGround;
+    // Decompress an entry into a buffer the caller keeps
+    bool extract(const PackData::Entry& entry, std::vector<uint8_t>& out) const {
+        out.resize(entry.size);
+        if (entry.compression == PackData::COMPRESSION_NONE) {
+            std::memcpy(out.data(), getStored(entry), entry.size);
+            return true;
+        }
+        return LZ4::decompress(getStored(entry), entry.storedSize, out.data(), entry.size);
     }
    
-    int getValue() const { return value; }
-    std::string getDescription() const { return description; }
-};
-
-class Weapon : public Item {
-private:
-    int minDamage;
-    int maxDamage;
-    int attackBonus;
-    std::string weaponType;
+    bool isOpen() const { return header != nullptr; }
+    uint32_t getEntryCount() const { return header ? header->entryCount : 0; }
+    size_t getSize() const { return file.getSize(); }
+    const char* getId(const PackData::Entry& entry) const { return strings + entry.id; }
+   
+    // A loose file's size and modification time, as an entry records them
+    static bool stamp(const char* path, uint64_t& size, int64_t& time) {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error) return false;
+        time = static_cast<int64_t>(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+        return !error;
+    }
    
-public:
-    Weapon(const std::string& name, ResourceManager& resources,
-           const std::string& description, int value,
-           int minDamage, int maxDamage, int attackBonus,
-           const std::string& weaponType)
-        : Item(name, "weapon", resources, description, value),
-          minDamage(minDamage), maxDamage(maxDamage),
-          attackBonus(attackBonus), weaponType(weaponType) {
+    // The packer: decode everything in the manifest and write one pack. Entries
+    // are LZ4-compressed when that saves at least a quarter of their size; music
+    // is already compressed and is stored as is, since sf::Music streams it.
+    static bool build(const std::string& packPath, bool compress) {
+        struct Pending {
+            PackData::Entry entry;
+            std::vector<uint8_t> data;
+        };
+        std::vector<Pending> pending;
+        std::string stringTable(1, '\0');
+       
+        for (const AssetFile& asset : MANIFEST) {
+            Pending item{};
+            item.entry.kind = asset.kind;
+            std::vector<uint8_t>& data = item.data;
+           
+            bool loaded = false;
+            if (asset.kind == PackData::ENTRY_TEXTURE) {
+                sf::Image image;
+                if (image.loadFromFile(asset.path)) {
+                    item.entry.width = image.getSize().x;
+                    item.entry.height = image.getSize().y;
+                    const uint8_t* pixels = image.getPixelsPtr();
+                    data.assign(pixels, pixels + static_cast<size_t>(item.entry.width) * item.entry.height * 4);
+                    loaded = true;
+                }
+            } else if (asset.kind == PackData::ENTRY_SOUND) {
+                sf::SoundBuffer buffer;
+                if (buffer.loadFromFile(asset.path)) {
+                    item.entry.width = buffer.getSampleRate();
+                    item.entry.height = buffer.getChannelCount();
+                    const uint8_t* samples = reinterpret_cast<const uint8_t*>(buffer.getSamples());
+                    data.assign(samples, samples + buffer.getSampleCount() * sizeof(sf::Int16));
+                    loaded = true;
+                }
+            } else {
+                std::ifstream in(asset.path, std::ios::binary);
+                if (in) {
+                    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+                    loaded = !data.empty();
+                }
+            }
+            if (!loaded || !stamp(asset.path, item.entry.sourceSize, item.entry.sourceTime)) {
+                std::cerr << "Skipping asset that failed to load: " << asset.path << std::endl;
+                continue;
+            }
+           
+            item.entry.size = data.size();
+            item.entry.storedSize = data.size();
+            item.entry.compression = PackData::COMPRESSION_NONE;
+            if (compress && asset.kind != PackData::ENTRY_MUSIC) {
+                std::vector<uint8_t> packed(LZ4::maxCompressedSize(data.size()));
+                size_t packedSize = LZ4::compress(data.data(), data.size(), packed.data());
+                if (packedSize <= data.size() - data.size() / 4) {
+                    packed.resize(packedSize);
+                    data.swap(packed);
+                    item.entry.storedSize = packedSize;
+                    item.entry.compression = PackData::COMPRESSION_LZ4;
+                }
+            }
+           
+            item.entry.id = static_cast<uint32_t>(stringTable.size());
+            stringTable += asset.id;
+            stringTable += '\0';
+            pending.push_back(std::move(item));
+        }
        
-        // Set specific weapon appearance based on type
-        if (weaponType == "Sword") {
-            sprite.setTextureRect(sf::IntRect(0, 0, 32, 32));
-        } else if (weaponType == "Axe") {
-            sprite.setTextureRect(sf::IntRect(32, 0, 32, 32));
-        } else if (weaponType == "Mace") {
-            sprite.setTextureRect(sf::IntRect(64, 0, 32, 32));
-        } else if (weaponType == "Staff") {
-            sprite.setTextureRect(sf::IntRect(96, 0, 32, 32));
+        std::sort(pending.begin(), pending.end(), [&stringTable](const Pending& a, const Pending& b) {
+            if (a.entry.kind != b.entry.kind) return a.entry.kind < b.entry.kind;
+            return std::strcmp(stringTable.c_str() + a.entry.id, stringTable.c_str() + b.entry.id) < 0;
+        });
+       
+        // Header, table of contents, strings, then the aligned entries
+        auto align = [](uint64_t offset) {
+            return (offset + PackData::ENTRY_ALIGNMENT - 1) / PackData::ENTRY_ALIGNMENT * PackData::ENTRY_ALIGNMENT;
+        };
+        PackData::Header h = {};
+        h.magic = PackData::MAGIC;
+        h.version = PackData::VERSION;
+        h.entryCount = static_cast<uint32_t>(pending.size());
+        h.stringOffset = static_cast<uint32_t>(sizeof(PackData::Header) + pending.size() * sizeof(PackData::Entry));
+        h.stringSize = static_cast<uint32_t>(stringTable.size());
+        uint64_t offset = align(h.stringOffset + h.stringSize);
+        for (Pending& item : pending) {
+            item.entry.offset = offset;
+            offset = align(offset + item.entry.storedSize);
         }
+        h.totalSize = offset;
+       
+        std::ofstream out(packPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Failed to write asset pack: " << packPath << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        for (const Pending& item : pending) {
+            out.write(reinterpret_cast<const char*>(&item.entry), sizeof(item.entry));
+        }
+        out.write(stringTable.data(), stringTable.size());
+        uint64_t written = h.stringOffset + h.stringSize;
+        const char zeros[PackData::ENTRY_ALIGNMENT] = {};
+        uint64_t rawTotal = 0;
+        for (const Pending& item : pending) {
+            out.write(zeros, static_cast<std::streamsize>(item.entry.offset - written));
+            out.write(reinterpret_cast<const char*>(item.data.data()), static_cast<std::streamsize>(item.data.size()));
+            written = item.entry.offset + item.data.size();
+            rawTotal += item.entry.size;
+        }
+        out.write(zeros, static_cast<std::streamsize>(h.totalSize - written));
+       
+        std::cout << "Packed " << pending.size() << " of " << std::size(MANIFEST) << " assets into " << packPath
+                  << ": " << h.totalSize << " bytes (" << rawTotal << " decoded)" << std::endl;
+        return static_cast<bool>(out);
     }
-   
-    int rollDamage() const {
-        return GameUtils::getRandomInt(minDamage, maxDamage);
-    }
-   
-    int getMinDamage() const { return minDamage; }
-    int getMaxDamage() const { return maxDamage; }
-    int getAttackBonus() const { return attackBonus; }
-    std::string getWeaponType() const { return weaponType; }
 };
 
-class Armor : public Item {
+// Materials - one shader for the per-sprite looks that used to be CPU work:
+// the damage flash, animated tiles and palette-swapped monster variants.
+// A material sprite's vertex colour holds parameters rather than a tint: red is
+// a palette row, green the time its damage flash ends and blue a surface. On a
+// surface tile red and green are instead its frame count and frames per second,
+// and the vertex shader moves it along its strip. The only thing that moves is
+// a time uniform set once per frame, so a flashing crowd or a lake of lava costs
+// no CPU per sprite. Since the vertex colour can't carry a tint, a light uniform
+// stands in for one: white, except while the isometric view lights what stands.
+// Without shader support the callers fall back to plain tints.
+class Materials {
+public:
+    enum Surface : uint8_t {
+        SURFACE_NONE = 0,
+        SURFACE_WATER = 1,
+        SURFACE_LAVA = 2,
+        SURFACE_TORCH = 3
+    };
+   
+    static constexpr float FLASH_SECONDS = 0.5f;
+    static constexpr float FLASH_STEPS_PER_SECOND = 32.0f;  // Resolution of a flash's end time
+    static constexpr int FLASH_PERIOD = 255;                 // End times wrap after this many steps
+    // The time uniform wraps at a whole number of flash periods, so it keeps its precision
+    static constexpr double TIME_PERIOD = FLASH_PERIOD / FLASH_STEPS_PER_SECOND * 128.0;
+   
 private:
-    int defense;
-    std::string armorType;
+    sf::Shader shader;
+    sf::Texture paletteTexture;    // Row 0 is unused: palette 0 keeps the texture's colours
+    std::vector<sf::Color> tints;  // Each palette's middle colour, for drawing without the shader
+    bool enabled;
+   
+    static constexpr const char* VERTEX_SHADER = R"(
+        uniform float time;
+        uniform float tileSize;
+        varying vec2 worldPosition;
+        void main() {
+            vec4 coord = gl_MultiTexCoord0;
+            vec3 params = floor(gl_Color.rgb * 255.0 + 0.5);
+           
+            // Animated tiles hold frame 0; step along the strip by the clock
+            if (params.b > 0.0 && params.r > 1.0) {
+                coord.x += mod(floor(time * params.g), params.r) * tileSize;
+            }
+           
+            worldPosition = gl_Vertex.xy;
+            gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+            gl_TexCoord[0] = gl_TextureMatrix[0] * coord;
+            gl_FrontColor = gl_Color;
+        }
+    )";
+   
+    static constexpr const char* FRAGMENT_SHADER = R"(
+        uniform sampler2D texture;
+        uniform sampler2D palettes;
+        uniform float paletteRows;
+        uniform float time;
+        uniform vec3 light;
+        varying vec2 worldPosition;
+       
+        void main() {
+            vec4 pixel = texture2D(texture, gl_TexCoord[0].xy);
+            vec3 params = floor(gl_Color.rgb * 255.0 + 0.5);
+            vec3 color = pixel.rgb;
+            float alpha = pixel.a * gl_Color.a;
+           
+            // Brightness picks a spot on the palette's ramp
+            if (params.b == 0.0 && params.r > 0.0) {
+                float shade = dot(color, vec3(0.299, 0.587, 0.114));
+                color = texture2D(palettes, vec2((shade * 7.0 + 0.5) / 8.0, (params.r + 0.5) / paletteRows)).rgb;
+            }
+           
+            // Light rolling over the frames, so neighbouring tiles don't pulse together
+            if (params.b == 1.0) {
+                color *= 0.85 + 0.15 * sin(time * 2.0 + (worldPosition.x + worldPosition.y) * 0.15) *
+                                       sin(time * 1.3 + worldPosition.y * 0.11);
+            } else if (params.b == 2.0) {
+                float glow = 0.8 + 0.2 * sin(time * 3.0 + worldPosition.x * 0.07 + worldPosition.y * 0.05);
+                color = color * glow + vec3(0.12, 0.03, 0.0) * glow;
+            }
+           
+            // Pulsing red until the flash's end time, as the CPU flash did
+            if (params.b == 0.0 && params.g > 0.0) {
+                float now = mod(floor(time * 32.0), 255.0);
+                float remaining = mod(params.g - 1.0 - now + 255.0, 255.0) / 32.0;
+                if (remaining <= 0.5) {
+                    color *= vec3(1.0, 0.39, 0.39);
+                    alpha *= 0.5 - 0.5 * sin(remaining * 30.0);
+                }
+            }
+           
+            gl_FragColor = vec4(color * light, alpha);
+        }
+    )";
    
 public:
-    Armor(const std::string& name, ResourceManager& resources,
-          const std::string& description, int value,
-          int defense, const std::string& armorType)
-        : Item(name, "armor", resources, description, value),
-          defense(defense), armorType(armorType) {
-       
-        // Set specific armor appearance based on type
-        if (armorType == "Leather") {
-            sprite.setTextureRect(sf::IntRect(0, 32, 32, 32));
-        } else if (armorType == "Chain") {
-            sprite.setTextureRect(sf::IntRect(32, 32, 32, 32));
-        } else if (armorType == "Plate") {
-            sprite.setTextureRect(sf::IntRect(64, 32, 32, 32));
-        } else if (armorType == "Shield") {
-            sprite.setTextureRect(sf::IntRect(96, 32, 32, 32));
+    Materials() : enabled(false) {}
+   
+    // Compile the shader; needs a GL context, so only once a window exists
+    bool create() {
+        enabled = sf::Shader::isAvailable() && shader.loadFromMemory(VERTEX_SHADER, FRAGMENT_SHADER);
+        if (!enabled) {
+            std::cerr << "Material shader unavailable; drawing flashes, floors and palettes with tints" << std::endl;
+            return false;
         }
+        shader.setUniform("texture", sf::Shader::CurrentTexture);
+        shader.setUniform("time", 0.0f);
+        shader.setUniform("tileSize", static_cast<float>(TILE_SIZE));
+        shader.setUniform("light", sf::Glsl::Vec3(1.0f, 1.0f, 1.0f));
+        return true;
     }
    
-    int getDefense() const { return defense; }
-    std::string getArmorType() const { return armorType; }
-};
-
-class Potion : public Item {
-private:
-    int healAmount;
-   
-public:
-    Potion(const std::string& name, ResourceManager& resources,
-           const std::string& description, int value,
-           int healAmount)
-        : Item(name, "potion", resources, description, value),
-          healAmount(healAmount) {
+    // One row of the lookup texture per palette, after the unused row 0
+    void buildPalettes(const ArchetypeTable& table) {
+        int rows = table.getPaletteCount() + 1;
+        sf::Image image;
+        image.create(GameData::PALETTE_SIZE, rows, sf::Color::White);
+        tints.assign(rows, sf::Color::White);
+        for (int p = 0; p < table.getPaletteCount(); p++) {
+            const GameData::PaletteRecord& palette = table.getPalette(p);
+            for (int i = 0; i < GameData::PALETTE_SIZE; i++) image.setPixel(i, p + 1, sf::Color(palette.colors[i]));
+            tints[p + 1] = sf::Color(palette.colors[GameData::PALETTE_SIZE / 2]);
+        }
+        if (!enabled) return;
        
-        // Set potion appearance
-        sprite.setTextureRect(sf::IntRect(0, 64, 32, 32));
+        paletteTexture.loadFromImage(image);
+        paletteTexture.setSmooth(true);
+        shader.setUniform("palettes", paletteTexture);
+        shader.setUniform("paletteRows", static_cast<float>(rows));
     }
    
-    bool use(Player& player) override {
-        player.heal(healAmount);
-        return true;  // Consumable
+    bool isEnabled() const { return enabled; }
+    sf::Shader* getShader() { return enabled ? &shader : nullptr; }
+    const sf::Shader* getShader() const { return enabled ? &shader : nullptr; }
+   
+    // What a palette looks like as a plain tint
+    sf::Color getTint(int palette) const {
+        return palette > 0 && palette < static_cast<int>(tints.size()) ? tints[palette] : sf::Color::White;
     }
    
-    int getHealAmount() const { return healAmount; }
-};
-
-// Spell class
-class Spell {
-private:
-    std::string name;
-    std::string description;
-    int manaCost;
-    int minimumLevel;
-    std::function<bool(Character&, Character&)> effect;
+    // The value for the time uniform at a game time in seconds
+    static float shaderTime(double seconds) {
+        return static_cast<float>(std::fmod(seconds, TIME_PERIOD));
+    }
    
-public:
-    Spell(const std::string& name, const std::string& description,
-          int manaCost, int minimumLevel,
-          std::function<bool(Character&, Character&)> effect)
-        : name(name), description(description),
-          manaCost(manaCost), minimumLevel(minimumLevel),
-          effect(effect) {}
+    // Green channel for a flash ending at a game time in seconds; 0 is no flash
+    static uint8_t flashUntil(double seconds) {
+        uint64_t steps = static_cast<uint64_t>(std::floor(shaderTime(seconds) * FLASH_STEPS_PER_SECOND));
+        return static_cast<uint8_t>(steps % FLASH_PERIOD + 1);
+    }
    
-    bool cast(Character& caster, Character& target) {
-        return effect(caster, target);
+    static sf::Color encode(int palette, uint8_t flash, Surface surface) {
+        return sf::Color(static_cast<sf::Uint8>(palette), flash, surface, 255);
     }
    
-    std::string getName() const { return name; }
-    std::string getDescription() const { return description; }
-    int getManaCost() const { return manaCost; }
-    int getMinimumLevel() const { return minimumLevel; }
+    // A surface tile showing frame 0 of a strip of frames
+    static sf::Color encodeTile(Surface surface, int frames, int framesPerSecond) {
+        return sf::Color(static_cast<sf::Uint8>(frames), static_cast<sf::Uint8>(framesPerSecond), surface, 255);
+    }
 };
 
-// Projectile class for spells/ranged attacks
-class Projectile : public Entity {
+// Resource Manager
+class ResourceManager {
 private:
-    float speed;
-    int damage;
-    Character* source;
-    sf::Vector2f direction;
-    float lifespan;
-    float lifetime;
+    std::map<std::string, sf::Texture> textures;
+    std::map<std::string, sf::Font> fonts;
+    ArchetypeTable archetypes;
+    std::vector<std::unique_ptr<ArchetypeTable>> retiredArchetypes;  // Entities may still hold their strings
+    LootTables loot;
+    Materials materials;
+    std::unique_ptr<AssetPack> pack;
+    std::vector<std::unique_ptr<AssetPack>> retiredPacks;    // The mixer may still read their mappings
+    std::vector<uint8_t> scratch;                            // Decompressed entry being uploaded
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> fontData;  // Compressed fonts, decompressed for sf::Font
+    float mediaLoadTimeMs;
+    int mediaLooseCount;
    
 public:
-    Projectile(const std::string& name, ResourceManager& resources,
-               Character* source, float x, float y,
-               float targetX, float targetY,
-               float speed, int damage)
-        : Entity(name, "projectile", resources, "fireball"),
-          speed(speed), damage(damage), source(source),
-          lifespan(2.0f), lifetime(0.0f) {
-       
-        setPosition(x, y);
+    // Every size text is drawn at. Their glyphs are rendered when a font loads,
+    // so a new size belongs here too.
+    static constexpr unsigned int TEXT_SIZES[] = {12, 14, 16, 18, 24, 32};
+   
+    // Headless tools pass false to skip textures and fonts and load only data
+    explicit ResourceManager(bool loadMedia = true)
+        : pack(std::make_unique<AssetPack>()), mediaLoadTimeMs(0.0f), mediaLooseCount(0) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_RESOURCES);
+        if (loadMedia) {
+            int fromPack = loadAssets("assets/assets.pack");
+            std::cout << "Assets: " << fromPack << " from assets/assets.pack, "
+                      << mediaLooseCount << " loose files in "
+                      << mediaLoadTimeMs << " ms" << std::endl;
+            materials.create();
+        }
        
-        // Calculate direction
-        direction.x = targetX - x;
-        direction.y = targetY - y;
-        float length = std::sqrt(direction.x * direction.x + direction.y * direction.y);
-        if (length > 0) {
-            direction /= length;
-        }
-       
-        // Rotate sprite to face direction
-        float angle = std::atan2(direction.y, direction.x) * 180 / 3.14159f;
-        sprite.setRotation(angle);
+        loadArchetypes("assets/data", "assets/data/archetypes.bin");
     }
    
-    void update(float deltaTime) override {
-        Entity::update(deltaTime);
-       
-        // Move along direction
-        position.x += direction.x * speed * deltaTime;
-        position.y += direction.y * speed * deltaTime;
-       
-        // Update lifetime
-        lifetime += deltaTime;
-        if (lifetime >= lifespan) {
-            setActive(false);
+    // Load everything in the manifest, from the pack where it has a current copy of
+    // the asset and from the loose file otherwise, so a stale or missing pack never
+    // breaks a run.
+    // Returns how many came from the pack.
+    int loadAssets(const std::string& packPath) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_RESOURCES);
+        sf::Clock clock;
+        fonts.clear();
+        fontData.clear();
+       
+        // Sounds and music streams point into the open pack's mapping, and the
+        // mixer thread reads them while it plays, so the pack is retired rather
+        // than unmapped, as swapArchetypes() retires tables
+        if (pack->isOpen()) {
+            retiredPacks.push_back(std::move(pack));
+            pack = std::make_unique<AssetPack>();
+        }
+        bool packed = pack->open(packPath);
+        int fromPack = 0;
+        mediaLooseCount = 0;
+       
+        for (const AssetPack::AssetFile& asset : AssetPack::MANIFEST) {
+            // Sounds are decoded on demand and music streamed, both by SoundManager
+            if (asset.kind == PackData::ENTRY_SOUND || asset.kind == PackData::ENTRY_MUSIC) continue;
+            const PackData::Entry* entry = packed ? pack->findCurrent(asset.kind, asset.id) : nullptr;
+            if (entry && loadPacked(*entry)) {
+                fromPack++;
+                continue;
+            }
+           
+            mediaLooseCount++;
+            if (asset.kind == PackData::ENTRY_TEXTURE) {
+                loadTexture(asset.id, asset.path);
+            } else {
+                loadFont(asset.id, asset.path);
+            }
         }
        
-        // Add a trail effect
-        // In a real implementation, you would add particle effects here
+        mediaLoadTimeMs = clock.getElapsedTime().asSeconds() * 1000.0f;
+        return fromPack;
     }
    
-    bool hit(Character& target) {
-        if (&target == source) return false;
+    // Textures are handed to SFML straight from the mapped pages, which copies
+    // them into its own buffers once; only compressed entries take a detour
+    // through a scratch buffer. Fonts are read lazily, so their bytes must outlive
+    // the sf::Font: the mapping does for stored ones, fontData for compressed ones.
+    bool loadPacked(const PackData::Entry& entry) {
+        const uint8_t* data = pack->getStored(entry);
+        if (entry.compression != PackData::COMPRESSION_NONE) {
+            if (!pack->extract(entry, scratch)) {
+                std::cerr << "Corrupt asset in pack: " << pack->getId(entry) << std::endl;
+                return false;
+            }
+            data = scratch.data();
+        }
        
-        if (intersects(target)) {
-            target.takeDamage(damage);
-            setActive(false);
+        std::string id = pack->getId(entry);
+        if (entry.kind == PackData::ENTRY_TEXTURE) {
+            sf::Texture& texture = textures[id];
+            if (!texture.create(entry.width, entry.height)) {
+                textures.erase(id);
+                return false;
+            }
+            texture.update(data);
+            return true;
+        }
+        if (entry.kind == PackData::ENTRY_FONT) {
+            if (entry.compression != PackData::COMPRESSION_NONE) {
+                fontData.push_back(std::make_unique<std::vector<uint8_t>>(scratch));
+                data = fontData.back()->data();
+            }
+            sf::Font font;
+            if (!font.loadFromMemory(data, entry.size)) {
+                return false;
+            }
+            fonts[id] = font;
+            prepareGlyphs(fonts[id]);
             return true;
         }
         return false;
     }
+   
+    // Sounds and music are read from here by SoundManager as they are needed
+    const AssetPack& getPack() const {
+        return *pack;
+    }
+   
+    float getMediaLoadTimeMs() const {
+        return mediaLoadTimeMs;
+    }
+   
+    // Compile the text definitions if they changed, then map the binary table
+    bool loadArchetypes(const std::string& dataDir, const std::string& blobPath) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_RESOURCES);
+        if (ArchetypeTable::isStale(dataDir, blobPath) &&
+            !ArchetypeTable::compile(dataDir, blobPath)) {
+            std::cerr << "Failed to compile archetype data from " << dataDir << std::endl;
+        }
+        if (!archetypes.load(blobPath)) {
+            return false;
+        }
+        loot.build(archetypes);
+        materials.buildPalettes(archetypes);
+       
+        std::cout << "Archetypes: " << archetypes.getMonsterCount() << " monsters, "
+                  << archetypes.getWeaponCount() << " weapons, "
+                  << archetypes.getArmorCount() << " armor, "
+                  << archetypes.getPotionCount() << " potions, "
+                  << archetypes.getLootTableCount() << " loot tables, "
+                  << archetypes.getSpellCount() << " spells, "
+                  << archetypes.getAnimationSetCount() << " animation sets ("
+                  << archetypes.getBlobSize() << " bytes) mapped in "
+                  << archetypes.getLoadTimeMs() << " ms" << std::endl;
+        return true;
+    }
+   
+    bool loadTexture(const std::string& id, const std::string& filepath) {
+        sf::Texture texture;
+        if (!texture.loadFromFile(filepath)) {
+            std::cerr << "Failed to load texture: " << filepath << std::endl;
+            // Use fallback texture instead of returning false
+            sf::Image fallback;
+            fallback.create(32, 32, sf::Color::Magenta);
+            texture.loadFromImage(fallback);
+        }
+        textures[id] = texture;
+        return true;
+    }
+   
+    bool loadFont(const std::string& id, const std::string& filepath) {
+        sf::Font font;
+        if (!font.loadFromFile(filepath)) {
+            std::cerr << "Failed to load font: " << filepath << std::endl;
+            return false;
+        }
+        fonts[id] = font;
+        prepareGlyphs(fonts[id]);
+        return true;
+    }
+   
+    // Render the printable Latin-1 glyphs at every text size, plain and with the
+    // one-pixel outline the UI uses. Text is laid out on the game thread while
+    // the render thread draws with the same font; a glyph added mid-game would
+    // grow the page texture it is drawing from, from a thread without the GL
+    // context. With every glyph in place, layout only reads the pages.
+    static void prepareGlyphs(const sf::Font& font) {
+        for (unsigned int size : TEXT_SIZES) {
+            for (float outline : {0.0f, 1.0f}) {
+                for (sf::Uint32 c = 32; c < 256; c++) {
+                    if (c >= 127 && c < 160) continue;  // Control characters
+                    font.getGlyph(c, size, false, outline);
+                }
+            }
+        }
+    }
+   
+    // Replace a texture's pixels in place, so every sprite using it picks them up.
+    // Sprites keep their texture rect, so a resized image only fits new sprites.
+    void reloadTexture(const std::string& id, const sf::Image& image) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_RESOURCES);
+        sf::Texture& texture = textures[id];
+        if (texture.getSize() == image.getSize()) {
+            texture.update(image);
+        } else {
+            texture.loadFromImage(image);
+        }
+    }
+   
+    // Swap in newly compiled archetype data. Live entities index the tables, so
+    // records may be changed or added but not removed without a restart.
+    bool swapArchetypes(std::unique_ptr<ArchetypeTable> table) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_RESOURCES);
+        if (!table || table->getMonsterCount() < archetypes.getMonsterCount() ||
+            table->getWeaponCount() < archetypes.getWeaponCount() ||
+            table->getArmorCount() < archetypes.getArmorCount() ||
+            table->getPotionCount() < archetypes.getPotionCount() ||
+            table->getSpellCount() < archetypes.getSpellCount() ||
+            table->getAnimationSetCount() < archetypes.getAnimationSetCount() ||
+            table->getClipCount() < archetypes.getClipCount() ||
+            table->getPaletteCount() < archetypes.getPaletteCount()) {
+            std::cerr << "Archetype data lost records; restart to apply it" << std::endl;
+            return false;
+        }
+        archetypes.swap(*table);
+        retiredArchetypes.push_back(std::move(table));
+        loot.build(archetypes);
+        materials.buildPalettes(archetypes);
+        return true;
+    }
+   
+    sf::Texture& getTexture(const std::string& id) {
+        return textures[id];
+    }
+   
+    sf::Font& getFont(const std::string& id) {
+        return fonts[id];
+    }
+   
+    // The id a texture or font was loaded under, or null for one from elsewhere
+    const std::string* findTextureId(const sf::Texture* texture) const {
+        for (const auto& entry : textures) {
+            if (&entry.second == texture) return &entry.first;
+        }
+        return nullptr;
+    }
+   
+    const std::string* findFontId(const sf::Font* font) const {
+        for (const auto& entry : fonts) {
+            if (&entry.second == font) return &entry.first;
+        }
+        return nullptr;
+    }
+   
+    // The material shader is the only one, under the id "material"
+    const std::string* findShaderId(const sf::Shader* shader) const {
+        static const std::string MATERIAL_ID = "material";
+        return shader && shader == materials.getShader() ? &MATERIAL_ID : nullptr;
+    }
+   
+    sf::Shader* getShader(const std::string& id) {
+        return id == "material" ? materials.getShader() : nullptr;
+    }
+   
+    Materials& getMaterials() {
+        return materials;
+    }
+   
+    const ArchetypeTable& getArchetypes() const {
+        return archetypes;
+    }
+   
+    const LootTables& getLoot() const {
+        return loot;
+    }
 };
 
-// Tile class for the world
-class Tile {
+// Decoded samples of one sound effect. Sounds stored uncompressed in the asset
+// pack point into the mapping; everything else owns its samples.
+struct SoundData {
+    std::vector<sf::Int16> owned;
+    const sf::Int16* samples = nullptr;
+    size_t frames = 0;
+    unsigned int sampleRate = 0;
+    unsigned int channels = 0;
+   
+    // Heap bytes, which is what the cache budget counts; mapped samples are free
+    size_t getHeapBytes() const {
+        return owned.size() * sizeof(sf::Int16);
+    }
+};
+
+// Audio Mixer - software mixing of every voice into one stereo stream. The game
+// thread only queues commands; the output thread applies them at the start of
+// the next chunk and mixes, so neither side ever waits on the other for longer
+// than a vector swap. Long tracks are streamed: each streamed voice owns a
+// decoder and a small window of decoded frames that slides as it plays.
+class AudioMixer {
 public:
-    enum class Type {
-        Floor,
-        Wall,
-        Door,
-        Chest,
-        Water,
-        Lava
+    static const unsigned int SAMPLE_RATE = 44100;
+    static const int CHUNK_FRAMES = 1024;         // About 23 ms per mix
+    static const int MAX_VOICES = 48;
+    static const int STREAM_WINDOW_FRAMES = 4096;
+   
+    enum Bus {
+        BUS_EFFECTS,
+        BUS_MUSIC,
+        BUS_AMBIENCE,
+        BUS_COUNT
+    };
+   
+    // Averages since the last resetStats()
+    struct Stats {
+        int voices = 0;             // Active at the end of the last chunk
+        int peakVoices = 0;
+        uint64_t chunks = 0;
+        uint64_t stolen = 0;        // Voices dropped to make room
+        double mixUs = 0.0;         // Per chunk
+        double voiceUs = 0.0;       // Per active voice per chunk
+        double streamVoiceUs = 0.0; // Per streamed voice per chunk, decoding included
+        double load = 0.0;          // Mix time as a share of the chunk's playback time
     };
    
 private:
-    Type type;
-    bool walkable;
-    bool explored;
-    sf::Sprite sprite;
+    struct Voice {
+        uint32_t handle = 0;
+        int bus = BUS_EFFECTS;
+        std::shared_ptr<const SoundData> sound;       // Buffered voices
+        std::unique_ptr<sf::InputSoundFile> stream;  // Streamed voices
+        std::vector<sf::Int16> window;
+        uint64_t windowStart = 0;
+        size_t windowFrames = 0;
+        size_t frames = 0;
+        unsigned int channels = 0;
+        double cursor = 0.0;  // In source frames
+        double step = 1.0;    // Source frames per output frame
+        float gain = 0.0f;
+        float target = 0.0f;
+        float gainStep = 0.0f;
+        bool loop = false;
+        bool stopWhenSilent = false;
+    };
+   
+    struct Command {
+        enum Type { PLAY, FADE, BUS_GAIN, STOP_ALL } type;
+        uint32_t handle;
+        int bus;
+        float gain;
+        float seconds;
+        bool stopAtEnd;
+        Voice voice;  // Carried by value, so a play doesn't allocate
+    };
+   
+    std::vector<Voice> voices;
+    std::vector<Voice*> active;
+    float busGains[BUS_COUNT];
+    std::vector<float> accumulator;
+   
+    std::mutex commandMutex;
+    std::vector<Command> pending;
+    std::vector<Command> applying;
+    std::atomic<uint32_t> nextHandle;
+   
+    // Written by the output thread, read by anyone through getStats()
+    std::atomic<int> voiceCount;
+    std::atomic<int> peakVoices;
+    std::atomic<uint64_t> chunks;
+    std::atomic<uint64_t> stolen;
+    std::atomic<uint64_t> mixNs;
+    std::atomic<uint64_t> voiceNs;
+    std::atomic<uint64_t> voiceChunks;
+    std::atomic<uint64_t> streamNs;
+    std::atomic<uint64_t> streamChunks;
    
 public:
-    Tile(Type type, ResourceManager& resources) : type(type), explored(false) {
-        switch (type) {
-            case Type::Floor:
-                sprite.setTexture(resources.getTexture("floor"));
-                walkable = true;
-                break;
-            case Type::Wall:
-                sprite.setTexture(resources.getTexture("wall"));
-                walkable = false;
-                break;
-            case Type::Door:
-                sprite.setTexture(resources.getTexture("door"));
-                walkable = true;
-                break;
-            case Type::Chest:
-                sprite.setTexture(resources.getTexture("chest"));
-                walkable = false;
-                break;
-            case Type::Water:
-                sprite.setTexture(resources.getTexture("floor"));
-                sprite.setColor(sf::Color(100, 100, 255));
-                walkable = false;
-                break;
-            case Type::Lava:
-                sprite.setTexture(resources.getTexture("floor"));
-                sprite.setColor(sf::Color(255, 100, 50));
-                walkable = false;
-                break;
-        }
+    AudioMixer() : voices(MAX_VOICES), accumulator(CHUNK_FRAMES * 2), nextHandle(1),
+                   voiceCount(0), peakVoices(0), chunks(0), stolen(0), mixNs(0),
+                   voiceNs(0), voiceChunks(0), streamNs(0), streamChunks(0) {
+        for (float& gain : busGains) gain = 1.0f;
+        active.reserve(MAX_VOICES);
+        // Up to a voice's worth of commands queue between mixes without allocating
+        pending.reserve(MAX_VOICES);
+        applying.reserve(MAX_VOICES);
     }
    
-    void setPosition(float x, float y) {
-        sprite.setPosition(x, y);
+    // Play decoded samples; returns a handle for fade()
+    uint32_t play(std::shared_ptr<const SoundData> sound, int bus, float gain, bool loop = false, float fadeIn = 0.0f) {
+        if (!sound || sound->frames == 0 || sound->channels == 0 || sound->channels > 2) return 0;
+        Voice voice;
+        voice.frames = sound->frames;
+        voice.channels = sound->channels;
+        voice.step = static_cast<double>(sound->sampleRate) / SAMPLE_RATE;
+        voice.sound = std::move(sound);
+        return queuePlay(std::move(voice), bus, gain, loop, fadeIn);
     }
    
-    void draw(sf::RenderWindow& window) {
-        window.draw(sprite);
+    // Stream an encoded file; the decoder runs on the output thread as the voice plays
+    uint32_t playStream(std::unique_ptr<sf::InputSoundFile> stream, int bus, float gain, bool loop, float fadeIn) {
+        if (!stream || stream->getChannelCount() == 0 || stream->getChannelCount() > 2) return 0;
+        Voice voice;
+        voice.channels = stream->getChannelCount();
+        voice.frames = static_cast<size_t>(stream->getSampleCount() / voice.channels);
+        voice.step = static_cast<double>(stream->getSampleRate()) / SAMPLE_RATE;
+        voice.window.resize(static_cast<size_t>(STREAM_WINDOW_FRAMES) * voice.channels);
+        voice.stream = std::move(stream);
+        if (voice.frames == 0) return 0;
+        return queuePlay(std::move(voice), bus, gain, loop, fadeIn);
     }
    
-    Type getType() const { return type; }
-    bool isWalkable() const { return walkable; }
+    // Ramp a voice to a new gain; stopAtEnd frees it once it reaches silence
+    void fade(uint32_t handle, float gain, float seconds, bool stopAtEnd = false) {
+        Command command{Command::FADE, handle, 0, gain, seconds, stopAtEnd, Voice()};
+        queue(std::move(command));
+    }
    
-    void setExplored(bool value) { explored = value; }
-    bool isExplored() const { return explored; }
+    void setBusGain(int bus, float gain) {
+        Command command{Command::BUS_GAIN, 0, bus, gain, 0.0f, false, Voice()};
+        queue(std::move(command));
+    }
    
-    sf::FloatRect getBounds() const {
-        return sprite.getGlobalBounds();
+    void stopAll() {
+        Command command{Command::STOP_ALL, 0, 0, 0.0f, 0.0f, false, Voice()};
+        queue(std::move(command));
     }
-};
-
-// Dungeon class
-class Dungeon {
-private:
-    ResourceManager& resources;
-    SoundManager& sounds;
-    std::vector<std::vector<Tile>> tiles;
-    std::vector<std::shared_ptr<Enemy>> enemies;
-    std::vector<std::shared_ptr<Item>> items;
-    Player* player;
-    int width;
-    int height;
    
-public:
-    Dungeon(ResourceManager& resources, SoundManager& sounds, Player* player, int width, int height)
-        : resources(resources), sounds(sounds), player(player), width(width), height(height) {
+    // Mix the next frames of interleaved stereo. Called by the output thread only.
+    void mix(sf::Int16* out, int frames) {
+        auto mixStart = std::chrono::steady_clock::now();
+        applyCommands();
+        if (static_cast<int>(accumulator.size()) < frames * 2) accumulator.resize(frames * 2);
+        std::fill(accumulator.begin(), accumulator.begin() + frames * 2, 0.0f);
+       
+        uint64_t bufferedNs = 0, streamedNs = 0;
+        int buffered = 0, streamed = 0;
+        for (size_t i = 0; i < active.size();) {
+            Voice& voice = *active[i];
+            auto voiceStart = std::chrono::steady_clock::now();
+            bool playing = render(voice, frames);
+            uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - voiceStart).count());
+            if (voice.stream) {
+                streamedNs += ns;
+                streamed++;
+            } else {
+                bufferedNs += ns;
+                buffered++;
+            }
+           
+            if (playing) {
+                i++;
+            } else {
+                release(voice);
+                active[i] = active.back();
+                active.pop_back();
+            }
+        }
        
-        // Initialize tiles
-        tiles.resize(height, std::vector<Tile>(width, Tile(Tile::Type::Floor, resources)));
+        for (int i = 0; i < frames * 2; i++) {
+            float sample = std::max(-32768.0f, std::min(32767.0f, accumulator[i]));
+            out[i] = static_cast<sf::Int16>(sample);
+        }
        
-        // Set tile positions
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                tiles[y][x].setPosition(x * TILE_SIZE, y * TILE_SIZE);
-            }
+        int count = static_cast<int>(active.size());
+        voiceCount.store(count, std::memory_order_relaxed);
+        if (count > peakVoices.load(std::memory_order_relaxed)) peakVoices.store(count, std::memory_order_relaxed);
+        voiceNs += bufferedNs + streamedNs;
+        voiceChunks += buffered + streamed;
+        streamNs += streamedNs;
+        streamChunks += streamed;
+        chunks++;
+        mixNs += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - mixStart).count());
+    }
+   
+    Stats getStats() const {
+        Stats stats;
+        stats.voices = voiceCount.load();
+        stats.peakVoices = peakVoices.load();
+        stats.chunks = chunks.load();
+        stats.stolen = stolen.load();
+        uint64_t voiceTotal = voiceChunks.load();
+        uint64_t streamTotal = streamChunks.load();
+        if (stats.chunks > 0) {
+            stats.mixUs = mixNs.load() / 1000.0 / stats.chunks;
+            stats.load = stats.mixUs / (1.0e6 * CHUNK_FRAMES / SAMPLE_RATE);
         }
+        if (voiceTotal > 0) stats.voiceUs = voiceNs.load() / 1000.0 / voiceTotal;
+        if (streamTotal > 0) stats.streamVoiceUs = streamNs.load() / 1000.0 / streamTotal;
+        return stats;
     }
    
-    // Generate a simple dungeon layout
-    void generateDungeon() {
-        // Create walls around the edges
-        for (int x = 0; x < width; x++) {
-            tiles[0][x] = Tile(Tile::Type::Wall, resources);
-            tiles[height-1][x] = Tile(Tile::Type::Wall, resources);
+    void resetStats() {
+        peakVoices = voiceCount.load();
+        chunks = 0;
+        stolen = 0;
+        mixNs = 0;
+        voiceNs = 0;
+        voiceChunks = 0;
+        streamNs = 0;
+        streamChunks = 0;
+    }
+   
+private:
+    uint32_t queuePlay(Voice voice, int bus, float gain, bool loop, float fadeIn) {
+        voice.handle = nextHandle++;
+        voice.bus = bus;
+        voice.loop = loop;
+        voice.target = gain;
+        voice.gain = fadeIn > 0.0f ? 0.0f : gain;
+        voice.gainStep = fadeIn > 0.0f ? gain / (fadeIn * SAMPLE_RATE) : 0.0f;
+        uint32_t handle = voice.handle;
+        Command command{Command::PLAY, handle, bus, gain, fadeIn, false, std::move(voice)};
+        queue(std::move(command));
+        return handle;
+    }
+   
+    void queue(Command command) {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        pending.push_back(std::move(command));
+    }
+   
+    void applyCommands() {
+        {
+            std::lock_guard<std::mutex> lock(commandMutex);
+            applying.swap(pending);
         }
-        for (int y = 0; y < height; y++) {
-            tiles[y][0] = Tile(Tile::Type::Wall, resources);
-            tiles[y][width-1] = Tile(Tile::Type::Wall, resources);
+        for (Command& command : applying) {
+            if (command.type == Command::PLAY) {
+                Voice* slot = freeVoice();
+                if (slot) {
+                    *slot = std::move(command.voice);
+                    active.push_back(slot);
+                }
+            } else if (command.type == Command::FADE) {
+                for (Voice* voice : active) {
+                    if (voice->handle != command.handle) continue;
+                    voice->target = command.gain;
+                    float frames = std::max(1.0f, command.seconds * SAMPLE_RATE);
+                    voice->gainStep = std::abs(command.gain - voice->gain) / frames;
+                    if (command.seconds <= 0.0f) voice->gain = command.gain;
+                    voice->stopWhenSilent = command.stopAtEnd;
+                }
+            } else if (command.type == Command::BUS_GAIN) {
+                busGains[command.bus] = command.gain;
+            } else if (command.type == Command::STOP_ALL) {
+                for (Voice* voice : active) release(*voice);
+                active.clear();
+            }
         }
-       
-        // Create some random walls
-        for (int i = 0; i < width * height / 20; i++) {
-            int x = GameUtils::getRandomInt(2, width - 3);
-            int y = GameUtils::getRandomInt(2, height - 3);
-            tiles[y][x] = Tile(Tile::Type::Wall, resources);
+        applying.clear();
+    }
+   
+    // An idle slot, or the quietest effect when all are busy. Music and ambience
+    // are never stolen; a new effect is dropped rather than cut one of them.
+    Voice* freeVoice() {
+        if (active.size() < voices.size()) {
+            for (Voice& voice : voices) {
+                if (std::find(active.begin(), active.end(), &voice) == active.end()) return &voice;
+            }
         }
-       
-        // Create some random water
-        for (int i = 0; i < width * height / 40; i++) {
-            int x = GameUtils::getRandomInt(2, width - 3);
-            int y = GameUtils::getRandomInt(2, height - 3);
-            tiles[y][x] = Tile(Tile::Type::Water, resources);
+        size_t quietest = active.size();
+        for (size_t i = 0; i < active.size(); i++) {
+            if (active[i]->bus != BUS_EFFECTS) continue;
+            if (quietest == active.size() || active[i]->gain < active[quietest]->gain) quietest = i;
         }
-       
-        // Create some random lava
-        for (int i = 0; i < width * height / 50; i++) {
-            int x = GameUtils::getRandomInt(2, width - 3);
-            int y = GameUtils::getRandomInt(2, height - 3);
-            tiles[y][x] = Tile(Tile::Type::Lava, resources);
+        stolen++;
+        if (quietest == active.size()) return nullptr;
+        Voice* slot = active[quietest];
+        release(*slot);
+        active[quietest] = active.back();
+        active.pop_back();
+        return slot;
+    }
+   
+    void release(Voice& voice) {
+        voice.sound.reset();
+        voice.stream.reset();
+        voice.handle = 0;
+    }
+   
+    // Source frame index of a streamed voice, refilling the window when playback
+    // leaves it. The window always keeps the frame before the one asked for, so
+    // interpolating across a refill never seeks backwards.
+    const sf::Int16* streamFrame(Voice& voice, uint64_t index) {
+        if (index < voice.windowStart || index >= voice.windowStart + voice.windowFrames) {
+            size_t kept = 0;
+            if (voice.windowFrames > 0 && index == voice.windowStart + voice.windowFrames) {
+                std::copy_n(voice.window.data() + (voice.windowFrames - 1) * voice.channels, voice.channels, voice.window.data());
+                kept = 1;
+            } else {
+                voice.stream->seek(index * voice.channels);
+            }
+            voice.windowStart = index - kept;
+            size_t wanted = (STREAM_WINDOW_FRAMES - kept) * voice.channels;
+            size_t read = static_cast<size_t>(voice.stream->read(voice.window.data() + kept * voice.channels, wanted));
+            voice.windowFrames = kept + read / voice.channels;
+            if (voice.windowFrames <= index - voice.windowStart) {
+                // Decoder came up short of the reported length; play silence from here
+                std::fill(voice.window.begin(), voice.window.end(), 0);
+                voice.windowStart = index;
+                voice.windowFrames = 1;
+            }
         }
-       
-        // Add some chests
-        for (int i = 0; i < width * height / 100; i++) {
-            int x = GameUtils::getRandomInt(2, width - 3);
-            int y = GameUtils::getRandomInt(2, height - 3);
-            tiles[y][x] = Tile(Tile::Type::Chest, resources);
+        return voice.window.data() + (index - voice.windowStart) * voice.channels;
+    }
+   
+    // Add a voice into the accumulator; false once it has finished
+    bool render(Voice& voice, int frames) {
+        float bus = busGains[voice.bus];
+        float* out = accumulator.data();
+        for (int i = 0; i < frames; i++) {
+            uint64_t index = static_cast<uint64_t>(voice.cursor);
+            float fraction = static_cast<float>(voice.cursor - index);
+            uint64_t nextIndex = index + 1;
+            if (nextIndex >= voice.frames) nextIndex = voice.loop ? 0 : index;
+           
+            const sf::Int16* a;
+            const sf::Int16* b;
+            if (voice.stream) {
+                a = streamFrame(voice, index);
+                sf::Int16 first[2] = {a[0], a[voice.channels - 1]};
+                b = streamFrame(voice, nextIndex);
+                float gain = voice.gain * bus;
+                out[i * 2] += (first[0] + (b[0] - first[0]) * fraction) * gain;
+                out[i * 2 + 1] += (first[1] + (b[voice.channels - 1] - first[1]) * fraction) * gain;
+            } else {
+                a = voice.sound->samples + index * voice.channels;
+                b = voice.sound->samples + nextIndex * voice.channels;
+                float gain = voice.gain * bus;
+                out[i * 2] += (a[0] + (b[0] - a[0]) * fraction) * gain;
+                out[i * 2 + 1] += (a[voice.channels - 1] + (b[voice.channels - 1] - a[voice.channels - 1]) * fraction) * gain;
+            }
+           
+            if (voice.gain != voice.target) {
+                voice.gain = voice.gain < voice.target ? std::min(voice.target, voice.gain + voice.gainStep)
+                                                       : std::max(voice.target, voice.gain - voice.gainStep);
+            } else if (voice.stopWhenSilent && voice.gain <= 0.0f) {
+                return false;
+            }
+           
+            voice.cursor += voice.step;
+            if (voice.cursor >= voice.frames) {
+                if (!voice.loop) return false;
+                voice.cursor -= voice.frames;
+            }
+        }
+        return true;
+    }
+};
+
+// Mixer output through the sound card. sf::SoundStream pulls chunks on its own
+// thread, which makes that thread the mixing thread.
+class MixerStream : public sf::SoundStream {
+private:
+    AudioMixer& mixer;
+    std::vector<sf::Int16> buffer;
+   
+public:
+    explicit MixerStream(AudioMixer& mixer) : mixer(mixer), buffer(AudioMixer::CHUNK_FRAMES * 2) {
+        initialize(2, AudioMixer::SAMPLE_RATE);
+    }
+   
+    ~MixerStream() {
+        stop();
+    }
+   
+protected:
+    bool onGetData(Chunk& data) override {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_AUDIO);
+        mixer.mix(buffer.data(), AudioMixer::CHUNK_FRAMES);
+        data.samples = buffer.data();
+        data.sampleCount = buffer.size();
+        return true;
+    }
+   
+    void onSeek(sf::Time) override {}
+};
+
+// Mixer output to nowhere, for headless runs. A thread still mixes every chunk,
+// paced to real time unless told otherwise, so costs and timing match a device.
+class NullAudioDevice {
+private:
+    AudioMixer& mixer;
+    std::thread worker;
+    std::atomic<bool> running;
+   
+public:
+    explicit NullAudioDevice(AudioMixer& mixer) : mixer(mixer), running(false) {}
+   
+    ~NullAudioDevice() {
+        stop();
+    }
+   
+    void start(bool paced = true) {
+        if (running.exchange(true)) return;
+        worker = std::thread([this, paced]() {
+            MemoryTracker::Scope memoryScope(MemoryTracker::TAG_AUDIO);
+            std::vector<sf::Int16> buffer(AudioMixer::CHUNK_FRAMES * 2);
+            auto chunk = std::chrono::microseconds(1000000LL * AudioMixer::CHUNK_FRAMES / AudioMixer::SAMPLE_RATE);
+            auto deadline = std::chrono::steady_clock::now();
+            while (running.load()) {
+                mixer.mix(buffer.data(), AudioMixer::CHUNK_FRAMES);
+                if (paced) {
+                    deadline += chunk;
+                    std::this_thread::sleep_until(deadline);
+                }
+            }
+        });
+    }
+   
+    void stop() {
+        if (!running.exchange(false)) return;
+        worker.join();
+    }
+};
+
+// Sound Cache - decoded effects, kept while they fit a memory budget. Anything
+// still playing is pinned by the voice's reference; the rest is evicted least
+// recently used first. Sounds are looked up in the asset pack, then on disk.
+class SoundCache {
+private:
+    struct Entry {
+        std::shared_ptr<const SoundData> data;
+        uint64_t lastUse;
+    };
+   
+    ResourceManager& resources;
+    std::map<std::string, Entry> entries;
+    size_t budget;
+    size_t used;
+    uint64_t useCounter;
+    uint64_t hits, misses, evictions;
+   
+public:
+    SoundCache(ResourceManager& resources, size_t budget)
+        : resources(resources), budget(budget), used(0), useCounter(0), hits(0), misses(0), evictions(0) {}
+   
+    std::shared_ptr<const SoundData> get(const std::string& id) {
+        auto it = entries.find(id);
+        if (it != entries.end()) {
+            hits++;
+            it->second.lastUse = ++useCounter;
+            return it->second.data;
+        }
+       
+        misses++;
+        std::shared_ptr<SoundData> data = decode(id);
+        // A sound that failed is kept empty, so it isn't decoded and reported on
+        // every play; the mixer skips it and trim() never evicts it
+        if (!data) data = std::make_shared<SoundData>();
+        insert(id, data);
+        return data;
+    }
+   
+    // Add decoded samples under an id, e.g. a sound built at runtime
+    void insert(const std::string& id, std::shared_ptr<const SoundData> data) {
+        auto it = entries.find(id);
+        if (it != entries.end()) {
+            used -= it->second.data->getHeapBytes();
+            entries.erase(it);
+        }
+        used += data->getHeapBytes();
+        entries[id] = Entry{std::move(data), ++useCounter};
+        trim();
+    }
+   
+    // Evict until under budget, oldest first, skipping sounds still playing
+    void trim() {
+        while (used > budget) {
+            auto oldest = entries.end();
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                if (it->second.data.use_count() > 1 || it->second.data->getHeapBytes() == 0) continue;
+                if (oldest == entries.end() || it->second.lastUse < oldest->second.lastUse) oldest = it;
+            }
+            if (oldest == entries.end()) break;
+            used -= oldest->second.data->getHeapBytes();
+            entries.erase(oldest);
+            evictions++;
+        }
+    }
+   
+    size_t getUsedBytes() const { return used; }
+    size_t getBudget() const { return budget; }
+    size_t getCount() const { return entries.size(); }
+    uint64_t getHits() const { return hits; }
+    uint64_t getMisses() const { return misses; }
+    uint64_t getEvictions() const { return evictions; }
+   
+    // Decode a whole sound file; safe to call from any thread
+    static std::shared_ptr<SoundData> decodeFile(const std::string& filepath) {
+        sf::InputSoundFile file;
+        if (!file.openFromFile(filepath) || file.getChannelCount() == 0) return nullptr;
+        auto data = std::make_shared<SoundData>();
+        data->sampleRate = file.getSampleRate();
+        data->channels = file.getChannelCount();
+        data->owned.resize(static_cast<size_t>(file.getSampleCount()));
+        data->owned.resize(static_cast<size_t>(file.read(data->owned.data(), data->owned.size())));
+        data->samples = data->owned.data();
+        data->frames = data->owned.size() / data->channels;
+        return data;
+    }
+   
+private:
+    std::shared_ptr<SoundData> decode(const std::string& id) {
+        auto data = std::make_shared<SoundData>();
+       
+        const AssetPack& pack = resources.getPack();
+        const PackData::Entry* entry = pack.findCurrent(PackData::ENTRY_SOUND, id);
+        if (entry && entry->width > 0 && entry->height > 0) {
+            data->sampleRate = entry->width;
+            data->channels = entry->height;
+            data->frames = static_cast<size_t>(entry->size / sizeof(sf::Int16) / data->channels);
+            if (entry->compression == PackData::COMPRESSION_NONE) {
+                data->samples = reinterpret_cast<const sf::Int16*>(pack.getStored(*entry));
+                return data;
+            }
+            std::vector<uint8_t> bytes;
+            if (pack.extract(*entry, bytes)) {
+                data->owned.resize(bytes.size() / sizeof(sf::Int16));
+                std::memcpy(data->owned.data(), bytes.data(), data->owned.size() * sizeof(sf::Int16));
+                data->samples = data->owned.data();
+                return data;
+            }
+            std::cerr << "Corrupt sound in pack: " << id << std::endl;
+        }
+       
+        for (const AssetPack::AssetFile& asset : AssetPack::MANIFEST) {
+            if (asset.kind == PackData::ENTRY_SOUND && id == asset.id) {
+                data = decodeFile(asset.path);
+                if (data) return data;
+                break;
+            }
+        }
+        std::cerr << "Failed to load sound: " << id << std::endl;
+        return nullptr;
+    }
+};
+
+// Sound Manager - effects from the cache, area music that crossfades, and
+// looping ambience layers, all mixed by AudioMixer into one output
+class SoundManager {
+public:
+    enum class Output {
+        Device,  // The sound card
+        Null     // A paced mixing thread with no output, for headless runs
+    };
+   
+    static const size_t EFFECT_BUDGET = 16 * 1024 * 1024;
+   
+private:
+    ResourceManager& resources;
+    SoundCache cache;
+    AudioMixer mixer;
+    std::unique_ptr<MixerStream> device;
+    NullAudioDevice nullDevice;
+    std::string musicId;
+    uint32_t musicVoice;
+    std::map<std::string, uint32_t> ambience;
+    float volume;
+   
+public:
+    SoundManager(ResourceManager& resources, Output output = Output::Device)
+        : resources(resources), cache(resources, EFFECT_BUDGET), nullDevice(mixer), musicVoice(0), volume(100.0f) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_AUDIO);
+        setVolume(volume);
+        if (output == Output::Device) {
+            device = std::make_unique<MixerStream>(mixer);
+            device->play();
+        } else {
+            nullDevice.start();
+        }
+    }
+   
+    ~SoundManager() {
+        // Stop the output thread before the mixer goes away
+        device.reset();
+        nullDevice.stop();
+    }
+   
+    void playSound(const std::string& id) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_AUDIO);
+        mixer.play(cache.get(id), AudioMixer::BUS_EFFECTS, 1.0f);
+    }
+   
+    // Crossfade to an area's music; playing the current track again does nothing
+    void playMusic(const std::string& id = "main_theme", float fadeSeconds = 2.0f) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_AUDIO);
+        if (id == musicId && musicVoice) return;
+        stopMusic(fadeSeconds);
+        musicVoice = mixer.playStream(openStream(id), AudioMixer::BUS_MUSIC, 1.0f, true, fadeSeconds);
+        musicId = musicVoice ? id : "";
+    }
+   
+    void stopMusic(float fadeSeconds = 0.5f) {
+        if (musicVoice) mixer.fade(musicVoice, 0.0f, fadeSeconds, true);
+        musicVoice = 0;
+        musicId.clear();
+    }
+   
+    // Start a looping ambience layer, or fade one already playing to a new level;
+    // a level of zero fades it out and frees it
+    void setAmbience(const std::string& id, float level, float fadeSeconds = 1.0f) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_AUDIO);
+        auto it = ambience.find(id);
+        if (it != ambience.end()) {
+            mixer.fade(it->second, level, fadeSeconds, level <= 0.0f);
+            if (level <= 0.0f) ambience.erase(it);
+            return;
+        }
+        if (level <= 0.0f) return;
+        uint32_t voice = mixer.playStream(openStream(id), AudioMixer::BUS_AMBIENCE, level, true, fadeSeconds);
+        if (voice) ambience[id] = voice;
+    }
+   
+    void setVolume(float newVolume) {
+        volume = std::max(0.0f, std::min(100.0f, newVolume));
+        mixer.setBusGain(AudioMixer::BUS_EFFECTS, volume / 100.0f);
+        mixer.setBusGain(AudioMixer::BUS_MUSIC, volume / 100.0f * 0.5f);
+        mixer.setBusGain(AudioMixer::BUS_AMBIENCE, volume / 100.0f * 0.5f);
+    }
+   
+    // New samples for an effect; voices already playing finish with the old ones
+    void replaceSound(const std::string& id, std::shared_ptr<const SoundData> data) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_AUDIO);
+        cache.insert(id, std::move(data));
+    }
+   
+    AudioMixer::Stats getMixerStats() const {
+        return mixer.getStats();
+    }
+   
+    const SoundCache& getCache() const {
+        return cache;
+    }
+   
+private:
+    // Music and ambience come from the pack's mapping when it has them, else from disk
+    std::unique_ptr<sf::InputSoundFile> openStream(const std::string& id) {
+        auto stream = std::make_unique<sf::InputSoundFile>();
+        const AssetPack& pack = resources.getPack();
+        const PackData::Entry* entry = pack.findCurrent(PackData::ENTRY_MUSIC, id);
+        if (entry && entry->compression == PackData::COMPRESSION_NONE &&
+            stream->openFromMemory(pack.getStored(*entry), static_cast<size_t>(entry->size))) {
+            return stream;
+        }
+        for (const AssetPack::AssetFile& asset : AssetPack::MANIFEST) {
+            if (asset.kind == PackData::ENTRY_MUSIC && id == asset.id && stream->openFromFile(asset.path)) return stream;
+        }
+        std::cerr << "Failed to open music: " << id << std::endl;
+        return nullptr;
+    }
+};
+
+// File watcher - reports files under a directory tree that were written or
+// moved into place. inotify on Linux; elsewhere the tree is rescanned for
+// changed modification times, which is slower but needs nothing from the OS.
+class FileWatcher {
+private:
+    std::string root;
+#ifdef __linux__
+    int fd;
+    std::map<int, std::string> watches;  // Watch descriptor -> directory
+#endif
+    std::map<std::string, std::filesystem::file_time_type> modified;
+   
+public:
+#ifdef __linux__
+    FileWatcher() : fd(-1) {}
+#else
+    FileWatcher() {}
+#endif
+   
+    ~FileWatcher() {
+        stop();
+    }
+   
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+   
+    bool start(const std::string& directory) {
+        stop();
+        root = directory;
+        std::error_code error;
+        if (!std::filesystem::is_directory(root, error)) {
+            std::cerr << "Cannot watch missing directory: " << root << std::endl;
+            return false;
+        }
+       
+        std::vector<std::string> directories(1, root);
+        for (auto it = std::filesystem::recursive_directory_iterator(root, error);
+             !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+            if (it->is_directory(error)) {
+                directories.push_back(it->path().generic_string());
+            } else if (it->is_regular_file(error)) {
+                modified[it->path().generic_string()] = it->last_write_time(error);
+            }
+        }
+       
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) {
+            std::cerr << "inotify unavailable, polling " << root << " instead" << std::endl;
+            return true;
+        }
+        for (const std::string& directory : directories) {
+            int watch = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (watch >= 0) watches[watch] = directory;
+        }
+#endif
+        return true;
+    }
+   
+    void stop() {
+#ifdef __linux__
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+        watches.clear();
+#endif
+        modified.clear();
+    }
+   
+    // Wait up to timeoutMs for changes and append the paths that changed
+    void poll(std::vector<std::string>& changed, int timeoutMs) {
+#ifdef __linux__
+        if (fd >= 0) {
+            pollfd request = {fd, POLLIN, 0};
+            if (::poll(&request, 1, timeoutMs) <= 0) return;
+           
+            alignas(inotify_event) char buffer[16384];
+            for (;;) {
+                ssize_t length = ::read(fd, buffer, sizeof(buffer));
+                if (length <= 0) break;
+                for (ssize_t at = 0; at < length;) {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + at);
+                    at += sizeof(inotify_event) + event->len;
+                    auto directory = watches.find(event->wd);
+                    if (directory == watches.end() || event->len == 0 || (event->mask & IN_ISDIR)) continue;
+                    changed.push_back(directory->second + "/" + event->name);
+                }
+            }
+            return;
+        }
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        std::error_code error;
+        for (auto it = std::filesystem::recursive_directory_iterator(root, error);
+             !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+            if (!it->is_regular_file(error)) continue;
+            auto time = it->last_write_time(error);
+            auto& known = modified[it->path().generic_string()];
+            if (!error && known != time) {
+                known = time;
+                changed.push_back(it->path().generic_string());
+            }
+        }
+    }
+};
+
+// Hot reload - watches the asset tree and reloads what changes while the game
+// runs. Decoding and data compilation happen on a background thread; the game
+// thread swaps finished reloads in from update(), at most one per frame, into
+// the objects it already hands out. Sprites point at the sf::Texture in
+// ResourceManager, so they show new pixels without being rebuilt. Archetype
+// data is swapped whole and the old mapping is kept, because entities hold
+// names from it.
+class HotReloader {
+public:
+    static const int DEBOUNCE_MS = 100;  // Editors often write a file more than once per save
+   
+private:
+    enum class Kind { Texture, Sound, Data };
+   
+    struct Reload {
+        Kind kind;
+        std::string id;
+        sf::Image image;
+        std::shared_ptr<SoundData> sound;
+        std::unique_ptr<ArchetypeTable> archetypes;
+        std::chrono::steady_clock::time_point detected;
+        float decodeMs;
+    };
+   
+    ResourceManager& resources;
+    SoundManager& sounds;
+    std::string root;
+    FileWatcher watcher;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::mutex readyMutex;
+    std::vector<std::unique_ptr<Reload>> ready;
+   
+    int applied;
+    int rejected;
+    float totalLatencyMs;
+    float maxLatencyMs;
+    float maxApplyMs;
+   
+public:
+    HotReloader(ResourceManager& resources, SoundManager& sounds)
+        : resources(resources), sounds(sounds), running(false), applied(0), rejected(0),
+          totalLatencyMs(0.0f), maxLatencyMs(0.0f), maxApplyMs(0.0f) {}
+   
+    ~HotReloader() {
+        stop();
+    }
+   
+    bool start(const std::string& assetRoot = "assets") {
+        stop();
+        root = assetRoot;
+        if (!watcher.start(root)) return false;
+        running = true;
+        worker = std::thread([this]() {
+            MemoryTracker::Scope memoryScope(MemoryTracker::TAG_RESOURCES);
+            watch();
+        });
+        std::cout << "Hot reload: watching " << root << std::endl;
+        return true;
+    }
+   
+    void stop() {
+        if (!running.exchange(false)) return;
+        worker.join();
+        watcher.stop();
+    }
+   
+    // Whether update() has something to swap in
+    bool hasReady() {
+        std::lock_guard<std::mutex> lock(readyMutex);
+        return !ready.empty();
+    }
+   
+    // Swap in the oldest finished reload; true if one was applied
+    bool update() {
+        std::unique_ptr<Reload> reload;
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            if (ready.empty()) return false;
+            reload = std::move(ready.front());
+            ready.erase(ready.begin());
+        }
+       
+        sf::Clock clock;
+        bool ok = true;
+        if (reload->kind == Kind::Texture) {
+            resources.reloadTexture(reload->id, reload->image);
+        } else if (reload->kind == Kind::Sound) {
+            sounds.replaceSound(reload->id, std::move(reload->sound));
+        } else {
+            ok = resources.swapArchetypes(std::move(reload->archetypes));
+        }
+        float applyMs = clock.getElapsedTime().asSeconds() * 1000.0f;
+       
+        float latencyMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - reload->detected).count();
+        if (ok) {
+            applied++;
+            totalLatencyMs += latencyMs;
+            maxLatencyMs = std::max(maxLatencyMs, latencyMs);
+        } else {
+            rejected++;
+        }
+        maxApplyMs = std::max(maxApplyMs, applyMs);
+        std::cout << (ok ? "Reloaded " : "Rejected reload of ") << reload->id << " in " << latencyMs
+                  << " ms (" << reload->decodeMs << " ms decoding, " << applyMs << " ms swapping in)" << std::endl;
+        return ok;
+    }
+   
+    int getAppliedCount() const { return applied; }
+    int getRejectedCount() const { return rejected; }
+    float getAverageLatencyMs() const { return applied ? totalLatencyMs / applied : 0.0f; }
+    float getMaxLatencyMs() const { return maxLatencyMs; }
+    float getMaxApplyMs() const { return maxApplyMs; }
+   
+private:
+    // Background thread: gather changes until the tree is quiet, then load them
+    void watch() {
+        std::vector<std::string> changed;
+        std::map<std::string, std::chrono::steady_clock::time_point> pending;
+        auto lastChange = std::chrono::steady_clock::now();
+        while (running.load()) {
+            changed.clear();
+            watcher.poll(changed, DEBOUNCE_MS / 2);
+            auto now = std::chrono::steady_clock::now();
+            for (const std::string& path : changed) {
+                pending.emplace(path, now);
+                lastChange = now;
+            }
+            if (pending.empty() || now - lastChange < std::chrono::milliseconds(DEBOUNCE_MS)) continue;
+           
+            bool dataChanged = false;
+            auto dataDetected = now;
+            for (const auto& change : pending) {
+                std::string relative = change.first.substr(std::min(change.first.size(), root.size() + 1));
+                if (relative.rfind("data/", 0) == 0 && relative.size() > 4 &&
+                    relative.compare(relative.size() - 4, 4, ".txt") == 0) {
+                    dataChanged = true;
+                    dataDetected = std::min(dataDetected, change.second);
+                    continue;
+                }
+                for (const AssetPack::AssetFile& asset : AssetPack::MANIFEST) {
+                    // Manifest paths are relative to the working directory's assets/
+                    if (relative != asset.path + std::strlen("assets/")) continue;
+                    if (asset.kind == PackData::ENTRY_TEXTURE) {
+                        load(Kind::Texture, asset.id, change.first, change.second);
+                    } else if (asset.kind == PackData::ENTRY_SOUND) {
+                        load(Kind::Sound, asset.id, change.first, change.second);
+                    }
+                }
+            }
+            if (dataChanged) load(Kind::Data, "archetype data", root + "/data", dataDetected);
+            pending.clear();
+        }
+    }
+   
+    void load(Kind kind, const std::string& id, const std::string& path, std::chrono::steady_clock::time_point detected) {
+        auto reload = std::make_unique<Reload>();
+        reload->kind = kind;
+        reload->id = id;
+        reload->detected = detected;
+        sf::Clock clock;
+       
+        bool ok = false;
+        if (kind == Kind::Texture) {
+            ok = reload->image.loadFromFile(path);
+        } else if (kind == Kind::Sound) {
+            reload->sound = SoundCache::decodeFile(path);
+            ok = reload->sound != nullptr;
+        } else {
+            // Compile beside the live blob and rename over it once mapped; the
+            // game's mapping of the old file stays valid through the rename
+            std::string blobPath = path + "/archetypes.bin";
+            std::string buildPath = blobPath + ".reload";
+            reload->archetypes = std::make_unique<ArchetypeTable>();
+            ok = ArchetypeTable::compile(path, buildPath) && reload->archetypes->load(buildPath);
+            std::error_code error;
+            if (ok) std::filesystem::rename(buildPath, blobPath, error);
+        }
+        if (!ok) {
+            std::cerr << "Hot reload failed: " << path << std::endl;
+            return;
+        }
+       
+        reload->decodeMs = clock.getElapsedTime().asSeconds() * 1000.0f;
+        std::lock_guard<std::mutex> lock(readyMutex);
+        ready.push_back(std::move(reload));
+    }
+};
+
+// Frame capture file: one draw list as written by DrawList::save. Textures and
+// fonts are named by their ResourceManager id so a replay can load the same ones.
+namespace CaptureData {
+    const uint32_t MAGIC = 0x5041434C;  // "LCAP"
+    const uint32_t VERSION = 2;
+    const uint32_t NO_RESOURCE = 0xFFFFFFFFu;
+   
+    enum CommandKind : uint8_t {
+        COMMAND_CLEAR = 0,
+        COMMAND_VIEW = 1,
+        COMMAND_VERTICES = 2,
+        COMMAND_TEXT = 3,
+        COMMAND_SHAPE = 4,
+        COMMAND_UNIFORM = 5
+    };
+   
+    enum Blend : uint8_t {
+        BLEND_ALPHA = 0,
+        BLEND_ADD = 1,
+        BLEND_MULTIPLY = 2,
+        BLEND_NONE = 3
+    };
+   
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width, height;
+        uint32_t commandCount;
+        uint32_t vertexCount;
+        uint32_t codePointCount;
+        uint32_t stringSize;
+    };
+   
+    struct Command {
+        uint8_t kind;
+        uint8_t source;        // DrawList::Source
+        uint8_t primitive;     // sf::PrimitiveType
+        uint8_t blend;
+        uint32_t resource;     // Texture or font id in the string table, or NO_RESOURCE
+        uint32_t shader;       // Shader id for vertices and uniforms, or NO_RESOURCE
+        uint32_t first;        // First vertex, first code point of a text, or a uniform's name
+        uint32_t count;        // Vertices, code points or a uniform's floats
+        uint32_t color;        // Clear, text or shape fill colour as RGBA
+        uint32_t outlineColor;
+        float outlineThickness;
+        uint32_t characterSize;
+        uint32_t style;
+        // Vertices: the transform's 3x3 matrix. Text and shapes: position, origin,
+        // scale and rotation, then a shape's size. Views: centre, size, rotation,
+        // viewport. Uniforms: the value, of as many floats as count.
+        float values[9];
+    };
+   
+    struct Vertex {
+        float x, y;
+        float u, v;
+        uint32_t color;
+    };
+   
+    static_assert(sizeof(Header) == 32, "Header layout changed");
+    static_assert(sizeof(Command) == 76, "Command layout changed");
+    static_assert(sizeof(Vertex) == 20, "Vertex layout changed");
+}
+
+// Draw List - one frame of drawing, recorded by the game and replayed by the
+// render thread. Sprites become quads, and runs of them on the same texture are
+// merged into one vertex batch, so a screen of tiles costs a few draw calls.
+// Text and shapes are copied into slots kept from frame to frame; copying into
+// them reuses their storage, so recording a frame doesn't touch the heap.
+// Commands are tagged with the code that drew them, and a list can be saved to
+// disk and loaded back to find out where a slow frame's draw calls came from.
+// Shader uniforms are recorded too, so the render thread sets them in order.
+class DrawList {
+public:
+    enum Source : uint8_t {
+        SOURCE_OTHER,
+        SOURCE_DUNGEON,
+        SOURCE_ENTITY,
+        SOURCE_EFFECTS,
+        SOURCE_UI,
+        SOURCE_COUNT
+    };
+   
+    static constexpr const char* SOURCE_NAMES[SOURCE_COUNT] = {"Other", "Dungeon", "Entity", "Effects", "UI"};
+   
+    // Everything drawn while one is alive is charged to its source
+    class Scope {
+        DrawList& list;
+        Source previous;
+       
+    public:
+        Scope(DrawList& list, Source source) : list(list), previous(list.source) { list.source = source; }
+        ~Scope() { list.source = previous; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+   
+    // Everything drawn while one is alive is moved by an offset, on the recording
+    // side like the sprite transform, so it still batches. Stands world-space
+    // entities up at their isometric positions.
+    class Offset {
+        DrawList& list;
+        sf::Vector2f previous;
+       
+    public:
+        Offset(DrawList& list, sf::Vector2f offset) : list(list), previous(list.offset) { list.offset = offset; }
+        ~Offset() { list.offset = previous; }
+        Offset(const Offset&) = delete;
+        Offset& operator=(const Offset&) = delete;
+    };
+   
+    // Sprites drawn without a shader while one is alive are multiplied by a
+    // colour, on the recording side like the offset, so they still batch. Lights
+    // what stands after the light map's pass. Text and shapes are left alone.
+    class Tint {
+        DrawList& list;
+        sf::Color previous;
+       
+    public:
+        Tint(DrawList& list, const sf::Color& tint) : list(list), previous(list.tint) { list.tint = tint; }
+        ~Tint() { list.tint = previous; }
+        Tint(const Tint&) = delete;
+        Tint& operator=(const Tint&) = delete;
+    };
+   
+    // What replaying the list costs, as SFML will submit it
+    struct Stats {
+        size_t drawCalls = 0;
+        size_t textureBinds = 0;   // Draw calls on a different texture from the one before
+        size_t vertices = 0;       // Text counted at 6 per glyph, shapes as SFML builds them
+        size_t views = 0;
+        size_t texts = 0;
+        size_t codePoints = 0;
+        size_t sourceDrawCalls[SOURCE_COUNT] = {};
+        size_t sourceVertices[SOURCE_COUNT] = {};
+    };
+   
+private:
+    enum class CommandType { Clear, View, Vertices, Text, Shape, Uniform };
+   
+    struct Command {
+        CommandType type;
+        Source source;
+        int index;        // Into views, batches, texts, shapes or uniforms
+        sf::Color color;  // For Clear
+    };
+   
+    struct Uniform {
+        sf::Shader* shader;
+        const char* name;      // A literal or interned
+        sf::Glsl::Vec3 value;  // A float is in x
+        int components;        // 1 or 3
+    };
+   
+    struct Batch {
+        size_t first;
+        size_t count;
+        sf::PrimitiveType primitive;
+        sf::RenderStates states;
+        bool mergeable;  // Separate primitives with no transform, so more can be appended
+    };
+   
+    std::vector<Command> commands;
+    std::vector<sf::View> views;
+    std::vector<Batch> batches;
+    std::vector<sf::Vertex> vertices;
+    std::vector<sf::Text> texts;
+    std::vector<sf::RectangleShape> shapes;
+    std::vector<Uniform> uniforms;
+    size_t textCount;
+    size_t shapeCount;
+    size_t spriteCount;
+    Source source;
+    sf::Vector2f offset;
+    sf::Color tint;
+   
+    sf::Vector2u size;
+    sf::View defaultView;
+    sf::View view;
+   
+public:
+    DrawList()
+        : textCount(0), shapeCount(0), spriteCount(0), source(SOURCE_OTHER), offset(0, 0), tint(sf::Color::White),
+          size(0, 0) {}
+   
+    // Start a frame for a target of the given size, in its default view
+    void reset(sf::Vector2u targetSize) {
+        commands.clear();
+        views.clear();
+        batches.clear();
+        vertices.clear();
+        uniforms.clear();
+        textCount = 0;
+        shapeCount = 0;
+        spriteCount = 0;
+        source = SOURCE_OTHER;
+        offset = sf::Vector2f(0, 0);
+        tint = sf::Color::White;
+        if (targetSize != size) {
+            size = targetSize;
+            defaultView.reset(sf::FloatRect(0, 0, static_cast<float>(size.x), static_cast<float>(size.y)));
+        }
+        view = defaultView;
+    }
+   
+    void clear(const sf::Color& color = sf::Color::Black) {
+        commands.push_back({CommandType::Clear, source, 0, color});
+    }
+   
+    void setView(const sf::View& newView) {
+        view = newView;
+        commands.push_back({CommandType::View, source, static_cast<int>(views.size()), sf::Color()});
+        views.push_back(newView);
+    }
+   
+    const sf::View& getView() const { return view; }
+    const sf::View& getDefaultView() const { return defaultView; }
+    sf::Vector2u getSize() const { return size; }
+   
+    // Applied when the replay reaches this point; the shader must outlive the list
+    void setUniform(sf::Shader& shader, const char* name, float value) {
+        commands.push_back({CommandType::Uniform, source, static_cast<int>(uniforms.size()), sf::Color()});
+        uniforms.push_back({&shader, name, sf::Glsl::Vec3(value, 0.0f, 0.0f), 1});
+    }
+   
+    void setUniform(sf::Shader& shader, const char* name, const sf::Glsl::Vec3& value) {
+        commands.push_back({CommandType::Uniform, source, static_cast<int>(uniforms.size()), sf::Color()});
+        uniforms.push_back({&shader, name, value, 3});
+    }
+   
+    // Transformed here, on the recording side, exactly as sf::Sprite would. Sprites
+    // with the same texture and shader still merge; a shader reads its per-sprite
+    // parameters from the vertex colour.
+    void draw(const sf::Sprite& sprite, const sf::Shader* shader = nullptr) {
+        const sf::Texture* texture = sprite.getTexture();
+        if (!texture) return;
+       
+        sf::Vertex* quad = append(sf::Quads, sf::RenderStates(sf::BlendAlpha, sf::Transform::Identity, texture, shader), 4);
+        spriteQuad(sprite, quad);
+        if (offset.x != 0.0f || offset.y != 0.0f) move(quad, 4);
+        if (!shader && tint != sf::Color::White) {
+            for (int corner = 0; corner < 4; corner++) quad[corner].color *= tint;
+        }
+        spriteCount++;
+    }
+   
+    // The four corners of a sprite in world space, for lists and cached meshes alike
+    static void spriteQuad(const sf::Sprite& sprite, sf::Vertex* quad) {
+        sf::IntRect rect = sprite.getTextureRect();
+        float width = static_cast<float>(std::abs(rect.width));
+        float height = static_cast<float>(std::abs(rect.height));
+        float left = static_cast<float>(rect.left);
+        float right = left + rect.width;
+        float top = static_cast<float>(rect.top);
+        float bottom = top + rect.height;
+        const sf::Transform& transform = sprite.getTransform();
+        sf::Color color = sprite.getColor();
+       
+        quad[0] = sf::Vertex(transform.transformPoint(0.0f, 0.0f), color, sf::Vector2f(left, top));
+        quad[1] = sf::Vertex(transform.transformPoint(width, 0.0f), color, sf::Vector2f(right, top));
+        quad[2] = sf::Vertex(transform.transformPoint(width, height), color, sf::Vector2f(right, bottom));
+        quad[3] = sf::Vertex(transform.transformPoint(0.0f, height), color, sf::Vector2f(left, bottom));
+    }
+   
+    // Returns the copy, good until the next draw, so a caller can adjust it in place
+    sf::Vertex* draw(const sf::Vertex* source, size_t count, sf::PrimitiveType primitive,
+                     const sf::RenderStates& states = sf::RenderStates::Default) {
+        if (count == 0) return nullptr;
+        sf::Vertex* copy = append(primitive, states, count);
+        std::copy(source, source + count, copy);
+        if (offset.x != 0.0f || offset.y != 0.0f) move(copy, count);
+        return copy;
+    }
+   
+    // Laid out now, so the render thread only reads the font's glyph pages. That
+    // holds for the sizes in ResourceManager::TEXT_SIZES, whose glyphs are all
+    // rendered at load; any other size would add glyphs while a frame is drawn.
+    void draw(const sf::Text& text) {
+        text.getLocalBounds();
+        commands.push_back({CommandType::Text, source, static_cast<int>(textCount), sf::Color()});
+        keep(texts, textCount, text);
+        texts[textCount - 1].move(offset);
+    }
+   
+    void draw(const sf::RectangleShape& shape) {
+        commands.push_back({CommandType::Shape, source, static_cast<int>(shapeCount), sf::Color()});
+        keep(shapes, shapeCount, shape);
+        shapes[shapeCount - 1].move(offset);
+    }
+   
+    void replay(sf::RenderTarget& target) const {
+        target.setView(defaultView);
+        for (const Command& command : commands) {
+            switch (command.type) {
+                case CommandType::Clear:
+                    target.clear(command.color);
+                    break;
+                case CommandType::View:
+                    target.setView(views[command.index]);
+                    break;
+                case CommandType::Vertices: {
+                    const Batch& batch = batches[command.index];
+                    target.draw(&vertices[batch.first], batch.count, batch.primitive, batch.states);
+                    break;
+                }
+                case CommandType::Text:
+                    target.draw(texts[command.index]);
+                    break;
+                case CommandType::Shape:
+                    target.draw(shapes[command.index]);
+                    break;
+                case CommandType::Uniform: {
+                    const Uniform& uniform = uniforms[command.index];
+                    if (uniform.components == 3) {
+                        uniform.shader->setUniform(uniform.name, uniform.value);
+                    } else {
+                        uniform.shader->setUniform(uniform.name, uniform.value.x);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+   
+    // Draw calls the replay makes, against the sprites, text and shapes recorded
+    size_t getDrawCallCount() const { return batches.size() + textCount + shapeCount; }
+    size_t getDrawnObjectCount() const { return spriteCount + textCount + shapeCount; }
+    size_t getVertexCount() const { return vertices.size(); }
+   
+    // Walk the commands as SFML would submit them. Outlined text and shapes take
+    // a second draw call; text binds its font's page for the character size.
+    Stats analyse() const {
+        Stats stats;
+        const void* bound = nullptr;
+        unsigned int boundSize = 0;
+        auto submit = [&](Source from, const void* texture, unsigned int textureSize, size_t count) {
+            stats.drawCalls++;
+            stats.vertices += count;
+            stats.sourceDrawCalls[from]++;
+            stats.sourceVertices[from] += count;
+            if (texture != bound || textureSize != boundSize) stats.textureBinds++;
+            bound = texture;
+            boundSize = textureSize;
+        };
+       
+        for (const Command& command : commands) {
+            if (command.type == CommandType::View) {
+                stats.views++;
+            } else if (command.type == CommandType::Vertices) {
+                const Batch& batch = batches[command.index];
+                submit(command.source, batch.states.texture, 0, batch.count);
+            } else if (command.type == CommandType::Text) {
+                const sf::Text& text = texts[command.index];
+                size_t glyphs = text.getString().getSize();
+                stats.texts++;
+                stats.codePoints += glyphs;
+                if (text.getOutlineThickness() != 0.0f) {
+                    submit(command.source, text.getFont(), text.getCharacterSize(), glyphs * 6);
+                }
+                submit(command.source, text.getFont(), text.getCharacterSize(), glyphs * 6);
+            } else if (command.type == CommandType::Shape) {
+                const sf::RectangleShape& shape = shapes[command.index];
+                submit(command.source, shape.getTexture(), 0, 6);
+                if (shape.getOutlineThickness() != 0.0f) submit(command.source, shape.getTexture(), 0, 10);
+            }
+        }
+        return stats;
+    }
+   
+    // Write the list as a capture, naming textures and fonts by their id in resources
+    bool save(const std::string& path, const ResourceManager& resources) const {
+        std::vector<CaptureData::Command> records;
+        std::vector<uint32_t> codePoints;
+        std::string stringTable;
+        auto intern = [&stringTable](const std::string* id) {
+            if (!id) return CaptureData::NO_RESOURCE;
+            size_t found = stringTable.find(*id + '\0');
+            if (found != std::string::npos && (found == 0 || stringTable[found - 1] == '\0')) {
+                return static_cast<uint32_t>(found);
+            }
+            uint32_t offset = static_cast<uint32_t>(stringTable.size());
+            stringTable.append(*id).push_back('\0');
+            return offset;
+        };
+       
+        records.reserve(commands.size());
+        for (const Command& command : commands) {
+            CaptureData::Command record = {};
+            record.source = command.source;
+            record.resource = CaptureData::NO_RESOURCE;
+            record.shader = CaptureData::NO_RESOURCE;
+            if (command.type == CommandType::Clear) {
+                record.kind = CaptureData::COMMAND_CLEAR;
+                record.color = command.color.toInteger();
+            } else if (command.type == CommandType::View) {
+                const sf::View& saved = views[command.index];
+                record.kind = CaptureData::COMMAND_VIEW;
+                const float values[9] = {
+                    saved.getCenter().x, saved.getCenter().y, saved.getSize().x, saved.getSize().y, saved.getRotation(),
+                    saved.getViewport().left, saved.getViewport().top, saved.getViewport().width, saved.getViewport().height
+                };
+                std::copy(values, values + 9, record.values);
+            } else if (command.type == CommandType::Vertices) {
+                const Batch& batch = batches[command.index];
+                record.kind = CaptureData::COMMAND_VERTICES;
+                record.primitive = static_cast<uint8_t>(batch.primitive);
+                record.blend = toBlend(batch.states.blendMode);
+                record.resource = intern(resources.findTextureId(batch.states.texture));
+                record.shader = intern(resources.findShaderId(batch.states.shader));
+                record.first = static_cast<uint32_t>(batch.first);
+                record.count = static_cast<uint32_t>(batch.count);
+                const float* matrix = batch.states.transform.getMatrix();
+                const float values[9] = {
+                    matrix[0], matrix[4], matrix[12], matrix[1], matrix[5], matrix[13], matrix[3], matrix[7], matrix[15]
+                };
+                std::copy(values, values + 9, record.values);
+            } else if (command.type == CommandType::Text) {
+                const sf::Text& text = texts[command.index];
+                std::basic_string<sf::Uint32> string = text.getString().toUtf32();
+                record.kind = CaptureData::COMMAND_TEXT;
+                record.resource = intern(resources.findFontId(text.getFont()));
+                record.first = static_cast<uint32_t>(codePoints.size());
+                record.count = static_cast<uint32_t>(string.size());
+                record.color = text.getFillColor().toInteger();
+                record.outlineColor = text.getOutlineColor().toInteger();
+                record.outlineThickness = text.getOutlineThickness();
+                record.characterSize = text.getCharacterSize();
+                record.style = text.getStyle();
+                storeTransformable(text, record.values);
+                codePoints.insert(codePoints.end(), string.begin(), string.end());
+            } else if (command.type == CommandType::Uniform) {
+                const Uniform& uniform = uniforms[command.index];
+                std::string name = uniform.name;
+                record.kind = CaptureData::COMMAND_UNIFORM;
+                record.shader = intern(resources.findShaderId(uniform.shader));
+                record.first = intern(&name);
+                record.count = static_cast<uint32_t>(uniform.components);
+                record.values[0] = uniform.value.x;
+                record.values[1] = uniform.value.y;
+                record.values[2] = uniform.value.z;
+            } else {
+                const sf::RectangleShape& shape = shapes[command.index];
+                record.kind = CaptureData::COMMAND_SHAPE;
+                record.resource = intern(resources.findTextureId(shape.getTexture()));
+                record.color = shape.getFillColor().toInteger();
+                record.outlineColor = shape.getOutlineColor().toInteger();
+                record.outlineThickness = shape.getOutlineThickness();
+                storeTransformable(shape, record.values);
+                record.values[7] = shape.getSize().x;
+                record.values[8] = shape.getSize().y;
+            }
+            records.push_back(record);
+        }
+       
+        std::vector<CaptureData::Vertex> vertexRecords(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            const sf::Vertex& vertex = vertices[i];
+            vertexRecords[i] = {vertex.position.x, vertex.position.y, vertex.texCoords.x, vertex.texCoords.y,
+                                vertex.color.toInteger()};
+        }
+       
+        CaptureData::Header h = {};
+        h.magic = CaptureData::MAGIC;
+        h.version = CaptureData::VERSION;
+        h.width = size.x;
+        h.height = size.y;
+        h.commandCount = static_cast<uint32_t>(records.size());
+        h.vertexCount = static_cast<uint32_t>(vertexRecords.size());
+        h.codePointCount = static_cast<uint32_t>(codePoints.size());
+        h.stringSize = static_cast<uint32_t>(stringTable.size());
+       
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Failed to write frame capture: " << path << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(CaptureData::Command));
+        out.write(reinterpret_cast<const char*>(vertexRecords.data()), vertexRecords.size() * sizeof(CaptureData::Vertex));
+        out.write(reinterpret_cast<const char*>(codePoints.data()), codePoints.size() * sizeof(uint32_t));
+        out.write(stringTable.data(), stringTable.size());
+        return static_cast<bool>(out);
+    }
+   
+    // Rebuild a saved list with the textures and fonts from resources. Ones that
+    // can't be found are left out, so the list still replays with the same calls.
+    bool load(const std::string& path, ResourceManager& resources) {
+        std::ifstream in(path, std::ios::binary);
+        CaptureData::Header h = {};
+        if (!in.read(reinterpret_cast<char*>(&h), sizeof(h)) || h.magic != CaptureData::MAGIC ||
+            h.version != CaptureData::VERSION) {
+            std::cerr << "Not a frame capture: " << path << std::endl;
+            return false;
+        }
+       
+        std::vector<CaptureData::Command> records(h.commandCount);
+        std::vector<CaptureData::Vertex> vertexRecords(h.vertexCount);
+        std::vector<uint32_t> codePoints(h.codePointCount);
+        std::string stringTable(h.stringSize, '\0');
+        in.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(CaptureData::Command));
+        in.read(reinterpret_cast<char*>(vertexRecords.data()), vertexRecords.size() * sizeof(CaptureData::Vertex));
+        in.read(reinterpret_cast<char*>(codePoints.data()), codePoints.size() * sizeof(uint32_t));
+        in.read(&stringTable[0], stringTable.size());
+        if (!in) {
+            std::cerr << "Truncated frame capture: " << path << std::endl;
+            return false;
+        }
+       
+        auto resourceId = [&stringTable](uint32_t offset) -> const char* {
+            return offset < stringTable.size() ? stringTable.c_str() + offset : nullptr;
+        };
+       
+        reset(sf::Vector2u(h.width, h.height));
+        vertices.resize(vertexRecords.size());
+        for (size_t i = 0; i < vertexRecords.size(); i++) {
+            const CaptureData::Vertex& record = vertexRecords[i];
+            vertices[i] = sf::Vertex(sf::Vector2f(record.x, record.y), sf::Color(record.color),
+                                     sf::Vector2f(record.u, record.v));
+        }
+       
+        for (const CaptureData::Command& record : records) {
+            source = record.source < SOURCE_COUNT ? static_cast<Source>(record.source) : SOURCE_OTHER;
+            const float* v = record.values;
+            if (record.kind == CaptureData::COMMAND_CLEAR) {
+                clear(sf::Color(record.color));
+            } else if (record.kind == CaptureData::COMMAND_VIEW) {
+                sf::View saved(sf::Vector2f(v[0], v[1]), sf::Vector2f(v[2], v[3]));
+                saved.setRotation(v[4]);
+                saved.setViewport(sf::FloatRect(v[5], v[6], v[7], v[8]));
+                setView(saved);
+            } else if (record.kind == CaptureData::COMMAND_VERTICES) {
+                if (static_cast<size_t>(record.first) + record.count > vertices.size()) return false;
+                const char* id = resourceId(record.resource);
+                const char* shaderId = resourceId(record.shader);
+                sf::RenderStates states(fromBlend(record.blend),
+                                        sf::Transform(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8]),
+                                        id ? &resources.getTexture(id) : nullptr,
+                                        shaderId ? resources.getShader(shaderId) : nullptr);
+                commands.push_back({CommandType::Vertices, source, static_cast<int>(batches.size()), sf::Color()});
+                batches.push_back({record.first, record.count, static_cast<sf::PrimitiveType>(record.primitive),
+                                   states, false});
+            } else if (record.kind == CaptureData::COMMAND_TEXT) {
+                if (static_cast<size_t>(record.first) + record.count > codePoints.size()) return false;
+                sf::Text text;
+                const char* id = resourceId(record.resource);
+                if (id) text.setFont(resources.getFont(id));
+                text.setString(sf::String(std::basic_string<sf::Uint32>(codePoints.begin() + record.first,
+                                                                        codePoints.begin() + record.first + record.count)));
+                text.setCharacterSize(record.characterSize);
+                text.setStyle(record.style);
+                text.setFillColor(sf::Color(record.color));
+                text.setOutlineColor(sf::Color(record.outlineColor));
+                text.setOutlineThickness(record.outlineThickness);
+                loadTransformable(text, v);
+                draw(text);
+            } else if (record.kind == CaptureData::COMMAND_SHAPE) {
+                sf::RectangleShape shape(sf::Vector2f(v[7], v[8]));
+                const char* id = resourceId(record.resource);
+                if (id) shape.setTexture(&resources.getTexture(id));
+                shape.setFillColor(sf::Color(record.color));
+                shape.setOutlineColor(sf::Color(record.outlineColor));
+                shape.setOutlineThickness(record.outlineThickness);
+                loadTransformable(shape, v);
+                draw(shape);
+            } else if (record.kind == CaptureData::COMMAND_UNIFORM) {
+                // Dropped when this machine has no such shader, like its vertices' shader
+                const char* shaderId = resourceId(record.shader);
+                const char* name = resourceId(record.first);
+                sf::Shader* shader = shaderId ? resources.getShader(shaderId) : nullptr;
+                if (!shader || !name) continue;
+                if (record.count == 3) {
+                    setUniform(*shader, GameUtils::intern(name), sf::Glsl::Vec3(v[0], v[1], v[2]));
+                } else {
+                    setUniform(*shader, GameUtils::intern(name), v[0]);
+                }
+            } else {
+                std::cerr << "Unknown command in frame capture: " << path << std::endl;
+                return false;
+            }
+        }
+        source = SOURCE_OTHER;
+        return true;
+    }
+   
+    // Lay every text out again, repeats times over, as a frame that changed them would
+    double timeTextLayout(int repeats) {
+        sf::Clock clock;
+        for (int r = 0; r < repeats; r++) {
+            for (size_t i = 0; i < textCount; i++) {
+                sf::String string = texts[i].getString();
+                texts[i].setString(sf::String());
+                texts[i].setString(string);
+                texts[i].getLocalBounds();
+            }
+        }
+        return clock.getElapsedTime().asSeconds() * 1000.0 / std::max(1, repeats);
+    }
+   
+private:
+    // Room for count more vertices, added to the last batch if nothing since would
+    // change how they draw. Batches don't span sources, so each is charged to one.
+    sf::Vertex* append(sf::PrimitiveType primitive, const sf::RenderStates& states, size_t count) {
+        bool mergeable = (primitive == sf::Quads || primitive == sf::Triangles || primitive == sf::Lines ||
+                          primitive == sf::Points) && isIdentity(states.transform);
+        Batch* last = !commands.empty() && commands.back().type == CommandType::Vertices &&
+                      commands.back().source == source ? &batches.back() : nullptr;
+        if (mergeable && last && last->mergeable && last->primitive == primitive &&
+            last->states.texture == states.texture && last->states.shader == states.shader &&
+            last->states.blendMode == states.blendMode) {
+            last->count += count;
+        } else {
+            commands.push_back({CommandType::Vertices, source, static_cast<int>(batches.size()), sf::Color()});
+            batches.push_back({vertices.size(), count, primitive, states, mergeable});
+        }
+        vertices.resize(vertices.size() + count);
+        return &vertices[vertices.size() - count];
+    }
+   
+    void move(sf::Vertex* first, size_t count) {
+        for (size_t i = 0; i < count; i++) first[i].position += offset;
+    }
+   
+    template <typename T>
+    static void keep(std::vector<T>& slots, size_t& count, const T& value) {
+        if (count < slots.size()) {
+            slots[count] = value;
+        } else {
+            slots.push_back(value);
+        }
+        count++;
+    }
+   
+    static bool isIdentity(const sf::Transform& transform) {
+        const float* matrix = transform.getMatrix();
+        const float* identity = sf::Transform::Identity.getMatrix();
+        return std::equal(matrix, matrix + 16, identity);
+    }
+   
+    static void storeTransformable(const sf::Transformable& object, float* values) {
+        values[0] = object.getPosition().x;
+        values[1] = object.getPosition().y;
+        values[2] = object.getOrigin().x;
+        values[3] = object.getOrigin().y;
+        values[4] = object.getScale().x;
+        values[5] = object.getScale().y;
+        values[6] = object.getRotation();
+    }
+   
+    static void loadTransformable(sf::Transformable& object, const float* values) {
+        object.setPosition(values[0], values[1]);
+        object.setOrigin(values[2], values[3]);
+        object.setScale(values[4], values[5]);
+        object.setRotation(values[6]);
+    }
+   
+    static uint8_t toBlend(const sf::BlendMode& mode) {
+        if (mode == sf::BlendAdd) return CaptureData::BLEND_ADD;
+        if (mode == sf::BlendMultiply) return CaptureData::BLEND_MULTIPLY;
+        if (mode == sf::BlendNone) return CaptureData::BLEND_NONE;
+        return CaptureData::BLEND_ALPHA;
+    }
+   
+    static sf::BlendMode fromBlend(uint8_t blend) {
+        if (blend == CaptureData::BLEND_ADD) return sf::BlendAdd;
+        if (blend == CaptureData::BLEND_MULTIPLY) return sf::BlendMultiply;
+        if (blend == CaptureData::BLEND_NONE) return sf::BlendNone;
+        return sf::BlendAlpha;
+    }
+};
+
+// Render Thread - owns the window's OpenGL context and draws the frames the game
+// records. Of the two draw lists, the game fills one while the other is drawn
+// and handed over by an atomic store, so a slow update overlaps the previous
+// frame's drawing and buffer swap instead of adding to it. The mutex and
+// condition variable only put a side to sleep when the other is behind.
+// Single-threaded, submit() draws the list on the spot.
+class RenderThread {
+private:
+    sf::RenderWindow& window;
+    bool threaded;
+    DrawList lists[2];
+    int writeIndex;               // The list the game records into
+    std::atomic<int> pending;     // The list handed over and not yet drawn, or -1
+    std::atomic<bool> running;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread thread;
+   
+    // Last frame, in microseconds
+    std::atomic<long long> drawMicros;  // Replay and buffer swap
+    std::atomic<long long> waitMicros;  // Game thread blocked in submit()
+   
+public:
+    RenderThread(sf::RenderWindow& window, bool threaded)
+        : window(window), threaded(threaded), writeIndex(0), pending(-1), running(false),
+          drawMicros(0), waitMicros(0) {}
+   
+    virtual ~RenderThread() {
+        stop();
+    }
+   
+    // Hand the window's context over to the render thread
+    void start() {
+        if (!threaded || running) return;
+        window.setActive(false);
+        running = true;
+        thread = std::thread([this]() { renderLoop(); });
+    }
+   
+    // Draw whatever is still queued and take the context back
+    void stop() {
+        if (!running) return;
+        finish();
+        running = false;
+        notify();
+        thread.join();
+        window.setActive(true);
+    }
+   
+    // Closing destroys the context, so the render thread lets go of it first
+    void close() {
+        stop();
+        window.close();
+    }
+   
+    // The list to record the next frame into
+    DrawList& begin() {
+        DrawList& list = lists[writeIndex];
+        list.reset(window.getSize());
+        return list;
+    }
+   
+    // Hand the recorded frame over; only waits while the previous one is still being drawn
+    void submit() {
+        sf::Clock clock;
+        if (!running) {
+            present(lists[writeIndex]);
+            drawMicros = clock.getElapsedTime().asMicroseconds();
+            waitMicros = 0;
+            return;
+        }
+       
+        finish();
+        waitMicros = clock.getElapsedTime().asMicroseconds();
+        pending.store(writeIndex, std::memory_order_release);
+        notify();
+        writeIndex ^= 1;
+    }
+   
+    // Block until the render thread is idle, e.g. before changing a texture it may be drawing
+    void finish() {
+        if (pending.load(std::memory_order_acquire) < 0) return;
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wake.wait(lock, [this]() { return pending.load(std::memory_order_acquire) < 0; });
+    }
+   
+    bool isThreaded() const { return running; }
+    long long getDrawMicros() const { return drawMicros; }
+    long long getWaitMicros() const { return waitMicros; }
+   
+protected:
+    virtual void present(const DrawList& list) {
+        list.replay(window);
+        window.display();
+    }
+   
+private:
+    // Taking the lock orders the store before a sleeper's check, so no wake-up is lost
+    void notify() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+        }
+        wake.notify_all();
+    }
+   
+    void renderLoop() {
+        window.setActive(true);
+        for (;;) {
+            int index;
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait(lock, [this]() { return pending.load(std::memory_order_acquire) >= 0 || !running; });
+                index = pending.load(std::memory_order_acquire);
+            }
+            if (index < 0) break;
+           
+            sf::Clock clock;
+            present(lists[index]);
+            drawMicros = clock.getElapsedTime().asMicroseconds();
+            pending.store(-1, std::memory_order_release);
+            notify();
+        }
+        window.setActive(false);
+    }
+};
+
+// Particle System - fixed-capacity pools stored as structure-of-arrays
+class ParticleSystem {
+public:
+    enum class EmitterType {
+        SpellTrail,
+        Hit,
+        Death,
+        Count
+    };
+
+private:
+    enum Batch { AlphaBatch, AdditiveBatch, BatchCount };
+
+    // One pool per emitter type. Live particles are packed into [0, count)
+    // so every update loop runs over contiguous floats with no branches.
+    struct Pool {
+        std::size_t capacity = 0;
+        std::size_t count = 0;
+        Batch batch = AlphaBatch;
+
+        // Emitter settings
+        sf::Color startColor;
+        sf::Color endColor;
+        float minSpeed = 0.0f;
+        float maxSpeed = 0.0f;
+        float minLife = 0.0f;
+        float maxLife = 0.0f;
+        float drag = 1.0f;      // Fraction of velocity kept per second
+        float gravity = 0.0f;
+        float size = 2.0f;
+
+        // Per-particle data
+        std::vector<float> posX, posY;
+        std::vector<float> velX, velY;
+        std::vector<float> life, invLifespan;
+        std::vector<float> fade;  // 0 at birth, 1 at death - drives the colour ramp
+    };
+
+    Pool pools[static_cast<int>(EmitterType::Count)];
+    std::vector<sf::Vertex> batches[BatchCount];
+
+public:
+    ParticleSystem() {
+        configurePool(EmitterType::SpellTrail, 40000, AdditiveBatch,
+                      sf::Color(255, 200, 80, 255), sf::Color(200, 40, 0, 0),
+                      5.0f, 30.0f, 0.2f, 0.5f, 0.2f, 0.0f, 3.0f);
+        configurePool(EmitterType::Hit, 30000, AdditiveBatch,
+                      sf::Color(255, 255, 180, 255), sf::Color(255, 60, 20, 0),
+                      60.0f, 160.0f, 0.15f, 0.35f, 0.05f, 0.0f, 2.0f);
+        configurePool(EmitterType::Death, 30000, AlphaBatch,
+                      sf::Color(160, 0, 0, 255), sf::Color(60, 0, 0, 0),
+                      20.0f, 90.0f, 0.5f, 1.2f, 0.1f, 120.0f, 3.0f);
+    }
+
+    // Spawn particles at a point, scattered around a base velocity.
+    // Particles that don't fit in the pool are dropped.
+    void emit(EmitterType type, float x, float y, int amount, float baseVelX = 0.0f, float baseVelY = 0.0f) {
+        Pool& pool = pools[static_cast<int>(type)];
+
+        for (int n = 0; n < amount && pool.count < pool.capacity; n++) {
+            std::size_t i = pool.count++;
+            float angle = GameUtils::getRandomFloat(0, 2 * 3.14159f);
+            float speed = GameUtils::getRandomFloat(pool.minSpeed, pool.maxSpeed);
+            float lifespan = GameUtils::getRandomFloat(pool.minLife, pool.maxLife);
+
+            pool.posX[i] = x;
+            pool.posY[i] = y;
+            pool.velX[i] = baseVelX + std::cos(angle) * speed;
+            pool.velY[i] = baseVelY + std::sin(angle) * speed;
+            pool.life[i] = lifespan;
+            pool.invLifespan[i] = 1.0f / lifespan;
+            pool.fade[i] = 0.0f;
+        }
+    }
+
+    void update(float deltaTime) {
+        for (auto& pool : pools) {
+            const std::size_t count = pool.count;
+            float* __restrict posX = pool.posX.data();
+            float* __restrict posY = pool.posY.data();
+            float* __restrict velX = pool.velX.data();
+            float* __restrict velY = pool.velY.data();
+            float* __restrict life = pool.life.data();
+            float* __restrict fade = pool.fade.data();
+            const float* __restrict invLifespan = pool.invLifespan.data();
+
+            const float damping = std::pow(pool.drag, deltaTime);
+            const float fall = pool.gravity * deltaTime;
+
+            // Integrate velocity and position
+            for (std::size_t i = 0; i < count; i++) {
+                velX[i] *= damping;
+                velY[i] = velY[i] * damping + fall;
+                posX[i] += velX[i] * deltaTime;
+                posY[i] += velY[i] * deltaTime;
+            }
+
+            // Age particles and advance the colour ramp
+            for (std::size_t i = 0; i < count; i++) {
+                life[i] -= deltaTime;
+                fade[i] = std::min(1.0f, 1.0f - life[i] * invLifespan[i]);
+            }
+
+            removeDead(pool);
+        }
+    }
+
+    // Fill one vertex batch per blend mode with a quad per live particle
+    void buildVertices() {
+        std::size_t batchSizes[BatchCount] = {0, 0};
+        for (const auto& pool : pools) {
+            batchSizes[pool.batch] += pool.count * 4;
+        }
+        for (int b = 0; b < BatchCount; b++) {
+            batches[b].resize(batchSizes[b]);
+        }
+
+        std::size_t offsets[BatchCount] = {0, 0};
+        for (const auto& pool : pools) {
+            sf::Vertex* quad = batches[pool.batch].data() + offsets[pool.batch];
+            offsets[pool.batch] += pool.count * 4;
+
+            const float half = pool.size / 2;
+            const float r0 = pool.startColor.r, dr = pool.endColor.r - r0;
+            const float g0 = pool.startColor.g, dg = pool.endColor.g - g0;
+            const float b0 = pool.startColor.b, db = pool.endColor.b - b0;
+            const float a0 = pool.startColor.a, da = pool.endColor.a - a0;
+
+            for (std::size_t i = 0; i < pool.count; i++, quad += 4) {
+                const float x = pool.posX[i];
+                const float y = pool.posY[i];
+                const float t = pool.fade[i];
+                const sf::Color color(static_cast<sf::Uint8>(r0 + dr * t),
+                                      static_cast<sf::Uint8>(g0 + dg * t),
+                                      static_cast<sf::Uint8>(b0 + db * t),
+                                      static_cast<sf::Uint8>(a0 + da * t));
+
+                quad[0].position = sf::Vector2f(x - half, y - half);
+                quad[1].position = sf::Vector2f(x + half, y - half);
+                quad[2].position = sf::Vector2f(x + half, y + half);
+                quad[3].position = sf::Vector2f(x - half, y + half);
+                quad[0].color = quad[1].color = quad[2].color = quad[3].color = color;
+            }
+        }
+    }
+
+    // One draw call per blend mode
+    void draw(DrawList& list) {
+        DrawList::Scope drawScope(list, DrawList::SOURCE_EFFECTS);
+        buildVertices();
+
+        if (!batches[AlphaBatch].empty()) {
+            list.draw(batches[AlphaBatch].data(), batches[AlphaBatch].size(), sf::Quads,
+                        sf::RenderStates(sf::BlendAlpha));
+        }
+        if (!batches[AdditiveBatch].empty()) {
+            list.draw(batches[AdditiveBatch].data(), batches[AdditiveBatch].size(), sf::Quads,
+                        sf::RenderStates(sf::BlendAdd));
+        }
+    }
+
+    void clear() {
+        for (auto& pool : pools) {
+            pool.count = 0;
+        }
+    }
+
+    std::size_t getLiveCount() const {
+        std::size_t total = 0;
+        for (const auto& pool : pools) {
+            total += pool.count;
+        }
+        return total;
+    }
+
+    std::size_t getCapacity(EmitterType type) const {
+        return pools[static_cast<int>(type)].capacity;
+    }
+
+private:
+    void configurePool(EmitterType type, std::size_t capacity, Batch batch,
+                       const sf::Color& startColor, const sf::Color& endColor,
+                       float minSpeed, float maxSpeed, float minLife, float maxLife,
+                       float drag, float gravity, float size) {
+        Pool& pool = pools[static_cast<int>(type)];
+        pool.capacity = capacity;
+        pool.count = 0;
+        pool.batch = batch;
+        pool.startColor = startColor;
+        pool.endColor = endColor;
+        pool.minSpeed = minSpeed;
+        pool.maxSpeed = maxSpeed;
+        pool.minLife = minLife;
+        pool.maxLife = maxLife;
+        pool.drag = drag;
+        pool.gravity = gravity;
+        pool.size = size;
+
+        // Allocate once up front; the pool never grows during play
+        pool.posX.assign(capacity, 0.0f);
+        pool.posY.assign(capacity, 0.0f);
+        pool.velX.assign(capacity, 0.0f);
+        pool.velY.assign(capacity, 0.0f);
+        pool.life.assign(capacity, 0.0f);
+        pool.invLifespan.assign(capacity, 0.0f);
+        pool.fade.assign(capacity, 0.0f);
+        // and its batch holds a quad for every particle it can have alive
+        batches[batch].reserve(batches[batch].capacity() + capacity * 4);
+    }
+
+    // Swap each dead particle with the last live one so the pool stays packed
+    void removeDead(Pool& pool) {
+        std::size_t i = 0;
+        while (i < pool.count) {
+            if (pool.life[i] > 0.0f) {
+                i++;
+                continue;
+            }
+
+            std::size_t last = --pool.count;
+            pool.posX[i] = pool.posX[last];
+            pool.posY[i] = pool.posY[last];
+            pool.velX[i] = pool.velX[last];
+            pool.velY[i] = pool.velY[last];
+            pool.life[i] = pool.life[last];
+            pool.invLifespan[i] = pool.invLifespan[last];
+            pool.fade[i] = pool.fade[last];
+        }
+    }
+};
+
+// Frame Profiler - per-section timings and counters for the debug overlay
+class FrameProfiler {
+private:
+    struct Section {
+        std::string name;
+        sf::Clock clock;
+        float frameMs = 0.0f;    // Accumulated this frame
+        float averageMs = 0.0f;  // Smoothed across frames
+    };
+   
+    struct Counter {
+        std::string name;
+        long long value = 0;
+    };
+   
+    std::vector<Section> sections;
+    std::vector<Counter> counters;
+    sf::Clock frameClock;
+    float averageFrameMs;
+    bool visible;
+    sf::Text overlayText;
+    sf::String overlayString;  // Kept, so handing the text over doesn't allocate
+   
+public:
+    FrameProfiler() : averageFrameMs(0.0f), visible(false) {
+        overlayText.setCharacterSize(12);
+        overlayText.setFillColor(sf::Color::Yellow);
+        overlayText.setOutlineColor(sf::Color::Black);
+        overlayText.setOutlineThickness(1);
+    }
+   
+    // Look up (or register) a timing section; keep the id instead of the name
+    int section(const std::string& name) {
+        for (size_t i = 0; i < sections.size(); i++) {
+            if (sections[i].name == name) return static_cast<int>(i);
+        }
+        sections.emplace_back();
+        sections.back().name = name;
+        return static_cast<int>(sections.size() - 1);
+    }
+   
+    int counter(const std::string& name) {
+        for (size_t i = 0; i < counters.size(); i++) {
+            if (counters[i].name == name) return static_cast<int>(i);
+        }
+        counters.push_back({name, 0});
+        return static_cast<int>(counters.size() - 1);
+    }
+   
+    void begin(int id) {
+        sections[id].clock.restart();
+    }
+   
+    void end(int id) {
+        sections[id].frameMs += sections[id].clock.getElapsedTime().asSeconds() * 1000.0f;
+    }
+   
+    void setCounter(int id, long long value) {
+        counters[id].value = value;
+    }
+   
+    // Fold this frame's timings into the running averages
+    void endFrame() {
+        float frameMs = frameClock.restart().asSeconds() * 1000.0f;
+        averageFrameMs = averageFrameMs * 0.95f + frameMs * 0.05f;
+       
+        for (auto& s : sections) {
+            s.averageMs = s.averageMs * 0.95f + s.frameMs * 0.05f;
+            s.frameMs = 0.0f;
+        }
+    }
+   
+    float getAverageMs(int id) const { return sections[id].averageMs; }
+    float getAverageFrameMs() const { return averageFrameMs; }
+   
+    void toggle() { visible = !visible; }
+    bool isVisible() const { return visible; }
+   
+    void draw(DrawList& list, const sf::Font& font) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_UI);
+        if (!visible) return;
+       
+        // Changes every frame, so the string is handed to SFML every frame while shown
+        TextBuilder text(1024);
+        text << "Frame: " << averageFrameMs << " ms ("
+             << (averageFrameMs > 0 ? 1000.0f / averageFrameMs : 0.0f) << " FPS)\n";
+        for (const auto& s : sections) {
+            text << s.name << ": " << s.averageMs << " ms\n";
+        }
+        for (const auto& c : counters) {
+            text << c.name << ": " << c.value << "\n";
+        }
+        MemoryTracker::appendOverlay(text);
+       
+        sf::View currentView = list.getView();
+        list.setView(list.getDefaultView());
+       
+        overlayText.setFont(font);
+        TextBuilder::copy(text.view(), overlayString);
+        overlayText.setString(overlayString);
+        overlayText.setPosition(10, 60);
+        list.draw(overlayText);
+       
+        list.setView(currentView);
+    }
+};
+
+// Frame pacer - how each frame ends. Gameplay renders every frame, held to the
+// display's refresh by vsync or to a frame cap by sleeping; menus and dialogs
+// draw once and then block until an event changes them. Sleeps wait for an
+// absolute deadline on a high-resolution timer, so a cap holds without spinning.
+// Wall time, CPU time and frames are kept per game state for comparison.
+class FramePacer {
+public:
+    enum class Mode {
+        Uncapped,    // Straight on to the next frame, as before pacing existed
+        Continuous,  // Every frame, at the refresh rate or the frame cap
+        OnDemand     // Only after something changed; otherwise wait for events
+    };
+   
+    struct Settings {
+        int frameCap;     // Frames per second while playing; 0 leaves it to vsync
+        bool uncapped;    // Uncapped in every state, to measure against
+        int idlePollMs;   // Waiting screens still wake this often (hot reload); 0 waits for input
+       
+        Settings() : frameCap(0), uncapped(false), idlePollMs(0) {}
+    };
+   
+    struct StateStats {
+        double wallSeconds = 0.0;
+        double cpuSeconds = 0.0;  // Whole process, so 100% is one core
+        long long frames = 0;
+    };
+   
+    static const int MAX_STATES = 8;
+   
+private:
+    using Clock = std::chrono::steady_clock;
+   
+    Settings settings;
+    Clock::time_point nextFrame;
+    StateStats stats[MAX_STATES];
+   
+    // Since the last account()
+    Clock::time_point periodStart;
+    double periodCpu;
+    long long periodFrames;
+   
+    // About a second's worth, for the overlay
+    Clock::time_point sampleStart;
+    double sampleCpu;
+    long long sampleFrames;
+    float recentFps;
+    float recentCpuPercent;
+   
+public:
+    explicit FramePacer(const Settings& settings = Settings())
+        : settings(settings), nextFrame(Clock::now()), periodStart(nextFrame), periodCpu(processCpuSeconds()),
+          periodFrames(0), sampleStart(nextFrame), sampleCpu(periodCpu), sampleFrames(0),
+          recentFps(0.0f), recentCpuPercent(0.0f) {}
+   
+    const Settings& getSettings() const { return settings; }
+   
+    // Vsync only when no cap is set, so the two don't fight
+    void apply(sf::RenderWindow& window) const {
+        window.setVerticalSyncEnabled(!settings.uncapped && settings.frameCap <= 0);
+    }
+   
+    Mode modeFor(bool staticScreen) const {
+        if (settings.uncapped) return Mode::Uncapped;
+        return staticScreen ? Mode::OnDemand : Mode::Continuous;
+    }
+   
+    // Block until the window has an event. With an idle poll interval, gives up
+    // and returns false once that passes, checking for input every 10 ms meanwhile.
+    bool waitForEvent(sf::RenderWindow& window, sf::Event& event) const {
+        if (settings.idlePollMs <= 0) return window.waitEvent(event);
+       
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(settings.idlePollMs);
+        while (!window.pollEvent(event)) {
+            Clock::time_point now = Clock::now();
+            if (now >= deadline) return false;
+            sleepUntil(std::min(deadline, now + std::chrono::milliseconds(10)));
+        }
+        return true;
+    }
+   
+    void frameRendered() {
+        periodFrames++;
+        sampleFrames++;
+    }
+   
+    // Sleep out the rest of a capped frame. A frame that ran long moves the
+    // schedule on rather than letting the next ones rush to catch up.
+    void endFrame(Mode mode) {
+        if (mode != Mode::Continuous || settings.frameCap <= 0) return;
+       
+        Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1.0 / settings.frameCap));
+        Clock::time_point now = Clock::now();
+        nextFrame += period;
+        if (nextFrame < now) {
+            nextFrame = now;
+        } else {
+            sleepUntil(nextFrame);
+        }
+    }
+   
+    // Charge the time and frames since the last call to a state
+    void account(int state) {
+        Clock::time_point now = Clock::now();
+        double cpu = processCpuSeconds();
+        if (state >= 0 && state < MAX_STATES) {
+            stats[state].wallSeconds += std::chrono::duration<double>(now - periodStart).count();
+            stats[state].cpuSeconds += cpu - periodCpu;
+            stats[state].frames += periodFrames;
+        }
+        periodStart = now;
+        periodCpu = cpu;
+        periodFrames = 0;
+       
+        double sampleSeconds = std::chrono::duration<double>(now - sampleStart).count();
+        if (sampleSeconds >= 1.0) {
+            recentFps = static_cast<float>(sampleFrames / sampleSeconds);
+            recentCpuPercent = static_cast<float>(100.0 * (cpu - sampleCpu) / sampleSeconds);
+            sampleStart = now;
+            sampleCpu = cpu;
+            sampleFrames = 0;
+        }
+    }
+   
+    const StateStats& getStats(int state) const { return stats[state]; }
+    float getRecentFps() const { return recentFps; }
+    float getRecentCpuPercent() const { return recentCpuPercent; }
+   
+    // Sleep until a deadline on the steady clock without spinning
+    static void sleepUntil(Clock::time_point deadline) {
+#if defined(__linux__)
+        // steady_clock is CLOCK_MONOTONIC here, so its epoch can be used as is
+        std::chrono::nanoseconds sinceEpoch = deadline.time_since_epoch();
+        timespec when;
+        when.tv_sec = static_cast<time_t>(sinceEpoch.count() / 1000000000);
+        when.tv_nsec = static_cast<long>(sinceEpoch.count() % 1000000000);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, nullptr) == EINTR) {}
+#elif defined(_WIN32)
+        // Sleep() rounds up to the 15.6 ms scheduler tick; a high-resolution
+        // waitable timer (Windows 10 1803 and later) wakes within a fraction of a ms
+        static HANDLE timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                                     TIMER_ALL_ACCESS);
+        Clock::duration remaining = deadline - Clock::now();
+        if (remaining <= Clock::duration::zero()) return;
+        if (timer) {
+            LARGE_INTEGER due;
+            due.QuadPart = -std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count() / 100;
+            if (SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) {
+                WaitForSingleObject(timer, INFINITE);
+                return;
+            }
+        }
+        std::this_thread::sleep_until(deadline);
+#else
+        std::this_thread::sleep_until(deadline);
+#endif
+    }
+   
+    // User plus system time of every thread in the process
+    static double processCpuSeconds() {
+#ifdef _WIN32
+        FILETIME created, exited, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0.0;
+        auto toSeconds = [](const FILETIME& time) {
+            return (static_cast<uint64_t>(time.dwHighDateTime) << 32 | time.dwLowDateTime) * 1.0e-7;
+        };
+        return toSeconds(kernel) + toSeconds(user);
+#else
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+               (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1.0e-6;
+#endif
+    }
+};
+
+// Isometric projection - the tile grid drawn as Diablo's 2:1 diamonds. World point
+// (x, y) lands at (x - y, (x + y) / 2) on screen, so a tile becomes a diamond twice
+// as wide as it is tall and keeps its area. The ground goes through a view turned
+// 45 degrees and squashed to half height, which is the same mapping done by the
+// view: cached meshes draw unchanged and mapPixelToCoords through it gives world
+// positions. What stands up is drawn unturned at its projected feet in the upright
+// view, which shows the same screen space one to one.
+class IsoProjection {
+public:
+    static constexpr float SQRT2 = 1.41421356f;
+    static constexpr float WALL_HEIGHT = TILE_SIZE * 2.5f;  // A wall's face above its diamond
+    static constexpr float STAND_LIFT = TILE_SIZE / 2.0f;   // Sprites are centred this far above their feet
+   
+    static sf::Vector2f project(sf::Vector2f world) {
+        return sf::Vector2f(world.x - world.y, (world.x + world.y) * 0.5f);
+    }
+   
+    static sf::Vector2f unproject(sf::Vector2f screen) {
+        return sf::Vector2f(screen.y + screen.x * 0.5f, screen.y - screen.x * 0.5f);
+    }
+   
+    // How far something drawn in world space moves to lie flat at its point on screen
+    static sf::Vector2f lyingOffset(sf::Vector2f point) {
+        return project(point) - point;
+    }
+   
+    // How far something drawn in world space at its feet moves to stand there on screen
+    static sf::Vector2f standingOffset(sf::Vector2f feet) {
+        return lyingOffset(feet) - sf::Vector2f(0.0f, STAND_LIFT);
+    }
+   
+    // Undo standingOffset: the world point under a screen point on something standing at feet
+    static sf::Vector2f pick(sf::Vector2f screen, sf::Vector2f feet) {
+        return screen - standingOffset(feet);
+    }
+   
+    // The ground view for a world-space camera
+    static sf::View groundView(const sf::View& camera) {
+        sf::View view(camera.getCenter(), sf::Vector2f(camera.getSize().x / SQRT2, camera.getSize().y * SQRT2));
+        view.setRotation(-45.0f);
+        return view;
+    }
+   
+    // The upright view for a world-space camera; it puts the camera's centre where the ground view does
+    static sf::View uprightView(const sf::View& camera) {
+        return sf::View(project(camera.getCenter()), camera.getSize());
+    }
+   
+    static sf::FloatRect screenRect(const sf::View& upright) {
+        sf::Vector2f size = upright.getSize();
+        return sf::FloatRect(upright.getCenter() - size / 2.0f, size);
+    }
+   
+    // Whether any tile of a block may show on a screen rectangle. Conservative:
+    // the block's extremes are tested against each screen edge on its own.
+    static bool sees(const sf::FloatRect& screen, int startX, int startY, int endX, int endY) {
+        float left = static_cast<float>(startX * TILE_SIZE);
+        float top = static_cast<float>(startY * TILE_SIZE);
+        float right = static_cast<float>(endX * TILE_SIZE);
+        float bottom = static_cast<float>(endY * TILE_SIZE);
+        return right - top >= screen.left && left - bottom <= screen.left + screen.width &&
+               (right + bottom) * 0.5f >= screen.top && (left + top) * 0.5f <= screen.top + screen.height;
+    }
+   
+    // The world x range of a band of world rows [top, bottom] that a screen rectangle shows
+    static void bandSpan(const sf::FloatRect& screen, float top, float bottom, float& left, float& right) {
+        left = std::max(screen.left + top, screen.top * 2.0f - bottom);
+        right = std::min(screen.left + screen.width + bottom, (screen.top + screen.height) * 2.0f - top);
+    }
+   
+    // The columns of tile row y that may show on a screen rectangle, unclamped
+    static void rowSpan(const sf::FloatRect& screen, int y, int& startX, int& endX) {
+        float left, right;
+        bandSpan(screen, static_cast<float>(y * TILE_SIZE), static_cast<float>((y + 1) * TILE_SIZE), left, right);
+        startX = static_cast<int>(std::ceil((left - TILE_SIZE) / TILE_SIZE));
+        endX = static_cast<int>(std::floor(right / TILE_SIZE)) + 1;
+    }
+};
+
+// Depth buckets - back-to-front order for what stands on an isometric floor. Each
+// thing is filed under its whole screen row and the rows are read top down: a
+// counting sort, two passes over the things and one over the rows, with no
+// comparisons. Things on one row keep the order they were added in.
+class DepthBuckets {
+private:
+    std::vector<int> starts;  // Things per row, then where each row begins in sorted
+    std::vector<int> rows;
+    std::vector<uint32_t> handles;
+    std::vector<uint32_t> sorted;
+   
+public:
+    // Empty, for rows [0, rowCount)
+    void reset(int rowCount) {
+        starts.assign(static_cast<size_t>(std::max(rowCount, 1)) + 1, 0);
+        rows.clear();
+        handles.clear();
+    }
+   
+    // Rows outside the range are filed at its nearest end
+    void add(int row, uint32_t handle) {
+        row = std::clamp(row, 0, static_cast<int>(starts.size()) - 2);
+        rows.push_back(row);
+        handles.push_back(handle);
+        starts[row + 1]++;
+    }
+   
+    // Every handle added since reset, back to front
+    const std::vector<uint32_t>& sort() {
+        for (size_t r = 1; r < starts.size(); r++) starts[r] += starts[r - 1];
+        sorted.resize(handles.size());
+        for (size_t i = 0; i < handles.size(); i++) sorted[starts[rows[i]]++] = handles[i];
+        return sorted;
+    }
+   
+    int getCount() const { return static_cast<int>(handles.size()); }
+    int getRowCount() const { return static_cast<int>(starts.size()) - 1; }
+};
+
+// Light Map - one light cell per tile, occluded by walls and composited multiplicatively.
+// Each light caches its footprint and the map caches accumulated light per region, so
+// only lights that moved to another tile (or saw a wall change) are recomputed.
+class LightMap {
+private:
+    static const int REGION_SIZE = 8;  // Tiles per side of a cached region
+   
+    struct Light {
+        bool active = false;
+        bool queued = false;
+        bool hasFootprint = false;
+        float x = 0.0f, y = 0.0f;      // World position
+        float radius = 0.0f;           // In tiles
+        float red = 0.0f, green = 0.0f, blue = 0.0f;
+        int tileX = 0, tileY = 0;      // Tile the cached footprint was computed from
+        int reach = 0;                 // Footprint half-size in tiles
+        std::vector<float> contribution;  // RGB per footprint cell
+    };
+   
+    int width;
+    int height;
+    int regionsX;
+    int regionsY;
+    std::vector<unsigned char> opaque;
+    std::vector<float> lightR, lightG, lightB;
+    std::vector<unsigned char> regionDirty;
+   
+    std::vector<Light> lights;
+    std::vector<int> freeLights;
+    std::vector<int> dirtyQueue;
+    size_t activeLights;
+   
+    sf::Color ambient;
+    size_t maxLights;
+    int maxUpdatesPerFrame;
+   
+    // Scratch buffers reused every frame
+    std::vector<sf::Color> cornerColors;
+    std::vector<int> rowSpans;
+    std::vector<sf::Vertex> vertices;
+   
+    // Stats from the last update
+    int lastLightUpdates;
+    int lastRegionUpdates;
+   
+public:
+    LightMap()
+        : width(0), height(0), regionsX(0), regionsY(0), activeLights(0),
+          ambient(40, 40, 60), maxLights(512), maxUpdatesPerFrame(24),
+          lastLightUpdates(0), lastRegionUpdates(0) {}
+   
+    // Drop all lights and size the map for a new level
+    void reset(int newWidth, int newHeight) {
+        width = newWidth;
+        height = newHeight;
+        regionsX = (width + REGION_SIZE - 1) / REGION_SIZE;
+        regionsY = (height + REGION_SIZE - 1) / REGION_SIZE;
+       
+        opaque.assign(width * height, 0);
+        lightR.assign(width * height, 0.0f);
+        lightG.assign(width * height, 0.0f);
+        lightB.assign(width * height, 0.0f);
+        regionDirty.assign(regionsX * regionsY, 1);
+       
+        lights.clear();
+        freeLights.clear();
+        dirtyQueue.clear();
+        activeLights = 0;
+    }
+   
+    void setAmbient(const sf::Color& color) {
+        ambient = color;
+        std::fill(regionDirty.begin(), regionDirty.end(), 1);
+    }
+   
+    // Limits that keep lighting inside a fixed frame budget
+    void setLimits(size_t lightLimit, int updatesPerFrame) {
+        maxLights = lightLimit;
+        maxUpdatesPerFrame = updatesPerFrame;
+    }
+   
+    // Mark a tile as blocking light or not; lights that can reach it are recomputed
+    void setOpaque(int x, int y, bool blocks) {
+        if (x < 0 || x >= width || y < 0 || y >= height) return;
+        unsigned char value = blocks ? 1 : 0;
+        if (opaque[y * width + x] == value) return;
+        opaque[y * width + x] = value;
+       
+        for (size_t i = 0; i < lights.size(); i++) {
+            const Light& light = lights[i];
+            if (light.active &&
+                std::abs(light.tileX - x) <= light.reach &&
+                std::abs(light.tileY - y) <= light.reach) {
+                markLightDirty(static_cast<int>(i));
+            }
+        }
+    }
+   
+    // Returns a light id, or -1 when the light limit is reached
+    int addLight(float x, float y, float radius, const sf::Color& color, float intensity = 1.0f) {
+        if (activeLights >= maxLights) return -1;
+       
+        int id;
+        if (!freeLights.empty()) {
+            id = freeLights.back();
+            freeLights.pop_back();
+        } else {
+            id = static_cast<int>(lights.size());
+            lights.emplace_back();
+        }
+       
+        Light& light = lights[id];
+        light.active = true;
+        light.hasFootprint = false;
+        light.x = x;
+        light.y = y;
+        light.radius = radius;
+        light.red = color.r / 255.0f * intensity;
+        light.green = color.g / 255.0f * intensity;
+        light.blue = color.b / 255.0f * intensity;
+        light.tileX = static_cast<int>(x) / TILE_SIZE;
+        light.tileY = static_cast<int>(y) / TILE_SIZE;
+        activeLights++;
+       
+        markLightDirty(id);
+        return id;
+    }
+   
+    // Only a move to a different tile invalidates the cached footprint
+    void moveLight(int id, float x, float y) {
+        if (id < 0 || id >= static_cast<int>(lights.size()) || !lights[id].active) return;
+       
+        Light& light = lights[id];
+        light.x = x;
+        light.y = y;
+       
+        int tileX = static_cast<int>(x) / TILE_SIZE;
+        int tileY = static_cast<int>(y) / TILE_SIZE;
+        if (tileX != light.tileX || tileY != light.tileY) {
+            markLightDirty(id);
+        }
+    }
+   
+    void removeLight(int id) {
+        if (id < 0 || id >= static_cast<int>(lights.size()) || !lights[id].active) return;
+       
+        Light& light = lights[id];
+        if (light.hasFootprint) {
+            markFootprintDirty(light);
+        }
+        light.active = false;
+        light.hasFootprint = false;
+        activeLights--;
+        freeLights.push_back(id);
+    }
+   
+    // Recompute dirty lights (up to the per-frame budget), then re-accumulate dirty regions
+    void update() {
+        lastLightUpdates = 0;
+        lastRegionUpdates = 0;
+       
+        size_t processed = 0;
+        while (processed < dirtyQueue.size() && lastLightUpdates < maxUpdatesPerFrame) {
+            Light& light = lights[dirtyQueue[processed++]];
+            light.queued = false;
+            if (!light.active) continue;
+           
+            if (light.hasFootprint) {
+                markFootprintDirty(light);
+            }
+            light.tileX = static_cast<int>(light.x) / TILE_SIZE;
+            light.tileY = static_cast<int>(light.y) / TILE_SIZE;
+            computeFootprint(light);
+            markFootprintDirty(light);
+            lastLightUpdates++;
+        }
+        // Lights over budget wait for the next frame
+        dirtyQueue.erase(dirtyQueue.begin(), dirtyQueue.begin() + processed);
+       
+        for (int ry = 0; ry < regionsY; ry++) {
+            for (int rx = 0; rx < regionsX; rx++) {
+                if (regionDirty[ry * regionsX + rx]) {
+                    accumulateRegion(rx, ry);
+                    regionDirty[ry * regionsX + rx] = 0;
+                    lastRegionUpdates++;
+                }
+            }
+        }
+    }
+   
+    // Multiply the visible part of the light buffer over the world. Given the
+    // screen rectangle of an isometric view, each row is trimmed to the tiles
+    // whose diamonds reach it.
+    void draw(DrawList& list, const sf::FloatRect* screen = nullptr) {
+        if (width == 0 || height == 0) return;
+        DrawList::Scope drawScope(list, DrawList::SOURCE_EFFECTS);
+       
+        sf::FloatRect viewBounds = GameUtils::viewBounds(list.getView());
+        int startX = std::max(0, static_cast<int>(viewBounds.left) / TILE_SIZE);
+        int startY = std::max(0, static_cast<int>(viewBounds.top) / TILE_SIZE);
+        int endX = std::min(width, static_cast<int>(viewBounds.left + viewBounds.width) / TILE_SIZE + 1);
+        int endY = std::min(height, static_cast<int>(viewBounds.top + viewBounds.height) / TILE_SIZE + 1);
+        if (startX >= endX || startY >= endY) return;
+       
+        // Columns [first, last) of each row
+        rowSpans.resize((endY - startY) * 2);
+        size_t quadCount = 0;
+        for (int y = startY; y < endY; y++) {
+            int first = startX;
+            int last = endX;
+            if (screen) {
+                IsoProjection::rowSpan(*screen, y, first, last);
+                first = std::clamp(first, startX, endX);
+                last = std::clamp(last, first, endX);
+            }
+            rowSpans[(y - startY) * 2] = first;
+            rowSpans[(y - startY) * 2 + 1] = last;
+            quadCount += last - first;
+        }
+       
+        // Light at each tile corner is the average of the tiles around it,
+        // so vertex colour interpolation gives smooth gradients. Only corners
+        // of the rows' spans are needed.
+        int cornersX = endX - startX + 1;
+        int cornersY = endY - startY + 1;
+        cornerColors.resize(cornersX * cornersY);
+        for (int cy = 0; cy < cornersY; cy++) {
+            int above = std::max(cy - 1, 0);
+            int below = std::min(cy, cornersY - 2);
+            int first = std::min(rowSpans[above * 2], rowSpans[below * 2]) - startX;
+            int last = std::max(rowSpans[above * 2 + 1], rowSpans[below * 2 + 1]) - startX;
+            for (int cx = first; cx <= last; cx++) {
+                cornerColors[cy * cornersX + cx] = cornerLight(startX + cx, startY + cy);
+            }
+        }
+       
+        vertices.resize(quadCount * 4);
+        sf::Vertex* quad = vertices.data();
+        for (int y = startY; y < endY; y++) {
+            for (int x = rowSpans[(y - startY) * 2]; x < rowSpans[(y - startY) * 2 + 1]; x++, quad += 4) {
+                int cx = x - startX;
+                int cy = y - startY;
+                float left = static_cast<float>(x * TILE_SIZE);
+                float top = static_cast<float>(y * TILE_SIZE);
+               
+                quad[0].position = sf::Vector2f(left, top);
+                quad[1].position = sf::Vector2f(left + TILE_SIZE, top);
+                quad[2].position = sf::Vector2f(left + TILE_SIZE, top + TILE_SIZE);
+                quad[3].position = sf::Vector2f(left, top + TILE_SIZE);
+                quad[0].color = cornerColors[cy * cornersX + cx];
+                quad[1].color = cornerColors[cy * cornersX + cx + 1];
+                quad[2].color = cornerColors[(cy + 1) * cornersX + cx + 1];
+                quad[3].color = cornerColors[(cy + 1) * cornersX + cx];
+            }
+        }
+       
+        list.draw(vertices.data(), vertices.size(), sf::Quads, sf::RenderStates(sf::BlendMultiply));
+    }
+   
+    // The light on the tile under a world point, for what is drawn after the
+    // multiply pass. Points off the map take the ambient light.
+    sf::Color lightAt(sf::Vector2f point) const {
+        int x = static_cast<int>(std::floor(point.x / TILE_SIZE));
+        int y = static_cast<int>(std::floor(point.y / TILE_SIZE));
+        if (x < 0 || x >= width || y < 0 || y >= height) return ambient;
+        auto toByte = [](float v) { return static_cast<sf::Uint8>(std::min(255.0f, v * 255.0f)); };
+        int cell = y * width + x;
+        return sf::Color(toByte(lightR[cell]), toByte(lightG[cell]), toByte(lightB[cell]));
+    }
+   
+    // The light at a tile corner, the average of the tiles around it, as the
+    // multiply pass colours its vertex there
+    sf::Color cornerLight(int cx, int cy) const {
+        float r = 0.0f, g = 0.0f, b = 0.0f;
+        int samples = 0;
+        for (int y = cy - 1; y <= cy; y++) {
+            for (int x = cx - 1; x <= cx; x++) {
+                if (x < 0 || x >= width || y < 0 || y >= height) continue;
+                r += lightR[y * width + x];
+                g += lightG[y * width + x];
+                b += lightB[y * width + x];
+                samples++;
+            }
+        }
+        if (samples == 0) return ambient;
+       
+        auto toByte = [samples](float v) {
+            return static_cast<sf::Uint8>(std::min(255.0f, v / samples * 255.0f));
+        };
+        return sf::Color(toByte(r), toByte(g), toByte(b));
+    }
+   
+    size_t getLightCount() const { return activeLights; }
+    int getLastLightUpdates() const { return lastLightUpdates; }
+    int getLastRegionUpdates() const { return lastRegionUpdates; }
+   
+private:
+    void markLightDirty(int id) {
+        if (!lights[id].queued) {
+            lights[id].queued = true;
+            dirtyQueue.push_back(id);
+        }
+    }
+   
+    void markFootprintDirty(const Light& light) {
+        int rx0 = std::max(0, (light.tileX - light.reach) / REGION_SIZE);
+        int ry0 = std::max(0, (light.tileY - light.reach) / REGION_SIZE);
+        int rx1 = std::min(regionsX - 1, (light.tileX + light.reach) / REGION_SIZE);
+        int ry1 = std::min(regionsY - 1, (light.tileY + light.reach) / REGION_SIZE);
+        for (int ry = ry0; ry <= ry1; ry++) {
+            for (int rx = rx0; rx <= rx1; rx++) {
+                regionDirty[ry * regionsX + rx] = 1;
+            }
+        }
+    }
+   
+    // Walk the tile line between two cells; walls strictly between them block light
+    bool isVisible(int x0, int y0, int x1, int y1) const {
+        int dx = std::abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+        int dy = -std::abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+        int err = dx + dy;
+        int x = x0, y = y0;
+       
+        while (true) {
+            int e2 = 2 * err;
+            if (e2 >= dy) { err += dy; x += sx; }
+            if (e2 <= dx) { err += dx; y += sy; }
+            if (x == x1 && y == y1) return true;
+            if (opaque[y * width + x]) return false;
+        }
+    }
+   
+    void computeFootprint(Light& light) {
+        light.reach = static_cast<int>(std::ceil(light.radius));
+        int size = light.reach * 2 + 1;
+        light.contribution.assign(size * size * 3, 0.0f);
+        light.hasFootprint = true;
+       
+        float lightX = light.x / TILE_SIZE;
+        float lightY = light.y / TILE_SIZE;
+       
+        for (int dy = -light.reach; dy <= light.reach; dy++) {
+            for (int dx = -light.reach; dx <= light.reach; dx++) {
+                int tx = light.tileX + dx;
+                int ty = light.tileY + dy;
+                if (tx < 0 || tx >= width || ty < 0 || ty >= height) continue;
+               
+                float distX = tx + 0.5f - lightX;
+                float distY = ty + 0.5f - lightY;
+                float dist = std::sqrt(distX * distX + distY * distY);
+                if (dist >= light.radius) continue;
+                if ((dx != 0 || dy != 0) && !isVisible(light.tileX, light.tileY, tx, ty)) continue;
+               
+                float falloff = 1.0f - dist / light.radius;
+                falloff *= falloff;
+               
+                float* cell = &light.contribution[((dy + light.reach) * size + (dx + light.reach)) * 3];
+                cell[0] = light.red * falloff;
+                cell[1] = light.green * falloff;
+                cell[2] = light.blue * falloff;
+            }
+        }
+    }
+   
+    void accumulateRegion(int rx, int ry) {
+        int x0 = rx * REGION_SIZE, x1 = std::min(width, x0 + REGION_SIZE);
+        int y0 = ry * REGION_SIZE, y1 = std::min(height, y0 + REGION_SIZE);
+       
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                lightR[y * width + x] = ambient.r / 255.0f;
+                lightG[y * width + x] = ambient.g / 255.0f;
+                lightB[y * width + x] = ambient.b / 255.0f;
+            }
+        }
+       
+        for (const auto& light : lights) {
+            if (!light.active || !light.hasFootprint) continue;
+           
+            int lx0 = std::max(x0, light.tileX - light.reach);
+            int ly0 = std::max(y0, light.tileY - light.reach);
+            int lx1 = std::min(x1, light.tileX + light.reach + 1);
+            int ly1 = std::min(y1, light.tileY + light.reach + 1);
+            if (lx0 >= lx1 || ly0 >= ly1) continue;
+           
+            int size = light.reach * 2 + 1;
+            for (int y = ly0; y < ly1; y++) {
+                const float* cell = &light.contribution[
+                    ((y - light.tileY + light.reach) * size + (lx0 - light.tileX + light.reach)) * 3];
+                for (int x = lx0; x < lx1; x++, cell += 3) {
+                    lightR[y * width + x] += cell[0];
+                    lightG[y * width + x] += cell[1];
+                    lightB[y * width + x] += cell[2];
+                }
+            }
+        }
+    }
+};
+
+// Timer wheel - hierarchical timing wheel on a fixed 10 ms tick. Four levels of 64
+// slots: a timer is filed in the level that matches how far away it is due and
+// drops a level each time the level above turns over. Scheduling and cancelling
+// are O(1) list splices, and a tick only touches the slot that comes due, so
+// thousands of idle timers cost nothing per frame.
+class TimerWheel {
+public:
+    // Slot index in the low half, generation in the high half; 0 is never a live timer
+    typedef uint64_t Handle;
+   
+    // A timer that came due. Kind 0 timers expire silently and are never reported.
+    struct Expired {
+        Handle handle;
+        uint16_t kind;
+        uint16_t data;
+        void* owner;
+    };
+   
+    static constexpr float TICK_SECONDS = 0.01f;
+   
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const uint32_t NONE = 0xFFFFFFFFu;
+   
+    struct Timer {
+        uint64_t due;          // Absolute tick
+        uint32_t generation;   // Bumped on release so stale handles stop matching
+        uint32_t bucket;       // level * SLOTS + slot, NONE when free
+        uint32_t prev, next;   // Neighbours in the bucket; next doubles as the free list link
+        uint16_t kind;
+        uint16_t data;
+        void* owner;
+    };
+   
+    std::vector<Timer> timers;
+    uint32_t buckets[LEVELS * SLOTS];
+    uint32_t freeList;
+    uint64_t now;
+    float accumulator;
+    size_t activeCount;
+    uint64_t expiredCount;
+    std::vector<Expired> expired;
+   
+public:
+    TimerWheel() : freeList(NONE), now(0), accumulator(0.0f), activeCount(0), expiredCount(0) {
+        std::fill(std::begin(buckets), std::end(buckets), NONE);
+        expired.reserve(256);  // A busy frame's worth, so reporting them doesn't allocate
+    }
+   
+    // Fire after at least delay seconds, rounded up to whole ticks
+    Handle schedule(float delay, uint16_t kind = 0, void* owner = nullptr, uint16_t data = 0) {
+        return scheduleTicks(static_cast<uint64_t>(std::ceil(delay / TICK_SECONDS)), kind, owner, data);
+    }
+   
+    Handle scheduleTicks(uint64_t ticks, uint16_t kind = 0, void* owner = nullptr, uint16_t data = 0) {
+        uint32_t index = freeList;
+        if (index != NONE) {
+            freeList = timers[index].next;
+        } else {
+            index = static_cast<uint32_t>(timers.size());
+            timers.push_back(Timer());
+            timers.back().generation = 1;
+        }
+       
+        Timer& timer = timers[index];
+        timer.due = now + std::max<uint64_t>(1, ticks);
+        timer.kind = kind;
+        timer.data = data;
+        timer.owner = owner;
+        file(index);
+        activeCount++;
+        return (static_cast<Handle>(timer.generation) << 32) | index;
+    }
+   
+    // Cancel a pending timer and clear the handle; stale or empty handles are ignored
+    bool cancel(Handle& handle) {
+        bool pending = isPending(handle);
+        if (pending) {
+            uint32_t index = static_cast<uint32_t>(handle);
+            unlink(index);
+            release(index);
+        }
+        handle = 0;
+        return pending;
+    }
+   
+    bool isPending(Handle handle) const {
+        uint32_t index = static_cast<uint32_t>(handle);
+        return index < timers.size() && timers[index].generation == static_cast<uint32_t>(handle >> 32) &&
+               timers[index].bucket != NONE;
+    }
+   
+    float remaining(Handle handle) const {
+        if (!isPending(handle)) return 0.0f;
+        uint64_t ticks = timers[static_cast<uint32_t>(handle)].due - now;
+        return std::max(0.0f, ticks * TICK_SECONDS - accumulator);
+    }
+   
+    // Run every whole tick in the elapsed time. Due timers are released before they
+    // are reported, so handlers may schedule and cancel freely.
+    void advance(float seconds) {
+        accumulator += seconds;
+        uint64_t ticks = static_cast<uint64_t>(accumulator / TICK_SECONDS);
+        accumulator = std::max(0.0f, accumulator - ticks * TICK_SECONDS);
+        advanceTicks(ticks);
+    }
+   
+    void advanceTicks(uint64_t ticks) {
+        expired.clear();
+        while (ticks-- > 0) tick();
+    }
+   
+    const std::vector<Expired>& getExpired() const { return expired; }
+    size_t getActiveCount() const { return activeCount; }
+    uint64_t getExpiredCount() const { return expiredCount; }
+    uint64_t getTick() const { return now; }
+   
+    // Seconds of game time the wheel has been advanced through
+    double getTime() const { return now * static_cast<double>(TICK_SECONDS) + accumulator; }
+   
+private:
+    void tick() {
+        now++;
+       
+        // Higher levels turn over first so their timers can fall through to level 0
+        for (int level = LEVELS - 1; level > 0; level--) {
+            if ((now & ((1ull << (SLOT_BITS * level)) - 1)) == 0) {
+                cascade(level * SLOTS + static_cast<uint32_t>((now >> (SLOT_BITS * level)) & (SLOTS - 1)));
+            }
+        }
+       
+        uint32_t bucket = static_cast<uint32_t>(now & (SLOTS - 1));
+        uint32_t index = buckets[bucket];
+        buckets[bucket] = NONE;
+        while (index != NONE) {
+            Timer& timer = timers[index];
+            uint32_t next = timer.next;
+            if (timer.kind != 0) {
+                expired.push_back({(static_cast<Handle>(timer.generation) << 32) | index,
+                                   timer.kind, timer.data, timer.owner});
+            }
+            release(index);
+            expiredCount++;
+            index = next;
+        }
+    }
+   
+    // Refile everything in a bucket; it lands in a lower level unless it is further
+    // out than the top level spans, in which case it goes round again
+    void cascade(uint32_t bucket) {
+        uint32_t index = buckets[bucket];
+        buckets[bucket] = NONE;
+        while (index != NONE) {
+            uint32_t next = timers[index].next;
+            file(index);
+            index = next;
+        }
+    }
+   
+    // The level is the highest 6-bit group in which the due tick differs from now
+    void file(uint32_t index) {
+        Timer& timer = timers[index];
+        uint64_t distance = timer.due ^ now;
+        int level = 0;
+        while (level < LEVELS - 1 && distance >= (1ull << (SLOT_BITS * (level + 1)))) level++;
+       
+        uint32_t bucket = level * SLOTS + static_cast<uint32_t>((timer.due >> (SLOT_BITS * level)) & (SLOTS - 1));
+        timer.bucket = bucket;
+        timer.prev = NONE;
+        timer.next = buckets[bucket];
+        if (timer.next != NONE) timers[timer.next].prev = index;
+        buckets[bucket] = index;
+    }
+   
+    void unlink(uint32_t index) {
+        Timer& timer = timers[index];
+        if (timer.prev != NONE) timers[timer.prev].next = timer.next;
+        else buckets[timer.bucket] = timer.next;
+        if (timer.next != NONE) timers[timer.next].prev = timer.prev;
+    }
+   
+    void release(uint32_t index) {
+        Timer& timer = timers[index];
+        timer.bucket = NONE;
+        timer.generation++;
+        timer.owner = nullptr;
+        timer.next = freeList;
+        freeList = index;
+        activeCount--;
+    }
+};
+
+// Timer kinds used by the game; the kind says what the owner pointer is
+enum TimerKind : uint16_t {
+    TIMER_SILENT = 0,         // Cooldowns and lifetimes that are only polled
+    TIMER_FLASH = 1,          // Character: end of the damage flash
+    TIMER_EFFECT_EXPIRE = 2,  // Character: status effect wears off, data = EffectId
+    TIMER_EFFECT_TICK = 3     // Character: periodic status effect tick, data = EffectId
+};
+
+// Animator - every playing sprite animation in parallel arrays, advanced in one
+// pass a frame. Clips and frame rects are the tables baked into the archetype
+// data, so playing a clip is an index lookup and a tick never touches a string
+// or a texture. Owners take the new rect only when they are drawn.
+class Animator {
+public:
+    static const int NONE = -1;
+   
+    struct Event {
+        Character* owner;
+        GameData::AnimationEvent event;
+    };
+   
+private:
+    const ArchetypeTable& table;    // ResourceManager's, which stays put across hot reloads
+    std::vector<uint16_t> sets;
+    std::vector<uint16_t> clips;    // Index into the clip table
+    std::vector<uint16_t> frames;   // Frame within the clip
+    std::vector<float> remaining;   // Seconds left of the current frame; huge for a free slot
+    std::vector<uint8_t> changed;   // Frame moved since the owner last took it
+    std::vector<Character*> owners; // Null for a free slot
+    std::vector<int> freeSlots;
+    std::vector<Event> events;
+    int activeCount;
+   
+public:
+    explicit Animator(const ArchetypeTable& table) : table(table), activeCount(0) {}
+   
+    // Start an owner on its set's idle clip; NONE if the set doesn't exist
+    int add(int animationSet, Character* owner) {
+        if (animationSet < 0 || animationSet >= table.getAnimationSetCount()) return NONE;
+       
+        int slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            MemoryTracker::Scope memoryScope(MemoryTracker::TAG_ENTITY);
+            slot = static_cast<int>(owners.size());
+            sets.push_back(0);
+            clips.push_back(0);
+            frames.push_back(0);
+            remaining.push_back(0.0f);
+            changed.push_back(0);
+            owners.push_back(nullptr);
+        }
+        sets[slot] = static_cast<uint16_t>(animationSet);
+        clips[slot] = table.getAnimationSet(animationSet).clips[GameData::CLIP_IDLE];
+        frames[slot] = 0;
+        remaining[slot] = table.getFrame(table.getClip(clips[slot]).firstFrame).duration;
+        changed[slot] = 1;
+        owners[slot] = owner;
+        activeCount++;
+        return slot;
+    }
+   
+    void remove(int slot) {
+        if (slot == NONE || !owners[slot]) return;
+        owners[slot] = nullptr;
+        remaining[slot] = std::numeric_limits<float>::max();
+        freeSlots.push_back(slot);
+        activeCount--;
+    }
+   
+    // Switch clips, restarting only on a change. A looping clip doesn't cut short
+    // a one-shot clip that is still playing, so a hit reaction isn't lost to the
+    // walk cycle requested on the same frame.
+    void play(int slot, GameData::ClipId id) {
+        if (slot == NONE) return;
+        uint16_t clip = table.getAnimationSet(sets[slot]).clips[id];
+        if (clip == clips[slot]) return;
+        const GameData::ClipRecord& next = table.getClip(clip);
+        if ((next.flags & GameData::CLIP_LOOP) && !(table.getClip(clips[slot]).flags & GameData::CLIP_LOOP)) return;
+       
+        clips[slot] = clip;
+        frames[slot] = 0;
+        remaining[slot] = table.getFrame(next.firstFrame).duration;
+        changed[slot] = 1;
+    }
+   
+    // Advance every animation. Most frames only count down; a long frame may step
+    // a clip several frames, and a one-shot clip that runs out returns to its
+    // set's idle clip.
+    void advance(float deltaTime) {
+        events.clear();
+        for (size_t i = 0; i < remaining.size(); i++) {
+            remaining[i] -= deltaTime;
+            if (remaining[i] > 0.0f) continue;
+           
+            const GameData::ClipRecord* clip = &table.getClip(clips[i]);
+            uint32_t frame = frames[i] < clip->frameCount ? frames[i] : 0;  // A reload may shorten the clip
+            float time = remaining[i];
+            while (time <= 0.0f) {
+                if (frame + 1 < clip->frameCount) {
+                    frame++;
+                } else if (clip->flags & GameData::CLIP_LOOP) {
+                    frame = 0;
+                } else {
+                    clips[i] = table.getAnimationSet(sets[i]).clips[GameData::CLIP_IDLE];
+                    clip = &table.getClip(clips[i]);
+                    frame = 0;
+                }
+                if (clip->event != GameData::ANIMATION_EVENT_NONE && frame == clip->eventFrame) {
+                    events.push_back({owners[i], static_cast<GameData::AnimationEvent>(clip->event)});
+                }
+                time += table.getFrame(clip->firstFrame + frame).duration;
+            }
+            frames[i] = static_cast<uint16_t>(frame);
+            remaining[i] = time;
+            changed[i] = 1;
+        }
+    }
+   
+    // The current frame's rect if it changed since the last call
+    bool takeFrame(int slot, sf::IntRect& rect) {
+        if (slot == NONE || !changed[slot]) return false;
+        changed[slot] = 0;
+        const GameData::ClipRecord& clip = table.getClip(clips[slot]);
+        uint32_t frame = frames[slot] < clip.frameCount ? frames[slot] : 0;
+        rect = GameData::toRect(table.getFrame(clip.firstFrame + frame).rect);
+        return true;
+    }
+   
+    GameData::ClipId getClip(int slot) const {
+        if (slot == NONE) return GameData::CLIP_IDLE;
+        const GameData::AnimationSetRecord& set = table.getAnimationSet(sets[slot]);
+        for (int id = GameData::CLIP_COUNT - 1; id > 0; id--) {
+            if (set.clips[id] == clips[slot]) return static_cast<GameData::ClipId>(id);
+        }
+        return GameData::CLIP_IDLE;
+    }
+   
+    // Raised by the last advance()
+    const std::vector<Event>& getEvents() const { return events; }
+    int getActiveCount() const { return activeCount; }
+};
+
+// Spatial grid - uniform cells over the world, rebuilt from scratch by a counting
+// sort whenever the things in it have moved. Each cell's ids are contiguous and a
+// row of cells is one contiguous run, so a query is a few array scans and never
+// allocates. Ids are whatever index the caller's own arrays use.
+class SpatialGrid {
+private:
+    float cellSize;
+    int columns;
+    int rows;
+    std::vector<int> cellStart;  // Start of each cell in ids, plus the total at the end
+    std::vector<int> ids;
+    std::vector<int> cellOf;     // Scratch for build()
+   
+public:
+    SpatialGrid() : cellSize(1.0f), columns(0), rows(0) {}
+   
+    void build(const float* xs, const float* ys, int count, float worldWidth, float worldHeight, float size) {
+        cellSize = size;
+        columns = std::max(1, static_cast<int>(std::ceil(worldWidth / size)));
+        rows = std::max(1, static_cast<int>(std::ceil(worldHeight / size)));
+        int cells = columns * rows;
+       
+        cellStart.assign(cells + 1, 0);
+        cellOf.resize(count);
+        ids.resize(count);
+        for (int i = 0; i < count; i++) {
+            cellOf[i] = cellIndex(xs[i], ys[i]);
+            cellStart[cellOf[i] + 1]++;
+        }
+        for (int c = 1; c <= cells; c++) cellStart[c] += cellStart[c - 1];
+       
+        // Scatter with each cell's start as its cursor, then shift the cursors
+        // (now each cell's end) back into starts
+        for (int i = 0; i < count; i++) ids[cellStart[cellOf[i]]++] = i;
+        for (int c = cells - 1; c > 0; c--) cellStart[c] = cellStart[c - 1];
+        cellStart[0] = 0;
+    }
+   
+    // Visit every id in the cells the rectangle touches; callers do the exact test
+    template<typename Visit>
+    void query(float minX, float minY, float maxX, float maxY, Visit visit) const {
+        if (ids.empty()) return;
+        int x0 = column(minX), x1 = column(maxX);
+        int y0 = row(minY), y1 = row(maxY);
+        for (int y = y0; y <= y1; y++) {
+            int end = cellStart[y * columns + x1 + 1];
+            for (int i = cellStart[y * columns + x0]; i < end; i++) visit(ids[i]);
+        }
+    }
+   
+    int getCount() const { return static_cast<int>(ids.size()); }
+   
+private:
+    int column(float x) const { return std::max(0, std::min(columns - 1, static_cast<int>(std::floor(x / cellSize)))); }
+    int row(float y) const { return std::max(0, std::min(rows - 1, static_cast<int>(std::floor(y / cellSize)))); }
+    int cellIndex(float x, float y) const { return row(y) * columns + column(x); }
+};
+
+// Tile collider - solid/open flags for every tile in one flat array, and box
+// movement against them. A move runs one axis at a time: the box's leading edge
+// visits every tile column (then row) it would cross, so no speed can skip a
+// wall, and the box stops flush against the first solid one while the other
+// axis carries on - which is what makes bodies slide along walls.
+class TileCollider {
+public:
+    static constexpr float SKIN = 0.01f;  // Gap left between a stopped box and the wall
+   
+    struct Move {
+        float x;
+        float y;
+        bool blockedX;
+        bool blockedY;
+    };
+   
+private:
+    int width;
+    int height;
+    float tileSize;
+    std::vector<uint8_t> solid;
+   
+public:
+    TileCollider() : width(0), height(0), tileSize(static_cast<float>(TILE_SIZE)) {}
+   
+    void reset(int columns, int rows, float size = static_cast<float>(TILE_SIZE)) {
+        width = columns;
+        height = rows;
+        tileSize = size;
+        solid.assign(static_cast<size_t>(columns) * rows, 0);
+    }
+   
+    void setSolid(int x, int y, bool value) {
+        if (x >= 0 && x < width && y >= 0 && y < height) solid[y * width + x] = value ? 1 : 0;
+    }
+   
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+   
+    // Outside the map counts as solid
+    bool isSolid(int x, int y) const {
+        return x < 0 || x >= width || y < 0 || y >= height || solid[y * width + x];
+    }
+   
+    // Whether a box centred on (x, y) overlaps any solid tile
+    bool overlaps(float x, float y, float halfWidth, float halfHeight) const {
+        int firstColumn = static_cast<int>(std::floor((x - halfWidth) / tileSize));
+        int lastColumn = static_cast<int>(std::ceil((x + halfWidth) / tileSize)) - 1;
+        int firstRow = static_cast<int>(std::floor((y - halfHeight) / tileSize));
+        int lastRow = static_cast<int>(std::ceil((y + halfHeight) / tileSize)) - 1;
+        for (int row = firstRow; row <= lastRow; row++) {
+            for (int column = firstColumn; column <= lastColumn; column++) {
+                if (isSolid(column, row)) return true;
+            }
+        }
+        return false;
+    }
+   
+    // Move a box centred on (x, y) by (dx, dy), horizontally then vertically
+    Move move(float x, float y, float halfWidth, float halfHeight, float dx, float dy) const {
+        Move result{x, y, false, false};
+        if (dx != 0.0f) {
+            result.x = sweep(x, dx, halfWidth, y, halfHeight, true, result.blockedX);
+        }
+        if (dy != 0.0f) {
+            result.y = sweep(y, dy, halfHeight, result.x, halfWidth, false, result.blockedY);
+        }
+        return result;
+    }
+   
+private:
+    // Sweep one axis. Tiles the box already overlaps are ignored, so a body that
+    // starts inside a wall can always get out again.
+    float sweep(float centre, float delta, float halfExtent, float across, float halfAcross,
+                bool horizontal, bool& blocked) const {
+        int firstLane = static_cast<int>(std::floor((across - halfAcross) / tileSize));
+        int lastLane = static_cast<int>(std::ceil((across + halfAcross) / tileSize)) - 1;
+       
+        // The far edge is worked out from the moved centre exactly as overlaps() does,
+        // so rounding can't let an unblocked move end a hair inside a wall
+        float moved = centre + delta;
+        if (delta > 0.0f) {
+            float edge = centre + halfExtent;
+            float target = moved + halfExtent;
+            for (int line = static_cast<int>(std::ceil(edge / tileSize)); line * tileSize < target; line++) {
+                if (laneBlocked(line, firstLane, lastLane, horizontal)) {
+                    blocked = true;
+                    return line * tileSize - SKIN - halfExtent;
+                }
+            }
+        } else {
+            float edge = centre - halfExtent;
+            float target = moved - halfExtent;
+            for (int line = static_cast<int>(std::floor(edge / tileSize)) - 1; (line + 1) * tileSize > target; line--) {
+                if (laneBlocked(line, firstLane, lastLane, horizontal)) {
+                    blocked = true;
+                    return (line + 1) * tileSize + SKIN + halfExtent;
+                }
+            }
+        }
+        return moved;
+    }
+   
+    // Any solid tile in one column (or row) across the box's span
+    bool laneBlocked(int line, int firstLane, int lastLane, bool horizontal) const {
+        for (int lane = firstLane; lane <= lastLane; lane++) {
+            if (horizontal ? isSolid(line, lane) : isSolid(lane, line)) return true;
+        }
+        return false;
+    }
+};
+
+// Path finder - hierarchical A* over the tile collider. The map is cut into
+// square clusters; wherever two neighbouring clusters share a run of open border
+// tiles there is a portal on each side, and the portals of one cluster are linked
+// by what it costs to walk between them. A query searches that small portal graph
+// and returns the portals to pass through; the tiles of each leg are filled in
+// only when a walker gets there. Recent answers are cached, and a changed tile
+// rebuilds just its own cluster and the borders it shares.
+class PathFinder {
+public:
+    static const int CLUSTER_SIZE = 16;
+    static const int CACHE_SIZE = 256;
+    static const int CACHE_ROUTE_RESERVE = 16;
+   
+private:
+    static const int STRAIGHT_COST = 10;
+    static const int DIAGONAL_COST = 14;
+    static constexpr int STEP_X[8] = {1, 0, -1, 0, 1, 1, -1, -1};
+    static constexpr int STEP_Y[8] = {0, 1, 0, -1, 1, -1, 1, -1};
+   
+    // A portal tile, paired with the tile across the border
+    struct Node {
+        int x;
+        int y;
+        int cluster;
+        int side;     // Border of its cluster: 0 east, 1 south, 2 west, 3 north
+        int partner;  // -1 once the node is freed
+        std::vector<std::pair<int, int>> links;  // Same-cluster node and walking cost
+    };
+   
+    struct CachedPath {
+        uint64_t key = 0;
+        bool valid = false;
+        std::vector<int> clusters;  // Every cluster the path passes through
+        std::vector<sf::Vector2i> waypoints;
+    };
+   
+    const TileCollider* tiles;
+    int width;
+    int height;
+    int clustersX;
+    int clustersY;
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    std::vector<std::vector<int>> clusterNodes;
+   
+    // Search scratch, stamped per search so nothing is cleared between queries
+    std::vector<int> tileCost;
+    std::vector<int> tileParent;
+    std::vector<uint32_t> tileSeen;
+    std::vector<uint32_t> tileClosed;
+    uint32_t tileSearch;
+    std::vector<int> nodeCost;
+    std::vector<int> nodeParent;
+    std::vector<int> nodeGoalCost;
+    std::vector<uint32_t> nodeSeen;
+    std::vector<uint32_t> nodeClosed;
+    uint32_t nodeSearch;
+    // Heap of (priority, id). The priority is minus the estimate, ties going to the
+    // entry that has come further, which keeps A* from fanning out across equal paths.
+    std::vector<std::pair<int64_t, int>> open;
+   
+    std::vector<CachedPath> cache;
+    uint64_t cacheHits;
+    uint64_t cacheMisses;
+   
+public:
+    PathFinder() : tiles(nullptr), width(0), height(0), clustersX(0), clustersY(0),
+                   tileSearch(0), nodeSearch(0), cacheHits(0), cacheMisses(0) {}
+   
+    // Cut the collider's map into clusters and build the whole portal graph
+    void build(const TileCollider& collider) {
+        tiles = &collider;
+        width = collider.getWidth();
+        height = collider.getHeight();
+        clustersX = (width + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+        clustersY = (height + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+       
+        nodes.clear();
+        freeNodes.clear();
+        clusterNodes.assign(clustersX * clustersY, std::vector<int>());
+        size_t count = static_cast<size_t>(width) * height;
+        tileCost.assign(count, 0);
+        tileParent.assign(count, -1);
+        tileSeen.assign(count, 0);
+        tileClosed.assign(count, 0);
+        tileSearch = 0;
+        nodeSeen.clear();
+        nodeClosed.clear();
+        nodeSearch = 0;
+        cache.assign(CACHE_SIZE, CachedPath());
+        for (CachedPath& entry : cache) {
+            // Sized for a typical route, so refilling an entry rarely allocates
+            entry.clusters.reserve(CACHE_ROUTE_RESERVE);
+            entry.waypoints.reserve(CACHE_ROUTE_RESERVE);
+        }
+       
+        // East and south borders cover every shared border once
+        for (int c = 0; c < clustersX * clustersY; c++) {
+            linkBorder(c, 0);
+            linkBorder(c, 1);
+        }
+        for (int c = 0; c < clustersX * clustersY; c++) {
+            linkCluster(c);
+        }
+        growScratch();
+    }
+   
+    // A tile changed: redo the portals on its cluster's borders, the links in it
+    // and its neighbours, and drop cached paths through it
+    void invalidate(int x, int y) {
+        if (!tiles || x < 0 || x >= width || y < 0 || y >= height) return;
+       
+        int cluster = clusterOf(x, y);
+        for (int side = 0; side < 4; side++) {
+            unlinkBorder(cluster, side);
+            linkBorder(cluster, side);
+        }
+        linkCluster(cluster);
+        for (int side = 0; side < 4; side++) {
+            int neighbour = neighbourOf(cluster, side);
+            if (neighbour >= 0) linkCluster(neighbour);
+        }
+        growScratch();
+       
+        for (CachedPath& entry : cache) {
+            if (entry.valid && std::find(entry.clusters.begin(), entry.clusters.end(), cluster) != entry.clusters.end()) {
+                entry.valid = false;
+            }
+        }
+    }
+   
+    // The portals to pass through on the way from one tile to another, ending with
+    // the goal itself. Walk it by refining one leg at a time.
+    bool findPath(sf::Vector2i start, sf::Vector2i goal, std::vector<sf::Vector2i>& waypoints) {
+        waypoints.clear();
+        if (!tiles || tiles->isSolid(start.x, start.y) || tiles->isSolid(goal.x, goal.y)) return false;
+       
+        uint64_t key = static_cast<uint64_t>(tileIndex(start)) << 32 | static_cast<uint32_t>(tileIndex(goal));
+        CachedPath& entry = cache[((key * 0x9E3779B97F4A7C15ull) >> 32) % CACHE_SIZE];
+        if (entry.valid && entry.key == key) {
+            cacheHits++;
+            waypoints = entry.waypoints;
+            return true;
+        }
+       
+        cacheMisses++;
+        if (!searchPortals(start, goal, waypoints)) return false;
+       
+        entry.key = key;
+        entry.valid = true;
+        entry.waypoints = waypoints;
+        entry.clusters.assign(1, clusterOf(start.x, start.y));
+        for (const sf::Vector2i& waypoint : waypoints) {
+            int cluster = clusterOf(waypoint.x, waypoint.y);
+            if (cluster != entry.clusters.back()) entry.clusters.push_back(cluster);
+        }
+        return true;
+    }
+   
+    // Tiles from one waypoint to the next, without the first and with the last
+    bool refine(sf::Vector2i from, sf::Vector2i to, std::vector<sf::Vector2i>& leg) {
+        leg.clear();
+        if (!tiles || from == to) return tiles != nullptr;
+       
+        // Consecutive waypoints share a cluster or face each other across a border
+        int minX = std::min(from.x, to.x) / CLUSTER_SIZE * CLUSTER_SIZE;
+        int minY = std::min(from.y, to.y) / CLUSTER_SIZE * CLUSTER_SIZE;
+        int maxX = std::min(width, (std::max(from.x, to.x) / CLUSTER_SIZE + 1) * CLUSTER_SIZE) - 1;
+        int maxY = std::min(height, (std::max(from.y, to.y) / CLUSTER_SIZE + 1) * CLUSTER_SIZE) - 1;
+        if (!searchTiles(tileIndex(from), tileIndex(to), minX, minY, maxX, maxY)) return false;
+        tracePath(tileIndex(from), tileIndex(to), leg);
+        return true;
+    }
+   
+    // Plain A* over the whole map, tile by tile; kept for comparison
+    bool findPathFlat(sf::Vector2i start, sf::Vector2i goal, std::vector<sf::Vector2i>& path) {
+        path.clear();
+        if (!tiles || tiles->isSolid(start.x, start.y) || tiles->isSolid(goal.x, goal.y)) return false;
+        if (!searchTiles(tileIndex(start), tileIndex(goal), 0, 0, width - 1, height - 1)) return false;
+        tracePath(tileIndex(start), tileIndex(goal), path);
+        return true;
+    }
+   
+    int getNodeCount() const { return static_cast<int>(nodes.size() - freeNodes.size()); }
+    uint64_t getCacheHits() const { return cacheHits; }
+    uint64_t getCacheMisses() const { return cacheMisses; }
+   
+private:
+    int tileIndex(sf::Vector2i tile) const { return tile.y * width + tile.x; }
+    int clusterOf(int x, int y) const { return (y / CLUSTER_SIZE) * clustersX + x / CLUSTER_SIZE; }
+   
+    int neighbourOf(int cluster, int side) const {
+        int x = cluster % clustersX + (side == 0 ? 1 : side == 2 ? -1 : 0);
+        int y = cluster / clustersX + (side == 1 ? 1 : side == 3 ? -1 : 0);
+        if (x < 0 || x >= clustersX || y < 0 || y >= clustersY) return -1;
+        return y * clustersX + x;
+    }
+   
+    void clusterBounds(int cluster, int& minX, int& minY, int& maxX, int& maxY) const {
+        minX = cluster % clustersX * CLUSTER_SIZE;
+        minY = cluster / clustersX * CLUSTER_SIZE;
+        maxX = std::min(width, minX + CLUSTER_SIZE) - 1;
+        maxY = std::min(height, minY + CLUSTER_SIZE) - 1;
+    }
+   
+    static int64_t priority(int estimate, int cost) {
+        return static_cast<int64_t>(-estimate) * (int64_t(1) << 32) + cost;
+    }
+   
+    int octile(int x, int y, int goalX, int goalY) const {
+        int dx = std::abs(x - goalX);
+        int dy = std::abs(y - goalY);
+        return STRAIGHT_COST * (dx + dy) + (DIAGONAL_COST - 2 * STRAIGHT_COST) * std::min(dx, dy);
+    }
+   
+    int addNode(int x, int y, int cluster, int side) {
+        int id;
+        if (!freeNodes.empty()) {
+            id = freeNodes.back();
+            freeNodes.pop_back();
+        } else {
+            id = static_cast<int>(nodes.size());
+            nodes.emplace_back();
+        }
+        Node& node = nodes[id];
+        node.x = x;
+        node.y = y;
+        node.cluster = cluster;
+        node.side = side;
+        node.partner = -1;
+        node.links.clear();
+        clusterNodes[cluster].push_back(id);
+        return id;
+    }
+   
+    // Find the runs of tiles open on both sides of a border and put a portal pair
+    // in each: one in the middle of a short run, one at each end of a long one
+    void linkBorder(int cluster, int side) {
+        int neighbour = neighbourOf(cluster, side);
+        if (neighbour < 0) return;
+       
+        int minX, minY, maxX, maxY;
+        clusterBounds(cluster, minX, minY, maxX, maxY);
+        bool vertical = side == 0 || side == 2;  // East and west borders run down a column
+        int line = side == 0 ? maxX : side == 1 ? maxY : side == 2 ? minX : minY;
+        int across = side < 2 ? 1 : -1;
+        int first = vertical ? minY : minX;
+        int last = vertical ? maxY : maxX;
+       
+        auto open = [&](int along) {
+            return vertical
+                ? !tiles->isSolid(line, along) && !tiles->isSolid(line + across, along)
+                : !tiles->isSolid(along, line) && !tiles->isSolid(along, line + across);
+        };
+        auto addPair = [&](int along) {
+            int own = vertical ? addNode(line, along, cluster, side) : addNode(along, line, cluster, side);
+            int other = vertical ? addNode(line + across, along, neighbour, (side + 2) % 4)
+                                 : addNode(along, line + across, neighbour, (side + 2) % 4);
+            nodes[own].partner = other;
+            nodes[other].partner = own;
+        };
+       
+        for (int along = first; along <= last;) {
+            if (!open(along)) {
+                along++;
+                continue;
+            }
+            int runStart = along;
+            while (along <= last && open(along)) along++;
+            int runEnd = along - 1;
+            if (runEnd - runStart < 6) {
+                addPair((runStart + runEnd) / 2);
+            } else {
+                addPair(runStart);
+                addPair(runEnd);
+            }
+        }
+    }
+   
+    // Free the portals on one border, on both sides of it
+    void unlinkBorder(int cluster, int side) {
+        int neighbour = neighbourOf(cluster, side);
+        if (neighbour < 0) return;
+        unlinkSide(cluster, side);
+        unlinkSide(neighbour, (side + 2) % 4);
+    }
+   
+    void unlinkSide(int cluster, int side) {
+        std::vector<int>& members = clusterNodes[cluster];
+        for (size_t i = 0; i < members.size();) {
+            Node& node = nodes[members[i]];
+            if (node.side != side) {
+                i++;
+                continue;
+            }
+            node.partner = -1;
+            node.links.clear();
+            freeNodes.push_back(members[i]);
+            members[i] = members.back();
+            members.pop_back();
+        }
+    }
+   
+    // Link every portal of a cluster to the others it can reach inside it, with
+    // one Dijkstra flood from each
+    void linkCluster(int cluster) {
+        int minX, minY, maxX, maxY;
+        clusterBounds(cluster, minX, minY, maxX, maxY);
+        const std::vector<int>& members = clusterNodes[cluster];
+        for (int id : members) {
+            Node& node = nodes[id];
+            node.links.clear();
+            searchTiles(node.y * width + node.x, -1, minX, minY, maxX, maxY);
+            for (int other : members) {
+                int tile = nodes[other].y * width + nodes[other].x;
+                if (other != id && tileSeen[tile] == tileSearch) node.links.push_back({other, tileCost[tile]});
+            }
+        }
+    }
+   
+    void growScratch() {
+        nodeCost.resize(nodes.size());
+        nodeParent.resize(nodes.size());
+        nodeGoalCost.resize(nodes.size());
+        nodeSeen.resize(nodes.size(), 0);
+        nodeClosed.resize(nodes.size(), 0);
+    }
+   
+    // A* over the tiles inside a rectangle, eight ways without cutting corners.
+    // With no goal (-1) it floods the whole rectangle instead, leaving the cost
+    // of every reachable tile in the scratch arrays.
+    bool searchTiles(int start, int goal, int minX, int minY, int maxX, int maxY) {
+        if (++tileSearch == 0) {
+            std::fill(tileSeen.begin(), tileSeen.end(), 0);
+            std::fill(tileClosed.begin(), tileClosed.end(), 0);
+            tileSearch = 1;
+        }
+        int goalX = goal % width;
+        int goalY = goal / width;
+       
+        open.clear();
+        tileCost[start] = 0;
+        tileParent[start] = -1;
+        tileSeen[start] = tileSearch;
+        open.push_back({0, start});
+       
+        while (!open.empty()) {
+            std::pop_heap(open.begin(), open.end());
+            int current = open.back().second;
+            open.pop_back();
+            if (tileClosed[current] == tileSearch) continue;
+            tileClosed[current] = tileSearch;
+            if (current == goal) return true;
+           
+            int x = current % width;
+            int y = current / width;
+            for (int d = 0; d < 8; d++) {
+                int nextX = x + STEP_X[d];
+                int nextY = y + STEP_Y[d];
+                if (nextX < minX || nextX > maxX || nextY < minY || nextY > maxY) continue;
+                if (tiles->isSolid(nextX, nextY)) continue;
+                if (d >= 4 && (tiles->isSolid(nextX, y) || tiles->isSolid(x, nextY))) continue;
+               
+                int next = nextY * width + nextX;
+                int cost = tileCost[current] + (d < 4 ? STRAIGHT_COST : DIAGONAL_COST);
+                if (tileSeen[next] == tileSearch && cost >= tileCost[next]) continue;
+                tileSeen[next] = tileSearch;
+                tileCost[next] = cost;
+                tileParent[next] = current;
+                int estimate = goal < 0 ? cost : cost + octile(nextX, nextY, goalX, goalY);
+                open.push_back({priority(estimate, cost), next});
+                std::push_heap(open.begin(), open.end());
+            }
+        }
+        return goal < 0;
+    }
+   
+    void tracePath(int start, int goal, std::vector<sf::Vector2i>& path) {
+        for (int tile = goal; tile != start; tile = tileParent[tile]) {
+            path.push_back(sf::Vector2i(tile % width, tile / width));
+        }
+        std::reverse(path.begin(), path.end());
+    }
+   
+    // A* over the portal graph. The start and goal join it through what it costs
+    // to reach their own cluster's portals, found with one flood each.
+    bool searchPortals(sf::Vector2i start, sf::Vector2i goal, std::vector<sf::Vector2i>& waypoints) {
+        int startCluster = clusterOf(start.x, start.y);
+        int goalCluster = clusterOf(goal.x, goal.y);
+        int minX, minY, maxX, maxY;
+       
+        // Within one cluster, try staying inside it first
+        if (startCluster == goalCluster) {
+            clusterBounds(startCluster, minX, minY, maxX, maxY);
+            if (searchTiles(tileIndex(start), tileIndex(goal), minX, minY, maxX, maxY)) {
+                waypoints.push_back(goal);
+                return true;
+            }
+        }
+       
+        clusterBounds(goalCluster, minX, minY, maxX, maxY);
+        searchTiles(tileIndex(goal), -1, minX, minY, maxX, maxY);
+        for (int id : clusterNodes[goalCluster]) {
+            int tile = nodes[id].y * width + nodes[id].x;
+            nodeGoalCost[id] = tileSeen[tile] == tileSearch ? tileCost[tile] : -1;
+        }
+       
+        if (++nodeSearch == 0) {
+            std::fill(nodeSeen.begin(), nodeSeen.end(), 0);
+            std::fill(nodeClosed.begin(), nodeClosed.end(), 0);
+            nodeSearch = 1;
+        }
+        open.clear();
+        clusterBounds(startCluster, minX, minY, maxX, maxY);
+        searchTiles(tileIndex(start), -1, minX, minY, maxX, maxY);
+        for (int id : clusterNodes[startCluster]) {
+            int tile = nodes[id].y * width + nodes[id].x;
+            if (tileSeen[tile] != tileSearch) continue;
+            nodeSeen[id] = nodeSearch;
+            nodeCost[id] = tileCost[tile];
+            nodeParent[id] = -1;
+            open.push_back({priority(nodeCost[id] + octile(nodes[id].x, nodes[id].y, goal.x, goal.y), nodeCost[id]), id});
+        }
+        std::make_heap(open.begin(), open.end());
+       
+        int best = -1;
+        int bestCost = std::numeric_limits<int>::max();
+        while (!open.empty()) {
+            std::pop_heap(open.begin(), open.end());
+            int estimate = static_cast<int>(-(open.back().first >> 32));
+            int id = open.back().second;
+            open.pop_back();
+            if (estimate >= bestCost) break;  // Nothing left can finish cheaper
+            if (nodeClosed[id] == nodeSearch) continue;
+            nodeClosed[id] = nodeSearch;
+           
+            const Node& node = nodes[id];
+            if (node.cluster == goalCluster && nodeGoalCost[id] >= 0 && nodeCost[id] + nodeGoalCost[id] < bestCost) {
+                best = id;
+                bestCost = nodeCost[id] + nodeGoalCost[id];
+            }
+           
+            relaxPortal(id, node.partner, STRAIGHT_COST, goal);
+            for (const auto& link : node.links) {
+                relaxPortal(id, link.first, link.second, goal);
+            }
+        }
+        if (best < 0) return false;
+       
+        for (int id = best; id >= 0; id = nodeParent[id]) {
+            waypoints.push_back(sf::Vector2i(nodes[id].x, nodes[id].y));
+        }
+        std::reverse(waypoints.begin(), waypoints.end());
+        waypoints.push_back(goal);
+        return true;
+    }
+   
+    void relaxPortal(int from, int to, int step, sf::Vector2i goal) {
+        int cost = nodeCost[from] + step;
+        if (nodeSeen[to] == nodeSearch && cost >= nodeCost[to]) return;
+        nodeSeen[to] = nodeSearch;
+        nodeCost[to] = cost;
+        nodeParent[to] = from;
+        open.push_back({priority(cost + octile(nodes[to].x, nodes[to].y, goal.x, goal.y), cost), to});
+        std::push_heap(open.begin(), open.end());
+    }
+};
+
+// Entity class - base for all game objects
+class Entity {
+protected:
+    sf::Sprite sprite;
+    const sf::Shader* material;  // Drawn with the material shader when set
+    sf::Vector2f position;
+    bool active;
+    const char* name;  // Interned or owned by the archetype table
+    const char* type;
+   
+public:
+    Entity(const std::string& name, const std::string& type, ResourceManager& resources, const std::string& textureId)
+        : Entity(GameUtils::intern(name), GameUtils::intern(type), resources, textureId) {}
+   
+    // Name and type must outlive the entity: interned, literals or archetype strings
+    Entity(const char* name, const char* type, ResourceManager& resources, const std::string& textureId)
+        : material(nullptr), name(name), type(type), active(true) {
+        sprite.setTexture(resources.getTexture(textureId));
+        sprite.setOrigin(sprite.getLocalBounds().width / 2, sprite.getLocalBounds().height / 2);
+    }
+   
+    virtual ~Entity() = default;
+   
+    virtual void update(float deltaTime) {
+        sprite.setPosition(position);
+    }
+   
+    virtual void draw(DrawList& list) {
+        DrawList::Scope drawScope(list, DrawList::SOURCE_ENTITY);
+        list.draw(sprite, material);
+    }
+   
+    void setPosition(float x, float y) {
+        position.x = x;
+        position.y = y;
+        sprite.setPosition(position);
+    }
+   
+    sf::Vector2f getPosition() const {
+        return position;
+    }
+   
+    virtual std::string getName() const {
+        return name;
+    }
+   
+    // The name as getName() has it, for text built in the frame arena
+    virtual void appendName(TextBuilder& out) const {
+        out << name;
+    }
+   
+    std::string getType() const {
+        return type;
+    }
+   
+    bool isActive() const {
+        return active;
+    }
+   
+    void setActive(bool value) {
+        active = value;
+    }
+   
+    sf::FloatRect getBounds() const {
+        return sprite.getGlobalBounds();
+    }
+   
+    bool intersects(const Entity& other) const {
+        return getBounds().intersects(other.getBounds());
+    }
+   
+    float distanceTo(const Entity& other) const {
+        return GameUtils::distance(position.x, position.y,
+                                 other.position.x, other.position.y);
+    }
+};
+
+// Item classes
+class Item : public Entity {
+protected:
+    int value;
+    const char* description;  // Owned by the archetype table
+    const char* prefix;       // Affix name fragments from the archetype table, or nullptr
+    const char* suffix;
+    const char* rarity;
+    bool onGround;
+   
+public:
+    Item(const char* name, const char* type, ResourceManager& resources,
+         const char* description, int value, const sf::IntRect& spriteRect)
+        : Entity(name, type, resources, "items"),
+          description(description), value(value), prefix(nullptr), suffix(nullptr),
+          rarity(nullptr), onGround(true) {
+       
+        // Sprite rect in the items sheet comes from the archetype
+        sprite.setTextureRect(spriteRect);
+    }
+   
+    virtual ~Item() = default;
+   
+    virtual bool use(Player& player) {
+        return false;  // Base items can't be used
+    }
+   
+    void draw(DrawList& list) override {
+        if (onGround) {
+            Entity::draw(list);
+           
+            // Add a subtle pulsing effect
+            static float pulseTimer = 0.0f;
+            pulseTimer += 0.05f;
+            float scale = 1.0f + 0.1f * std::sin(pulseTimer);
+            sprite.setScale(scale, scale);
+        }
+    }
+   
+    void pickUp() {
+        onGround = false;
+    }
+   
+    bool isOnGround() const {
+        return onGround;
+    }
+   
+    // Affixes only record their name fragment; the full name is built when displayed
+    virtual void applyAffix(const ArchetypeTable& table, int index) {
+        const GameData::AffixRecord& affix = table.getAffix(index);
+        const char*& slot = affix.position == GameData::AFFIX_PREFIX ? prefix : suffix;
+        slot = table.getString(affix.name);
+        value += value * affix.valuePercent / 100;
+    }
+   
+    void setRarity(const char* name) {
+        rarity = name;
+    }
+   
+    std::string getName() const override {
+        std::string result;
+        if (prefix) result.append(prefix).append(" ");
+        result.append(name);
+        if (suffix) result.append(" ").append(suffix);
+        return result;
+    }
+   
+    void appendName(TextBuilder& out) const override {
+        if (prefix) out << prefix << ' ';
+        out << name;
+        if (suffix) out << ' ' << suffix;
+    }
+   
+    int getValue() const { return value; }
+    const char* getDescription() const { return description; }
+    const char* getRarity() const { return rarity ? rarity : ""; }
+};
+
+class Weapon : public Item {
+private:
+    int archetype;           // Index into the archetype table
+    const char* weaponType;  // Owned by the archetype table
+    int minDamage;
+    int maxDamage;
+    int attackBonus;
+   
+public:
+    // Build a weapon from its archetype, scaled to a character level
+    Weapon(int archetype, ResourceManager& resources, int level = 0)
+        : Weapon(archetype, resources.getArchetypes(), resources, level) {}
+   
+    int rollDamage() const {
+        return GameUtils::getRandomInt(minDamage, maxDamage);
+    }
+   
+    void applyAffix(const ArchetypeTable& table, int index) override {
+        Item::applyAffix(table, index);
+        const GameData::AffixRecord& affix = table.getAffix(index);
+        minDamage += affix.damage;
+        maxDamage += affix.damage;
+        attackBonus += affix.attack;
+    }
+   
+    int getArchetype() const { return archetype; }
+    int getMinDamage() const { return minDamage; }
+    int getMaxDamage() const { return maxDamage; }
+    int getAttackBonus() const { return attackBonus; }
+    std::string getWeaponType() const { return weaponType; }
+   
+private:
+    Weapon(int archetype, const ArchetypeTable& table, ResourceManager& resources, int level)
+        : Item(table.getString(table.getWeapon(archetype).name), "weapon", resources,
+               table.getString(table.getWeapon(archetype).description),
+               GameData::scaled(table.getWeapon(archetype).value, table.getWeapon(archetype).valuePerLevel, level),
+               GameData::toRect(table.getWeapon(archetype).rect)),
+          archetype(archetype),
+          weaponType(table.getString(table.getWeapon(archetype).weaponType)) {
+       
+        const GameData::WeaponRecord& record = table.getWeapon(archetype);
+        minDamage = GameData::scaled(record.minDamage, record.minDamagePerLevel, level);
+        maxDamage = std::max(minDamage, GameData::scaled(record.maxDamage, record.maxDamagePerLevel, level));
+        attackBonus = record.attackBonus;
+    }
+};
+
+class Armor : public Item {
+private:
+    int archetype;
+    const char* armorType;
+    int defense;
+   
+public:
+    Armor(int archetype, ResourceManager& resources, int level = 0)
+        : Armor(archetype, resources.getArchetypes(), resources, level) {}
+   
+    void applyAffix(const ArchetypeTable& table, int index) override {
+        Item::applyAffix(table, index);
+        defense += table.getAffix(index).defense;
+    }
+   
+    int getArchetype() const { return archetype; }
+    int getDefense() const { return defense; }
+    std::string getArmorType() const { return armorType; }
+   
+private:
+    Armor(int archetype, const ArchetypeTable& table, ResourceManager& resources, int level)
+        : Item(table.getString(table.getArmor(archetype).name), "armor", resources,
+               table.getString(table.getArmor(archetype).description),
+               GameData::scaled(table.getArmor(archetype).value, table.getArmor(archetype).valuePerLevel, level),
+               GameData::toRect(table.getArmor(archetype).rect)),
+          archetype(archetype),
+          armorType(table.getString(table.getArmor(archetype).armorType)) {
+       
+        const GameData::ArmorRecord& record = table.getArmor(archetype);
+        defense = GameData::scaled(record.defense, record.defensePerLevel, level);
+    }
+};
+
+// Spell class - a spell a character knows. What it does is all in its archetype
+// record; SpellSystem carries it out.
+class Spell {
+private:
+    int archetype;
+    const char* name;
+    const char* description;
+    int manaCost;
+    int minimumLevel;
+   
+public:
+    Spell(int archetype, const ArchetypeTable& table)
+        : archetype(archetype),
+          name(table.getString(table.getSpell(archetype).name)),
+          description(table.getString(table.getSpell(archetype).description)),
+          manaCost(table.getSpell(archetype).manaCost),
+          minimumLevel(table.getSpell(archetype).minimumLevel) {}
+   
+    int getArchetype() const { return archetype; }
+    const char* getName() const { return name; }
+    const char* getDescription() const { return description; }
+    int getManaCost() const { return manaCost; }
+    int getMinimumLevel() const { return minimumLevel; }
+};
+
+// Character class - base for player and enemies
+class Character : public Entity {
+protected:
+    // D&D stats
+    int strength;
+    int dexterity;
+    int constitution;
+    int intelligence;
+    int wisdom;
+    int charisma;
+   
+    // Derived stats
+    int health;
+    int maxHealth;
+    int mana;
+    int maxMana;
+    int armorClass;
+    int attackBonus;
+    int level;
+   
+    // Equipment
+    std::shared_ptr<Weapon> equippedWeapon;
+    std::shared_ptr<Armor> equippedArmor;
+   
+    // Animation; the clip and its timing live in the Animator
+    int animation;
+    bool facingRight;
+   
+    // Visual effects. With the material shader the sprite colour holds its
+    // parameters and the shader pulses the flash; otherwise it's a tint.
+    TimerWheel::Handle flashTimer;
+    sf::Color baseColor;  // What the sprite colour returns to after a flash
+   
+public:
+    // One status effect on this character; StatusEffects owns the rules
+    struct ActiveEffect {
+        int stacks;
+        TimerWheel::Handle expiry;
+        TimerWheel::Handle tick;
+    };
+   
+protected:
+    ActiveEffect effects[GameData::EFFECT_COUNT];
+    int effectAttackBonus;
+    GameData::EffectId onHitEffect;  // Inflicted by this character's melee hits
+    int onHitChance;                 // Percent
+   
+    // Walls; without a collider the character moves freely
+    const TileCollider* collider;
+   
+    // Resources
+    ResourceManager& resources;
+    SoundManager& sounds;
+    TimerWheel& timers;
+    Animator& animator;
+   
+public:
+    // animationSet indexes the archetype table's sets; any other value leaves the sprite still
+    Character(const std::string& name, const std::string& type,
+              ResourceManager& resources, SoundManager& sounds, TimerWheel& timers, Animator& animator,
+              const std::string& textureId, int animationSet, int strength, int dexterity,
+              int constitution, int intelligence, int wisdom, int charisma)
+        : Entity(name, type, resources, textureId),
+          resources(resources), sounds(sounds), timers(timers), animator(animator),
+          strength(strength), dexterity(dexterity), constitution(constitution),
+          intelligence(intelligence), wisdom(wisdom), charisma(charisma),
+          animation(Animator::NONE), flashTimer(0), baseColor(sf::Color::White),
+          facingRight(true), level(1), effects(), effectAttackBonus(0),
+          onHitEffect(GameData::EFFECT_NONE), onHitChance(0), collider(nullptr) {
+       
+        // Calculate derived stats
+        maxHealth = 10 + constitution + GameUtils::rollDice(1, 8);
+        health = maxHealth;
+        maxMana = 10 + intelligence;
+        mana = maxMana;
+        armorClass = 10 + (dexterity - 10) / 2; // AC = 10 + DEX modifier
+        attackBonus = (strength - 10) / 2; // Attack bonus = STR modifier
+       
+        animation = animator.add(animationSet, this);
+       
+        material = resources.getMaterials().getShader();
+        if (material) {
+            baseColor = Materials::encode(0, 0, Materials::SURFACE_NONE);
+            sprite.setColor(baseColor);
+        }
+    }
+   
+    // Recolour with a palette from the archetype table, 0 for the texture's own colours
+    void setPalette(int palette) {
+        if (material) {
+            baseColor.r = static_cast<sf::Uint8>(palette);
+        } else {
+            baseColor = resources.getMaterials().getTint(palette);
+        }
+        if (!timers.isPending(flashTimer)) sprite.setColor(baseColor);
+    }
+   
+    // Collision box half-size: a little under half a tile, so bodies fit through
+    // one-tile corridors
+    static constexpr float BODY_HALF_SIZE = TILE_SIZE * 0.35f;
+   
+    void setCollider(const TileCollider* tiles) {
+        collider = tiles;
+    }
+   
+    // Move by an offset, stopping at walls and sliding along them
+    void moveBy(float dx, float dy) {
+        if (!collider) {
+            position += sf::Vector2f(dx, dy);
+            return;
+        }
+        TileCollider::Move result = collider->move(position.x, position.y, BODY_HALF_SIZE, BODY_HALF_SIZE, dx, dy);
+        position = sf::Vector2f(result.x, result.y);
+    }
+   
+    // Timers and the animation point at this character, so none may outlive it
+    ~Character() {
+        animator.remove(animation);
+        timers.cancel(flashTimer);
+        for (ActiveEffect& effect : effects) {
+            timers.cancel(effect.expiry);
+            timers.cancel(effect.tick);
+        }
+    }
+   
+    virtual void update(float deltaTime) override {
+        Entity::update(deltaTime);
+       
+        // Pulsing red while the damage flash runs; its timer restores the colour.
+        // The material shader pulses it on the GPU instead.
+        if (!material && timers.isPending(flashTimer)) {
+            int alpha = static_cast<int>(255 * (0.5f + 0.5f * std::sin(timers.remaining(flashTimer) * 30)));
+            sprite.setColor(sf::Color(255, 100, 100, 255 - alpha));
+        }
+    }
+   
+    // The texture rect only follows the animation when drawn, so characters
+    // outside the view cost nothing per frame change
+    void draw(DrawList& list) override {
+        sf::IntRect frame;
+        if (animator.takeFrame(animation, frame)) {
+            sprite.setTextureRect(frame);
+            sprite.setOrigin(frame.width / 2.0f, frame.height / 2.0f);
+        }
+        Entity::draw(list);
+    }
+   
+    // The flash timer; status effect timers go to StatusEffects
+    void onTimer(const TimerWheel::Expired& timer) {
+        if (timer.kind == TIMER_FLASH && timer.handle == flashTimer) {
+            sprite.setColor(baseColor);
+        }
+    }
+   
+    void setAnimation(GameData::ClipId clip) {
+        animator.play(animation, clip);
+    }
+   
+    GameData::ClipId getAnimation() const {
+        return animator.getClip(animation);
+    }
+   
+    void setFacingDirection(bool right) {
+        if (right == facingRight) return;
+        facingRight = right;
+        sprite.setScale(right ? 1.0f : -1.0f, 1.0f);
+    }
+   
+    // Added to the d20 attack roll: STR modifier, the weapon's bonus and any blessing
+    int getAttackModifier() const {
+        return attackBonus + effectAttackBonus + (equippedWeapon ? equippedWeapon->getAttackBonus() : 0);
+    }
+   
+    // Weapon damage range before the STR bonus; unarmed is 1d4
+    void getDamageRange(int& minDamage, int& maxDamage) const {
+        minDamage = equippedWeapon ? equippedWeapon->getMinDamage() : 1;
+        maxDamage = equippedWeapon ? equippedWeapon->getMaxDamage() : 4;
+    }
+   
+    int getDamageBonus() const {
+        return std::max(0, (strength - 10) / 2);
+    }
+   
+    // Only the combat system calls this; returns true if the damage was fatal
+    bool applyDamage(int amount) {
+        if (amount <= 0 || health <= 0) return false;
+       
+        health -= amount;
+        if (health > 0) return false;
+       
+        health = 0;
+        setActive(false);
+        return true;
+    }
+   
+    // Hit reaction, played when the combat event is presented
+    void showHit() {
+        timers.cancel(flashTimer);
+        flashTimer = timers.schedule(Materials::FLASH_SECONDS, TIMER_FLASH, this);
+        if (material) {
+            sf::Color flashing = baseColor;
+            flashing.g = Materials::flashUntil(timers.getTime() + Materials::FLASH_SECONDS);
+            sprite.setColor(flashing);
+        }
+        setAnimation(GameData::CLIP_HURT);
+    }
+   
+    void heal(int amount) {
+        if (amount <= 0) return;
+       
+        health += amount;
+        if (health > maxHealth) health = maxHealth;
+    }
+   
+    int getHealth() const { return health; }
+    int getMaxHealth() const { return maxHealth; }
+    int getMana() const { return mana; }
+    int getMaxMana() const { return maxMana; }
+    int getStrength() const { return strength; }
+    int getDexterity() const { return dexterity; }
+    int getConstitution() const { return constitution; }
+    int getIntelligence() const { return intelligence; }
+    int getWisdom() const { return wisdom; }
+    int getCharisma() const { return charisma; }
+    int getArmorClass() const {
+        int ac = 10 + (dexterity - 10) / 2;
+        if (equippedArmor) ac += equippedArmor->getDefense();
+        return ac;
+    }
+    int getLevel() const { return level; }
+   
+    bool isAlive() const { return health > 0; }
+   
+    // Status effects
+    bool hasEffect(GameData::EffectId id) const { return effects[id].stacks > 0; }
+    int getEffectStacks(GameData::EffectId id) const { return effects[id].stacks; }
+    float getEffectRemaining(GameData::EffectId id) const { return timers.remaining(effects[id].expiry); }
+    ActiveEffect& getEffectState(GameData::EffectId id) { return effects[id]; }  // For StatusEffects
+    void setEffectAttackBonus(int bonus) { effectAttackBonus = bonus; }
+    GameData::EffectId getOnHitEffect() const { return onHitEffect; }
+    int getOnHitChance() const { return onHitChance; }
+   
+    // Equip weapon
+    void equipWeapon(std::shared_ptr<Weapon> weapon) {
+        equippedWeapon = weapon;
+    }
+   
+    // Equip armor
+    void equipArmor(std::shared_ptr<Armor> armor) {
+        equippedArmor = armor;
+    }
+};
+
+// Player class
+class Player : public Character {
+private:
+    int experience;
+    int gold;
+    std::vector<std::shared_ptr<Item>> inventory;
+    std::vector<std::shared_ptr<Spell>> spells;
+    std::map<std::string, bool> questFlags;
+   
+    // Movement
+    float moveSpeed;
+    sf::Vector2f velocity;
+   
+    // Camera
+    sf::View& gameView;
+   
+    // UI
+    sf::RectangleShape healthBar;
+    sf::RectangleShape manaBar;
+    sf::Text nameText;
+   
+public:
+    Player(const std::string& name, ResourceManager& resources, SoundManager& sounds,
+           TimerWheel& timers, Animator& animator, sf::View& gameView,
+           int strength = 12, int dexterity = 12, int constitution = 12,
+           int intelligence = 12, int wisdom = 12, int charisma = 12)
+        : Character(name, "player", resources, sounds, timers, animator, "player",
+                   resources.getArchetypes().findAnimationSet("player"), strength, dexterity, constitution, intelligence, wisdom, charisma),
+          experience(0), gold(50), moveSpeed(PLAYER_SPEED), gameView(gameView) {
+       
+        // Initialize UI elements
+        healthBar.setSize(sf::Vector2f(50, 6));
+        healthBar.setFillColor(sf::Color::Red);
+        healthBar.setOutlineColor(sf::Color::Black);
+        healthBar.setOutlineThickness(1);
+       
+        manaBar.setSize(sf::Vector2f(50, 4));
+        manaBar.setFillColor(sf::Color::Blue);
+        manaBar.setOutlineColor(sf::Color::Black);
+        manaBar.setOutlineThickness(1);
+       
+        nameText.setFont(resources.getFont("main"));
+        nameText.setString(name);
+        nameText.setCharacterSize(12);
+        nameText.setFillColor(sf::Color::White);
+        nameText.setOutlineColor(sf::Color::Black);
+        nameText.setOutlineThickness(1);
+    }
+   
+    void update(float deltaTime) override {
+        // Update base character
+        Character::update(deltaTime);
+       
+        // Apply movement
+        moveBy(velocity.x * deltaTime, velocity.y * deltaTime);
+        velocity = sf::Vector2f(0, 0);
+       
+        // Update camera to follow player
+        gameView.setCenter(position);
+       
+        // Update UI elements
+        healthBar.setPosition(position.x - 25, position.y - 40);
+        healthBar.setSize(sf::Vector2f(50.0f * health / maxHealth, 6));
+       
+        manaBar.setPosition(position.x - 25, position.y - 32);
+        manaBar.setSize(sf::Vector2f(50.0f * mana / maxMana, 4));
+       
+        nameText.setPosition(position.x - nameText.getLocalBounds().width / 2, position.y - 55);
+    }
+   
+    void draw(DrawList& list) override {
+        DrawList::Scope drawScope(list, DrawList::SOURCE_ENTITY);
+       
+        // Draw character
+        Character::draw(list);
+       
+        // Draw UI elements
+        list.draw(healthBar);
+        list.draw(manaBar);
+        list.draw(nameText);
+    }
+   
+    void move(float dx, float dy) {
+        if (dx != 0 || dy != 0) {
+            velocity = sf::Vector2f(dx, dy);
+           
+            // Normalize velocity for diagonal movement
+            float length = std::sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
+            if (length > 0) {
+                velocity /= length;
+            }
+           
+            velocity *= moveSpeed;
+           
+            // Set facing direction
+            if (dx != 0) {
+                setFacingDirection(dx > 0);
+            }
+           
+            setAnimation(GameData::CLIP_WALK);
+        } else {
+            setAnimation(GameData::CLIP_IDLE);
+        }
+    }
+   
+    void gainExperience(int exp) {
+        experience += exp;
+       
+        // Check for level up
+        int requiredExp = level * 1000;
+        if (experience >= requiredExp) {
+            levelUp();
+        }
+    }
+   
+    void levelUp() {
+        level++;
+        experience -= level * 1000;
+       
+        // Increase stats based on D&D rules
+        maxHealth += GameUtils::rollDice(1, 8) + (constitution - 10) / 2;
+        health = maxHealth;
+       
+        maxMana += GameUtils::rollDice(1, 4) + (intelligence - 10) / 2;
+        mana = maxMana;
+       
+        // Increase a random attribute
+        int statChoice = GameUtils::getRandomInt(1, 6);
+        switch (statChoice) {
+            case 1: strength++; break;
+            case 2: dexterity++; break;
+            case 3: constitution++; break;
+            case 4: intelligence++; break;
+            case 5: wisdom++; break;
+            case 6: charisma++; break;
+        }
+       
+        // Recalculate derived stats
+        armorClass = 10 + (dexterity - 10) / 2;
+        attackBonus = (strength - 10) / 2;
+       
+        sounds.playSound("level_up");
+    }
+   
+    // Inventory management
+    void addItem(std::shared_ptr<Item> item) {
+        inventory.push_back(item);
+        sounds.playSound("item");
+    }
+   
+    void removeItem(int index) {
+        if (index >= 0 && index < inventory.size()) {
+            inventory.erase(inventory.begin() + index);
+        }
+    }
+   
+    void addGold(int amount) {
+        gold += amount;
+        sounds.playSound("item");
+    }
+   
+    // Quest management
+    void setQuestFlag(const std::string& quest, bool completed) {
+        questFlags[quest] = completed;
+    }
+   
+    bool hasQuestFlag(const std::string& quest) const {
+        auto it = questFlags.find(quest);
+        return it != questFlags.end() && it->second;
+    }
+   
+    // Spell management
+    void learnSpell(std::shared_ptr<Spell> spell) {
+        spells.push_back(spell);
+    }
+   
+    // Pay for a known spell; returns its archetype for SpellSystem, or -1 if it can't be cast
+    int beginCast(int spellIndex) {
+        if (spellIndex < 0 || spellIndex >= spells.size()) return -1;
+       
+        const Spell& spell = *spells[spellIndex];
+        if (level < spell.getMinimumLevel() || mana < spell.getManaCost()) return -1;
+       
+        mana -= spell.getManaCost();
+        return spell.getArchetype();
+    }
+   
+    // Getters
+    int getExperience() const { return experience; }
+    int getGold() const { return gold; }
+    const std::vector<std::shared_ptr<Item>>& getInventory() const { return inventory; }
+    const std::vector<std::shared_ptr<Spell>>& getSpells() const { return spells; }
+};
+
+// Enemy class
+class Enemy : public Character {
+private:
+    int archetype;  // Index into the archetype table
+    float detectionRange;
+    float attackRange;
+    Player* target;
+    TimerWheel::Handle attackCooldown;
+    TimerWheel::Handle wanderCooldown;
+    sf::Vector2f wanderTarget;
+    bool aggravated;
+    bool attackPending;
+   
+    // Route being walked: the path finder's waypoints, and the tiles of the current leg
+    PathFinder* pathfinder;
+    std::vector<sf::Vector2i> waypoints;
+    size_t nextWaypoint;
+    std::vector<sf::Vector2i> leg;
+    size_t nextStep;
+    TimerWheel::Handle repathCooldown;
+   
+    // AI states
+    enum class State { Idle, Wander, Chase, Attack };
+    State currentState;
+   
+public:
+    Enemy(int archetype, ResourceManager& resources, SoundManager& sounds, TimerWheel& timers, Animator& animator)
+        : Enemy(archetype, resources.getArchetypes(), resources, sounds, timers, animator) {}
+   
+    ~Enemy() {
+        timers.cancel(attackCooldown);
+        timers.cancel(wanderCooldown);
+        timers.cancel(repathCooldown);
+    }
+   
+private:
+    Enemy(int archetype, const ArchetypeTable& table, ResourceManager& resources, SoundManager& sounds,
+          TimerWheel& timers, Animator& animator)
+        : Character(table.getString(table.getMonster(archetype).name),
+                   table.getString(table.getMonster(archetype).texture),
+                   resources, sounds, timers, animator,
+                   table.getString(table.getMonster(archetype).texture),
+                   table.getMonster(archetype).animationSet,
+                   table.getMonster(archetype).stats[0], table.getMonster(archetype).stats[1],
+                   table.getMonster(archetype).stats[2], table.getMonster(archetype).stats[3],
+                   table.getMonster(archetype).stats[4], table.getMonster(archetype).stats[5]),
+          archetype(archetype),
+          detectionRange(200.0f), attackRange(50.0f), target(nullptr),
+          attackCooldown(0), wanderCooldown(0), aggravated(false), attackPending(false),
+          pathfinder(nullptr), nextWaypoint(0), nextStep(0), repathCooldown(0),
+          currentState(State::Idle) {
+       
+        onHitEffect = static_cast<GameData::EffectId>(table.getMonster(archetype).onHitEffect);
+        onHitChance = table.getMonster(archetype).onHitChance;
+        setPalette(table.getMonster(archetype).palette);
+       
+        // Set random wander target
+        updateWanderTarget();
+        wanderCooldown = timers.schedule(3.0f);
+    }
+   
+public:   
+    void update(float deltaTime) override {
+        Character::update(deltaTime);
+       
+        if (!isAlive() || !target) return;
+       
+        // Asleep until the effect wears off or something hits it
+        if (hasEffect(GameData::EFFECT_SLEEP)) {
+            setAnimation(GameData::CLIP_IDLE);
+            return;
+        }
+       
+        // Update AI state based on distance to target
+        float distanceToTarget = GameUtils::distance(position.x, position.y,
+                                                   target->getPosition().x, target->getPosition().y);
+       
+        if (aggravated || distanceToTarget < detectionRange) {
+            if (distanceToTarget <= attackRange) {
+                currentState = State::Attack;
+            } else {
+                currentState = State::Chase;
+                aggravated = true;
+            }
+        } else if (!timers.isPending(wanderCooldown)) {
+            updateWanderTarget();
+            wanderCooldown = timers.schedule(3.0f);
+            currentState = State::Wander;
+        }
+       
+        // Execute behavior based on state
+        switch (currentState) {
+            case State::Idle:
+                setAnimation(GameData::CLIP_IDLE);
+                break;
+               
+            case State::Wander:
+                if (pathfinder) {
+                    if (!followPath(deltaTime, 50.0f)) currentState = State::Idle;
+                    break;
+                }
+                moveTowardsPoint(wanderTarget.x, wanderTarget.y, deltaTime, 50.0f);
+                if (GameUtils::distance(position.x, position.y, wanderTarget.x, wanderTarget.y) < 10.0f) {
+                    currentState = State::Idle;
+                }
+                break;
+               
+            case State::Chase:
+                // Further than a couple of tiles, go around walls; re-plan twice a second
+                if (pathfinder && distanceToTarget > TILE_SIZE * 2.0f) {
+                    if (!timers.isPending(repathCooldown)) {
+                        planPath(target->getPosition().x, target->getPosition().y);
+                        repathCooldown = timers.schedule(0.5f);
+                    }
+                    if (followPath(deltaTime, 100.0f)) break;
+                }
+                moveTowardsPoint(target->getPosition().x, target->getPosition().y, deltaTime, 100.0f);
+                break;
+               
+            case State::Attack:
+                if (!timers.isPending(attackCooldown)) {  // Attack every second
+                    attackPending = true;
+                    attackCooldown = timers.schedule(1.0f);
+                }
+                break;
+        }
+    }
+   
+    void moveTowardsPoint(float x, float y, float deltaTime, float speed) {
+        sf::Vector2f direction(x - position.x, y - position.y);
+        float length = std::sqrt(direction.x * direction.x + direction.y * direction.y);
+       
+        if (length > 0) {
+            direction /= length;
+            float step = std::min(speed * deltaTime, length);  // Don't overshoot
+            moveBy(direction.x * step, direction.y * step);
+           
+            // Update facing direction
+            setFacingDirection(direction.x > 0);
+            setAnimation(GameData::CLIP_WALK);
+        }
+    }
+   
+    // Set a random point within reasonable distance; with a path finder, only one
+    // that can actually be walked to
+    void updateWanderTarget() {
+        for (int attempt = 0; attempt < 4; attempt++) {
+            float angle = GameUtils::getRandomFloat(0, 2 * 3.14159f);
+            float distance = GameUtils::getRandomFloat(50, 150);
+            wanderTarget.x = position.x + std::cos(angle) * distance;
+            wanderTarget.y = position.y + std::sin(angle) * distance;
+            if (!pathfinder || planPath(wanderTarget.x, wanderTarget.y)) return;
+        }
+    }
+   
+    // Plan a route to a world position
+    bool planPath(float x, float y) {
+        leg.clear();
+        nextStep = 0;
+        nextWaypoint = 0;
+        return pathfinder->findPath(tileOf(position.x, position.y), tileOf(x, y), waypoints);
+    }
+   
+    // Walk the planned route, refining each leg when the last one runs out.
+    // Returns false once the route is used up.
+    bool followPath(float deltaTime, float speed) {
+        while (nextStep >= leg.size()) {
+            if (nextWaypoint >= waypoints.size()) return false;
+            sf::Vector2i from = leg.empty() ? tileOf(position.x, position.y) : leg.back();
+            if (!pathfinder->refine(from, waypoints[nextWaypoint++], leg)) {
+                waypoints.clear();
+                return false;
+            }
+            nextStep = 0;
+        }
+       
+        float stepX = (leg[nextStep].x + 0.5f) * TILE_SIZE;
+        float stepY = (leg[nextStep].y + 0.5f) * TILE_SIZE;
+        moveTowardsPoint(stepX, stepY, deltaTime, speed);
+        if (GameUtils::distance(position.x, position.y, stepX, stepY) < 2.0f) nextStep++;
+        return true;
+    }
+   
+    static sf::Vector2i tileOf(float x, float y) {
+        return sf::Vector2i(static_cast<int>(x) / TILE_SIZE, static_cast<int>(y) / TILE_SIZE);
+    }
+   
+    void setPathFinder(PathFinder* paths) {
+        pathfinder = paths;
+        // Room for a typical route up front, so walking one rarely grows these
+        waypoints.reserve(16);
+        leg.reserve(2 * PathFinder::CLUSTER_SIZE);
+    }
+   
+    void setTarget(Player* player) {
+        target = player;
+    }
+   
+    void aggravate() {
+        aggravated = true;
+    }
+   
+    // The AI only decides to attack; the dungeon hands the intent to the combat system
+    bool takeAttackIntent() {
+        bool pending = attackPending;
+        attackPending = false;
+        return pending;
+    }
+   
+    int getArchetype() const { return archetype; }
+    int getExperienceValue() const { return resources.getArchetypes().getMonster(archetype).experience; }
+    int getGoldValue() const { return resources.getArchetypes().getMonster(archetype).gold; }
+};
+
+// Combat system - attacks are queued as intents while entities update and are
+// resolved together once per tick, so no update loop changes health halfway
+// through an iteration. The batch is rolled in one branch-free pass over plain
+// arrays, with dice taken from a seeded counter-based hash: the same seed and the
+// same intents always give the same outcome. Resolution records Miss / Hit / Death
+// events that audio, particles and the UI consume afterwards.
+class CombatSystem {
+public:
+    enum class EventType { Miss, Hit, Death };
+   
+    struct Event {
+        EventType type;
+        Character* attacker;  // nullptr for damage without a source
+        Character* target;
+        int amount;
+        bool critical;
+        bool melee;           // false for projectiles and other automatic hits
+        float x, y;           // Target position when resolved
+    };
+   
+private:
+    // Pending intents, one array per field
+    std::vector<Character*> attackers;
+    std::vector<Character*> targets;
+    std::vector<int32_t> modifiers;
+    std::vector<int32_t> damageMin;
+    std::vector<uint32_t> damageFaces;  // max - min + 1
+    std::vector<int32_t> damageBonus;
+    std::vector<int32_t> autoHit;
+   
+    // Filled in by resolve()
+    std::vector<int32_t> armorClasses;
+    std::vector<int32_t> hits;
+    std::vector<int32_t> criticals;
+    std::vector<int32_t> damage;
+    std::vector<Event> events;
+   
+    uint32_t seed;
+    uint32_t stream;  // Dice drawn since the last reseed
+    uint64_t attacksResolved;
+   
+public:
+    // Intents a tick can hold before the batch arrays have to grow
+    static const size_t RESERVED_INTENTS = 256;
+   
+    explicit CombatSystem(uint32_t seed = 0x4C414E43u)
+        : seed(seed), stream(0), attacksResolved(0) {
+        attackers.reserve(RESERVED_INTENTS);
+        targets.reserve(RESERVED_INTENTS);
+        modifiers.reserve(RESERVED_INTENTS);
+        damageMin.reserve(RESERVED_INTENTS);
+        damageFaces.reserve(RESERVED_INTENTS);
+        damageBonus.reserve(RESERVED_INTENTS);
+        autoHit.reserve(RESERVED_INTENTS);
+        armorClasses.reserve(RESERVED_INTENTS);
+        hits.reserve(RESERVED_INTENTS);
+        criticals.reserve(RESERVED_INTENTS);
+        damage.reserve(RESERVED_INTENTS);
+        events.reserve(RESERVED_INTENTS * 2);  // A hit can add a death
+    }
+   
+    // Restart the dice sequence; replaying the same intents repeats the same results
+    void reseed(uint32_t value) {
+        seed = value;
+        stream = 0;
+    }
+   
+    void queueAttack(Character& attacker, Character& target) {
+        int minDamage, maxDamage;
+        attacker.getDamageRange(minDamage, maxDamage);
+        push(&attacker, target, attacker.getAttackModifier(), minDamage, maxDamage,
+             attacker.getDamageBonus(), false);
+    }
+   
+    // Damage that has already connected, e.g. a projectile hit; no attack roll
+    void queueDamage(Character* source, Character& target, int amount) {
+        push(source, target, 0, amount, amount, 0, true);
+    }
+   
+    void resolve() {
+        events.clear();
+        size_t count = attackers.size();
+        if (count == 0) return;
+       
+        // Armor class is read at resolution so equipment changed this tick counts
+        armorClasses.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            armorClasses[i] = targets[i]->getArmorClass();
+        }
+       
+        rollBatch(count);
+       
+        // Apply in queue order. A character killed earlier in the batch takes no
+        // further hits and its own melee swings are dropped.
+        for (size_t i = 0; i < count; i++) {
+            Character* attacker = attackers[i];
+            Character* target = targets[i];
+            if (!target->isAlive() || (!autoHit[i] && attacker && !attacker->isAlive())) continue;
+           
+            Event event = {hits[i] ? EventType::Hit : EventType::Miss, attacker, target, damage[i],
+                           criticals[i] != 0, autoHit[i] == 0, target->getPosition().x, target->getPosition().y};
+            events.push_back(event);
+           
+            if (hits[i] && target->applyDamage(damage[i])) {
+                event.type = EventType::Death;
+                events.push_back(event);
+            }
+        }
+       
+        attacksResolved += count;
+        attackers.clear();
+        targets.clear();
+        modifiers.clear();
+        damageMin.clear();
+        damageFaces.clear();
+        damageBonus.clear();
+        autoHit.clear();
+    }
+   
+    // Drop the pending intents against a character that is about to be destroyed,
+    // and its own melee swings. Damage it already dealt still lands, unattributed.
+    void forget(const Character& character) {
+        size_t kept = 0;
+        for (size_t i = 0; i < attackers.size(); i++) {
+            if (targets[i] == &character || (attackers[i] == &character && !autoHit[i])) continue;
+            attackers[kept] = attackers[i] == &character ? nullptr : attackers[i];
+            targets[kept] = targets[i];
+            modifiers[kept] = modifiers[i];
+            damageMin[kept] = damageMin[i];
+            damageFaces[kept] = damageFaces[i];
+            damageBonus[kept] = damageBonus[i];
+            autoHit[kept] = autoHit[i];
+            kept++;
+        }
+        attackers.resize(kept);
+        targets.resize(kept);
+        modifiers.resize(kept);
+        damageMin.resize(kept);
+        damageFaces.resize(kept);
+        damageBonus.resize(kept);
+        autoHit.resize(kept);
+    }
+   
+    const std::vector<Event>& getEvents() const { return events; }
+    size_t getPendingCount() const { return attackers.size(); }
+    uint64_t getAttacksResolved() const { return attacksResolved; }
+   
+private:
+    void push(Character* attacker, Character& target, int modifier, int minDamage, int maxDamage,
+              int bonus, bool automatic) {
+        attackers.push_back(attacker);
+        targets.push_back(&target);
+        modifiers.push_back(modifier);
+        damageMin.push_back(minDamage);
+        int64_t faces = std::clamp<int64_t>(int64_t{maxDamage} - minDamage + 1, 1, UINT32_MAX);
+        damageFaces.push_back(static_cast<uint32_t>(faces));
+        damageBonus.push_back(bonus);
+        autoHit.push_back(automatic ? 1 : 0);
+    }
+   
+    // lowbias32 integer hash; cheap enough to draw every die in the batch from it
+    static uint32_t hash(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7FEB352Du;
+        x ^= x >> 15;
+        x *= 0x846CA68Bu;
+        x ^= x >> 16;
+        return x;
+    }
+   
+    void rollBatch(size_t count) {
+        hits.resize(count);
+        criticals.resize(count);
+        damage.resize(count);
+       
+        uint32_t n = static_cast<uint32_t>(count);
+        rollDice(seed, stream, n, modifiers.data(), armorClasses.data(), damageMin.data(), damageFaces.data(),
+                 damageBonus.data(), autoHit.data(), hits.data(), criticals.data(), damage.data());
+        stream += n * 2u;
+    }
+   
+    // d20 against armor class and the damage die for every intent. No branches and
+    // no generator state inside the loop, so the compiler can vectorize it. Natural
+    // 20 always hits for double damage, natural 1 always misses. The damage die
+    // scales all 32 bits in 64-bit math, so a range of any size stays uniform.
+    static void rollDice(uint32_t seed, uint32_t base, uint32_t n,
+                         const int32_t* __restrict modifier, const int32_t* __restrict armorClass,
+                         const int32_t* __restrict minimum, const uint32_t* __restrict faces,
+                         const int32_t* __restrict bonus, const int32_t* __restrict automatic,
+                         int32_t* __restrict hit, int32_t* __restrict critical, int32_t* __restrict amount) {
+        uint32_t draw = base;
+        for (uint32_t i = 0; i < n; i++, draw += 2u) {
+            uint32_t rollBits = hash(seed ^ (draw * 0x9E3779B9u));
+            uint32_t damageBits = hash(seed ^ ((draw + 1u) * 0x9E3779B9u));
+           
+            int32_t roll = 1 + static_cast<int32_t>(((rollBits >> 8) * 20u) >> 24);
+            int32_t natural20 = roll == 20;
+            int32_t crit = natural20 & (automatic[i] ^ 1);
+            int32_t lands = ((roll + modifier[i] >= armorClass[i]) & (roll != 1)) | natural20 | automatic[i];
+            int32_t dealt = minimum[i] + static_cast<int32_t>((uint64_t{damageBits} * faces[i]) >> 32) + bonus[i];
+           
+            hit[i] = lands;
+            critical[i] = crit & lands;
+            amount[i] = lands * dealt * (1 + crit);
+        }
+    }
+};
+
+// Status effects - poison, sleep, bless and regeneration, driven by timer wheel
+// events rather than per-frame countdowns. A character holds at most one instance
+// of each effect: reapplying adds a stack up to the rule's limit and restarts the
+// duration, while periodic ticks keep their rhythm. Poison damage goes through the
+// combat queue like any other hit.
+class StatusEffects {
+public:
+    struct Rule {
+        const char* name;
+        float duration;     // Seconds
+        float period;       // Seconds between ticks, 0 for none
+        int magnitude;      // Per stack: poison damage, regeneration heal or attack bonus
+        int maxStacks;
+        sf::Color color;
+    };
+   
+private:
+    TimerWheel& timers;
+    CombatSystem& combat;
+   
+public:
+    StatusEffects(TimerWheel& timers, CombatSystem& combat) : timers(timers), combat(combat) {}
+   
+    static const Rule& getRule(GameData::EffectId id) {
+        static const Rule rules[GameData::EFFECT_COUNT] = {
+            {"None", 0.0f, 0.0f, 0, 0, sf::Color::White},
+            {"Poisoned", 12.0f, 2.0f, 2, 3, sf::Color(120, 220, 80)},
+            {"Asleep", 8.0f, 0.0f, 0, 1, sf::Color(150, 150, 255)},
+            {"Blessed", 30.0f, 0.0f, 2, 1, sf::Color(255, 230, 120)},
+            {"Regenerating", 20.0f, 1.0f, 1, 1, sf::Color(120, 255, 160)}
+        };
+        return rules[id];
+    }
+   
+    // Returns true if the effect took hold or gained a stack; at the stack limit
+    // only the duration is refreshed
+    bool apply(Character& target, GameData::EffectId id, int stacks = 1) {
+        if (id <= GameData::EFFECT_NONE || id >= GameData::EFFECT_COUNT || !target.isAlive()) return false;
+       
+        const Rule& rule = getRule(id);
+        Character::ActiveEffect& effect = target.getEffectState(id);
+        bool gained = effect.stacks < rule.maxStacks;
+        if (effect.stacks == 0 && rule.period > 0.0f) {
+            effect.tick = timers.schedule(rule.period, TIMER_EFFECT_TICK, &target, id);
+        }
+        effect.stacks = std::min(rule.maxStacks, effect.stacks + stacks);
+       
+        timers.cancel(effect.expiry);
+        effect.expiry = timers.schedule(rule.duration, TIMER_EFFECT_EXPIRE, &target, id);
+        refresh(target);
+        return gained;
+    }
+   
+    void remove(Character& target, GameData::EffectId id) {
+        Character::ActiveEffect& effect = target.getEffectState(id);
+        if (effect.stacks == 0) return;
+       
+        timers.cancel(effect.expiry);
+        timers.cancel(effect.tick);
+        effect.stacks = 0;
+        refresh(target);
+    }
+   
+    void clear(Character& target) {
+        for (int id = GameData::EFFECT_NONE + 1; id < GameData::EFFECT_COUNT; id++) {
+            remove(target, static_cast<GameData::EffectId>(id));
+        }
+    }
+   
+    // Expiry and periodic ticks. Records for timers that were replaced after they
+    // fired (reapplied or removed in the same frame) no longer match and are dropped.
+    void onTimer(const TimerWheel::Expired& timer) {
+        Character& target = *static_cast<Character*>(timer.owner);
+        GameData::EffectId id = static_cast<GameData::EffectId>(timer.data);
+        Character::ActiveEffect& effect = target.getEffectState(id);
+        if (!target.isAlive()) return;  // Dead this frame; the death event clears its effects
+       
+        if (timer.kind == TIMER_EFFECT_EXPIRE) {
+            if (timer.handle == effect.expiry) remove(target, id);
+            return;
+        }
+        if (timer.kind != TIMER_EFFECT_TICK || timer.handle != effect.tick) return;
+       
+        const Rule& rule = getRule(id);
+        effect.tick = timers.schedule(rule.period, TIMER_EFFECT_TICK, &target, id);
+        int amount = rule.magnitude * effect.stacks;
+        if (id == GameData::EFFECT_POISON) {
+            combat.queueDamage(nullptr, target, amount);
+        } else if (id == GameData::EFFECT_REGENERATION) {
+            target.heal(amount);
+        }
+    }
+   
+private:
+    // Stats derived from the active effects
+    void refresh(Character& target) {
+        target.setEffectAttackBonus(getRule(GameData::EFFECT_BLESS).magnitude *
+                                    target.getEffectStacks(GameData::EFFECT_BLESS));
+    }
+};
+
+class Potion : public Item {
+private:
+    int archetype;
+    int healAmount;
+   
+public:
+    Potion(int archetype, ResourceManager& resources, int level = 0)
+        : Potion(archetype, resources.getArchetypes(), resources, level) {}
+   
+    bool use(Player& player) override {
+        player.heal(healAmount);
+        return true;  // Consumable
+    }
+   
+    void applyAffix(const ArchetypeTable& table, int index) override {
+        Item::applyAffix(table, index);
+        healAmount += table.getAffix(index).heal;
+    }
+   
+    int getArchetype() const { return archetype; }
+    int getHealAmount() const { return healAmount; }
+   
+private:
+    Potion(int archetype, const ArchetypeTable& table, ResourceManager& resources, int level)
+        : Item(table.getString(table.getPotion(archetype).name), "potion", resources,
+               table.getString(table.getPotion(archetype).description),
+               GameData::scaled(table.getPotion(archetype).value, table.getPotion(archetype).valuePerLevel, level),
+               GameData::toRect(table.getPotion(archetype).rect)),
+          archetype(archetype) {
+       
+        const GameData::PotionRecord& record = table.getPotion(archetype);
+        healAmount = GameData::scaled(record.heal, record.healPerLevel, level);
+    }
+};
+
+// Projectile class for spells/ranged attacks. SpellSystem keeps a fixed pool of
+// these and relaunches idle ones; a projectile only flies, glows and leaves a
+// trail, and the spell system decides what happens where it stops.
+class Projectile : public Entity {
+private:
+    ResourceManager& resources;
+    ParticleSystem& particles;
+    LightMap& lights;
+    TimerWheel& timers;
+    int light;
+    int spell;
+    Character* source;
+    float speed;
+    sf::Vector2f direction;
+    TimerWheel::Handle expiry;
+    float trailTimer;
+   
+public:
+    Projectile(ResourceManager& resources, ParticleSystem& particles, LightMap& lights, TimerWheel& timers)
+        : Entity("Projectile", "projectile", resources, "fireball"),
+          resources(resources), particles(particles), lights(lights), timers(timers),
+          light(-1), spell(-1), source(nullptr), speed(0.0f), expiry(0), trailTimer(0.0f) {
+        setActive(false);
+    }
+   
+    // Fly from (x, y) toward the target point for lifespan seconds
+    void launch(int spellIndex, Character* caster, const std::string& textureId,
+                float x, float y, float targetX, float targetY, float projectileSpeed, float lifespan) {
+        spell = spellIndex;
+        source = caster;
+        speed = projectileSpeed;
+        trailTimer = 0.0f;
+        sprite.setTexture(resources.getTexture(textureId), true);
+        sprite.setOrigin(sprite.getLocalBounds().width / 2, sprite.getLocalBounds().height / 2);
+        setPosition(x, y);
+        setActive(true);
+       
+        timers.cancel(expiry);
+        expiry = timers.schedule(lifespan);
+       
+        // Spell glow follows the projectile
+        light = lights.addLight(x, y, 4.0f, sf::Color(255, 160, 60));
+       
+        // Calculate direction
+        direction.x = targetX - x;
+        direction.y = targetY - y;
+        float length = std::sqrt(direction.x * direction.x + direction.y * direction.y);
+        if (length > 0) {
+            direction /= length;
+        }
+       
+        // Rotate sprite to face direction
+        float angle = std::atan2(direction.y, direction.x) * 180 / 3.14159f;
+        sprite.setRotation(angle);
+    }
+   
+    void update(float deltaTime) override {
+        Entity::update(deltaTime);
+       
+        // Move along direction
+        position.x += direction.x * speed * deltaTime;
+        position.y += direction.y * speed * deltaTime;
+        lights.moveLight(light, position.x, position.y);
+       
+        // Leave a trail at a fixed rate regardless of frame time
+        trailTimer += deltaTime;
+        int trailCount = static_cast<int>(trailTimer / 0.01f);
+        if (trailCount > 0) {
+            trailTimer -= trailCount * 0.01f;
+            particles.emit(ParticleSystem::EmitterType::SpellTrail, position.x, position.y, trailCount,
+                           -direction.x * speed * 0.1f, -direction.y * speed * 0.1f);
+        }
+    }
+   
+    // Back to the pool
+    void deactivate() {
+        setActive(false);
+        lights.removeLight(light);
+        light = -1;
+        timers.cancel(expiry);
+    }
+   
+    bool hasExpired() const { return !timers.isPending(expiry); }
+    int getSpell() const { return spell; }
+    Character* getSource() const { return source; }
+   
+    ~Projectile() {
+        lights.removeLight(light);
+        timers.cancel(expiry);
+    }
+};
+
+// Tile class for the world
+class Tile {
+public:
+    enum class Type : uint8_t {
+        Floor,
+        Wall,
+        Door,
+        Chest,
+        Water,
+        Lava,
+        Torch,
+        COUNT
+    };
+   
+    // Frame rate of the types drawn from a strip of frames; the strip's width gives the count
+    static constexpr uint8_t FRAMES_PER_SECOND[static_cast<int>(Type::COUNT)] = {0, 0, 0, 0, 6, 4, 10};
+   
+    // Layout of a wall sheet's blob pieces
+    static constexpr int BLOB_COLUMNS = 8;
+    static constexpr int BLOB_ROWS = 6;
+   
+private:
+    Type type;
+    bool walkable;
+    bool explored;
+    uint8_t frameCount;  // 1 for a still tile
+    sf::Sprite sprite;
+    const sf::Shader* material;  // Animated tiles play in the material shader when it's available
+   
+public:
+    Tile(Type type, ResourceManager& resources) : type(type), explored(false), frameCount(1), material(nullptr) {
+        switch (type) {
+            case Type::Floor:
+                sprite.setTexture(resources.getTexture("floor"));
+                walkable = true;
+                break;
+            case Type::Wall:
+                sprite.setTexture(resources.getTexture("wall"));
+                walkable = false;
+                break;
+            case Type::Door:
+                sprite.setTexture(resources.getTexture("door"));
+                walkable = true;
+                break;
+            case Type::Chest:
+                sprite.setTexture(resources.getTexture("chest"));
+                walkable = false;
+                break;
+            case Type::Water:
+                setAnimated(resources, "water", Materials::SURFACE_WATER);
+                walkable = false;
+                break;
+            case Type::Lava:
+                setAnimated(resources, "lava", Materials::SURFACE_LAVA);
+                walkable = false;
+                break;
+            case Type::Torch:
+                setAnimated(resources, "torch", Materials::SURFACE_TORCH);
+                walkable = false;
+                break;
+            case Type::COUNT:
+                break;
+        }
+    }
+   
+    void setPosition(float x, float y) {
+        sprite.setPosition(x, y);
+    }
+   
+    // Drawn through the dungeon's TileMesh rather than one by one
+    const sf::Sprite& getSprite() const { return sprite; }
+    const sf::Shader* getMaterial() const { return material; }
+    int getFrameCount() const { return frameCount; }
+    int getFramesPerSecond() const { return FRAMES_PER_SECOND[static_cast<int>(type)]; }
+   
+    Type getType() const { return type; }
+    bool isWalkable() const { return walkable; }
+    bool isOpaque() const { return type == Type::Wall || type == Type::Torch; }
+   
+    // Show a wall's piece of the blob sheet; a wall image too small for one keeps its single look
+    void setShape(uint8_t shape) {
+        if (type != Type::Wall || !sprite.getTexture()) return;
+        sf::Vector2u size = sprite.getTexture()->getSize();
+        if (size.x < BLOB_COLUMNS * TILE_SIZE || size.y < BLOB_ROWS * TILE_SIZE) return;
+        sprite.setTextureRect(sf::IntRect(shape % BLOB_COLUMNS * TILE_SIZE, shape / BLOB_COLUMNS * TILE_SIZE,
+                                          TILE_SIZE, TILE_SIZE));
+    }
+   
+    void setExplored(bool value) { explored = value; }
+    bool isExplored() const { return explored; }
+   
+    sf::FloatRect getBounds() const {
+        return sprite.getGlobalBounds();
+    }
+   
+private:
+    // Show frame 0 of the strip; the shader, or the mesh without one, moves it along
+    void setAnimated(ResourceManager& resources, const std::string& textureId, Materials::Surface surface) {
+        const sf::Texture& texture = resources.getTexture(textureId);
+        sprite.setTexture(texture);
+        sprite.setTextureRect(sf::IntRect(0, 0, TILE_SIZE, TILE_SIZE));
+        frameCount = static_cast<uint8_t>(std::clamp(static_cast<int>(texture.getSize().x) / TILE_SIZE, 1, 255));
+       
+        material = resources.getMaterials().getShader();
+        if (material) sprite.setColor(Materials::encodeTile(surface, frameCount, getFramesPerSecond()));
+    }
+};
+
+// The compact form of a tile, one per cell in a flat row-major grid
+struct TileRecord {
+    Tile::Type type;
+    uint8_t shape;  // Blob piece for walls, from the Autotiler
+};
+static_assert(sizeof(TileRecord) == 2, "TileRecord must stay two bytes");
+
+// Autotiler - gives every wall one of the 47 pieces of a blob tile set from its
+// eight neighbours. The neighbours make a bitmask; a corner only matters when
+// both walls beside it are present, which folds the 256 masks down to 47, and a
+// constexpr table maps each mask to its piece. The full pass runs a row at a
+// time over byte rows, so the mask loop vectorizes, and splits the map into
+// bands of rows across threads. Torches join walls; the map's edge counts as wall.
+class Autotiler {
+public:
+    static constexpr int PIECE_COUNT = 47;
+   
+    enum Neighbour : uint8_t {
+        NORTH = 1,
+        NORTH_EAST = 2,
+        EAST = 4,
+        SOUTH_EAST = 8,
+        SOUTH = 16,
+        SOUTH_WEST = 32,
+        WEST = 64,
+        NORTH_WEST = 128
+    };
+   
+    // Clear the corners that don't count
+    static constexpr uint8_t reduce(uint8_t mask) {
+        if ((mask & (NORTH | EAST)) != (NORTH | EAST)) mask &= ~NORTH_EAST;
+        if ((mask & (SOUTH | EAST)) != (SOUTH | EAST)) mask &= ~SOUTH_EAST;
+        if ((mask & (SOUTH | WEST)) != (SOUTH | WEST)) mask &= ~SOUTH_WEST;
+        if ((mask & (NORTH | WEST)) != (NORTH | WEST)) mask &= ~NORTH_WEST;
+        return mask;
+    }
+   
+private:
+    // Pieces are numbered by their reduced mask in ascending order
+    static constexpr std::array<uint8_t, 256> buildPieces() {
+        std::array<bool, 256> used{};
+        for (int mask = 0; mask < 256; mask++) used[reduce(static_cast<uint8_t>(mask))] = true;
+        std::array<uint8_t, 256> rank{};
+        int count = 0;
+        for (int mask = 0; mask < 256; mask++) {
+            rank[mask] = static_cast<uint8_t>(count);
+            if (used[mask]) count++;
+        }
+        std::array<uint8_t, 256> pieces{};
+        for (int mask = 0; mask < 256; mask++) pieces[mask] = rank[reduce(static_cast<uint8_t>(mask))];
+        return pieces;
+    }
+   
+public:
+    static const std::array<uint8_t, 256> PIECES;  // Reduced mask rank for every mask
+   
+    static bool joins(Tile::Type type) {
+        return type == Tile::Type::Wall || type == Tile::Type::Torch;
+    }
+   
+    // Autotile a whole grid, across up to threads workers. Small maps stay on the
+    // calling thread, since starting one costs more than a few thousand rows.
+    static void run(TileRecord* records, int width, int height, int threads = 1) {
+        const int ROWS_PER_THREAD = 256;
+        threads = std::max(1, std::min(threads, height / ROWS_PER_THREAD));
+        if (threads == 1) {
+            runRows(records, width, height, 0, height);
+            return;
+        }
+       
+        std::vector<std::thread> workers;
+        int band = (height + threads - 1) / threads;
+        for (int t = 1; t < threads; t++) {
+            int first = std::min(height, t * band);
+            int end = std::min(height, first + band);
+            workers.emplace_back([=]() { runRows(records, width, height, first, end); });
+        }
+        runRows(records, width, height, 0, std::min(height, band));
+        for (std::thread& worker : workers) worker.join();
+    }
+   
+    // Redo the cell at x, y and its neighbours after it changed
+    static void update(TileRecord* records, int width, int height, int x, int y) {
+        for (int ny = std::max(0, y - 1); ny <= std::min(height - 1, y + 1); ny++) {
+            for (int nx = std::max(0, x - 1); nx <= std::min(width - 1, x + 1); nx++) {
+                TileRecord& record = records[static_cast<size_t>(ny) * width + nx];
+                record.shape = joins(record.type) ? PIECES[maskAt(records, width, height, nx, ny)] : 0;
+            }
+        }
+    }
+   
+    // One cell's mask by direct lookups, as update() uses
+    static uint8_t maskAt(const TileRecord* records, int width, int height, int x, int y) {
+        auto wall = [&](int cx, int cy) {
+            return cx < 0 || cx >= width || cy < 0 || cy >= height ||
+                   joins(records[static_cast<size_t>(cy) * width + cx].type);
+        };
+        return static_cast<uint8_t>((wall(x, y - 1) ? NORTH : 0) | (wall(x + 1, y - 1) ? NORTH_EAST : 0) |
+                                    (wall(x + 1, y) ? EAST : 0) | (wall(x + 1, y + 1) ? SOUTH_EAST : 0) |
+                                    (wall(x, y + 1) ? SOUTH : 0) | (wall(x - 1, y + 1) ? SOUTH_WEST : 0) |
+                                    (wall(x - 1, y) ? WEST : 0) | (wall(x - 1, y - 1) ? NORTH_WEST : 0));
+    }
+   
+private:
+    // Rows [first, end). Three rows of wall bytes roll down the band, each padded
+    // by one wall column either side so the edges need no tests.
+    static void runRows(TileRecord* records, int width, int height, int first, int end) {
+        if (first >= end) return;
+        std::vector<uint8_t> buffer(static_cast<size_t>(width + 2) * 3 + width);
+        uint8_t* above = buffer.data();
+        uint8_t* row = above + width + 2;
+        uint8_t* below = row + width + 2;
+        uint8_t* masks = below + width + 2;
+       
+        auto fill = [&](uint8_t* out, int y) {
+            out[0] = 1;
+            out[width + 1] = 1;
+            if (y < 0 || y >= height) {
+                std::fill(out + 1, out + width + 1, uint8_t(1));
+                return;
+            }
+            const TileRecord* source = records + static_cast<size_t>(y) * width;
+            for (int x = 0; x < width; x++) {
+                out[x + 1] = static_cast<uint8_t>((source[x].type == Tile::Type::Wall) | (source[x].type == Tile::Type::Torch));
+            }
+        };
+        fill(above, first - 1);
+        fill(row, first);
+       
+        for (int y = first; y < end; y++) {
+            fill(below, y + 1);
+            for (int x = 0; x < width; x++) {
+                masks[x] = static_cast<uint8_t>(above[x + 1] | above[x + 2] << 1 | row[x + 2] << 2 | below[x + 2] << 3 |
+                                                below[x + 1] << 4 | below[x] << 5 | row[x] << 6 | above[x] << 7);
+            }
+            TileRecord* out = records + static_cast<size_t>(y) * width;
+            // A multiply rather than a branch: walls are as good as random to the predictor
+            for (int x = 0; x < width; x++) out[x].shape = static_cast<uint8_t>(PIECES[masks[x]] * row[x + 1]);
+           
+            uint8_t* spare = above;
+            above = row;
+            row = below;
+            below = spare;
+        }
+    }
+};
+
+constexpr std::array<uint8_t, 256> Autotiler::PIECES = Autotiler::buildPieces();
+static_assert(*std::max_element(Autotiler::PIECES.begin(), Autotiler::PIECES.end()) == Autotiler::PIECE_COUNT - 1,
+              "the blob set has 47 pieces");
+
+// Tile mesh - the dungeon's tiles as cached quads, in square chunks with one
+// layer per tile type. A chunk is rebuilt only when one of its tiles changes.
+// Animated tiles are stored at frame 0 and the material shader picks the frame
+// from its time uniform, so the cache survives every frame of the animation.
+// Without the shader the animated layers of the chunks in view have their
+// texture coordinates moved when the clock reaches a new frame; still layers
+// are never touched either way. For the isometric view each chunk also keeps its
+// walls and torches stood up as faces in screen space, in runs along its
+// diagonals, which are screen rows; a frame files the runs in view for depth
+// sorting, trimmed to the faces on screen.
+class TileMesh {
+public:
+    static constexpr int CHUNK_TILES = 8;
+    static constexpr int LAYER_COUNT = static_cast<int>(Tile::Type::COUNT);
+   
+    struct Stats {
+        int chunksDrawn = 0;
+        int quadsDrawn = 0;
+        int quadsAnimated = 0;   // Animated quads moved to a new frame on the CPU
+        int faceRuns = 0;        // Runs of standing faces gathered for the isometric view
+        long long chunksRebuilt = 0;  // Since the last reset
+    };
+   
+    // How opaque a standing face that would hide the player is drawn
+    static constexpr sf::Uint8 SEE_THROUGH_ALPHA = 80;
+   
+private:
+    static constexpr int DIAGONALS = CHUNK_TILES * 2 - 1;  // Also its columns, x - y
+    static constexpr int SLICES = 3;
+   
+    // A chunk's quads, laid out in SLICES bands of its columns, each diagonal by
+    // diagonal: the screen columns and rows of the isometric view
+    struct Layer {
+        std::vector<sf::Vertex> vertices;
+        const sf::Texture* texture = nullptr;
+        const sf::Shader* shader = nullptr;
+        int frameCount = 1;
+        int framesPerSecond = 0;
+        int shownFrame = 0;
+        bool standing = false;  // Walls and torches, stood up as faces in the isometric view
+        uint32_t diagonalEnds[SLICES * DIAGONALS];  // Vertices up to the end of each slice's diagonals
+    };
+   
+    // Faces of one layer on one screen row, next to each other in the chunk's faces
+    struct FaceRun {
+        float row;       // Screen y of the diamonds' centres
+        float left;      // Screen x of the run's ends
+        float right;
+        int layer;
+        uint32_t first;  // First vertex
+        uint32_t count;  // Vertices
+        int shownFrame;
+    };
+   
+    // A chunk in view, with the slices and diagonals an isometric view shows
+    struct Visible {
+        int index;
+        int firstSlice;
+        int endSlice;
+        int firstDiagonal;
+        int endDiagonal;
+    };
+   
+    // A face run handed out by gatherFaces(), trimmed to the faces that reach the
+    // screen. Only a rebuild moves what it points to, and none happens before the
+    // next gather.
+    struct Gathered {
+        FaceRun* run;
+        const Layer* layer;
+        sf::Vertex* faces;  // The chunk's
+        uint32_t first;     // Vertices into faces
+        uint32_t count;
+    };
+   
+    struct Chunk {
+        Layer layers[LAYER_COUNT];
+        std::vector<sf::Vertex> faces;
+        std::vector<FaceRun> faceRuns;
+        uint32_t runEnds[DIAGONALS];  // Runs up to the end of each of the chunk's diagonals
+        bool dirty = true;
+    };
+   
+    std::vector<Chunk> chunks;
+    int width;
+    int height;
+    int chunksX;
+    std::vector<Visible> visible;  // Chunks in view for the current draw
+    std::vector<Gathered> gathered;
+    Stats stats;
+   
+public:
+    TileMesh() : width(0), height(0), chunksX(0) {}
+   
+    // Size for a map, with every chunk due for a rebuild
+    void reset(int mapWidth, int mapHeight) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        width = mapWidth;
+        height = mapHeight;
+        chunksX = (width + CHUNK_TILES - 1) / CHUNK_TILES;
+        chunks.assign(static_cast<size_t>(chunksX) * ((height + CHUNK_TILES - 1) / CHUNK_TILES), Chunk());
+        stats = Stats();
+    }
+   
+    // Rebuild everything now, so play never meets a chunk for the first time
+    void build(const std::vector<std::vector<Tile>>& tiles) {
+        for (size_t i = 0; i < chunks.size(); i++) rebuild(static_cast<int>(i), tiles);
+    }
+   
+    void invalidate(int x, int y) {
+        if (x < 0 || x >= width || y < 0 || y >= height) return;
+        chunks[(y / CHUNK_TILES) * chunksX + x / CHUNK_TILES].dirty = true;
+    }
+   
+    // Add the chunks overlapping a rectangle of tiles, layer by layer so a layer's
+    // quads from neighbouring chunks merge into one draw call. time is the value
+    // the material shader's time uniform has this frame. Given the screen
+    // rectangle of an isometric view, only the slices and diagonals of a chunk
+    // that reach it are copied, and the standing layers are skipped: their faces
+    // cover their diamonds.
+    void draw(DrawList& list, const std::vector<std::vector<Tile>>& tiles, int startX, int startY, int endX, int endY,
+              float time, const sf::FloatRect* screen = nullptr) {
+        stats.chunksDrawn = 0;
+        stats.quadsDrawn = 0;
+        stats.quadsAnimated = 0;
+        visible.clear();
+        if (startX >= endX || startY >= endY) return;
+       
+        for (int cy = startY / CHUNK_TILES; cy <= (endY - 1) / CHUNK_TILES; cy++) {
+            for (int cx = startX / CHUNK_TILES; cx <= (endX - 1) / CHUNK_TILES; cx++) {
+                if (screen && !IsoProjection::sees(*screen, cx * CHUNK_TILES, cy * CHUNK_TILES,
+                                                   (cx + 1) * CHUNK_TILES, (cy + 1) * CHUNK_TILES)) {
+                    continue;
+                }
+                int index = cy * chunksX + cx;
+                if (chunks[index].dirty) rebuild(index, tiles);
+                Visible chunk = {index, 0, SLICES, 0, DIAGONALS};
+                if (screen) {
+                    // Diagonal d's diamonds cover rows (first + d) to (first + d + 2) half tiles down
+                    int first = cx * CHUNK_TILES + cy * CHUNK_TILES;
+                    int top = static_cast<int>(std::floor(screen->top * 2.0f / TILE_SIZE));
+                    int bottom = static_cast<int>(std::ceil((screen->top + screen->height) * 2.0f / TILE_SIZE));
+                    chunk.firstDiagonal = std::max(0, top - first - 1);
+                    chunk.endDiagonal = std::min(DIAGONALS, bottom - first);
+                    if (chunk.firstDiagonal >= chunk.endDiagonal) continue;
+                   
+                    // Column c's diamonds cover (left + c) to (left + c + 2) tiles across
+                    float left = static_cast<float>((cx - cy - 1) * CHUNK_TILES * TILE_SIZE);
+                    chunk.firstSlice = SLICES;
+                    chunk.endSlice = 0;
+                    for (int slice = 0; slice < SLICES; slice++) {
+                        float sliceLeft = left + sliceStart(slice) * TILE_SIZE;
+                        float sliceRight = left + (sliceStart(slice + 1) + 1) * TILE_SIZE;
+                        if (sliceRight <= screen->left || sliceLeft >= screen->left + screen->width) continue;
+                        chunk.firstSlice = std::min(chunk.firstSlice, slice);
+                        chunk.endSlice = slice + 1;
+                    }
+                    if (chunk.firstSlice >= chunk.endSlice) continue;
+                }
+                visible.push_back(chunk);
+            }
+        }
+        stats.chunksDrawn = static_cast<int>(visible.size());
+       
+        for (int l = 0; l < LAYER_COUNT; l++) {
+            for (const Visible& chunk : visible) {
+                Layer& layer = chunks[chunk.index].layers[l];
+                if (layer.vertices.empty() || (screen && layer.standing)) continue;
+                if (!layer.shader && layer.frameCount > 1) {
+                    showFrame(layer, static_cast<int>(std::floor(time * layer.framesPerSecond)) % layer.frameCount);
+                }
+                sf::RenderStates states(sf::BlendAlpha, sf::Transform::Identity, layer.texture, layer.shader);
+                if (!screen) {
+                    list.draw(layer.vertices.data(), layer.vertices.size(), sf::Quads, states);
+                    stats.quadsDrawn += static_cast<int>(layer.vertices.size() / 4);
+                    continue;
+                }
+                for (int slice = chunk.firstSlice; slice < chunk.endSlice; slice++) {
+                    int firstEnd = slice * DIAGONALS + chunk.firstDiagonal;
+                    uint32_t first = firstEnd > 0 ? layer.diagonalEnds[firstEnd - 1] : 0;
+                    uint32_t count = layer.diagonalEnds[slice * DIAGONALS + chunk.endDiagonal - 1] - first;
+                    list.draw(layer.vertices.data() + first, count, sf::Quads, states);
+                    stats.quadsDrawn += static_cast<int>(count / 4);
+                }
+            }
+        }
+    }
+   
+    // Hand every face run that shows on an isometric screen rectangle to
+    // add(row, handle), without the faces at its ends that miss it. Handles are
+    // good for drawFaces() until the next gather.
+    template <typename Add>
+    void gatherFaces(const std::vector<std::vector<Tile>>& tiles, const sf::FloatRect& view, Add add) {
+        gathered.clear();
+        // The rows whose faces, rising from half a tile below the row, reach the view
+        sf::FloatRect screen(view.left, view.top - TILE_SIZE / 2.0f, view.width, view.height + IsoProjection::WALL_HEIGHT);
+        float right = screen.left + screen.width;
+        float bottom = screen.top + screen.height;
+        int startX = std::max(0, static_cast<int>(std::floor(screen.top + screen.left * 0.5f)) / TILE_SIZE);
+        int endX = std::min(width, static_cast<int>(std::floor(bottom + right * 0.5f)) / TILE_SIZE + 1);
+        int startY = std::max(0, static_cast<int>(std::floor(screen.top - right * 0.5f)) / TILE_SIZE);
+        int endY = std::min(height, static_cast<int>(std::floor(bottom - screen.left * 0.5f)) / TILE_SIZE + 1);
+        if (startX >= endX || startY >= endY) return;
+       
+        const float chunkSize = static_cast<float>(CHUNK_TILES * TILE_SIZE);
+        int topRow = static_cast<int>(std::floor(screen.top * 2.0f / TILE_SIZE));
+        int bottomRow = static_cast<int>(std::ceil(bottom * 2.0f / TILE_SIZE));
+        for (int cy = startY / CHUNK_TILES; cy <= (endY - 1) / CHUNK_TILES; cy++) {
+            // Only the chunks of this band of chunk rows that the screen crosses
+            float bandLeft, bandRight;
+            IsoProjection::bandSpan(screen, cy * chunkSize, (cy + 1) * chunkSize, bandLeft, bandRight);
+            int firstCx = std::max(startX / CHUNK_TILES, static_cast<int>(std::floor(bandLeft / chunkSize)));
+            int lastCx = std::min((endX - 1) / CHUNK_TILES, static_cast<int>(std::floor(bandRight / chunkSize)));
+            for (int cx = firstCx; cx <= lastCx; cx++) {
+                int index = cy * chunksX + cx;
+                if (chunks[index].dirty) rebuild(index, tiles);
+                Chunk& chunk = chunks[index];
+               
+                // Diagonal d's runs sit on row (origin + d + 1) half tiles down
+                int origin = cx * CHUNK_TILES + cy * CHUNK_TILES;
+                int firstDiagonal = std::max(0, topRow - origin);
+                int endDiagonal = std::min(DIAGONALS, bottomRow - origin - 1);
+                if (firstDiagonal >= endDiagonal) continue;
+                uint32_t end = chunk.runEnds[endDiagonal - 1];
+                for (uint32_t r = firstDiagonal > 0 ? chunk.runEnds[firstDiagonal - 1] : 0; r < end; r++) {
+                    FaceRun& run = chunk.faceRuns[r];
+                    if (run.left >= right || run.right <= screen.left) continue;
+                   
+                    // A run's faces go right to left across the screen
+                    uint32_t first = 0;
+                    uint32_t last = run.count;
+                    if (run.left < screen.left || run.right > right) {
+                        const sf::Vertex* faces = &chunk.faces[run.first];
+                        while (first < last && faces[first].position.x >= right) first += 4;
+                        while (last > first && faces[last - 3].position.x <= screen.left) last -= 4;
+                    }
+                    if (first == last) continue;
+                   
+                    add(run.row, static_cast<uint32_t>(gathered.size()));
+                    gathered.push_back({&run, &chunk.layers[run.layer], chunk.faces.data(), run.first + first,
+                                        last - first});
+                }
+            }
+        }
+        stats.faceRuns = static_cast<int>(gathered.size());
+    }
+   
+    // Copy a gathered run to the list, each face lit as the ground at its diamond's
+    // left and right corners. Faces on rows below fadeBelow that overlap fade are
+    // drawn see-through, so they don't hide what stands behind them. Faces with a
+    // material are torches, which give light rather than take it.
+    void drawFaces(DrawList& list, uint32_t handle, float time, const LightMap& lights, const sf::FloatRect& fade,
+                   float fadeBelow) {
+        const Gathered& part = gathered[handle];
+        FaceRun& run = *part.run;
+        const Layer& layer = *part.layer;
+        if (!layer.shader && layer.frameCount > 1) {
+            showFrame(run, part.faces + run.first,
+                      static_cast<int>(std::floor(time * layer.framesPerSecond)) % layer.frameCount);
+        }
+        const sf::Vertex* vertices = part.faces + part.first;
+        sf::RenderStates states(sf::BlendAlpha, sf::Transform::Identity, layer.texture, layer.shader);
+       
+        auto hides = [&](const sf::Vertex* face) {
+            return face[0].position.x < fade.left + fade.width && face[2].position.x > fade.left &&
+                   face[0].position.y < fade.top + fade.height && face[2].position.y > fade.top;
+        };
+        bool fading = false;
+        if (run.row > fadeBelow && vertices[0].position.y < fade.top + fade.height) {
+            for (uint32_t v = 0; v < part.count && !fading; v += 4) fading = hides(&vertices[v]);
+        }
+        sf::Vertex* copy = list.draw(vertices, part.count, sf::Quads, states);
+        if (!fading && layer.shader) return;
+       
+        // A face's bottom corners are half a tile below its diamond's side corners
+        auto cornerLight = [&lights](sf::Vector2f bottom) {
+            sf::Vector2f corner = IsoProjection::unproject(bottom - sf::Vector2f(0.0f, TILE_SIZE / 2.0f));
+            return lights.cornerLight(static_cast<int>(std::lround(corner.x / TILE_SIZE)),
+                                      static_cast<int>(std::lround(corner.y / TILE_SIZE)));
+        };
+        for (uint32_t v = 0; v < part.count; v += 4) {
+            sf::Vertex* face = copy + v;
+            if (!layer.shader) {
+                sf::Color left = cornerLight(face[3].position);
+                sf::Color right = cornerLight(face[2].position);
+                face[0].color *= left;
+                face[1].color *= right;
+                face[2].color *= right;
+                face[3].color *= left;
+            }
+            if (fading && hides(face)) {
+                for (int corner = 0; corner < 4; corner++) face[corner].color.a = SEE_THROUGH_ALPHA;
+            }
+        }
+    }
+   
+    const Stats& getStats() const { return stats; }
+   
+private:
+    // The first column of a slice; slice SLICES starts past the last
+    static constexpr int sliceStart(int slice) { return slice * DIAGONALS / SLICES; }
+   
+    void rebuild(int index, const std::vector<std::vector<Tile>>& tiles) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        Chunk& chunk = chunks[index];
+        for (Layer& layer : chunk.layers) {
+            layer.vertices.clear();
+            layer.shownFrame = 0;
+        }
+       
+        int firstX = (index % chunksX) * CHUNK_TILES;
+        int firstY = (index / chunksX) * CHUNK_TILES;
+        int lastX = std::min(firstX + CHUNK_TILES, width);
+        int lastY = std::min(firstY + CHUNK_TILES, height);
+        for (int slice = 0; slice < SLICES; slice++) {
+            for (int diagonal = 0; diagonal < DIAGONALS; diagonal++) {
+                for (int y = firstY; y < lastY; y++) {
+                    int x = firstX + diagonal - (y - firstY);
+                    int column = (x - firstX) - (y - firstY) + CHUNK_TILES - 1;
+                    if (x < firstX || x >= lastX || column < sliceStart(slice) || column >= sliceStart(slice + 1)) {
+                        continue;
+                    }
+                    const Tile& tile = tiles[y][x];
+                    const sf::Sprite& sprite = tile.getSprite();
+                    if (!sprite.getTexture()) continue;
+                   
+                    // Every tile of a type shares its texture, material and strip
+                    Layer& layer = chunk.layers[static_cast<int>(tile.getType())];
+                    layer.texture = sprite.getTexture();
+                    layer.shader = tile.getMaterial();
+                    layer.frameCount = tile.getFrameCount();
+                    layer.framesPerSecond = tile.getFramesPerSecond();
+                    layer.standing = tile.isOpaque();
+                    layer.vertices.resize(layer.vertices.size() + 4);
+                    DrawList::spriteQuad(sprite, &layer.vertices[layer.vertices.size() - 4]);
+                }
+                for (Layer& layer : chunk.layers) {
+                    layer.diagonalEnds[slice * DIAGONALS + diagonal] = static_cast<uint32_t>(layer.vertices.size());
+                }
+            }
+        }
+        buildFaces(chunk, firstX, firstY, tiles);
+        chunk.dirty = false;
+        stats.chunksRebuilt++;
+    }
+   
+    // Stand each wall and torch up on its diamond's bottom corner, as wide as the
+    // diamond and WALL_HEIGHT tall. A chunk's diagonals are its screen rows, so
+    // walking them in turn, one layer at a time, leaves the runs in row order.
+    void buildFaces(Chunk& chunk, int firstX, int firstY, const std::vector<std::vector<Tile>>& tiles) {
+        chunk.faces.clear();
+        chunk.faceRuns.clear();
+        int lastX = std::min(firstX + CHUNK_TILES, width);
+        int lastY = std::min(firstY + CHUNK_TILES, height);
+        for (int diagonal = 0; diagonal < DIAGONALS; diagonal++) {
+            for (int l = 0; l < LAYER_COUNT; l++) {
+                for (int y = firstY; y < lastY; y++) {
+                    int x = firstX + diagonal - (y - firstY);
+                    if (x < firstX || x >= lastX) continue;
+                    const Tile& tile = tiles[y][x];
+                    const sf::Sprite& sprite = tile.getSprite();
+                    if (static_cast<int>(tile.getType()) != l || !tile.isOpaque() || !sprite.getTexture()) continue;
+                   
+                    sf::Vector2f center = IsoProjection::project(sf::Vector2f((x + 0.5f) * TILE_SIZE,
+                                                                              (y + 0.5f) * TILE_SIZE));
+                    if (chunk.faceRuns.empty() || chunk.faceRuns.back().row != center.y ||
+                        chunk.faceRuns.back().layer != l) {
+                        chunk.faceRuns.push_back({center.y, center.x - TILE_SIZE, center.x + TILE_SIZE, l,
+                                                  static_cast<uint32_t>(chunk.faces.size()), 0, 0});
+                    }
+                    chunk.faceRuns.back().left = center.x - TILE_SIZE;
+                    chunk.faceRuns.back().count += 4;
+                   
+                    float bottom = center.y + TILE_SIZE / 2.0f;
+                    float top = bottom - IsoProjection::WALL_HEIGHT;
+                    sf::IntRect rect = sprite.getTextureRect();
+                    float u = static_cast<float>(rect.left);
+                    float v = static_cast<float>(rect.top);
+                    sf::Color color = sprite.getColor();
+                    chunk.faces.emplace_back(sf::Vector2f(center.x - TILE_SIZE, top), color, sf::Vector2f(u, v));
+                    chunk.faces.emplace_back(sf::Vector2f(center.x + TILE_SIZE, top), color,
+                                             sf::Vector2f(u + rect.width, v));
+                    chunk.faces.emplace_back(sf::Vector2f(center.x + TILE_SIZE, bottom), color,
+                                             sf::Vector2f(u + rect.width, v + rect.height));
+                    chunk.faces.emplace_back(sf::Vector2f(center.x - TILE_SIZE, bottom), color,
+                                             sf::Vector2f(u, v + rect.height));
+                }
+            }
+            chunk.runEnds[diagonal] = static_cast<uint32_t>(chunk.faceRuns.size());
+        }
+    }
+   
+    // Point every quad of an animated layer at one frame of its strip
+    void showFrame(Layer& layer, int frame) {
+        if (frame == layer.shownFrame) return;
+        float left = static_cast<float>(frame * TILE_SIZE);
+        float right = left + TILE_SIZE;
+        for (size_t v = 0; v < layer.vertices.size(); v += 4) {
+            layer.vertices[v].texCoords.x = left;
+            layer.vertices[v + 1].texCoords.x = right;
+            layer.vertices[v + 2].texCoords.x = right;
+            layer.vertices[v + 3].texCoords.x = left;
+        }
+        layer.shownFrame = frame;
+        stats.quadsAnimated += static_cast<int>(layer.vertices.size() / 4);
+    }
+   
+    // The same for one run of standing faces
+    void showFrame(FaceRun& run, sf::Vertex* vertices, int frame) {
+        if (frame == run.shownFrame) return;
+        float left = static_cast<float>(frame * TILE_SIZE);
+        float right = left + TILE_SIZE;
+        for (uint32_t v = 0; v < run.count; v += 4) {
+            vertices[v].texCoords.x = left;
+            vertices[v + 1].texCoords.x = right;
+            vertices[v + 2].texCoords.x = right;
+            vertices[v + 3].texCoords.x = left;
+        }
+        run.shownFrame = frame;
+        stats.quadsAnimated += static_cast<int>(run.count / 4);
+    }
+};
+
+// Decal save data: the decals a DecalLayer holds, oldest first. A corpse names
+// its monster archetype and is rebuilt from the same data when loaded.
+namespace DecalData {
+    const uint32_t MAGIC = 0x4C434544;  // "DECL"
+    const uint32_t VERSION = 1;
+   
+    enum Kind : uint8_t {
+        KIND_BLOOD = 0,
+        KIND_SCORCH = 1,
+        KIND_CORPSE = 2,
+        KIND_COUNT
+    };
+   
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t count;
+        uint32_t capacity;  // The layer's budget when saved
+    };
+   
+    struct Record {
+        float x, y;         // World position of the centre
+        uint8_t kind;
+        uint8_t rotation;   // 256ths of a turn
+        uint8_t scale;      // Eighths of the drawn size
+        uint8_t padding;
+        uint16_t variant;   // Row of the decal sheet, or a corpse's monster archetype
+        uint16_t padding2;
+    };
+   
+    static_assert(sizeof(Header) == 16, "Header layout changed");
+    static_assert(sizeof(Record) == 16, "Record layout changed");
+}
+
+// Decal layer - blood, scorch marks and corpses left on the ground. Each one is
+// stamped as a quad into a bucket per chunk and material, on the TileMesh's
+// chunk grid, and not touched again until evicted: a full layer drops its
+// oldest decal for every new one. Eviction leaves a hole rather than moving a
+// newer quad into it, so later decals stay on top, and a bucket is compacted
+// once half of it is holes. Nothing runs per frame but appending the chunks in
+// view.
+class DecalLayer {
+public:
+    static constexpr int DEFAULT_CAPACITY = 4096;
+   
+private:
+    struct Material {
+        const sf::Texture* texture;
+        const sf::Shader* shader;
+    };
+   
+    struct Bucket {
+        std::vector<sf::Vertex> vertices;
+        std::vector<int> slots;  // Ring slot of each quad, -1 for a hole
+        int holes = 0;
+    };
+   
+    struct Chunk {
+        std::vector<Bucket> buckets;  // Indexed like materials
+    };
+   
+    // A decal and where its quad went
+    struct Slot {
+        DecalData::Record decal;
+        int chunk;
+        int bucket;
+        int quad;
+    };
+   
+    ResourceManager& resources;
+    std::vector<Slot> ring;
+    int capacity;
+    int next;   // Slot the next stamp takes; the oldest decal's once the layer is full
+    int count;
+    std::vector<Material> materials;
+    std::vector<Chunk> chunks;
+    int width;
+    int height;
+    int chunksX;
+    int reach;                 // Tiles the widest decal stamped since the reset reaches past its own
+    std::vector<int> visible;  // Chunks in view for the current draw
+    int quadsDrawn;
+    uint64_t stamped;
+    uint64_t evicted;
+   
+public:
+    explicit DecalLayer(ResourceManager& resources, int capacity = DEFAULT_CAPACITY)
+        : resources(resources), ring(std::max(0, capacity)), capacity(std::max(0, capacity)), next(0), count(0),
+          width(0), height(0), chunksX(0), reach(0), quadsDrawn(0), stamped(0), evicted(0) {}
+   
+    // Size for a map and drop every decal
+    void reset(int mapWidth, int mapHeight) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        width = mapWidth;
+        height = mapHeight;
+        chunksX = (width + TileMesh::CHUNK_TILES - 1) / TileMesh::CHUNK_TILES;
+        chunks.assign(static_cast<size_t>(chunksX) * ((height + TileMesh::CHUNK_TILES - 1) / TileMesh::CHUNK_TILES),
+                      Chunk());
+        next = 0;
+        count = 0;
+        reach = 0;
+       
+        // The sheet's marks always draw under corpses
+        if (materials.empty()) materials.push_back({&resources.getTexture("decals"), nullptr});
+    }
+   
+    void clear() {
+        reset(width, height);
+    }
+   
+    // Change the budget, keeping the newest decals that fit
+    void setCapacity(int newCapacity) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        std::vector<DecalData::Record> kept = getDecals();
+        capacity = std::max(0, newCapacity);
+        ring.assign(capacity, Slot());
+        clear();
+        size_t first = kept.size() > static_cast<size_t>(capacity) ? kept.size() - capacity : 0;
+        for (size_t i = first; i < kept.size(); i++) stamp(kept[i]);
+    }
+   
+    // Add a decal, evicting the oldest if the layer is full. A corpse of an
+    // unknown archetype, or anything off the map, is dropped.
+    void stamp(const DecalData::Record& decal) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        if (capacity == 0 || chunks.empty() || decal.kind >= DecalData::KIND_COUNT) return;
+        if (decal.x < 0.0f || decal.y < 0.0f || decal.x >= width * TILE_SIZE || decal.y >= height * TILE_SIZE) return;
+       
+        sf::Vertex quad[4];
+        Material material;
+        if (!buildQuad(decal, quad, material)) return;
+        float extent = 0.0f;
+        for (const sf::Vertex& corner : quad) {
+            extent = std::max({extent, std::abs(corner.position.x - decal.x), std::abs(corner.position.y - decal.y)});
+        }
+        reach = std::max(reach, static_cast<int>(std::ceil(extent / TILE_SIZE)));
+        if (count == capacity) {
+            evict(next);
+            count--;
+        }
+       
+        int tileX = static_cast<int>(decal.x) / TILE_SIZE;
+        int tileY = static_cast<int>(decal.y) / TILE_SIZE;
+        Slot& slot = ring[next];
+        slot.decal = decal;
+        slot.chunk = (tileY / TileMesh::CHUNK_TILES) * chunksX + tileX / TileMesh::CHUNK_TILES;
+        slot.bucket = findMaterial(material);
+       
+        Chunk& chunk = chunks[slot.chunk];
+        if (chunk.buckets.size() <= static_cast<size_t>(slot.bucket)) chunk.buckets.resize(slot.bucket + 1);
+        Bucket& bucket = chunk.buckets[slot.bucket];
+        slot.quad = static_cast<int>(bucket.slots.size());
+        bucket.vertices.insert(bucket.vertices.end(), quad, quad + 4);
+        bucket.slots.push_back(next);
+       
+        next = (next + 1) % capacity;
+        count++;
+        stamped++;
+    }
+   
+    // Add the decals on a rectangle of tiles, a material at a time across the
+    // chunks so each merges into one draw call. A decal is filed under the chunk
+    // of its centre but reaches past it, a scorch by several tiles, so the chunks
+    // that far beyond the rectangle are included, and those that far beyond an
+    // isometric view's screen rectangle when one is given.
+    void draw(DrawList& list, int startX, int startY, int endX, int endY, const sf::FloatRect* screen = nullptr) {
+        quadsDrawn = 0;
+        visible.clear();
+        startX = std::max(0, startX - reach);
+        startY = std::max(0, startY - reach);
+        endX = std::min(width, endX + reach);
+        endY = std::min(height, endY + reach);
+        if (count == 0 || startX >= endX || startY >= endY) return;
+       
+        for (int cy = startY / TileMesh::CHUNK_TILES; cy <= (endY - 1) / TileMesh::CHUNK_TILES; cy++) {
+            for (int cx = startX / TileMesh::CHUNK_TILES; cx <= (endX - 1) / TileMesh::CHUNK_TILES; cx++) {
+                if (screen && !IsoProjection::sees(*screen, cx * TileMesh::CHUNK_TILES - reach,
+                                                   cy * TileMesh::CHUNK_TILES - reach,
+                                                   (cx + 1) * TileMesh::CHUNK_TILES + reach,
+                                                   (cy + 1) * TileMesh::CHUNK_TILES + reach)) {
+                    continue;
+                }
+                visible.push_back(cy * chunksX + cx);
+            }
+        }
+        for (size_t m = 0; m < materials.size(); m++) {
+            sf::RenderStates states(sf::BlendAlpha, sf::Transform::Identity, materials[m].texture, materials[m].shader);
+            for (int index : visible) {
+                const Chunk& chunk = chunks[index];
+                if (m >= chunk.buckets.size() || chunk.buckets[m].vertices.empty()) continue;
+                const Bucket& bucket = chunk.buckets[m];
+                list.draw(bucket.vertices.data(), bucket.vertices.size(), sf::Quads, states);
+                quadsDrawn += static_cast<int>(bucket.slots.size()) - bucket.holes;
+            }
+        }
+    }
+   
+    // Every decal, oldest first
+    std::vector<DecalData::Record> getDecals() const {
+        std::vector<DecalData::Record> decals;
+        decals.reserve(count);
+        for (int i = 0; i < count; i++) decals.push_back(ring[(next - count + i + capacity) % capacity].decal);
+        return decals;
+    }
+   
+    bool save(const std::string& path) const {
+        std::vector<DecalData::Record> decals = getDecals();
+        DecalData::Header h = {};
+        h.magic = DecalData::MAGIC;
+        h.version = DecalData::VERSION;
+        h.count = static_cast<uint32_t>(decals.size());
+        h.capacity = static_cast<uint32_t>(capacity);
+       
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Failed to write decals: " << path << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(decals.data()), decals.size() * sizeof(DecalData::Record));
+        return static_cast<bool>(out);
+    }
+   
+    // Replace the decals with saved ones. The current budget applies, so a
+    // smaller one keeps only the newest, and only those are read. The header's
+    // count is checked against the file before anything is allocated for it.
+    bool load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        DecalData::Header h = {};
+        if (!in.read(reinterpret_cast<char*>(&h), sizeof(h)) || h.magic != DecalData::MAGIC ||
+            h.version != DecalData::VERSION) {
+            std::cerr << "Not a decal file: " << path << std::endl;
+            return false;
+        }
+        std::streamoff start = in.tellg();
+        std::streamoff end = in.seekg(0, std::ios::end).tellg();
+        if (end < start || static_cast<uint64_t>(end - start) < uint64_t{h.count} * sizeof(DecalData::Record)) {
+            std::cerr << "Truncated decal file: " << path << std::endl;
+            return false;
+        }
+       
+        uint32_t kept = std::min(h.count, static_cast<uint32_t>(capacity));
+        std::vector<DecalData::Record> decals(kept);
+        in.seekg(start + static_cast<std::streamoff>((uint64_t{h.count} - kept) * sizeof(DecalData::Record)));
+        if (!in.read(reinterpret_cast<char*>(decals.data()), decals.size() * sizeof(DecalData::Record))) {
+            std::cerr << "Truncated decal file: " << path << std::endl;
+            return false;
+        }
+       
+        clear();
+        for (const DecalData::Record& decal : decals) stamp(decal);
+        return true;
+    }
+   
+    int getCount() const { return count; }
+    int getCapacity() const { return capacity; }
+    int getQuadsDrawn() const { return quadsDrawn; }
+    uint64_t getStampedCount() const { return stamped; }
+    uint64_t getEvictedCount() const { return evicted; }
+   
+private:
+    // Leave a hole: a zero-size quad draws nothing
+    void evict(int index) {
+        Slot& slot = ring[index];
+        Bucket& bucket = chunks[slot.chunk].buckets[slot.bucket];
+        sf::Vertex* quad = &bucket.vertices[static_cast<size_t>(slot.quad) * 4];
+        for (int v = 1; v < 4; v++) quad[v].position = quad[0].position;
+        bucket.slots[slot.quad] = -1;
+        bucket.holes++;
+        evicted++;
+        if (bucket.holes * 2 > static_cast<int>(bucket.slots.size())) compact(bucket);
+    }
+   
+    // Close the holes, keeping the quads in stamp order
+    void compact(Bucket& bucket) {
+        size_t kept = 0;
+        for (size_t q = 0; q < bucket.slots.size(); q++) {
+            int owner = bucket.slots[q];
+            if (owner < 0) continue;
+            if (kept != q) {
+                std::copy(bucket.vertices.begin() + q * 4, bucket.vertices.begin() + q * 4 + 4,
+                          bucket.vertices.begin() + kept * 4);
+                bucket.slots[kept] = owner;
+                ring[owner].quad = static_cast<int>(kept);
+            }
+            kept++;
+        }
+        bucket.slots.resize(kept);
+        bucket.vertices.resize(kept * 4);
+        bucket.holes = 0;
+    }
+   
+    int findMaterial(const Material& material) {
+        for (size_t m = 0; m < materials.size(); m++) {
+            if (materials[m].texture == material.texture && materials[m].shader == material.shader) {
+                return static_cast<int>(m);
+            }
+        }
+        materials.push_back(material);
+        return static_cast<int>(materials.size()) - 1;
+    }
+   
+    // Blood and scorch marks come from the decal sheet, a column per kind and a
+    // row per variant. A corpse is its monster's hurt frame, darkened.
+    bool buildQuad(const DecalData::Record& decal, sf::Vertex* quad, Material& material) {
+        sf::IntRect rect;
+        sf::Color color = sf::Color::White;
+        material.shader = nullptr;
+       
+        if (decal.kind == DecalData::KIND_CORPSE) {
+            const ArchetypeTable& table = resources.getArchetypes();
+            if (decal.variant >= table.getMonsterCount()) return false;
+            const GameData::MonsterRecord& monster = table.getMonster(decal.variant);
+            material.texture = &resources.getTexture(table.getString(monster.texture));
+            sf::Vector2u size = material.texture->getSize();
+            rect = sf::IntRect(0, 0, size.x, size.y);
+           
+            if (monster.animationSet != GameData::NO_ANIMATION) {
+                const GameData::AnimationSetRecord& set = table.getAnimationSet(monster.animationSet);
+                uint16_t clip = set.clips[GameData::CLIP_HURT] != GameData::NO_ANIMATION ?
+                                set.clips[GameData::CLIP_HURT] : set.clips[GameData::CLIP_IDLE];
+                if (clip != GameData::NO_ANIMATION) {
+                    const GameData::ClipRecord& record = table.getClip(clip);
+                    const int16_t* r = table.getFrame(record.firstFrame + record.frameCount - 1).rect;
+                    rect = sf::IntRect(r[0], r[1], r[2], r[3]);
+                }
+            }
+           
+            Materials& shading = resources.getMaterials();
+            material.shader = shading.getShader();
+            if (material.shader) {
+                color = Materials::encode(monster.palette, 0, Materials::SURFACE_NONE);
+            } else {
+                color = shading.getTint(monster.palette);
+                color = sf::Color(color.r * 3 / 5, color.g * 3 / 5, color.b * 3 / 5);
+            }
+        } else {
+            material.texture = &resources.getTexture("decals");
+            int rows = std::max(1, static_cast<int>(material.texture->getSize().y) / TILE_SIZE);
+            rect = sf::IntRect(decal.kind * TILE_SIZE, decal.variant % rows * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+        }
+       
+        // Corners turned about the centre
+        float scale = decal.scale / 8.0f;
+        float halfWidth = std::abs(rect.width) * scale / 2.0f;
+        float halfHeight = std::abs(rect.height) * scale / 2.0f;
+        float angle = decal.rotation * (2.0f * 3.14159265f / 256.0f);
+        float c = std::cos(angle);
+        float s = std::sin(angle);
+        const float cornerX[4] = {-halfWidth, halfWidth, halfWidth, -halfWidth};
+        const float cornerY[4] = {-halfHeight, -halfHeight, halfHeight, halfHeight};
+        const float u[4] = {0.0f, 1.0f, 1.0f, 0.0f};
+        const float v[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+        for (int i = 0; i < 4; i++) {
+            quad[i] = sf::Vertex(sf::Vector2f(decal.x + cornerX[i] * c - cornerY[i] * s,
+                                              decal.y + cornerX[i] * s + cornerY[i] * c),
+                                 color,
+                                 sf::Vector2f(rect.left + u[i] * rect.width, rect.top + v[i] * rect.height));
+        }
+        return true;
+    }
+};
+
+// Dungeon class
+class Dungeon {
+private:
+    ResourceManager& resources;
+    SoundManager& sounds;
+    CombatSystem& combat;
+    TimerWheel& timers;
+    Animator& animator;
+    LightMap& lights;
+    std::vector<std::vector<Tile>> tiles;
+    std::vector<TileRecord> records;  // The same tiles compactly, row-major, with their wall pieces
+    std::vector<std::shared_ptr<Enemy>> enemies;
+    std::vector<std::shared_ptr<Item>> items;
+    Player* player;
+    int width;
+    int height;
+   
+    // Enemy positions as of the last update, indexed for area queries
+    static constexpr float ENEMY_GRID_CELL = TILE_SIZE * 2.0f;
+    SpatialGrid enemyGrid;
+    std::vector<float> enemyX;
+    std::vector<float> enemyY;
+    std::vector<float> pushX;  // Scratch for separateEnemies()
+    std::vector<float> pushY;
+   
+    // Ground items indexed the same way; they don't move, so the grid is only
+    // rebuilt when the list changes
+    static constexpr float ITEM_GRID_CELL = TILE_SIZE * 4.0f;
+    SpatialGrid itemGrid;
+    std::vector<float> itemX;
+    std::vector<float> itemY;
+    bool itemGridDirty;
+   
+    // What draw() draws: ids of everything near the view, in list order
+    std::vector<int> visibleEnemies;
+    std::vector<int> visibleItems;
+   
+    // What drawIsometric() stands up, back to front: a kind in the top bits over the
+    // tile mesh's handle for a run of walls or a list index for the rest
+    static constexpr uint32_t STAND_WALL = 0u << 30;
+    static constexpr uint32_t STAND_ENEMY = 1u << 30;
+    static constexpr uint32_t STAND_PLAYER = 2u << 30;
+    static constexpr uint32_t STAND_INDEX = (1u << 30) - 1;
+    DepthBuckets depth;
+   
+    TileCollider collider;
+    PathFinder paths;
+    TileMesh tileMesh;
+    DecalLayer decals;
+   
+public:
+    Dungeon(ResourceManager& resources, SoundManager& sounds, CombatSystem& combat, TimerWheel& timers,
+            Animator& animator, LightMap& lights, Player* player, int width, int height)
+        : resources(resources), sounds(sounds), combat(combat), timers(timers), animator(animator), lights(lights),
+          player(player), width(width), height(height), itemGridDirty(true), decals(resources) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+       
+        // Initialize tiles
+        tiles.resize(height, std::vector<Tile>(width, Tile(Tile::Type::Floor, resources)));
+        collider.reset(width, height);
+        paths.build(collider);
+       
+        // Set tile positions
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                tiles[y][x].setPosition(x * TILE_SIZE, y * TILE_SIZE);
+            }
+        }
+        records.assign(static_cast<size_t>(width) * height, TileRecord{Tile::Type::Floor, 0});
+        tileMesh.reset(width, height);
+        decals.reset(width, height);
+    }
+   
+    // Generate a simple dungeon layout
+    void generateDungeon() {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        // Create walls around the edges
+        for (int x = 0; x < width; x++) {
+            tiles[0][x] = Tile(Tile::Type::Wall, resources);
+            tiles[height-1][x] = Tile(Tile::Type::Wall, resources);
+        }
+        for (int y = 0; y < height; y++) {
+            tiles[y][0] = Tile(Tile::Type::Wall, resources);
+            tiles[y][width-1] = Tile(Tile::Type::Wall, resources);
+        }
+       
+        // Create some random walls
+        for (int i = 0; i < width * height / 20; i++) {
+            int x = GameUtils::getRandomInt(2, width - 3);
+            int y = GameUtils::getRandomInt(2, height - 3);
+            tiles[y][x] = Tile(Tile::Type::Wall, resources);
+        }
+       
+        // Create some random water
+        for (int i = 0; i < width * height / 40; i++) {
+            int x = GameUtils::getRandomInt(2, width - 3);
+            int y = GameUtils::getRandomInt(2, height - 3);
+            tiles[y][x] = Tile(Tile::Type::Water, resources);
+        }
+       
+        // Create some random lava
+        for (int i = 0; i < width * height / 50; i++) {
+            int x = GameUtils::getRandomInt(2, width - 3);
+            int y = GameUtils::getRandomInt(2, height - 3);
+            tiles[y][x] = Tile(Tile::Type::Lava, resources);
+        }
+       
+        // Add some chests
+        for (int i = 0; i < width * height / 100; i++) {
+            int x = GameUtils::getRandomInt(2, width - 3);
+            int y = GameUtils::getRandomInt(2, height - 3);
+            tiles[y][x] = Tile(Tile::Type::Chest, resources);
+        }
+       
+        // Add some doors
+        for (int i = 0; i < width * height / 80; i++) {
+            int x = GameUtils::getRandomInt(2, width - 3);
+            int y = GameUtils::getRandomInt(2, height - 3);
+            tiles[y][x] = Tile(Tile::Type::Door, resources);
+        }
+       
+        // Occasional torch on walls that face open floor
+        for (int y = 1; y < height - 1; y++) {
+            for (int x = 1; x < width - 1; x++) {
+                if (tiles[y][x].getType() == Tile::Type::Wall &&
+                    (tiles[y][x-1].isWalkable() || tiles[y][x+1].isWalkable() ||
+                     tiles[y-1][x].isWalkable() || tiles[y+1][x].isWalkable()) &&
+                    GameUtils::getRandomInt(1, 100) <= 4) {
+                    tiles[y][x] = Tile(Tile::Type::Torch, resources);
+                }
+            }
+        }
+       
+        // Set positions
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                tiles[y][x].setPosition(x * TILE_SIZE, y * TILE_SIZE);
+            }
+        }
+       
+        autotile();
+        tileMesh.reset(width, height);
+        tileMesh.build(tiles);
+        decals.clear();
+        buildLighting();
+        buildCollision();
+    }
+   
+    // Refill the tile records and give every wall its blob piece
+    void autotile() {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                records[static_cast<size_t>(y) * width + x].type = tiles[y][x].getType();
+            }
+        }
+        Autotiler::run(records.data(), width, height, static_cast<int>(std::thread::hardware_concurrency()));
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                tiles[y][x].setShape(records[static_cast<size_t>(y) * width + x].shape);
+            }
+        }
+    }
+   
+    // Mirror tile walkability into the collider's flat array, and plan paths over it
+    void buildCollision() {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        collider.reset(width, height);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                collider.setSolid(x, y, !tiles[y][x].isWalkable());
+            }
+        }
+        paths.build(collider);
+    }
+   
+    // Register wall occluders, lava glow and wall torches with the light map
+    void buildLighting() {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        lights.reset(width, height);
+       
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                float centerX = x * TILE_SIZE + TILE_SIZE / 2.0f;
+                float centerY = y * TILE_SIZE + TILE_SIZE / 2.0f;
+               
+                switch (tiles[y][x].getType()) {
+                    case Tile::Type::Wall:
+                        lights.setOpaque(x, y, true);
+                        break;
+                       
+                    case Tile::Type::Torch:
+                        lights.setOpaque(x, y, true);
+                        lights.addLight(centerX, centerY, 6.0f, sf::Color(255, 180, 90));
+                        break;
+                       
+                    case Tile::Type::Lava:
+                        lights.addLight(centerX, centerY, 3.0f, sf::Color(255, 90, 30), 0.8f);
+                        break;
+                       
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+   
+    // Replace a single tile, keeping lighting in sync
+    void setTile(int x, int y, Tile::Type type) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        if (x < 0 || x >= width || y < 0 || y >= height) return;
+       
+        tiles[y][x] = Tile(type, resources);
+        tiles[y][x].setPosition(x * TILE_SIZE, y * TILE_SIZE);
+        lights.setOpaque(x, y, tiles[y][x].isOpaque());
+       
+        // Neighbouring walls may change piece too
+        records[static_cast<size_t>(y) * width + x].type = type;
+        Autotiler::update(records.data(), width, height, x, y);
+        for (int ny = std::max(0, y - 1); ny <= std::min(height - 1, y + 1); ny++) {
+            for (int nx = std::max(0, x - 1); nx <= std::min(width - 1, x + 1); nx++) {
+                tiles[ny][nx].setShape(records[static_cast<size_t>(ny) * width + nx].shape);
+                tileMesh.invalidate(nx, ny);
+            }
+        }
+        collider.setSolid(x, y, !tiles[y][x].isWalkable());
+        paths.invalidate(x, y);
+    }
+   
+    // Add an enemy of the given monster archetype to the dungeon
+    void addEnemy(int archetype, int x, int y) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_ENTITY);
+        auto enemy = std::make_shared<Enemy>(archetype, resources, sounds, timers, animator);
+       
+        enemy->setPosition(x * TILE_SIZE + TILE_SIZE / 2, y * TILE_SIZE + TILE_SIZE / 2);
+        enemy->setTarget(player);
+        enemy->setCollider(&collider);
+        enemy->setPathFinder(&paths);
+        enemies.push_back(enemy);
+    }
+   
+    // Add item to the dungeon
+    template<typename T, typename... Args>
+    void addItem(int x, int y, Args&&... args) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_ENTITY);
+        auto item = std::make_shared<T>(std::forward<Args>(args)...);
+        item->setPosition(x * TILE_SIZE + TILE_SIZE / 2, y * TILE_SIZE + TILE_SIZE / 2);
+        items.push_back(item);
+        itemGridDirty = true;
+    }
+   
+    // Get tile at world position
+    Tile* getTileAtPosition(float x, float y) {
+        int tileX = static_cast<int>(x) / TILE_SIZE;
+        int tileY = static_cast<int>(y) / TILE_SIZE;
+       
+        if (tileX >= 0 && tileX < width && tileY >= 0 && tileY < height) {
+            return &tiles[tileY][tileX];
+        }
+        return nullptr;
+    }
+   
+    // Check if position is walkable
+    bool isWalkable(float x, float y) {
+        Tile* tile = getTileAtPosition(x, y);
+        return tile && tile->isWalkable();
+    }
+   
+    // Update all entities in the dungeon
+    void update(float deltaTime) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        // Update enemies
+        for (auto it = enemies.begin(); it != enemies.end();) {
+            auto& enemy = *it;
+           
+            if (enemy->isActive()) {
+                enemy->update(deltaTime);
+                if (enemy->takeAttackIntent()) {
+                    combat.queueAttack(*enemy, *player);
+                }
+                ++it;
+            } else {
+                // Drop loot when enemy dies; the loot table decides the chance
+                dropLoot(*enemy);
+                addDecal(DecalData::KIND_BLOOD, enemy->getPosition().x, enemy->getPosition().y,
+                         static_cast<uint16_t>(GameUtils::getRandomInt(0, 3)), GameUtils::getRandomInt(8, 14));
+                addDecal(DecalData::KIND_CORPSE, enemy->getPosition().x, enemy->getPosition().y,
+                         static_cast<uint16_t>(enemy->getArchetype()), 8);
+                // Intents queued this tick are resolved after the erase
+                combat.forget(*enemy);
+                it = enemies.erase(it);
+            }
+        }
+        rebuildEnemyGrid();
+        separateEnemies();
+        rebuildEnemyGrid();
+       
+        // Update items
+        for (auto it = items.begin(); it != items.end();) {
+            auto& item = *it;
+           
+            if (item->isActive() && item->isOnGround()) {
+                item->update(deltaTime);
+               
+                // Check if player is close enough to pick up item
+                if (GameUtils::distance(player->getPosition().x, player->getPosition().y,
+                                      item->getPosition().x, item->getPosition().y) < 30.0f) {
+                   
+                    // Determine the item type and add to player inventory
+                    if (item->getType() == "weapon") {
+                        auto weapon = std::dynamic_pointer_cast<Weapon>(item);
+                        if (weapon) {
+                            player->addItem(weapon);
+                        }
+                    } else if (item->getType() == "armor") {
+                        auto armor = std::dynamic_pointer_cast<Armor>(item);
+                        if (armor) {
+                            player->addItem(armor);
+                        }
+                    } else if (item->getType() == "potion") {
+                        auto potion = std::dynamic_pointer_cast<Potion>(item);
+                        if (potion) {
+                            player->addItem(potion);
+                        }
+                    }
+                   
+                    item->pickUp();
+                }
+               
+                ++it;
+            } else {
+                it = items.erase(it);
+                itemGridDirty = true;
+            }
+        }
+    }
+   
+    // Snapshot enemy positions and index them. Ids are indices into getEnemies()
+    // and stay valid until the next update removes the dead.
+    void rebuildEnemyGrid() {
+        enemyX.resize(enemies.size());
+        enemyY.resize(enemies.size());
+        for (size_t i = 0; i < enemies.size(); i++) {
+            enemyX[i] = enemies[i]->getPosition().x;
+            enemyY[i] = enemies[i]->getPosition().y;
+        }
+        enemyGrid.build(enemyX.data(), enemyY.data(), static_cast<int>(enemies.size()),
+                        static_cast<float>(width * TILE_SIZE), static_cast<float>(height * TILE_SIZE), ENEMY_GRID_CELL);
+    }
+   
+    void rebuildItemGrid() {
+        itemX.resize(items.size());
+        itemY.resize(items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            itemX[i] = items[i]->getPosition().x;
+            itemY[i] = items[i]->getPosition().y;
+        }
+        itemGrid.build(itemX.data(), itemY.data(), static_cast<int>(items.size()),
+                       static_cast<float>(width * TILE_SIZE), static_cast<float>(height * TILE_SIZE), ITEM_GRID_CELL);
+        itemGridDirty = false;
+    }
+   
+    // Push overlapping enemies apart, half the overlap each, using the grid built
+    // this update to find neighbours. Pushes go through the collider, so a crowd
+    // can't shove anyone into a wall.
+    void separateEnemies() {
+        const float minimum = Character::BODY_HALF_SIZE * 2.0f;
+        pushX.assign(enemies.size(), 0.0f);
+        pushY.assign(enemies.size(), 0.0f);
+       
+        for (size_t i = 0; i < enemies.size(); i++) {
+            if (!enemies[i]->isAlive()) continue;
+            float x = enemyX[i];
+            float y = enemyY[i];
+            enemyGrid.query(x - minimum, y - minimum, x + minimum, y + minimum, [&](int j) {
+                if (j <= static_cast<int>(i) || !enemies[j]->isAlive()) return;
+                float dx = enemyX[j] - x;
+                float dy = enemyY[j] - y;
+                float distanceSquared = dx * dx + dy * dy;
+                if (distanceSquared >= minimum * minimum) return;
+               
+                // Bodies on the same spot are split sideways
+                float distance = std::sqrt(distanceSquared);
+                float unitX = distance > 0.001f ? dx / distance : 1.0f;
+                float unitY = distance > 0.001f ? dy / distance : 0.0f;
+                float push = (minimum - distance) * 0.5f;
+                pushX[i] -= unitX * push;
+                pushY[i] -= unitY * push;
+                pushX[j] += unitX * push;
+                pushY[j] += unitY * push;
+            });
+        }
+       
+        for (size_t i = 0; i < enemies.size(); i++) {
+            if (pushX[i] != 0.0f || pushY[i] != 0.0f) enemies[i]->moveBy(pushX[i], pushY[i]);
+        }
+    }
+   
+    const TileCollider& getCollider() const { return collider; }
+    PathFinder& getPathFinder() { return paths; }
+    const TileMesh& getTileMesh() const { return tileMesh; }
+    const std::vector<TileRecord>& getTileRecords() const { return records; }
+   
+    // Rebuild every tile chunk now instead of as each comes into view, after many setTile calls
+    void rebuildTileMesh() { tileMesh.build(tiles); }
+   
+    // Leave a mark on the ground at a random angle; corpses only lie on their side
+    void addDecal(DecalData::Kind kind, float x, float y, uint16_t variant, int scale) {
+        DecalData::Record decal = {};
+        decal.x = x;
+        decal.y = y;
+        decal.kind = kind;
+        decal.rotation = static_cast<uint8_t>(kind == DecalData::KIND_CORPSE ? (GameUtils::getRandomInt(0, 1) ? 64 : 192)
+                                                                             : GameUtils::getRandomInt(0, 255));
+        decal.scale = static_cast<uint8_t>(std::clamp(scale, 1, 255));
+        decal.variant = variant;
+        decals.stamp(decal);
+    }
+   
+    DecalLayer& getDecals() { return decals; }
+    const SpatialGrid& getEnemyGrid() const { return enemyGrid; }
+    const float* getEnemyX() const { return enemyX.data(); }
+    const float* getEnemyY() const { return enemyY.data(); }
+   
+    // Draw the dungeon
+    void draw(DrawList& list) {
+        DrawList::Scope drawScope(list, DrawList::SOURCE_DUNGEON);
+       
+        // Get the view bounds
+        sf::FloatRect viewBounds = GameUtils::viewBounds(list.getView());
+       
+        // Only draw tiles that are visible
+        int startX = std::max(0, static_cast<int>(viewBounds.left) / TILE_SIZE);
+        int startY = std::max(0, static_cast<int>(viewBounds.top) / TILE_SIZE);
+        int endX = std::min(width, static_cast<int>(viewBounds.left + viewBounds.width) / TILE_SIZE + 1);
+        int endY = std::min(height, static_cast<int>(viewBounds.top + viewBounds.height) / TILE_SIZE + 1);
+       
+        // Draw tiles from the cached chunks, animated ones at the shader's time, then what lies on them
+        tileMesh.draw(list, tiles, startX, startY, endX, endY, Materials::shaderTime(timers.getTime()));
+        decals.draw(list, startX, startY, endX, endY);
+       
+        // Draw only the items and enemies near the view
+        cullEntities(viewBounds);
+        for (int id : visibleItems) {
+            items[id]->draw(list);
+        }
+        for (int id : visibleEnemies) {
+            enemies[id]->draw(list);
+        }
+    }
+   
+    // Draw the dungeon as Diablo's diamonds around a world-space camera. The floor,
+    // decals and the walls' footprints come from the same chunk caches through the
+    // ground view, and the light map, which must be up to date, is multiplied over
+    // them. Items are laid on it in the upright view, then the chunks' cached wall
+    // runs, enemies and the player stand up, back to front by screen row; walls in
+    // front of the player are drawn see-through. What is drawn after the multiply
+    // takes the light at its feet instead. The list is left in the ground view, for
+    // effects on the floor.
+    void drawIsometric(DrawList& list, const sf::View& camera) {
+        DrawList::Scope drawScope(list, DrawList::SOURCE_DUNGEON);
+        sf::View ground = IsoProjection::groundView(camera);
+        sf::View upright = IsoProjection::uprightView(camera);
+        sf::FloatRect screen = IsoProjection::screenRect(upright);
+        float time = Materials::shaderTime(timers.getTime());
+       
+        sf::FloatRect viewBounds = GameUtils::viewBounds(ground);
+        int startX = std::max(0, static_cast<int>(viewBounds.left) / TILE_SIZE);
+        int startY = std::max(0, static_cast<int>(viewBounds.top) / TILE_SIZE);
+        int endX = std::min(width, static_cast<int>(viewBounds.left + viewBounds.width) / TILE_SIZE + 1);
+        int endY = std::min(height, static_cast<int>(viewBounds.top + viewBounds.height) / TILE_SIZE + 1);
+       
+        list.setView(ground);
+        tileMesh.draw(list, tiles, startX, startY, endX, endY, time, &screen);
+        decals.draw(list, startX, startY, endX, endY, &screen);
+        lights.draw(list, &screen);
+       
+        // Walls rise WALL_HEIGHT above their diamonds and sprites reach DRAW_MARGIN
+        // from their feet, so things that far past the bottom and sides still show
+        sf::FloatRect reach(screen.left - DRAW_MARGIN, screen.top - DRAW_MARGIN, screen.width + DRAW_MARGIN * 2.0f,
+                            screen.height + DRAW_MARGIN + std::max(DRAW_MARGIN, IsoProjection::WALL_HEIGHT));
+        depth.reset(static_cast<int>(reach.height) + 1);
+        auto rowOf = [&reach](sf::Vector2f feet) {
+            return static_cast<int>(IsoProjection::project(feet).y - reach.top);
+        };
+       
+        // Wall runs are filed at their diamonds' centres, so a character beside one sorts on the right side of it
+        tileMesh.gatherFaces(tiles, screen, [&](float row, uint32_t handle) {
+            depth.add(static_cast<int>(row - reach.top), STAND_WALL | handle);
+        });
+       
+        // The ground the screen shows is a diamond, so the grids are asked for it a
+        // band of whole cell rows at a time rather than for its bounding box. Grid
+        // rows clamp at the map's edges, so each band keeps only the feet inside it.
+        if (enemyGrid.getCount() != static_cast<int>(enemies.size())) rebuildEnemyGrid();
+        if (itemGridDirty) rebuildItemGrid();
+        visibleEnemies.clear();
+        visibleItems.clear();
+        float reachRight = reach.left + reach.width;
+        float reachBottom = reach.top + reach.height;
+        float bandHeight = ITEM_GRID_CELL;
+        for (float top = std::floor((reach.top - reachRight * 0.5f) / bandHeight) * bandHeight;
+             top < reachBottom - reach.left * 0.5f; top += bandHeight) {
+            float bottom = top + bandHeight;
+            float left, right;
+            IsoProjection::bandSpan(reach, top, bottom, left, right);
+            if (left > right) continue;
+            auto shows = [&](float x, float y) {
+                return y >= top && y < bottom && reach.contains(IsoProjection::project(sf::Vector2f(x, y)));
+            };
+            itemGrid.query(left, top, right, bottom - 1.0f, [&](int id) {
+                if (shows(itemX[id], itemY[id]) && items[id]->isOnGround()) visibleItems.push_back(id);
+            });
+            enemyGrid.query(left, top, right, bottom - 1.0f, [&](int id) {
+                if (shows(enemyX[id], enemyY[id])) {
+                    visibleEnemies.push_back(id);
+                    depth.add(rowOf(enemies[id]->getPosition()), STAND_ENEMY | id);
+                }
+            });
+        }
+        if (player) depth.add(rowOf(player->getPosition()), STAND_PLAYER);
+       
+        // Walls in front of the player that overlap its sprite would hide it
+        sf::FloatRect playerRect;
+        float playerY = std::numeric_limits<float>::max();
+        if (player) {
+            sf::Vector2f feet = IsoProjection::project(player->getPosition());
+            playerRect = sf::FloatRect(feet.x - TILE_SIZE, feet.y - IsoProjection::STAND_LIFT - TILE_SIZE * 1.5f,
+                                       TILE_SIZE * 2.0f, TILE_SIZE * 2.0f + IsoProjection::STAND_LIFT);
+            playerY = feet.y;
+        }
+       
+        // A plain sprite is tinted by the light at its feet; a material sprite's
+        // colour is taken, so the shader's light uniform carries it, sent only when
+        // it changes and back to white for torches and whatever comes after
+        sf::Shader* material = resources.getMaterials().getShader();
+        sf::Color shaderLight = sf::Color::White;
+        auto useLight = [&](const sf::Color& light) {
+            if (material && light != shaderLight) {
+                sf::Glsl::Vec3 value(light.r / 255.0f, light.g / 255.0f, light.b / 255.0f);
+                list.setUniform(*material, "light", value);
+                shaderLight = light;
+            }
+            return light;
+        };
+       
+        // Items lie on the floor, under anything standing, so they need no sorting
+        list.setView(upright);
+        for (int id : visibleItems) {
+            DrawList::Offset offset(list, IsoProjection::lyingOffset(items[id]->getPosition()));
+            DrawList::Tint tint(list, useLight(lights.lightAt(items[id]->getPosition())));
+            items[id]->draw(list);
+        }
+       
+        // Wall runs next to each other in the order merge into one batch on the list
+        for (uint32_t handle : depth.sort()) {
+            uint32_t index = handle & STAND_INDEX;
+            if ((handle & ~STAND_INDEX) == STAND_WALL) {
+                useLight(sf::Color::White);
+                tileMesh.drawFaces(list, index, time, lights, playerRect, playerY);
+            } else if ((handle & ~STAND_INDEX) == STAND_ENEMY) {
+                DrawList::Offset offset(list, IsoProjection::standingOffset(enemies[index]->getPosition()));
+                DrawList::Tint tint(list, useLight(lights.lightAt(enemies[index]->getPosition())));
+                enemies[index]->draw(list);
+            } else {
+                DrawList::Offset offset(list, IsoProjection::standingOffset(player->getPosition()));
+                DrawList::Tint tint(list, useLight(lights.lightAt(player->getPosition())));
+                player->draw(list);
+            }
+        }
+        useLight(sf::Color::White);
+        list.setView(ground);
+    }
+   
+    int getStandingCount() const { return depth.getCount(); }
+   
+    // Sprites, health bars and names reach at most this far from an entity's position
+    static constexpr float DRAW_MARGIN = TILE_SIZE * 2.0f;
+   
+    // Find the enemies and ground items within DRAW_MARGIN of a view rectangle.
+    // The grids narrow it to a few cells, the positions decide; ids are sorted
+    // so overlapping sprites keep their order as things move between cells.
+    void cullEntities(const sf::FloatRect& view) {
+        if (enemyGrid.getCount() != static_cast<int>(enemies.size())) rebuildEnemyGrid();
+        if (itemGridDirty) rebuildItemGrid();
+       
+        float minX = view.left - DRAW_MARGIN;
+        float minY = view.top - DRAW_MARGIN;
+        float maxX = view.left + view.width + DRAW_MARGIN;
+        float maxY = view.top + view.height + DRAW_MARGIN;
+        auto inside = [&](float x, float y) { return x >= minX && x <= maxX && y >= minY && y <= maxY; };
+       
+        visibleEnemies.clear();
+        enemyGrid.query(minX, minY, maxX, maxY, [&](int id) {
+            if (inside(enemyX[id], enemyY[id])) visibleEnemies.push_back(id);
+        });
+        std::sort(visibleEnemies.begin(), visibleEnemies.end());
+       
+        visibleItems.clear();
+        itemGrid.query(minX, minY, maxX, maxY, [&](int id) {
+            if (inside(itemX[id], itemY[id]) && items[id]->isOnGround()) visibleItems.push_back(id);
+        });
+        std::sort(visibleItems.begin(), visibleItems.end());
+    }
+   
+    const std::vector<int>& getVisibleEnemies() const { return visibleEnemies; }
+    const std::vector<int>& getVisibleItems() const { return visibleItems; }
+    int getVisibleEntityCount() const { return static_cast<int>(visibleEnemies.size() + visibleItems.size()); }
+    int getEntityCount() const { return static_cast<int>(enemies.size() + items.size()); }
+   
+    // Roll the enemy's loot table at the player's level and place the drop where it died
+    void dropLoot(const Enemy& enemy) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_ENTITY);
+        LootDrop drop;
+        int level = player->getLevel();
+        if (!resources.getLoot().roll(enemy.getArchetype(), level, GameUtils::rng, drop)) {
+            return;
+        }
+       
+        std::shared_ptr<Item> item;
+        switch (drop.kind) {
+            case GameData::KIND_WEAPON:
+                item = std::make_shared<Weapon>(drop.archetype, resources, level);
+                break;
+            case GameData::KIND_ARMOR:
+                item = std::make_shared<Armor>(drop.archetype, resources, level);
+                break;
+            default:
+                item = std::make_shared<Potion>(drop.archetype, resources, level);
+                break;
+        }
+       
+        const ArchetypeTable& archetypes = resources.getArchetypes();
+        if (drop.rarity >= 0) item->setRarity(archetypes.getString(archetypes.getRarity(drop.rarity).name));
+        if (drop.prefix >= 0) item->applyAffix(archetypes, drop.prefix);
+        if (drop.suffix >= 0) item->applyAffix(archetypes, drop.suffix);
+       
+        item->setPosition(enemy.getPosition().x, enemy.getPosition().y);
+        items.push_back(item);
+        itemGridDirty = true;
+    }
+   
+    // Find a random walkable tile inside the given bounds
+    sf::Vector2i findWalkableTile(int minX, int minY, int maxX, int maxY) {
+        int x, y;
+        do {
+            x = GameUtils::getRandomInt(minX, maxX);
+            y = GameUtils::getRandomInt(minY, maxY);
+        } while (!isWalkable(x * TILE_SIZE, y * TILE_SIZE));
+        return sf::Vector2i(x, y);
+    }
+   
+    // Populate dungeon from the monster archetypes: density-based spawns plus one boss
+    void populateEnemies() {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        const ArchetypeTable& archetypes = resources.getArchetypes();
+       
+        for (int i = 0; i < archetypes.getMonsterCount(); i++) {
+            const GameData::MonsterRecord& monster = archetypes.getMonster(i);
+           
+            if (monster.flags & GameData::FLAG_BOSS) {
+                sf::Vector2i tile = findWalkableTile(width / 2, height / 2, width - 5, height - 5);
+                addEnemy(i, tile.x, tile.y);
+            } else if (monster.density > 0) {
+                for (int n = 0; n < width * height / monster.density; n++) {
+                    sf::Vector2i tile = findWalkableTile(2, 2, width - 3, height - 3);
+                    addEnemy(i, tile.x, tile.y);
+                }
+            }
+        }
+        rebuildEnemyGrid();
+    }
+   
+    // Populate dungeon with loot: density-based ground items and starter gear near the entrance
+    void populateItems() {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_DUNGEON);
+        const ArchetypeTable& archetypes = resources.getArchetypes();
+       
+        auto placeItems = [this](auto addAt, uint16_t density, uint16_t flags) {
+            if (flags & GameData::FLAG_STARTER) {
+                sf::Vector2i tile(GameUtils::getRandomInt(2, 5), GameUtils::getRandomInt(2, 5));
+                addAt(tile.x, tile.y);
+            }
+            if (density > 0) {
+                for (int n = 0; n < width * height / density; n++) {
+                    sf::Vector2i tile = findWalkableTile(2, 2, width - 3, height - 3);
+                    addAt(tile.x, tile.y);
+                }
+            }
+        };
+       
+        for (int i = 0; i < archetypes.getWeaponCount(); i++) {
+            const GameData::WeaponRecord& weapon = archetypes.getWeapon(i);
+            placeItems([this, i](int x, int y) { addItem<Weapon>(x, y, i, resources); },
+                       weapon.density, weapon.flags);
+        }
+        for (int i = 0; i < archetypes.getArmorCount(); i++) {
+            const GameData::ArmorRecord& armor = archetypes.getArmor(i);
+            placeItems([this, i](int x, int y) { addItem<Armor>(x, y, i, resources); },
+                       armor.density, armor.flags);
+        }
+        for (int i = 0; i < archetypes.getPotionCount(); i++) {
+            const GameData::PotionRecord& potion = archetypes.getPotion(i);
+            placeItems([this, i](int x, int y) { addItem<Potion>(x, y, i, resources); },
+                       potion.density, potion.flags);
+        }
+    }
+   
+    // Get enemies in the dungeon
+    const std::vector<std::shared_ptr<Enemy>>& getEnemies() const {
+        return enemies;
+    }
+   
+    const std::vector<std::shared_ptr<Item>>& getItems() const {
+        return items;
+    }
+};
+
+// Spell system - carries out spells as their archetype records describe. Area
+// spells ask the dungeon's enemy grid for nearby candidates, test the whole batch
+// against the shape in one pass over the position snapshot, and queue everything
+// they hit on the combat system together. Projectiles come from a fixed pool
+// filled at startup; a radius spell's projectile bursts where it stops.
+class SpellSystem {
+public:
+    static const int MAX_PROJECTILES = 64;
+    static constexpr float BODY_RADIUS = TILE_SIZE * 0.4f;  // How close a spell must come to an enemy's centre
+   
+private:
+    ResourceManager& resources;
+    CombatSystem& combat;
+    StatusEffects& effects;
+    ParticleSystem& particles;
+    std::vector<std::unique_ptr<Projectile>> pool;
+    std::vector<int> candidates;  // Scratch: enemy ids from the grid
+    std::vector<int> targets;     // Scratch: candidates inside the shape
+    uint64_t targetsHit;
+   
+public:
+    SpellSystem(ResourceManager& resources, CombatSystem& combat, StatusEffects& effects,
+                ParticleSystem& particles, LightMap& lights, TimerWheel& timers)
+        : resources(resources), combat(combat), effects(effects), particles(particles), targetsHit(0) {
+        for (int i = 0; i < MAX_PROJECTILES; i++) {
+            pool.push_back(std::make_unique<Projectile>(resources, particles, lights, timers));
+        }
+    }
+   
+    // Cast toward a point, pulled in to the spell's range. Returns false if the
+    // spell found nothing to act on or no projectile was free.
+    bool cast(Character& caster, int spell, float targetX, float targetY, Dungeon& dungeon) {
+        const GameData::SpellRecord& record = resources.getArchetypes().getSpell(spell);
+        float originX = caster.getPosition().x;
+        float originY = caster.getPosition().y;
+        float dx = targetX - originX;
+        float dy = targetY - originY;
+        float distance = std::sqrt(dx * dx + dy * dy);
+        if (distance > record.range) {
+            targetX = originX + dx * record.range / distance;
+            targetY = originY + dy * record.range / distance;
+            distance = record.range;
+        }
+       
+        switch (record.targeting) {
+            case GameData::TARGET_SELF:
+                return record.effect != GameData::EFFECT_NONE &&
+                       effects.apply(caster, static_cast<GameData::EffectId>(record.effect), record.effectStacks);
+               
+            case GameData::TARGET_SINGLE:
+            case GameData::TARGET_RADIUS:
+                if (record.projectileSpeed > 0.0f) {
+                    // A single-target projectile flies its full range, a radius one stops at the aim point
+                    float flight = record.targeting == GameData::TARGET_SINGLE ? record.range : distance;
+                    return launch(caster, spell, originX, originY, targetX, targetY, flight / record.projectileSpeed);
+                }
+                if (record.targeting == GameData::TARGET_RADIUS) {
+                    return burst(caster, spell, targetX, targetY, dungeon);
+                }
+                targets.clear();
+                if (int target = nearestEnemy(dungeon, targetX, targetY, BODY_RADIUS * 2.0f, &caster); target >= 0) {
+                    targets.push_back(target);
+                }
+                return applyToTargets(caster, record, dungeon);
+               
+            default:
+                return sweep(caster, record, originX, originY, targetX, targetY, dungeon);
+        }
+    }
+   
+    // Everything within the spell's area of a point. The grid narrows it to a few
+    // cells; one pass over the candidates' positions does the exact test.
+    bool burst(Character& caster, int spell, float x, float y, Dungeon& dungeon) {
+        const GameData::SpellRecord& record = resources.getArchetypes().getSpell(spell);
+        float reach = record.area + BODY_RADIUS;
+        gather(dungeon, x - reach, y - reach, x + reach, y + reach);
+       
+        const float* xs = dungeon.getEnemyX();
+        const float* ys = dungeon.getEnemyY();
+        float reachSquared = reach * reach;
+        targets.resize(candidates.size());
+        size_t count = 0;
+        for (int id : candidates) {
+            float dx = xs[id] - x;
+            float dy = ys[id] - y;
+            targets[count] = id;
+            count += dx * dx + dy * dy <= reachSquared;
+        }
+        targets.resize(count);
+       
+        particles.emit(ParticleSystem::EmitterType::Hit, x, y, 48);
+        if (record.damageDice > 0) {
+            dungeon.addDecal(DecalData::KIND_SCORCH, x, y, static_cast<uint16_t>(GameUtils::getRandomInt(0, 3)),
+                             static_cast<int>(record.area * 2.0f * 8.0f / TILE_SIZE));
+        }
+        return applyToTargets(caster, record, dungeon);
+    }
+   
+    // Fly every active projectile. It stops on the first enemy it touches, on a
+    // wall or when its time runs out.
+    void update(float deltaTime, Dungeon& dungeon) {
+        for (auto& projectile : pool) {
+            if (!projectile->isActive()) continue;
+            projectile->update(deltaTime);
+           
+            sf::Vector2f position = projectile->getPosition();
+            Character* source = projectile->getSource();
+            int hit = nearestEnemy(dungeon, position.x, position.y, BODY_RADIUS, source);
+            if (hit < 0 && !projectile->hasExpired() && dungeon.isWalkable(position.x, position.y)) continue;
+           
+            int spell = projectile->getSpell();
+            const GameData::SpellRecord& record = resources.getArchetypes().getSpell(spell);
+            projectile->deactivate();
+            if (record.targeting == GameData::TARGET_RADIUS) {
+                burst(*source, spell, position.x, position.y, dungeon);
+            } else if (hit >= 0) {
+                targets.assign(1, hit);
+                applyToTargets(*source, record, dungeon);
+            }
+        }
+    }
+   
+    void draw(DrawList& list) {
+        for (auto& projectile : pool) {
+            if (projectile->isActive()) projectile->draw(list);
+        }
+    }
+   
+    // Ground every projectile, e.g. before the characters they came from go away
+    void clear() {
+        for (auto& projectile : pool) {
+            if (projectile->isActive()) projectile->deactivate();
+        }
+    }
+   
+    int getActiveProjectiles() const {
+        int count = 0;
+        for (const auto& projectile : pool) count += projectile->isActive() ? 1 : 0;
+        return count;
+    }
+   
+    const std::vector<int>& getLastTargets() const { return targets; }
+    uint64_t getTargetsHit() const { return targetsHit; }
+   
+private:
+    bool launch(Character& caster, int spell, float x, float y, float targetX, float targetY, float lifespan) {
+        for (auto& projectile : pool) {
+            if (projectile->isActive()) continue;
+            const ArchetypeTable& archetypes = resources.getArchetypes();
+            projectile->launch(spell, &caster, archetypes.getString(archetypes.getSpell(spell).projectileTexture),
+                               x, y, targetX, targetY, archetypes.getSpell(spell).projectileSpeed, lifespan);
+            return true;
+        }
+        return false;
+    }
+   
+    // Cones and lines start at the caster and run along the aim
+    bool sweep(Character& caster, const GameData::SpellRecord& record, float originX, float originY,
+               float targetX, float targetY, Dungeon& dungeon) {
+        float dirX = targetX - originX;
+        float dirY = targetY - originY;
+        float length = std::sqrt(dirX * dirX + dirY * dirY);
+        if (length <= 0.0f) return false;
+        dirX /= length;
+        dirY /= length;
+       
+        float range = record.range + BODY_RADIUS;
+        float endX = originX + dirX * range;
+        float endY = originY + dirY * range;
+        bool cone = record.targeting == GameData::TARGET_CONE;
+        if (cone) {
+            gather(dungeon, originX - range, originY - range, originX + range, originY + range);
+        } else {
+            float pad = record.area + BODY_RADIUS;
+            gather(dungeon, std::min(originX, endX) - pad, std::min(originY, endY) - pad,
+                   std::max(originX, endX) + pad, std::max(originY, endY) + pad);
+        }
+       
+        const float* xs = dungeon.getEnemyX();
+        const float* ys = dungeon.getEnemyY();
+        float cosHalfAngle = std::cos(record.area * 3.14159f / 180.0f);
+        float halfWidth = record.area + BODY_RADIUS;
+        targets.resize(candidates.size());
+        size_t count = 0;
+        for (int id : candidates) {
+            float vx = xs[id] - originX;
+            float vy = ys[id] - originY;
+            float along = vx * dirX + vy * dirY;
+            bool inside;
+            if (cone) {
+                float distance = std::sqrt(vx * vx + vy * vy);
+                inside = distance <= range && along >= cosHalfAngle * distance;
+            } else {
+                inside = along >= 0.0f && along <= range && std::abs(vx * dirY - vy * dirX) <= halfWidth;
+            }
+            targets[count] = id;
+            count += inside;
+        }
+        targets.resize(count);
+       
+        for (float t = 0.0f; t < range; t += TILE_SIZE / 2.0f) {
+            particles.emit(ParticleSystem::EmitterType::SpellTrail, originX + dirX * t, originY + dirY * t, 4,
+                           dirX * 60.0f, dirY * 60.0f);
+        }
+        return applyToTargets(caster, record, dungeon);
+    }
+   
+    // One damage roll for the whole cast, as area spells are rolled at the table
+    bool applyToTargets(Character& caster, const GameData::SpellRecord& record, Dungeon& dungeon) {
+        const auto& enemies = dungeon.getEnemies();
+        int amount = record.damageDice > 0
+            ? GameUtils::rollDice(record.damageDice, record.damageFaces) + record.damageBonus : 0;
+       
+        int hit = 0;
+        for (int id : targets) {
+            Enemy& enemy = *enemies[id];
+            if (&enemy == &caster || !enemy.isAlive()) continue;
+           
+            if (amount > 0) combat.queueDamage(&caster, enemy, amount);
+            if (record.effect != GameData::EFFECT_NONE) {
+                effects.apply(enemy, static_cast<GameData::EffectId>(record.effect), record.effectStacks);
+            }
+            enemy.aggravate();
+            hit++;
+        }
+        targetsHit += hit;
+        return hit > 0;
+    }
+   
+    int nearestEnemy(Dungeon& dungeon, float x, float y, float reach, const Character* exclude) {
+        gather(dungeon, x - reach, y - reach, x + reach, y + reach);
+        const auto& enemies = dungeon.getEnemies();
+        const float* xs = dungeon.getEnemyX();
+        const float* ys = dungeon.getEnemyY();
+       
+        int best = -1;
+        float bestDistance = reach * reach;
+        for (int id : candidates) {
+            float dx = xs[id] - x;
+            float dy = ys[id] - y;
+            float distance = dx * dx + dy * dy;
+            if (distance <= bestDistance && enemies[id].get() != exclude && enemies[id]->isAlive()) {
+                best = id;
+                bestDistance = distance;
+            }
+        }
+        return best;
+    }
+   
+    void gather(const Dungeon& dungeon, float minX, float minY, float maxX, float maxY) {
+        candidates.clear();
+        dungeon.getEnemyGrid().query(minX, minY, maxX, maxY, [this](int id) { candidates.push_back(id); });
+    }
+};
+
+// UI Manager
+class UIManager {
+private:
+    ResourceManager& resources;
+    sf::RenderWindow& window;
+    FramePacer& pacer;
+    RenderThread& renderer;
+    Player& player;
+   
+    // The view the world was last drawn in; the window's own belongs to the render thread
+    sf::View worldView;
+   
+    sf::RectangleShape inventoryPanel;
+    sf::RectangleShape statsPanel;
+    sf::RectangleShape minimapPanel;
+    sf::Text titleText;
+    sf::Text statsText;
+    sf::Text inventoryText;
+    sf::Text minimapText;
+   
+    // Text last handed to SFML. Converting to sf::String allocates, so the panels
+    // are rebuilt in the frame arena every frame but only set when they change.
+    std::string statsString;
+    std::string inventoryString;
+   
+    // Floating damage numbers in world space, in a ring of slots built up front
+    // so a busy fight reuses them instead of building and copying sf::Texts
+    static constexpr size_t MAX_COMBAT_TEXTS = 32;
+    struct CombatText {
+        sf::Text text;
+        sf::Vector2f anchor;  // The world point it rose from
+        float timer;          // Free once it reaches zero
+    };
+    std::vector<CombatText> combatTexts;
+    size_t nextCombatText;  // Oldest slot, and the next to be taken
+    sf::String combatString;
+   
+    bool inventoryOpen;
+    bool isometric;  // The world is drawn through IsoProjection's views
+   
+public:
+    UIManager(ResourceManager& resources, sf::RenderWindow& window, FramePacer& pacer, RenderThread& renderer,
+              Player& player)
+        : resources(resources), window(window), pacer(pacer), renderer(renderer), player(player),
+          worldView(window.getDefaultView()), combatTexts(MAX_COMBAT_TEXTS), nextCombatText(0),
+          inventoryOpen(false), isometric(false) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_UI);
+       
+        // Initialize UI panels
+        inventoryPanel.setSize(sf::Vector2f(300, 400));
+        inventoryPanel.setFillColor(sf::Color(30, 30, 30, 220));
+        inventoryPanel.setOutlineColor(sf::Color(100, 100, 100));
+        inventoryPanel.setOutlineThickness(2);
+       
+        statsPanel.setSize(sf::Vector2f(window.getSize().x, 50));
+        statsPanel.setFillColor(sf::Color(20, 20, 20, 200));
+       
+        minimapPanel.setSize(sf::Vector2f(150, 150));
+        minimapPanel.setFillColor(sf::Color(20, 20, 20, 180));
+        minimapPanel.setOutlineColor(sf::Color(80, 80, 80));
+        minimapPanel.setOutlineThickness(1);
+       
+        // Initialize text elements
+        titleText.setFont(resources.getFont("main"));
+        titleText.setCharacterSize(18);
+        titleText.setFillColor(sf::Color::White);
+       
+        statsText.setFont(resources.getFont("main"));
+        statsText.setCharacterSize(14);
+        statsText.setFillColor(sf::Color::White);
+       
+        inventoryText.setFont(resources.getFont("main"));
+        inventoryText.setCharacterSize(14);
+        inventoryText.setFillColor(sf::Color::White);
+       
+        minimapText.setFont(resources.getFont("main"));
+        minimapText.setCharacterSize(12);
+        minimapText.setFillColor(sf::Color::White);
+        minimapText.setString("Map");
+       
+        for (auto& combatText : combatTexts) {
+            combatText.text.setFont(resources.getFont("main"));
+            combatText.text.setCharacterSize(14);
+            combatText.text.setOutlineColor(sf::Color::Black);
+            combatText.text.setOutlineThickness(1);
+            combatText.timer = 0.0f;
+        }
+    }
+   
+    void update(float deltaTime) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_UI);
+       
+        // Float combat text upwards and drop it once it has faded
+        for (auto& combatText : combatTexts) {
+            if (combatText.timer <= 0.0f) continue;
+            combatText.timer -= deltaTime;
+            combatText.text.move(0, -30.0f * deltaTime);
+            sf::Color color = combatText.text.getFillColor();
+            color.a = static_cast<sf::Uint8>(255 * std::max(0.0f, std::min(1.0f, combatText.timer)));
+            combatText.text.setFillColor(color);
+        }
+       
+        // Update panel positions
+        sf::Vector2f viewCenter = worldView.getCenter();
+        sf::Vector2f viewSize = worldView.getSize();
+       
+        statsPanel.setPosition(viewCenter.x - viewSize.x / 2, viewCenter.y - viewSize.y / 2);
+       
+        minimapPanel.setPosition(
+            viewCenter.x + viewSize.x / 2 - minimapPanel.getSize().x - 10,
+            viewCenter.y - viewSize.y / 2 + 60
+        );
+        minimapText.setPosition(
+            minimapPanel.getPosition().x + 10,
+            minimapPanel.getPosition().y + 5
+        );
+       
+        if (inventoryOpen) {
+            inventoryPanel.setPosition(
+                viewCenter.x - inventoryPanel.getSize().x / 2,
+                viewCenter.y - inventoryPanel.getSize().y / 2
+            );
+           
+            // Update inventory content
+            TextBuilder text(2048);
+            text << "INVENTORY\n\n";
+           
+            const auto& inventory = player.getInventory();
+            if (inventory.empty()) {
+                text << "Empty";
+            } else {
+                for (size_t i = 0; i < inventory.size(); i++) {
+                    const Item* item = inventory[i].get();
+                    text << i + 1 << ". ";
+                    item->appendName(text);
+                    if (item->getRarity()[0] != '\0') {
+                        text << " (" << item->getRarity() << ")";
+                    }
+                    text << " - " << item->getDescription() << "\n";
+                   
+                    if (const Weapon* weapon = dynamic_cast<const Weapon*>(item)) {
+                        text << "   Damage: " << weapon->getMinDamage() << "-"
+                             << weapon->getMaxDamage() << ", +" << weapon->getAttackBonus() << " Attack\n";
+                    } else if (const Armor* armor = dynamic_cast<const Armor*>(item)) {
+                        text << "   Defense: +" << armor->getDefense() << "\n";
+                    } else if (const Potion* potion = dynamic_cast<const Potion*>(item)) {
+                        text << "   Heals: " << potion->getHealAmount() << " HP\n";
+                    }
+                   
+                    text << "   Value: " << item->getValue() << " gold\n\n";
+                }
+            }
+           
+            // Spells are cast with the number keys, aimed at the mouse
+            const auto& spells = player.getSpells();
+            if (!spells.empty()) {
+                text << "\nSPELLS\n\n";
+                for (size_t i = 0; i < spells.size() && i < 9; i++) {
+                    text << "[" << i + 1 << "] " << spells[i]->getName() << " - " << spells[i]->getManaCost()
+                         << " mana\n   " << spells[i]->getDescription() << "\n";
+                }
+            }
+           
+            if (text.view() != inventoryString) {
+                inventoryString.assign(text.view());
+                inventoryText.setString(inventoryString);
+            }
+            inventoryText.setPosition(
+                inventoryPanel.getPosition().x + 10,
+                inventoryPanel.getPosition().y + 10
+            );
+        }
+       
+        // Update stats text
+        TextBuilder text;
+        player.appendName(text);
+        text << " | Level " << player.getLevel()
+             << " | HP: " << player.getHealth() << "/" << player.getMaxHealth()
+             << " | Mana: " << player.getMana() << "/" << player.getMaxMana()
+             << " | Gold: " << player.getGold()
+             << " | XP: " << player.getExperience() << "/" << (player.getLevel() * 1000);
+       
+        // Active status effects with stacks and seconds left
+        for (int id = GameData::EFFECT_NONE + 1; id < GameData::EFFECT_COUNT; id++) {
+            GameData::EffectId effect = static_cast<GameData::EffectId>(id);
+            if (!player.hasEffect(effect)) continue;
+            text << " | " << StatusEffects::getRule(effect).name;
+            if (player.getEffectStacks(effect) > 1) text << " x" << player.getEffectStacks(effect);
+            text << " " << static_cast<int>(std::ceil(player.getEffectRemaining(effect))) << "s";
+        }
+       
+        if (text.view() != statsString) {
+            statsString.assign(text.view());
+            statsText.setString(statsString);
+        }
+        statsText.setPosition(
+            statsPanel.getPosition().x + 10,
+            statsPanel.getPosition().y + 15
+        );
+    }
+   
+    void draw(DrawList& list) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_UI);
+        DrawList::Scope drawScope(list, DrawList::SOURCE_UI);
+       
+        // Combat text lives in the world, so draw it before switching views; in the
+        // upright view it stands over where it rose from, as the characters do
+        // Oldest first, so newer text lands on top
+        for (size_t i = 0; i < MAX_COMBAT_TEXTS; ++i) {
+            const CombatText& combatText = combatTexts[(nextCombatText + i) % MAX_COMBAT_TEXTS];
+            if (combatText.timer <= 0.0f) continue;
+            DrawList::Offset offset(list, isometric ? IsoProjection::standingOffset(combatText.anchor) : sf::Vector2f());
+            list.draw(combatText.text);
+        }
+       
+        // Store current view
+        sf::View currentView = list.getView();
+        worldView = currentView;
+       
+        // Switch to UI view
+        sf::View uiView = list.getDefaultView();
+        list.setView(uiView);
+       
+        // Draw stats panel
+        list.draw(statsPanel);
+        list.draw(statsText);
+       
+        // Draw minimap
+        list.draw(minimapPanel);
+        list.draw(minimapText);
+       
+        // Draw inventory if open
+        if (inventoryOpen) {
+            list.draw(inventoryPanel);
+            list.draw(inventoryText);
+        }
+       
+        // Restore previous view
+        list.setView(currentView);
+    }
+   
+    void toggleInventory() {
+        inventoryOpen = !inventoryOpen;
+    }
+   
+    void setIsometric(bool value) {
+        isometric = value;
+    }
+   
+    bool isInventoryOpen() const {
+        return inventoryOpen;
+    }
+   
+    // Show a short-lived number or word above a point in the world; once every
+    // slot is in use the oldest text is replaced
+    void addCombatText(float x, float y, std::string_view message, const sf::Color& color) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_UI);
+        CombatText& combatText = combatTexts[nextCombatText];
+        nextCombatText = (nextCombatText + 1) % MAX_COMBAT_TEXTS;
+       
+        TextBuilder::copy(message, combatString);
+        combatText.text.setString(combatString);
+        combatText.text.setFillColor(color);
+        combatText.text.setPosition(x - combatText.text.getLocalBounds().width / 2, y - 30);
+        combatText.anchor = sf::Vector2f(x, y);
+        combatText.timer = 1.0f;
+    }
+   
+    // Show dialog with message
+    void showDialog(const std::string& title, const std::string& message) {
+        MemoryTracker::Scope memoryScope(MemoryTracker::TAG_UI);
+        // Views of the frames the dialog records
+        sf::View currentView = worldView;
+        sf::View uiView = window.getDefaultView();
+       
+        // Create dialog panel
+        sf::RectangleShape dialogPanel;
+        dialogPanel.setSize(sf::Vector2f(400, 200));
+        dialogPanel.setFillColor(sf::Color(40, 40, 40, 230));
+        dialogPanel.setOutlineColor(sf::Color(150, 150, 150));
+        dialogPanel.setOutlineThickness(2);
+        dialogPanel.setPosition(
+            window.getSize().x / 2 - dialogPanel.getSize().x / 2,
+            window.getSize().y / 2 - dialogPanel.getSize().y / 2
+        );
+       
+        // Create title text
+        sf::Text dialogTitle;
+        dialogTitle.setFont(resources.getFont("main"));
+        dialogTitle.setString(title);
+        dialogTitle.setCharacterSize(18);
+        dialogTitle.setFillColor(sf::Color::White);
+        dialogTitle.setPosition(
+            dialogPanel.getPosition().x + 20,
+            dialogPanel.getPosition().y + 20
+        );
+       
+        // Create message text
+        sf::Text dialogMessage;
+        dialogMessage.setFont(resources.getFont("main"));
+        dialogMessage.setString(message);
+        dialogMessage.setCharacterSize(14);
+        dialogMessage.setFillColor(sf::Color::White);
+        dialogMessage.setPosition(
+            dialogPanel.getPosition().x + 20,
+            dialogPanel.getPosition().y + 60
+        );
+       
+        // Create continue button
+        sf::RectangleShape continueButton;
+        continueButton.setSize(sf::Vector2f(100, 30));
+        continueButton.setFillColor(sf::Color(80, 80, 80));
+        continueButton.setOutlineColor(sf::Color(150, 150, 150));
+        continueButton.setOutlineThickness(1);
+        continueButton.setPosition(
+            dialogPanel.getPosition().x + dialogPanel.getSize().x / 2 - continueButton.getSize().x / 2,
+            dialogPanel.getPosition().y + dialogPanel.getSize().y - 50
+        );
+       
+        sf::Text continueText;
+        continueText.setFont(resources.getFont("main"));
+        continueText.setString("Continue");
+        continueText.setCharacterSize(14);
+        continueText.setFillColor(sf::Color::White);
+        continueText.setPosition(
+            continueButton.getPosition().x + continueButton.getSize().x / 2 - continueText.getGlobalBounds().width / 2,
+            continueButton.getPosition().y + continueButton.getSize().y / 2 - continueText.getGlobalBounds().height
+        );
+       
+        // Wait for user to click continue. The dialog is static, so it is only
+        // drawn again after an event and otherwise sleeps in the event queue.
+        bool dialogOpen = true;
+        bool redraw = true;
+        while (dialogOpen && window.isOpen()) {
+            if (redraw) {
+                DrawList& list = renderer.begin();
+                DrawList::Scope drawScope(list, DrawList::SOURCE_UI);
+                list.clear(sf::Color(0, 0, 0));
+               
+                // Draw game in background (restoring previous view)
+                list.setView(currentView);
+                // Game rendering would go here
+               
+                // Draw dialog
+                list.setView(uiView);
+                list.draw(dialogPanel);
+                list.draw(dialogTitle);
+                list.draw(dialogMessage);
+                list.draw(continueButton);
+                list.draw(continueText);
+               
+                renderer.submit();
+                pacer.frameRendered();
+                redraw = false;
+            }
+           
+            sf::Event event;
+            if (!pacer.waitForEvent(window, event)) continue;
+            do {
+                if (event.type == sf::Event::Closed) {
+                    renderer.close();
+                    return;
+                }
+               
+                if (event.type == sf::Event::MouseButtonPressed) {
+                    sf::Vector2f mousePos = window.mapPixelToCoords(
+                        sf::Vector2i(event.mouseButton.x, event.mouseButton.y),
+                        uiView
+                    );
+                   
+                    if (continueButton.getGlobalBounds().contains(mousePos)) {
+                        dialogOpen = false;
+                    }
+                }
+               
+                if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Return) {
+                    dialogOpen = false;
+                }
+               
+                redraw |= event.type != sf::Event::MouseMoved;
+            } while (window.pollEvent(event));
+        }
+    }
+};
+
+// Game State Manager
+class GameState {
+public:
+    enum class State {
+        MainMenu,
+        CharacterCreation,
+        Playing,
+        Inventory,
+        Combat,
+        Dialogue,
+        GameOver,
+        Victory
+    };
+   
+private:
+    State currentState;
+   
+public:
+    GameState() : currentState(State::MainMenu) {}
+   
+    void setState(State state) {
+        currentState = state;
+    }
+   
+    State getState() const {
+        return currentState;
+    }
+   
+    static const char* getName(State state) {
+        static const char* const names[] = {
+            "Main menu", "Character creation", "Playing", "Inventory", "Combat", "Dialogue", "Game over", "Victory"
+        };
+        return names[static_cast<int>(state)];
+    }
+};
+
+// Main game class
+class Game {
+private:
+    sf::RenderWindow window;
+    ResourceManager resources;
+    SoundManager sounds;
+    HotReloader reloader;
+    ParticleSystem particles;
+    LightMap lights;
+    CombatSystem combat;
+    TimerWheel timers;
+    Animator animator;
+    StatusEffects effects;
+    SpellSystem spells;
+    FrameProfiler profiler;
+    FramePacer pacer;
+    RenderThread renderer;
+    GameState gameState;
+    UIManager* ui;
+   
+    sf::View gameView;
+    sf::Clock gameClock;
+   
+    std::unique_ptr<Player> player;
+    std::unique_ptr<Dungeon> currentDungeon;
+    int playerLight;
+   
+    // Profiler sections and counters
+    int updateSection;
+    int particleSection;
+    int lightingSection;
+    int renderSection;
+    int combatSection;
+    int particleCounter;
+    int lightCounter;
+    int lightUpdateCounter;
+    int attackCounter;
+    int timerCounter;
+    int animationCounter;
+    int audioVoiceCounter;
+    int audioMixCounter;
+    int arenaCounter;
+    int drawnCounter;
+    int entityCounter;
+    int tileChunkCounter;
+    int decalCounter;
+    int fpsCounter;
+    int cpuCounter;
+    int renderDrawCounter;
+    int renderWaitCounter;
+    int drawCallCounter;
+   
+    // Main menu elements
+    sf::Text titleText;
+    sf::Text startText;
+    sf::Text quitText;
+   
+    // Character creation elements
+    sf::Text creationTitle;
+    std::vector<sf::Text> attributeNames;
+    std::vector<sf::Text> attributeValues;
+    std::vector<sf::RectangleShape> increaseButtons;
+    std::vector<sf::RectangleShape> decreaseButtons;
+    sf::RectangleShape confirmButton;
+    sf::Text confirmText;
+    sf::Text pointsText;
+    int attributePoints;
+    std::vector<int> attributes;
+   
+    bool showIntro;
+    bool captureNextFrame;
+    int maxDecals;
+    bool isometric;  // Draw the dungeon as diamonds through IsoProjection instead of top-down
+   
+public:
+    // A long stall (a modal dialog, a dragged window) is not simulated as one huge step
+    static constexpr float MAX_FRAME_TIME = 0.1f;
+   
+    // hotReload watches assets/ and swaps changed files in while the game runs;
+    // threadedRendering draws on a render thread instead of between updates;
+    // maxDecals is how many corpses and marks a dungeon keeps; isometric starts in
+    // the isometric view, which F6 toggles
+    explicit Game(bool hotReload = false, const FramePacer::Settings& pacing = FramePacer::Settings(),
+                  bool threadedRendering = true, int maxDecals = DecalLayer::DEFAULT_CAPACITY, bool isometric = false)
+           : window(sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), GAME_TITLE),
+             resources(), sounds(resources), reloader(resources, sounds), animator(resources.getArchetypes()),
+             effects(timers, combat),
+             spells(resources, combat, effects, particles, lights, timers), pacer(withReloadPolling(pacing, hotReload)),
+             renderer(window, threadedRendering), playerLight(-1), showIntro(true), captureNextFrame(false),
+             maxDecals(maxDecals), isometric(isometric) {
+        pacer.apply(window);
+       
+        // Register profiler sections
+        updateSection = profiler.section("Update");
+        particleSection = profiler.section("Particles");
+        lightingSection = profiler.section("Lighting");
+        renderSection = profiler.section("Render");
+        combatSection = profiler.section("Combat");
+        particleCounter = profiler.counter("Particles live");
+        lightCounter = profiler.counter("Lights");
+        lightUpdateCounter = profiler.counter("Lights recomputed");
+        attackCounter = profiler.counter("Attacks resolved");
+        timerCounter = profiler.counter("Timers active");
+        animationCounter = profiler.counter("Animations playing");
+        audioVoiceCounter = profiler.counter("Audio voices");
+        audioMixCounter = profiler.counter("Audio mix us/chunk");
+        arenaCounter = profiler.counter("Frame arena bytes");
+        drawnCounter = profiler.counter("Entities drawn");
+        entityCounter = profiler.counter("Entities total");
+        tileChunkCounter = profiler.counter("Tile chunks rebuilt");
+        decalCounter = profiler.counter("Decals");
+        fpsCounter = profiler.counter("Frames rendered/s");
+        cpuCounter = profiler.counter("Process CPU %");
+        renderDrawCounter = profiler.counter("Render thread us/frame");
+        renderWaitCounter = profiler.counter("Waiting for render us/frame");
+        drawCallCounter = profiler.counter("Draw calls");
+       
+        // Setup game view
+        gameView.setSize(sf::Vector2f(WINDOW_WIDTH, WINDOW_HEIGHT));
+        gameView.setCenter(sf::Vector2f(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2));
+       
+        // Setup main menu
+        setupMainMenu();
+       
+        // Setup character creation
+        setupCharacterCreation();
+       
+        // Start with main menu
+        gameState.setState(GameState::State::MainMenu);
+       
+        // Start background music
+        sounds.playMusic();
+       
+        if (hotReload) reloader.start("assets");
+       
+        // From here on only the render thread touches OpenGL through the window
+        renderer.start();
+    }
+   
+    ~Game() {
+        renderer.stop();
+        delete ui;
+    }
+   
+    void run() {
+        bool redraw = true;
+        GameState::State shownState = gameState.getState();
+       
+        while (window.isOpen()) {
+            GameState::State state = gameState.getState();
+            FramePacer::Mode mode = pacingMode();
+           
+            // A static screen that hasn't changed sleeps until the next event
+            if (mode == FramePacer::Mode::OnDemand && !redraw) {
+                sf::Event event;
+                if (pacer.waitForEvent(window, event)) redraw |= handleEvent(event);
+            }
+           
+            // Calculate delta time
+            float deltaTime = std::min(gameClock.restart().asSeconds(), MAX_FRAME_TIME);
+           
+            // Process events
+            redraw |= processEvents();
+           
+            // Swap in an asset that changed on disk, if one is ready. Textures are
+            // replaced in place, so the frame being drawn has to finish first.
+            if (reloader.hasReady()) renderer.finish();
+            redraw |= reloader.update();
+           
+            // Update game
+            update(deltaTime);
+            if (gameState.getState() != shownState) {
+                shownState = gameState.getState();
+                redraw = true;
+            }
+           
+            // Render
+            if (mode != FramePacer::Mode::OnDemand || redraw) {
+                render();
+                pacer.frameRendered();
+                redraw = false;
+            }
+           
+            profiler.endFrame();
+            MemoryTracker::endFrame();
+           
+            // Nothing built in the frame arena outlives the frame
+            profiler.setCounter(arenaCounter, static_cast<long long>(FrameArena::local().getLastFrameBytes()));
+            FrameArena::local().reset();
+           
+            pacer.endFrame(mode);
+            pacer.account(static_cast<int>(state));
+            profiler.setCounter(fpsCounter, static_cast<long long>(pacer.getRecentFps() + 0.5f));
+            profiler.setCounter(cpuCounter, static_cast<long long>(pacer.getRecentCpuPercent() + 0.5f));
+        }
+       
+        printPacingReport();
+    }
+   
+private:
+    // Hot reload needs the idle loop to come round even with no input
+    static FramePacer::Settings withReloadPolling(FramePacer::Settings settings, bool hotReload) {
+        if (hotReload && settings.idlePollMs <= 0) settings.idlePollMs = 100;
+        return settings;
+    }
+   
+    // Menus only change when the player does something
+    FramePacer::Mode pacingMode() const {
+        GameState::State state = gameState.getState();
+        return pacer.modeFor(state == GameState::State::MainMenu || state == GameState::State::CharacterCreation);
+    }
+   
+    // A blocking dialog, with its time charged to the given state rather than the one underneath
+    void showModal(GameState::State state, const std::string& title, const std::string& message) {
+        GameState::State previous = gameState.getState();
+        pacer.account(static_cast<int>(previous));
+        gameState.setState(state);
+        ui->showDialog(title, message);
+        pacer.account(static_cast<int>(state));
+        gameState.setState(previous);
+        gameClock.restart();
+    }
+   
+    void printPacingReport() const {
+        std::cout << std::fixed << std::setprecision(1) << "Frame pacing by state:" << std::endl;
+        for (int state = 0; state < FramePacer::MAX_STATES; state++) {
+            const FramePacer::StateStats& stats = pacer.getStats(state);
+            if (stats.wallSeconds < 0.1) continue;
+            std::cout << "  " << std::left << std::setw(20) << GameState::getName(static_cast<GameState::State>(state))
+                      << std::right << std::setw(8) << stats.wallSeconds << " s " << std::setw(8)
+                      << stats.frames / stats.wallSeconds << " frames/s " << std::setw(6)
+                      << 100.0 * stats.cpuSeconds / stats.wallSeconds << "% CPU" << std::endl;
+        }
+    }
+   
+    void setupMainMenu() {
+        titleText.setFont(resources.getFont("main"));
+        titleText.setString("Dragonlance: Chronicles of the Lance");
+        titleText.setCharacterSize(32);
+        titleText.setFillColor(sf::Color::White);
+        titleText.setPosition(
+            WINDOW_WIDTH / 2 - titleText.getGlobalBounds().width / 2,
+            100
+        );
+       
+        startText.setFont(resources.getFont("main"));
+        startText.setString("Start Game");
+        startText.setCharacterSize(24);
+        startText.setFillColor(sf::Color::White);
+        startText.setPosition(
+            WINDOW_WIDTH / 2 - startText.getGlobalBounds().width / 2,
+            300
+        );
+       
+        quitText.setFont(resources.getFont("main"));
+        quitText.setString("Quit");
+        quitText.setCharacterSize(24);
+        quitText.setFillColor(sf::Color::White);
+        quitText.setPosition(
+            WINDOW_WIDTH / 2 - quitText.getGlobalBounds().width / 2,
+            350
+        );
+    }
+   
+    void setupCharacterCreation() {
+        creationTitle.setFont(resources.getFont("main"));
+        creationTitle.setString("Character Creation");
+        creationTitle.setCharacterSize(24);
+        creationTitle.setFillColor(sf::Color::White);
+        creationTitle.setPosition(
+            WINDOW_WIDTH / 2 - creationTitle.getGlobalBounds().width / 2,
+            50
+        );
+       
+        attributePoints = 10;
+        attributes = {10, 10, 10, 10, 10, 10}; // STR, DEX, CON, INT, WIS, CHA
+       
+        std::vector<std::string> attrNames = {
+            "Strength", "Dexterity", "Constitution",
+            "Intelligence", "Wisdom", "Charisma"
+        };
+       
+        for (int i = 0; i < 6; i++) {
+            sf::Text name;
+            name.setFont(resources.getFont("main"));
+            name.setString(attrNames[i]);
+            name.setCharacterSize(18);
+            name.setFillColor(sf::Color::White);
+            name.setPosition(WINDOW_WIDTH / 2 - 100, 150 + i * 40);
+            attributeNames.push_back(name);
+           
+            sf::Text value;
+            value.setFont(resources.getFont("main"));
+            value.setString(std::to_string(attributes[i]));
+            value.setCharacterSize(18);
+            value.setFillColor(sf::Color::White);
+            value.setPosition(WINDOW_WIDTH / 2 + 50, 150 + i * 40);
+            attributeValues.push_back(value);
+           
+            sf::RectangleShape increase;
+            increase.setSize(sf::Vector2f(20, 20));
+            increase.setFillColor(sf::Color(80, 80, 80));
+            increase.setPosition(WINDOW_WIDTH / 2 + 80, 150 + i * 40);
+            increaseButtons.push_back(increase);
+           
+            sf::RectangleShape decrease;
+            decrease.setSize(sf::Vector2f(20, 20));
+            decrease.setFillColor(sf::Color(80, 80, 80));
+            decrease.setPosition(WINDOW_WIDTH / 2 + 20, 150 + i * 40);
+            decreaseButtons.push_back(decrease);
+        }
+       
+        confirmButton.setSize(sf::Vector2f(120, 30));
+        confirmButton.setFillColor(sf::Color(80, 80, 80));
+        confirmButton.setPosition(
+            WINDOW_WIDTH / 2 - 60,
+            400
+        );
+       
+        confirmText.setFont(resources.getFont("main"));
+        confirmText.setString("Start Adventure");
+        confirmText.setCharacterSize(16);
+        confirmText.setFillColor(sf::Color::White);
+        confirmText.setPosition(
+            confirmButton.getPosition().x + confirmButton.getSize().x / 2 - confirmText.getGlobalBounds().width / 2,
+            confirmButton.getPosition().y + 5
+        );
+       
+        pointsText.setFont(resources.getFont("main"));
+        pointsText.setCharacterSize(18);
+        pointsText.setFillColor(sf::Color::White);
+        pointsText.setPosition(WINDOW_WIDTH / 2 - 80, 350);
+        updatePointsText();
+    }
+   
+    // Only changes on a click, so it isn't rebuilt every frame
+    void updatePointsText() {
+        pointsText.setString("Points remaining: " + std::to_string(attributePoints));
+    }
+   
+    void startGame() {
+        // Projectiles still in flight belong to the old player
+        spells.clear();
+       
+        // Create player
+        {
+            MemoryTracker::Scope memoryScope(MemoryTracker::TAG_ENTITY);
+            player = std::make_unique<Player>("Hero", resources, sounds, timers, animator, gameView,
+                                            attributes[0], attributes[1], attributes[2],
+                                            attributes[3], attributes[4], attributes[5]);
+           
+            // Every spell in the data is known from the start; level and mana gate casting
+            const ArchetypeTable& archetypes = resources.getArchetypes();
+            for (int i = 0; i < archetypes.getSpellCount(); i++) {
+                player->learnSpell(std::make_shared<Spell>(i, archetypes));
+            }
+        }
+       
+        // Set player position
+        player->setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
+       
+        // Create UI manager
+        ui = new UIManager(resources, window, pacer, renderer, *player);
+        ui->setIsometric(isometric);
+       
+        // Create and generate dungeon
+        particles.clear();
+        currentDungeon = std::make_unique<Dungeon>(resources, sounds, combat, timers, animator, lights, player.get(), 50, 50);
+        currentDungeon->getDecals().setCapacity(maxDecals);
+        currentDungeon->generateDungeon();
+        player->setCollider(&currentDungeon->getCollider());
+        currentDungeon->populateEnemies();
+        currentDungeon->populateItems();
+       
+        // Set player position to a valid spot
+        for (int y = 0; y < 50; y++) {
+            for (int x = 0; x < 50; x++) {
+                if (currentDungeon->isWalkable(x * TILE_SIZE, y * TILE_SIZE)) {
+                    player->setPosition(x * TILE_SIZE + TILE_SIZE / 2, y * TILE_SIZE + TILE_SIZE / 2);
+                    break;
+                }
+            }
+        }
+       
+        // The player carries a lantern
+        playerLight = lights.addLight(player->getPosition().x, player->getPosition().y,
+                                      7.0f, sf::Color(255, 230, 200));
+       
+        // Switch to playing state
+        gameState.setState(GameState::State::Playing);
+       
+        // Show intro if enabled
+        if (showIntro) {
+            showModal(GameState::State::Dialogue, "Welcome to Krynn",
+                      "In the world of Krynn, the evil forces of Queen Takhisis threaten to engulf the land. "
+                      "You are a hero who has been called upon by the gods to defend the realm against "
+                      "her draconian armies.\n\n"
+                      "Your journey begins in the ancient ruins beneath the city of Xak Tsaroth, "
+                      "where rumors speak of a powerful artifact that could turn the tide of war...");
+            showIntro = false;
+        }
+    }
+   
+    // Handle everything queued; true if anything could have changed the screen
+    bool processEvents() {
+        bool changed = false;
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            changed |= handleEvent(event);
+        }
+        return changed;
+    }
+   
+    // Mouse movement alone changes nothing on a static screen
+    bool handleEvent(const sf::Event& event) {
+        if (event.type == sf::Event::Closed) {
+            renderer.close();
+        }
+       
+        if (event.type == sf::Event::KeyPressed) {
+            if (event.key.code == sf::Keyboard::Escape) {
+                if (gameState.getState() == GameState::State::Playing) {
+                    renderer.close();
+                }
+            }
+           
+            if (event.key.code == sf::Keyboard::I &&
+                gameState.getState() == GameState::State::Playing) {
+                ui->toggleInventory();
+            }
+           
+            if (event.key.code == sf::Keyboard::F3) {
+                profiler.toggle();
+            }
+           
+            if (event.key.code == sf::Keyboard::F4) {
+                std::ofstream report("memory_report.json");
+                MemoryTracker::writeJson(report);
+                std::cout << "Wrote memory_report.json" << std::endl;
+            }
+           
+            if (event.key.code == sf::Keyboard::F5) {
+                captureNextFrame = true;
+            }
+           
+            if (event.key.code == sf::Keyboard::F6 &&
+                gameState.getState() == GameState::State::Playing) {
+                isometric = !isometric;
+                ui->setIsometric(isometric);
+            }
+           
+            if (event.key.code >= sf::Keyboard::Num1 && event.key.code <= sf::Keyboard::Num9 &&
+                gameState.getState() == GameState::State::Playing) {
+                castPlayerSpell(event.key.code - sf::Keyboard::Num1);
+            }
         }
        
-        // Add some doors
-        for (int i = 0; i < width * height / 80; i++) {
-            int x = GameUtils::getRandomInt(2, width - 3);
-            int y = GameUtils::getRandomInt(2, height - 3);
-            tiles[y][x] = Tile(Tile::Type::Door, resources);
+        if (event.type == sf::Event::MouseButtonPressed) {
+            handleMouseClick(event.mouseButton.x, event.mouseButton.y);
         }
        
-        // Set positions
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                tiles[y][x].setPosition(x * TILE_SIZE, y * TILE_SIZE);
-            }
-        }
+        return event.type != sf::Event::MouseMoved;
     }
    
-    // Add enemies to the dungeon
-    void addEnemy(const std::string& name, const std::string& type, int x, int y,
-                 int strength, int dexterity, int constitution,
-                 int intelligence, int wisdom, int charisma,
-                 int experienceValue, int goldValue) {
+    // Cast the player's spell in the given slot toward the mouse
+    void castPlayerSpell(int slot) {
+        if (player->hasEffect(GameData::EFFECT_SLEEP)) return;
        
-        auto enemy = std::make_shared<Enemy>(name, type, resources, sounds,
-                                           strength, dexterity, constitution,
-                                           intelligence, wisdom, charisma,
-                                           experienceValue, goldValue);
+        int spell = player->beginCast(slot);
+        if (spell < 0) return;
        
-        enemy->setPosition(x * TILE_SIZE + TILE_SIZE / 2, y * TILE_SIZE + TILE_SIZE / 2);
-        enemy->setTarget(player);
-        enemies.push_back(enemy);
+        sf::Vector2f aim = window.mapPixelToCoords(sf::Mouse::getPosition(window), groundView());
+        spells.cast(*player, spell, aim.x, aim.y, *currentDungeon);
+        sounds.playSound("spell");
     }
    
-    // Add item to the dungeon
-    template<typename T, typename... Args>
-    void addItem(int x, int y, Args&&... args) {
-        auto item = std::make_shared<T>(std::forward<Args>(args)...);
-        item->setPosition(x * TILE_SIZE + TILE_SIZE / 2, y * TILE_SIZE + TILE_SIZE / 2);
-        items.push_back(item);
+    void handleMouseClick(int x, int y) {
+        switch (gameState.getState()) {
+            case GameState::State::MainMenu:
+                handleMainMenuClick(x, y);
+                break;
+               
+            case GameState::State::CharacterCreation:
+                handleCharacterCreationClick(x, y);
+                break;
+               
+            case GameState::State::Playing:
+                // Game clicks handled in update
+                break;
+               
+            default:
+                break;
+        }
     }
    
-    // Get tile at world position
-    Tile* getTileAtPosition(float x, float y) {
-        int tileX = static_cast<int>(x) / TILE_SIZE;
-        int tileY = static_cast<int>(y) / TILE_SIZE;
+    void handleMainMenuClick(int x, int y) {
+        if (startText.getGlobalBounds().contains(sf::Vector2f(x, y))) {
+            gameState.setState(GameState::State::CharacterCreation);
+            sounds.playSound("item");
+        }
        
-        if (tileX >= 0 && tileX < width && tileY >= 0 && tileY < height) {
-            return &tiles[tileY][tileX];
+        if (quitText.getGlobalBounds().contains(sf::Vector2f(x, y))) {
+            renderer.close();
         }
-        return nullptr;
-    }
-   
-    // Check if position is walkable
-    bool isWalkable(float x, float y) {
-        Tile* tile = getTileAtPosition(x, y);
-        return tile && tile->isWalkable();
     }
    
-    // Update all entities in the dungeon
-    void update(float deltaTime) {
-        // Update enemies
-        for (auto it = enemies.begin(); it != enemies.end();) {
-            auto& enemy = *it;
-           
-            if (enemy->isActive()) {
-                enemy->update(deltaTime);
-                ++it;
-            } else {
-                // Drop loot when enemy dies
-                if (GameUtils::getRandomInt(1, 100) <= 30) {
-                    // 30% chance to drop an item
-                    createRandomLoot(enemy->getPosition().x, enemy->getPosition().y);
+    void handleCharacterCreationClick(int x, int y) {
+        for (int i = 0; i < 6; i++) {
+            if (increaseButtons[i].getGlobalBounds().contains(sf::Vector2f(x, y))) {
+                if (attributePoints > 0 && attributes[i] < 18) {
+                    attributes[i]++;
+                    attributePoints--;
+                    attributeValues[i].setString(std::to_string(attributes[i]));
+                    updatePointsText();
+                    sounds.playSound("item");
                 }
-                it = enemies.erase(it);
             }
-        }
-       
-        // Update items
-        for (auto it = items.begin(); it != items.end();) {
-            auto& item = *it;
            
-            if (item->isActive() && item->isOnGround()) {
-                item->update(deltaTime);
-               
-                // Check if player is close enough to pick up item
-                if (GameUtils::distance(player->getPosition().x, player->getPosition().y,
-                                      item->getPosition().x, item->getPosition().y) < 30.0f) {
-                   
-                    // Determine the item type and add to player inventory
-                    if (item->getType() == "weapon") {
-                        auto weapon = std::dynamic_pointer_cast<Weapon>(item);
-                        if (weapon) {
-                            player->addItem(weapon);
-                        }
-                    } else if (item->getType() == "armor") {
-                        auto armor = std::dynamic_pointer_cast<Armor>(item);
-                        if (armor) {
-                            player->addItem(armor);
-                        }
-                    } else if (item->getType() == "potion") {
-                        auto potion = std::dynamic_pointer_cast<Potion>(item);
-                        if (potion) {
-                            player->addItem(potion);
-                        }
-                    }
-                   
-                    item->pickUp();
+            if (decreaseButtons[i].getGlobalBounds().contains(sf::Vector2f(x, y))) {
+                if (attributes[i] > 8) {
+                    attributes[i]--;
+                    attributePoints++;
+                    attributeValues[i].setString(std::to_string(attributes[i]));
+                    updatePointsText();
+                    sounds.playSound("item");
                 }
-               
-                ++it;
-            } else {
-                it = items.erase(it);
-            }
-        }
-    }
-   
-    // Draw the dungeon
-    void draw(sf::RenderWindow& window) {
-        // Get the view bounds
-        sf::Vector2f viewCenter = window.getView().getCenter();
-        sf::Vector2f viewSize = window.getView().getSize();
-        sf::FloatRect viewBounds(
-            viewCenter.x - viewSize.x / 2,
-            viewCenter.y - viewSize.y / 2,
-            viewSize.x,
-            viewSize.y
-        );
-       
-        // Only draw tiles that are visible
-        int startX = std::max(0, static_cast<int>(viewBounds.left) / TILE_SIZE);
-        int startY = std::max(0, static_cast<int>(viewBounds.top) / TILE_SIZE);
-        int endX = std::min(width, static_cast<int>(viewBounds.left + viewBounds.width) / TILE_SIZE + 1);
-        int endY = std::min(height, static_cast<int>(viewBounds.top + viewBounds.height) / TILE_SIZE + 1);
-       
-        // Draw tiles
-        for (int y = startY; y < endY; y++) {
-            for (int x = startX; x < endX; x++) {
-                tiles[y][x].draw(window);
             }
         }
        
-        // Draw items
-        for (auto& item : items) {
-            item->draw(window);
-        }
-       
-        // Draw enemies
-        for (auto& enemy : enemies) {
-            enemy->draw(window);
+        if (confirmButton.getGlobalBounds().contains(sf::Vector2f(x, y))) {
+            startGame();
+            sounds.playSound("level_up");
         }
     }
    
-    // Create random loot item
-    void createRandomLoot(float x, float y) {
-        int lootType = GameUtils::getRandomInt(1, 3);
-       
-        switch (lootType) {
-            case 1: {  // Weapon
-                std::vector<std::string> weaponTypes = {"Sword", "Axe", "Mace", "Staff"};
-                std::string type = weaponTypes[GameUtils::getRandomInt(0, weaponTypes.size() - 1)];
-                int minDamage = 1 + player->getLevel() / 2;
-                int maxDamage = 3 + player->getLevel();
-               
-                auto weapon = std::make_shared<Weapon>(
-                    type + " of Power",
-                    resources,
-                    "A well-crafted " + type + " that seems to glow faintly.",
-                    player->getLevel() * 10,
-                    minDamage,
-                    maxDamage,
-                    1,
-                    type
-                );
-               
-                weapon->setPosition(x, y);
-                items.push_back(weapon);
+    void update(float deltaTime) {
+        switch (gameState.getState()) {
+            case GameState::State::MainMenu:
+                // No updates needed for main menu
                 break;
-            }
-           
-            case 2: {  // Armor
-                std::vector<std::string> armorTypes = {"Leather", "Chain", "Plate", "Shield"};
-                std::string type = armorTypes[GameUtils::getRandomInt(0, armorTypes.size() - 1)];
-                int defense = 1 + player->getLevel() / 2;
                
-                auto armor = std::make_shared<Armor>(
-                    type + " of Defense",
-                    resources,
-                    "A sturdy piece of " + type + " armor.",
-                    player->getLevel() * 15,
-                    defense,
-                    type
-                );
-               
-                armor->setPosition(x, y);
-                items.push_back(armor);
+            case GameState::State::CharacterCreation:
+                // Update character creation display
                 break;
-            }
-           
-            case 3: {  // Potion
-                int healAmount = 5 + player->getLevel() * 3;
                
-                auto potion = std::make_shared<Potion>(
-                    "Healing Potion",
-                    resources,
-                    "A red potion that restores health.",
-                    player->getLevel() * 5,
-                    healAmount
-                );
+            case GameState::State::Playing:
+                updateGame(deltaTime);
+                break;
                
-                potion->setPosition(x, y);
-                items.push_back(potion);
+            default:
                 break;
-            }
         }
     }
    
-    // Populate dungeon with Dragonlance-themed enemies
-    void populateEnemies() {
-        // Add some goblins
-        for (int i = 0; i < width * height / 60; i++) {
-            int x, y;
-            do {
-                x = GameUtils::getRandomInt(2, width - 3);
-                y = GameUtils::getRandomInt(2, height - 3);
-            } while (!isWalkable(x * TILE_SIZE, y * TILE_SIZE));
-           
-            addEnemy("Goblin", "goblin", x, y, 8, 14, 10, 6, 8, 5, 50, 5);
+    void updateGame(float deltaTime) {
+        // Fire due timers: damage flashes and status effects
+        timers.advance(deltaTime);
+        for (const TimerWheel::Expired& timer : timers.getExpired()) {
+            if (timer.kind == TIMER_EFFECT_EXPIRE || timer.kind == TIMER_EFFECT_TICK) {
+                effects.onTimer(timer);
+            } else {
+                static_cast<Character*>(timer.owner)->onTimer(timer);
+            }
         }
+        profiler.setCounter(timerCounter, timers.getActiveCount());
        
-        // Add some skeletons
-        for (int i = 0; i < width * height / 80; i++) {
-            int x, y;
-            do {
-                x = GameUtils::getRandomInt(2, width - 3);
-                y = GameUtils::getRandomInt(2, height - 3);
-            } while (!isWalkable(x * TILE_SIZE, y * TILE_SIZE));
-           
-            addEnemy("Skeleton", "skeleton", x, y, 10, 12, 12, 8, 8, 5, 75, 10);
+        // Every character's animation in one pass; a swing is heard as its blow lands
+        animator.advance(deltaTime);
+        for (const Animator::Event& event : animator.getEvents()) {
+            if (event.event == GameData::ANIMATION_EVENT_HIT) sounds.playSound("attack");
         }
+        profiler.setCounter(animationCounter, animator.getActiveCount());
+        AudioMixer::Stats audio = sounds.getMixerStats();
+        profiler.setCounter(audioVoiceCounter, audio.voices);
+        profiler.setCounter(audioMixCounter, static_cast<long long>(audio.mixUs));
        
-        // Add boss
-        int bossX, bossY;
-        do {
-            bossX = GameUtils::getRandomInt(width / 2, width - 5);
-            bossY = GameUtils::getRandomInt(height / 2, height - 5);
-        } while (!isWalkable(bossX * TILE_SIZE, bossY * TILE_SIZE));
+        // Update player movement from keyboard; a sleeping player can't act
+        float moveX = 0, moveY = 0;
+        bool asleep = player->hasEffect(GameData::EFFECT_SLEEP);
        
-        addEnemy("Baaz Draconian", "dragon", bossX, bossY, 16, 12, 16, 10, 12, 8, 500, 100);
-    }
-   
-    // Populate dungeon with loot
-    void populateItems() {
-        // Add some healing potions
-        for (int i = 0; i < width * height / 70; i++) {
-            int x, y;
-            do {
-                x = GameUtils::getRandomInt(2, width - 3);
-                y = GameUtils::getRandomInt(2, height - 3);
-            } while (!isWalkable(x * TILE_SIZE, y * TILE_SIZE));
-           
-            addItem<Potion>(x, y, "Healing Potion", resources, "A red potion that restores health.", 10, 20);
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::W) || sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) {
+            moveY = -1;
+        }
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::S) || sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) {
+            moveY = 1;
+        }
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::A) || sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) {
+            moveX = -1;
+        }
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::D) || sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) {
+            moveX = 1;
         }
        
-        // Add starter weapon
-        int weaponX = GameUtils::getRandomInt(2, 5);
-        int weaponY = GameUtils::getRandomInt(2, 5);
-        addItem<Weapon>(weaponX, weaponY, "Bronze Sword", resources, "A simple but effective blade.", 15, 2, 5, 1, "Sword");
-       
-        // Add starter armor
-        int armorX = GameUtils::getRandomInt(2, 5);
-        int armorY = GameUtils::getRandomInt(2, 5);
-        addItem<Armor>(armorX, armorY, "Leather Armor", resources, "Basic protection crafted from tanned hides.", 20, 2, "Leather");
-    }
-   
-    // Get enemies in the dungeon
-    const std::vector<std::shared_ptr<Enemy>>& getEnemies() const {
-        return enemies;
-    }
-};
-
-// UI Manager
-class UIManager {
-private:
-    ResourceManager& resources;
-    sf::RenderWindow& window;
-    Player& player;
-   
-    sf::RectangleShape inventoryPanel;
-    sf::RectangleShape statsPanel;
-    sf::RectangleShape minimapPanel;
-    sf::Text titleText;
-    sf::Text statsText;
-    sf::Text inventoryText;
-    sf::Text minimapText;
-   
-    bool inventoryOpen;
-   
-public:
-    UIManager(ResourceManager& resources, sf::RenderWindow& window, Player& player)
-        : resources(resources), window(window), player(player), inventoryOpen(false) {
-       
-        // Initialize UI panels
-        inventoryPanel.setSize(sf::Vector2f(300, 400));
-        inventoryPanel.setFillColor(sf::Color(30, 30, 30, 220));
-        inventoryPanel.setOutlineColor(sf::Color(100, 100, 100));
-        inventoryPanel.setOutlineThickness(2);
-       
-        statsPanel.setSize(sf::Vector2f(window.getSize().x, 50));
-        statsPanel.setFillColor(sf::Color(20, 20, 20, 200));
+        if (asleep) moveX = moveY = 0;
+        player->move(moveX, moveY);
        
-        minimapPanel.setSize(sf::Vector2f(150, 150));
-        minimapPanel.setFillColor(sf::Color(20, 20, 20, 180));
-        minimapPanel.setOutlineColor(sf::Color(80, 80, 80));
-        minimapPanel.setOutlineThickness(1);
+        // Update player; the dungeon's collider keeps it out of the walls
+        player->update(deltaTime);
        
-        // Initialize text elements
-        titleText.setFont(resources.getFont("main"));
-        titleText.setCharacterSize(18);
-        titleText.setFillColor(sf::Color::White);
+        // Update dungeon
+        profiler.begin(updateSection);
+        currentDungeon->update(deltaTime);
+        spells.update(deltaTime, *currentDungeon);
+        lights.moveLight(playerLight, player->getPosition().x, player->getPosition().y);
+        profiler.end(updateSection);
        
-        statsText.setFont(resources.getFont("main"));
-        statsText.setCharacterSize(14);
-        statsText.setFillColor(sf::Color::White);
+        // Update particle effects
+        profiler.begin(particleSection);
+        particles.update(deltaTime);
+        profiler.end(particleSection);
+        profiler.setCounter(particleCounter, particles.getLiveCount());
        
-        inventoryText.setFont(resources.getFont("main"));
-        inventoryText.setCharacterSize(14);
-        inventoryText.setFillColor(sf::Color::White);
+        // Update UI
+        ui->update(deltaTime);
        
-        minimapText.setFont(resources.getFont("main"));
-        minimapText.setCharacterSize(12);
-        minimapText.setFillColor(sf::Color::White);
-        minimapText.setString("Map");
-    }
-   
-    void update() {
-        // Update panel positions
-        sf::Vector2f viewCenter = window.getView().getCenter();
-        sf::Vector2f viewSize = window.getView().getSize();
+        // Check for combat
+        const auto& enemies = currentDungeon->getEnemies();
+        for (const auto& enemy : enemies) {
+            float dist = player->distanceTo(*enemy);
+            if (dist < 50.0f) {
+                // Close enough to attack if clicked
+                if (!asleep && sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
+                    sf::Vector2i mousePos = sf::Mouse::getPosition(window);
+                    sf::Vector2f worldPos = window.mapPixelToCoords(mousePos, gameView);
+                    if (isometric) {
+                        // The enemy stands at its projected feet; take the click back into its world space
+                        worldPos = IsoProjection::pick(
+                            window.mapPixelToCoords(mousePos, IsoProjection::uprightView(gameView)),
+                            enemy->getPosition());
+                    }
+                   
+                    if (enemy->getBounds().contains(worldPos)) {
+                        combat.queueAttack(*player, *enemy);
+                    }
+                }
+            }
+        }
        
-        statsPanel.setPosition(viewCenter.x - viewSize.x / 2, viewCenter.y - viewSize.y / 2);
+        // Resolve everything queued this tick in one pass, then play the results
+        profiler.begin(combatSection);
+        size_t attacks = combat.getPendingCount();
+        combat.resolve();
+        presentCombatEvents();
+        profiler.end(combatSection);
+        profiler.setCounter(attackCounter, attacks);
        
-        minimapPanel.setPosition(
-            viewCenter.x + viewSize.x / 2 - minimapPanel.getSize().x - 10,
-            viewCenter.y - viewSize.y / 2 + 60
-        );
-        minimapText.setPosition(
-            minimapPanel.getPosition().x + 10,
-            minimapPanel.getPosition().y + 5
-        );
+        // Check for victory (all enemies defeated)
+        if (enemies.empty()) {
+            showModal(GameState::State::Victory, "Victory!",
+                      "You have cleared this dungeon of all enemies and recovered the Dragon Orb, "
+                      "a powerful artifact that will help in the fight against Takhisis. "
+                      "The heroes of Krynn thank you for your bravery!\n\n"
+                      "Continue your journey in the full game...");
+           
+            gameState.setState(GameState::State::MainMenu);
+        }
        
-        if (inventoryOpen) {
-            inventoryPanel.setPosition(
-                viewCenter.x - inventoryPanel.getSize().x / 2,
-                viewCenter.y - inventoryPanel.getSize().y / 2
-            );
+        // Check for game over
+        if (!player->isAlive()) {
+            showModal(GameState::State::GameOver, "Game Over",
+                      "You have fallen in battle. The forces of Takhisis grow stronger without "
+                      "your opposition. Perhaps another hero will rise to take your place...\n\n"
+                      "Try again?");
            
-            // Update inventory content
-            std::stringstream ss;
-            ss << "INVENTORY\n\n";
+            gameState.setState(GameState::State::MainMenu);
+        }
+    }
+   
+    // Sound, particles and floating text for the combat resolved this tick
+    void presentCombatEvents() {
+        for (const CombatSystem::Event& event : combat.getEvents()) {
+            if (event.melee && event.type != CombatSystem::EventType::Death) {
+                event.attacker->setAnimation(GameData::CLIP_ATTACK);
+            }
            
-            const auto& inventory = player.getInventory();
-            if (inventory.empty()) {
-                ss << "Empty";
-            } else {
-                for (size_t i = 0; i < inventory.size(); i++) {
-                    ss << i + 1 << ". " << inventory[i]->getName() << " - "
-                       << inventory[i]->getDescription() << "\n";
+            switch (event.type) {
+                case CombatSystem::EventType::Miss:
+                    ui->addCombatText(event.x, event.y, "Miss", sf::Color(180, 180, 180));
+                    break;
                    
-                    if (inventory[i]->getType() == "weapon") {
-                        auto weapon = std::dynamic_pointer_cast<Weapon>(inventory[i]);
-                        if (weapon) {
-                            ss << "   Damage: " << weapon->getMinDamage() << "-"
-                               << weapon->getMaxDamage() << ", +" << weapon->getAttackBonus() << " Attack\n";
-                        }
-                    } else if (inventory[i]->getType() == "armor") {
-                        auto armor = std::dynamic_pointer_cast<Armor>(inventory[i]);
-                        if (armor) {
-                            ss << "   Defense: +" << armor->getDefense() << "\n";
-                        }
-                    } else if (inventory[i]->getType() == "potion") {
-                        auto potion = std::dynamic_pointer_cast<Potion>(inventory[i]);
-                        if (potion) {
-                            ss << "   Heals: " << potion->getHealAmount() << " HP\n";
-                        }
+                case CombatSystem::EventType::Hit: {
+                    // Damage wakes a sleeper, and some monsters' hits carry an effect
+                    effects.remove(*event.target, GameData::EFFECT_SLEEP);
+                    if (event.melee && event.attacker->getOnHitEffect() != GameData::EFFECT_NONE &&
+                        GameUtils::getRandomInt(1, 100) <= event.attacker->getOnHitChance() &&
+                        effects.apply(*event.target, event.attacker->getOnHitEffect())) {
+                        const StatusEffects::Rule& rule = StatusEffects::getRule(event.attacker->getOnHitEffect());
+                        ui->addCombatText(event.x, event.y - 16, rule.name, rule.color);
                     }
-                   
-                    ss << "   Value: " << inventory[i]->getValue() << " gold\n\n";
+                    event.target->showHit();
+                    sounds.playSound("hurt");
+                    particles.emit(ParticleSystem::EmitterType::Hit, event.x, event.y, event.critical ? 24 : 12);
+                    TextBuilder amount(16);
+                    amount << event.amount;
+                    if (event.critical) amount << '!';
+                    ui->addCombatText(event.x, event.y, amount.view(),
+                                      event.critical ? sf::Color(255, 220, 60) : sf::Color(255, 90, 90));
+                    break;
                 }
+                   
+                case CombatSystem::EventType::Death:
+                    effects.clear(*event.target);
+                    sounds.playSound("death");
+                    particles.emit(ParticleSystem::EmitterType::Death, event.x, event.y, 40);
+                    break;
             }
-           
-            inventoryText.setString(ss.str());
-            inventoryText.setPosition(
-                inventoryPanel.getPosition().x + 10,
-                inventoryPanel.getPosition().y + 10
-            );
         }
-       
-        // Update stats text
-        std::stringstream statsStream;
-        statsStream << player.getName() << " | Level " << player.getLevel()
-                    << " | HP: " << player.getHealth() << "/" << player.getMaxHealth()
-                    << " | Mana: " << player.getMana() << "/" << player.getMaxMana()
-                    << " | Gold: " << player.getGold()
-                    << " | XP: " << player.getExperience() << "/" << (player.getLevel() * 1000);
-       
-        statsText.setString(statsStream.str());
-        statsText.setPosition(
-            statsPanel.getPosition().x + 10,
-            statsPanel.getPosition().y + 15
-        );
     }
    
-    void draw() {
-        // Store current view
-        sf::View currentView = window.getView();
-       
-        // Switch to UI view
-        sf::View uiView = window.getDefaultView();
-        window.setView(uiView);
+    // Record the frame and hand it to the render thread
+    void render() {
+        DrawList& list = renderer.begin();
+        list.clear(sf::Color(20, 20, 20));
        
-        // Draw stats panel
-        window.draw(statsPanel);
-        window.draw(statsText);
+        switch (gameState.getState()) {
+            case GameState::State::MainMenu:
+                renderMainMenu(list);
+                break;
+               
+            case GameState::State::CharacterCreation:
+                renderCharacterCreation(list);
+                break;
+               
+            case GameState::State::Playing:
+                renderGame(list);
+                break;
+               
+            default:
+                break;
+        }
        
-        // Draw minimap
-        window.draw(minimapPanel);
-        window.draw(minimapText);
+        profiler.draw(list, resources.getFont("main"));
+        profiler.setCounter(drawCallCounter, static_cast<long long>(list.getDrawCallCount()));
        
-        // Draw inventory if open
-        if (inventoryOpen) {
-            window.draw(inventoryPanel);
-            window.draw(inventoryText);
+        // Replay it with --replay-capture to see what the frame cost
+        if (captureNextFrame) {
+            captureNextFrame = false;
+            if (list.save("frame_capture.lcap", resources)) {
+                std::cout << "Wrote frame_capture.lcap" << std::endl;
+            }
         }
        
-        // Restore previous view
-        window.setView(currentView);
+        renderer.submit();
+        profiler.setCounter(renderDrawCounter, renderer.getDrawMicros());
+        profiler.setCounter(renderWaitCounter, renderer.getWaitMicros());
     }
    
-    void toggleInventory() {
-        inventoryOpen = !inventoryOpen;
+    void renderMainMenu(DrawList& list) {
+        list.draw(titleText);
+        list.draw(startText);
+        list.draw(quitText);
     }
    
-    bool isInventoryOpen() const {
-        return inventoryOpen;
+    void renderCharacterCreation(DrawList& list) {
+        list.draw(creationTitle);
+       
+        for (int i = 0; i < 6; i++) {
+            list.draw(attributeNames[i]);
+            list.draw(attributeValues[i]);
+            list.draw(increaseButtons[i]);
+            list.draw(decreaseButtons[i]);
+        }
+       
+        list.draw(confirmButton);
+        list.draw(confirmText);
+        list.draw(pointsText);
     }
    
-    // Show dialog with message
-    void showDialog(const std::string& title, const std::string& message) {
-        // Store current view
-        sf::View currentView = window.getView();
+    // The view the floor is drawn in; mapPixelToCoords through it gives a world position
+    sf::View groundView() const {
+        return isometric ? IsoProjection::groundView(gameView) : gameView;
+    }
+   
+    void renderGame(DrawList& list) {
+        // Set game view
+        list.setView(groundView());
        
-        // Switch to UI view
-        sf::View uiView = window.getDefaultView();
-        window.setView(uiView);
+        // The one value the material shader animates flashes, water and lava from
+        if (sf::Shader* shader = resources.getMaterials().getShader()) {
+            list.setUniform(*shader, "time", Materials::shaderTime(timers.getTime()));
+        }
        
-        // Create dialog panel
-        sf::RectangleShape dialogPanel;
-        dialogPanel.setSize(sf::Vector2f(400, 200));
-        dialogPanel.setFillColor(sf::Color(40, 40, 40, 230));
-        dialogPanel.setOutlineColor(sf::Color(150, 150, 150));
-        dialogPanel.setOutlineThickness(2);
-        dialogPanel.setPosition(
-            window.getSize().x / 2 - dialogPanel.getSize().x / 2,
-            window.getSize().y / 2 - dialogPanel.getSize().y / 2
-        );
+        // The isometric pass lights the floor before it stands things up, so the
+        // light map is brought up to date first; lighting is timed on its own
+        profiler.begin(lightingSection);
+        lights.update();
+        profiler.end(lightingSection);
        
-        // Create title text
-        sf::Text dialogTitle;
-        dialogTitle.setFont(resources.getFont("main"));
-        dialogTitle.setString(title);
-        dialogTitle.setCharacterSize(18);
-        dialogTitle.setFillColor(sf::Color::White);
-        dialogTitle.setPosition(
-            dialogPanel.getPosition().x + 20,
-            dialogPanel.getPosition().y + 20
-        );
+        // Draw dungeon; the isometric pass stands the player up with everything else
+        profiler.begin(renderSection);
+        if (isometric) {
+            currentDungeon->drawIsometric(list, gameView);
+        } else {
+            currentDungeon->draw(list);
+        }
+        profiler.setCounter(drawnCounter, currentDungeon->getVisibleEntityCount());
+        profiler.setCounter(entityCounter, currentDungeon->getEntityCount());
+        profiler.setCounter(tileChunkCounter, currentDungeon->getTileMesh().getStats().chunksRebuilt);
+        profiler.setCounter(decalCounter, currentDungeon->getDecals().getCount());
+        spells.draw(list);
        
-        // Create message text
-        sf::Text dialogMessage;
-        dialogMessage.setFont(resources.getFont("main"));
-        dialogMessage.setString(message);
-        dialogMessage.setCharacterSize(14);
-        dialogMessage.setFillColor(sf::Color::White);
-        dialogMessage.setPosition(
-            dialogPanel.getPosition().x + 20,
-            dialogPanel.getPosition().y + 60
-        );
+        // Draw player
+        if (!isometric) player->draw(list);
+        profiler.end(renderSection);
+       
+        // Darken the top-down world with the light map
+        if (!isometric) {
+            profiler.begin(lightingSection);
+            lights.draw(list);
+            profiler.end(lightingSection);
+        }
+        profiler.setCounter(lightCounter, lights.getLightCount());
+        profiler.setCounter(lightUpdateCounter, lights.getLastLightUpdates());
        
-        // Create continue button
-        sf::RectangleShape continueButton;
-        continueButton.setSize(sf::Vector2f(100, 30));
-        continueButton.setFillColor(sf::Color(80, 80, 80));
-        continueButton.setOutlineColor(sf::Color(150, 150, 150));
-        continueButton.setOutlineThickness(1);
-        continueButton.setPosition(
-            dialogPanel.getPosition().x + dialogPanel.getSize().x / 2 - continueButton.getSize().x / 2,
-            dialogPanel.getPosition().y + dialogPanel.getSize().y - 50
-        );
+        // Draw particle effects over the lit world so spells glow
+        profiler.begin(particleSection);
+        particles.draw(list);
+        profiler.end(particleSection);
        
-        sf::Text continueText;
-        continueText.setFont(resources.getFont("main"));
-        continueText.setString("Continue");
-        continueText.setCharacterSize(14);
-        continueText.setFillColor(sf::Color::White);
-        continueText.setPosition(
-            continueButton.getPosition().x + continueButton.getSize().x / 2 - continueText.getGlobalBounds().width / 2,
-            continueButton.getPosition().y + continueButton.getSize().y / 2 - continueText.getGlobalBounds().height
-        );
+        // Draw UI; combat text stands up like the characters it comes from
+        if (isometric) list.setView(IsoProjection::uprightView(gameView));
+        ui->draw(list);
+    }
+};
+
+// Headless benchmarks, run from the command line instead of the game
+namespace Benchmarks {
+    // Keep every particle pool full and time update + vertex building per frame
+    int particles(int frames) {
+        ParticleSystem system;
+        const ParticleSystem::EmitterType types[] = {
+            ParticleSystem::EmitterType::SpellTrail,
+            ParticleSystem::EmitterType::Hit,
+            ParticleSystem::EmitterType::Death
+        };
        
-        // Wait for user to click continue
-        bool dialogOpen = true;
-        while (dialogOpen) {
-            sf::Event event;
-            while (window.pollEvent(event)) {
-                if (event.type == sf::Event::Closed) {
-                    window.close();
-                    return;
-                }
-               
-                if (event.type == sf::Event::MouseButtonPressed) {
-                    sf::Vector2f mousePos = window.mapPixelToCoords(
-                        sf::Vector2i(event.mouseButton.x, event.mouseButton.y),
-                        uiView
-                    );
-                   
-                    if (continueButton.getGlobalBounds().contains(mousePos)) {
-                        dialogOpen = false;
-                    }
-                }
-               
-                if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Return) {
-                    dialogOpen = false;
-                }
+        sf::Clock clock;
+        float totalTime = 0.0f;
+        float worstTime = 0.0f;
+        std::size_t totalLive = 0;
+       
+        for (int frame = 0; frame < frames; frame++) {
+            // Top the pools back up so the live count stays at capacity
+            for (auto type : types) {
+                system.emit(type, GameUtils::getRandomFloat(0, 1600), GameUtils::getRandomFloat(0, 1600),
+                            static_cast<int>(system.getCapacity(type)));
             }
+            totalLive += system.getLiveCount();
            
-            // Draw dialog
-            window.clear(sf::Color(0, 0, 0));
-           
-            // Draw game in background (restoring previous view)
-            window.setView(currentView);
-            // Game rendering would go here
+            clock.restart();
+            system.update(1.0f / 60.0f);
+            system.buildVertices();
+            float frameTime = clock.getElapsedTime().asSeconds() * 1000.0f;
            
-            // Draw dialog
-            window.setView(uiView);
-            window.draw(dialogPanel);
-            window.draw(dialogTitle);
-            window.draw(dialogMessage);
-            window.draw(continueButton);
-            window.draw(continueText);
-           
-            window.display();
+            totalTime += frameTime;
+            worstTime = std::max(worstTime, frameTime);
         }
        
-        // Restore view
-        window.setView(currentView);
-    }
-};
-
-// Game State Manager
-class GameState {
-public:
-    enum class State {
-        MainMenu,
-        CharacterCreation,
-        Playing,
-        Inventory,
-        Combat,
-        Dialogue,
-        GameOver,
-        Victory
-    };
-   
-private:
-    State currentState;
-   
-public:
-    GameState() : currentState(State::MainMenu) {}
-   
-    void setState(State state) {
-        currentState = state;
+        std::cout << "Particles: " << totalLive / frames << " live on average over " << frames << " frames\n"
+                  << "  update + vertex build: " << totalTime / frames << " ms avg, "
+                  << worstTime << " ms worst (60 FPS budget 16.67 ms)" << std::endl;
+        return 0;
     }
    
-    State getState() const {
-        return currentState;
+    // Time compiling and mapping the archetype table and report per-instance sizes
+    int archetypeData(const std::string& dataDir, const std::string& blobPath, int loads) {
+        sf::Clock clock;
+        if (!ArchetypeTable::compile(dataDir, blobPath)) return 1;
+        float compileMs = clock.getElapsedTime().asSeconds() * 1000.0f;
+       
+        float totalLoadMs = 0.0f;
+        ArchetypeTable table;
+        for (int i = 0; i < loads; i++) {
+            if (!table.load(blobPath)) return 1;
+            totalLoadMs += table.getLoadTimeMs();
+        }
+       
+        std::cout << "Archetype data: " << table.getMonsterCount() << " monsters, "
+                  << table.getWeaponCount() << " weapons, " << table.getArmorCount() << " armor, "
+                  << table.getPotionCount() << " potions, " << table.getBlobSize() << " bytes\n"
+                  << "  compile: " << compileMs << " ms, map + validate: "
+                  << totalLoadMs / loads << " ms avg over " << loads << " loads\n"
+                  << "  per instance: Enemy " << sizeof(Enemy) << " B, Weapon " << sizeof(Weapon)
+                  << " B, Armor " << sizeof(Armor) << " B, Potion " << sizeof(Potion) << " B\n"
+                  << "  names are pointers into the table (" << 2 * sizeof(const char*)
+                  << " B per entity, was " << 2 * sizeof(std::string) << " B of strings plus heap)" << std::endl;
+        return 0;
     }
-};
-
-// Main game class
-class Game {
-private:
-    sf::RenderWindow window;
-    ResourceManager resources;
-    SoundManager sounds;
-    GameState gameState;
-    UIManager* ui;
    
-    sf::View gameView;
-    sf::Clock gameClock;
-   
-    std::unique_ptr<Player> player;
-    std::unique_ptr<Dungeon> currentDungeon;
-   
-    // Main menu elements
-    sf::Text titleText;
-    sf::Text startText;
-    sf::Text quitText;
-   
-    // Character creation elements
-    sf::Text creationTitle;
-    std::vector<sf::Text> attributeNames;
-    std::vector<sf::Text> attributeValues;
-    std::vector<sf::RectangleShape> increaseButtons;
-    std::vector<sf::RectangleShape> decreaseButtons;
-    sf::RectangleShape confirmButton;
-    sf::Text confirmText;
-    int attributePoints;
-    std::vector<int> attributes;
-   
-    bool showIntro;
-   
-public:
-    Game() : window(sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), GAME_TITLE),
-             resources(), sounds(resources), showIntro(true) {
-       
-        // Setup game view
-        gameView.setSize(sf::Vector2f(WINDOW_WIDTH, WINDOW_HEIGHT));
-        gameView.setCenter(sf::Vector2f(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2));
+    // Monte Carlo check of the loot tables: roll many kills for every monster and
+    // compare observed drop, item, rarity and affix rates with the rates the weights
+    // imply. Returns non-zero if any rate is more than 4 standard deviations off.
+    int lootSimulation(const std::string& dataDir, const std::string& blobPath, int kills, int level) {
+        if (ArchetypeTable::isStale(dataDir, blobPath) && !ArchetypeTable::compile(dataDir, blobPath)) return 1;
+        ArchetypeTable table;
+        if (!table.load(blobPath)) return 1;
+        LootTables loot;
+        loot.build(table);
+       
+        const int kindCounts[GameData::KIND_COUNT] = {table.getWeaponCount(), table.getArmorCount(), table.getPotionCount()};
+        const int kindOffsets[GameData::KIND_COUNT] = {0, kindCounts[0], kindCounts[0] + kindCounts[1]};
+        const char* kindNames[GameData::KIND_COUNT] = {"weapon", "armor", "potion"};
+        int itemSlots = kindOffsets[2] + kindCounts[2];
+        auto itemName = [&](int slot) {
+            int kind = slot < kindOffsets[1] ? 0 : (slot < kindOffsets[2] ? 1 : 2);
+            int index = slot - kindOffsets[kind];
+            uint32_t name = kind == 0 ? table.getWeapon(index).name
+                          : (kind == 1 ? table.getArmor(index).name : table.getPotion(index).name);
+            return std::string(kindNames[kind]) + " " + table.getString(name);
+        };
        
-        // Setup main menu
-        setupMainMenu();
+        // Affix weights available to each kind and position
+        double affixTotals[GameData::KIND_COUNT][2] = {};
+        for (int a = 0; a < table.getAffixCount(); a++) {
+            const GameData::AffixRecord& affix = table.getAffix(a);
+            for (int kind = 0; kind < GameData::KIND_COUNT; kind++) {
+                if (affix.kinds & (1 << kind)) affixTotals[kind][affix.position] += affix.weight;
+            }
+        }
+        double rarityTotal = 0.0;
+        double positionChance[2] = {};
+        for (int r = 0; r < table.getRarityCount(); r++) rarityTotal += table.getRarity(r).weight;
+        for (int r = 0; r < table.getRarityCount(); r++) {
+            positionChance[GameData::AFFIX_PREFIX] += table.getRarity(r).prefixes ? table.getRarity(r).weight / rarityTotal : 0.0;
+            positionChance[GameData::AFFIX_SUFFIX] += table.getRarity(r).suffixes ? table.getRarity(r).weight / rarityTotal : 0.0;
+        }
        
-        // Setup character creation
-        setupCharacterCreation();
+        int outliers = 0;
+        auto report = [&](const std::string& label, double expected, long long count) {
+            if (expected <= 0.0 && count == 0) return;
+            double observed = static_cast<double>(count) / kills;
+            double sigma = std::sqrt(expected * (1.0 - expected) / kills);
+            bool outlier = std::abs(observed - expected) > 4.0 * sigma + 1e-9;
+            if (outlier) outliers++;
+            std::cout << "    " << std::left << std::setw(32) << label << std::right
+                      << std::setw(9) << expected * 100.0 << "%" << std::setw(9) << observed * 100.0 << "%"
+                      << (outlier ? "   <- more than 4 sigma off" : "") << "\n";
+        };
        
-        // Start with main menu
-        gameState.setState(GameState::State::MainMenu);
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "Loot simulation: " << kills << " kills per monster at level " << level << "\n";
+        std::mt19937 generator(12345);
+        for (int m = 0; m < table.getMonsterCount(); m++) {
+            const char* monsterName = table.getString(table.getMonster(m).name);
+            int t = loot.findTable(m, level);
+            if (t < 0) {
+                std::cout << "  " << monsterName << ": no loot table\n";
+                continue;
+            }
+           
+            std::vector<long long> itemCounts(itemSlots, 0);
+            std::vector<long long> rarityCounts(table.getRarityCount(), 0);
+            std::vector<long long> affixCounts(table.getAffixCount(), 0);
+            long long drops = 0;
+           
+            sf::Clock clock;
+            LootDrop drop;
+            for (int i = 0; i < kills; i++) {
+                if (!loot.roll(m, level, generator, drop)) continue;
+                drops++;
+                itemCounts[kindOffsets[drop.kind] + drop.archetype]++;
+                if (drop.rarity >= 0) rarityCounts[drop.rarity]++;
+                if (drop.prefix >= 0) affixCounts[drop.prefix]++;
+                if (drop.suffix >= 0) affixCounts[drop.suffix]++;
+            }
+            float seconds = clock.getElapsedTime().asSeconds();
+           
+            // Expected rates straight from the weights
+            const GameData::LootTableRecord& lootTable = table.getLootTable(t);
+            double entryTotal = 0.0;
+            for (uint32_t e = 0; e < lootTable.entryCount; e++) entryTotal += table.getLootEntry(lootTable.firstEntry + e).weight;
+            std::vector<double> itemExpected(itemSlots, 0.0);
+            double kindExpected[GameData::KIND_COUNT] = {};
+            for (uint32_t e = 0; e < lootTable.entryCount; e++) {
+                const GameData::LootEntryRecord& entry = table.getLootEntry(lootTable.firstEntry + e);
+                double chance = lootTable.dropChance * entry.weight / entryTotal;
+                itemExpected[kindOffsets[entry.kind] + entry.archetype] += chance;
+                kindExpected[entry.kind] += chance;
+            }
+           
+            std::cout << "  " << monsterName << " (loot table " << t << "): "
+                      << seconds * 1000.0f << " ms, " << kills / seconds / 1.0e6f << " M kills/s\n"
+                      << "    " << std::left << std::setw(32) << "outcome" << std::right
+                      << std::setw(10) << "expected" << std::setw(10) << "observed" << "\n";
+            report("any drop", std::min(1.0, static_cast<double>(lootTable.dropChance)), drops);
+            for (int slot = 0; slot < itemSlots; slot++) {
+                report(itemName(slot), itemExpected[slot], itemCounts[slot]);
+            }
+            double dropped = std::min(1.0, static_cast<double>(lootTable.dropChance));
+            for (int r = 0; r < table.getRarityCount(); r++) {
+                report(std::string("rarity ") + table.getString(table.getRarity(r).name),
+                       dropped * table.getRarity(r).weight / rarityTotal, rarityCounts[r]);
+            }
+            for (int a = 0; a < table.getAffixCount(); a++) {
+                const GameData::AffixRecord& affix = table.getAffix(a);
+                double expected = 0.0;
+                for (int kind = 0; kind < GameData::KIND_COUNT; kind++) {
+                    if (affix.kinds & (1 << kind)) {
+                        expected += kindExpected[kind] * positionChance[affix.position] * affix.weight / affixTotals[kind][affix.position];
+                    }
+                }
+                report(std::string("affix ") + table.getString(affix.name), expected, affixCounts[a]);
+            }
+        }
        
-        // Start background music
-        sounds.playMusic();
+        std::cout << (outliers == 0 ? "All rates within 4 sigma of their weights" : "Some rates are off") << std::endl;
+        return outliers == 0 ? 0 : 1;
     }
    
-    ~Game() {
-        delete ui;
+    // Every combatant queues one melee attack per tick and the whole batch is
+    // resolved at once. The arena is run twice with the same seeds and the event
+    // streams compared, so a non-deterministic change shows up here. Then checks
+    // that a dead enemy's queued intents are dropped when the dungeon erases it.
+    int combat(int combatants, int ticks) {
+        ResourceManager resources(false);
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        if (resources.getArchetypes().getMonsterCount() == 0) return 1;
+       
+        double queueSeconds = 0.0;
+        double resolveSeconds = 0.0;
+        uint64_t checksums[2] = {};
+        size_t hits = 0, deaths = 0;
+       
+        for (int run = 0; run < 2; run++) {
+            GameUtils::rng.seed(42);
+            CombatSystem combat(1234);
+            TimerWheel timers;
+            Animator animator(resources.getArchetypes());
+            std::vector<std::unique_ptr<Enemy>> arena;
+            for (int i = 0; i < combatants; i++) {
+                arena.push_back(std::make_unique<Enemy>(i % resources.getArchetypes().getMonsterCount(), resources, sounds, timers, animator));
+            }
+           
+            sf::Clock clock;
+            for (int tick = 0; tick < ticks; tick++) {
+                clock.restart();
+                for (int i = 0; i < combatants; i++) {
+                    combat.queueAttack(*arena[i], *arena[(i * 7 + tick + 1) % combatants]);
+                }
+                float queued = clock.getElapsedTime().asSeconds();
+                combat.resolve();
+                float resolved = clock.getElapsedTime().asSeconds();
+               
+                if (run == 0) {
+                    queueSeconds += queued;
+                    resolveSeconds += resolved - queued;
+                }
+                for (const CombatSystem::Event& event : combat.getEvents()) {
+                    checksums[run] = checksums[run] * 31 + static_cast<uint64_t>(event.type) * 1000 + event.amount;
+                    if (run == 0 && event.type == CombatSystem::EventType::Hit) hits++;
+                    if (run == 0 && event.type == CombatSystem::EventType::Death) deaths++;
+                }
+               
+                // Bring the fallen back so the arena stays full
+                for (auto& fighter : arena) {
+                    if (!fighter->isAlive()) fighter->heal(fighter->getMaxHealth());
+                }
+            }
+        }
+       
+        // An enemy killed while intents by it and against it are still queued. The
+        // dungeon erases it before they resolve, and none of them may reach it.
+        int stale = 0;
+        {
+            TimerWheel timers;
+            Animator animator(resources.getArchetypes());
+            CombatSystem combat(99);
+            LightMap lights;
+            sf::View view;
+            Player player("Bench", resources, sounds, timers, animator, view);
+            Dungeon dungeon(resources, sounds, combat, timers, animator, lights, &player, 16, 16);
+            dungeon.addEnemy(0, 2, 2);
+            dungeon.addEnemy(0, 12, 12);
+            Enemy& doomed = *dungeon.getEnemies().front();
+            const Character* doomedAddress = &doomed;
+            combat.queueAttack(player, doomed);
+            combat.queueAttack(doomed, player);
+            combat.queueDamage(nullptr, doomed, 5);
+            combat.queueDamage(&doomed, player, 5);
+            doomed.applyDamage(doomed.getMaxHealth());
+           
+            dungeon.update(1.0f / 60.0f);
+            if (dungeon.getEnemies().size() != 1) stale++;
+            combat.resolve();
+            bool landed = false;
+            for (const CombatSystem::Event& event : combat.getEvents()) {
+                if (event.target == doomedAddress || event.attacker == doomedAddress) stale++;
+                if (event.target == &player && event.attacker == nullptr && event.amount == 5) landed = true;
+            }
+            if (!landed) stale++;
+        }
+       
+        double attacks = static_cast<double>(combatants) * ticks;
+        std::cout << "Combat: " << combatants << " combatants x " << ticks << " ticks = "
+                  << static_cast<long long>(attacks) << " attacks, " << hits << " hits, " << deaths << " deaths\n"
+                  << "  queue: " << queueSeconds * 1000.0 << " ms, resolve: " << resolveSeconds * 1000.0 << " ms\n"
+                  << "  throughput: " << attacks / (queueSeconds + resolveSeconds) / 1.0e6 << " M attacks/s ("
+                  << attacks / resolveSeconds / 1.0e6 << " M/s resolve only)\n"
+                  << "  deterministic: " << (checksums[0] == checksums[1] ? "yes" : "NO") << "\n"
+                  << "  intents outliving a dead enemy: " << stale << std::endl;
+        return checksums[0] == checksums[1] && stale == 0 ? 0 : 1;
     }
    
-    void run() {
-        float deltaTime;
+    // Two passes over the timer wheel. First, timers spread across every level
+    // (and past the top one) must each fire on exactly the tick they were due,
+    // and cancelled ones never. Then a population of status effects is held at
+    // the requested size for a stretch of 60 FPS frames, reapplying whatever
+    // wears off, so the frame cost reflects steady churn.
+    int statusEffects(int effectCount, int frames) {
+        ResourceManager resources(false);
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        if (resources.getArchetypes().getMonsterCount() == 0) return 1;
+       
+        int wrong = 0;
+        {
+            TimerWheel wheel;
+            std::vector<uint64_t> dueTicks(200000);
+            std::vector<TimerWheel::Handle> handles(dueTicks.size());
+            uint64_t lastDue = 0;
+            for (size_t i = 0; i < dueTicks.size(); i++) {
+                uint64_t ticks = 1 + GameUtils::rng() % (1ull << GameUtils::getRandomInt(1, 25));
+                dueTicks[i] = ticks;
+                handles[i] = wheel.scheduleTicks(ticks, 1, &dueTicks[i]);
+                lastDue = std::max(lastDue, ticks);
+            }
+            size_t cancelled = 0;
+            for (size_t i = 0; i < handles.size(); i += 10) {
+                if (wheel.cancel(handles[i])) cancelled++;
+                dueTicks[i] = 0;
+            }
+           
+            sf::Clock clock;
+            size_t fired = 0;
+            while (wheel.getTick() < lastDue) {
+                wheel.advanceTicks(1);
+                for (const TimerWheel::Expired& timer : wheel.getExpired()) {
+                    if (*static_cast<uint64_t*>(timer.owner) != wheel.getTick()) wrong++;
+                    fired++;
+                }
+            }
+            std::cout << "Timer wheel: " << dueTicks.size() << " timers over " << lastDue << " ticks ("
+                      << lastDue * TimerWheel::TICK_SECONDS / 3600.0f << " h), " << cancelled << " cancelled, "
+                      << fired << " fired, " << wrong << " off their tick, "
+                      << clock.getElapsedTime().asSeconds() * 1000.0f << " ms" << std::endl;
+            if (fired + cancelled != dueTicks.size()) wrong++;
+        }
        
-        while (window.isOpen()) {
-            // Calculate delta time
-            deltaTime = gameClock.restart().asSeconds();
+        TimerWheel timers;
+        Animator animator(resources.getArchetypes());
+        CombatSystem combat(7);
+        StatusEffects effects(timers, combat);
+        const int kinds = GameData::EFFECT_COUNT - 1;
+        int characterCount = (effectCount + kinds - 1) / kinds;
+        std::vector<std::unique_ptr<Enemy>> population;
+        for (int i = 0; i < characterCount; i++) {
+            population.push_back(std::make_unique<Enemy>(i % resources.getArchetypes().getMonsterCount(),
+                                                         resources, sounds, timers, animator));
+        }
+       
+        // Effects arrive over the first ten seconds so expiries don't all land together
+        const float frameTime = 1.0f / 60.0f;
+        const int rampFrames = 600;
+        int applied = 0;
+        uint64_t dispatched = 0;
+        double totalMs = 0.0;
+        double worstMs = 0.0;
+        sf::Clock clock;
+       
+        for (int frame = 0; frame < rampFrames + frames; frame++) {
+            clock.restart();
+            int target = std::min(effectCount, static_cast<int>(static_cast<long long>(effectCount) * (frame + 1) / rampFrames));
+            for (; applied < target; applied++) {
+                effects.apply(*population[applied / kinds], static_cast<GameData::EffectId>(1 + applied % kinds));
+            }
            
-            // Process events
-            processEvents();
+            timers.advance(frameTime);
+            for (const TimerWheel::Expired& timer : timers.getExpired()) {
+                Character& owner = *static_cast<Character*>(timer.owner);
+                if (timer.kind == TIMER_EFFECT_EXPIRE || timer.kind == TIMER_EFFECT_TICK) {
+                    effects.onTimer(timer);
+                    GameData::EffectId id = static_cast<GameData::EffectId>(timer.data);
+                    if (!owner.hasEffect(id)) effects.apply(owner, id);
+                } else {
+                    owner.onTimer(timer);
+                }
+            }
+            dispatched += timers.getExpired().size();
+            animator.advance(frameTime);
            
-            // Update game
-            update(deltaTime);
+            // Poison goes through combat; revive whatever it kills so the population holds
+            combat.resolve();
+            for (const CombatSystem::Event& event : combat.getEvents()) {
+                if (event.type == CombatSystem::EventType::Death) event.target->heal(event.target->getMaxHealth());
+            }
            
-            // Render
-            render();
+            if (frame >= rampFrames) {
+                double ms = clock.getElapsedTime().asSeconds() * 1000.0;
+                totalMs += ms;
+                worstMs = std::max(worstMs, ms);
+            }
+        }
+       
+        int live = 0;
+        for (const auto& character : population) {
+            for (int id = 1; id < GameData::EFFECT_COUNT; id++) {
+                live += character->hasEffect(static_cast<GameData::EffectId>(id)) ? 1 : 0;
+            }
+        }
+       
+        std::cout << "Status effects: " << live << " active on " << characterCount << " characters, "
+                  << timers.getActiveCount() << " timers in the wheel (AI cooldowns included)\n"
+                  << "  " << frames << " frames at 60 FPS: " << totalMs / frames << " ms avg, "
+                  << worstMs << " ms worst\n"
+                  << "  timers fired: " << static_cast<double>(dispatched) / (rampFrames + frames) << " per frame, "
+                  << "everything else untouched" << std::endl;
+        return wrong == 0 && live == effectCount ? 0 : 1;
+    }
+   
+    // A fireball dropped into a dense cluster of enemies, over and over. Each cast
+    // rebuilds the enemy grid, gathers and tests the blast area in one batch and
+    // resolves the damage; the targets are checked against a scan of every enemy.
+    int spells(int enemyCount, int casts) {
+        ResourceManager resources(false);
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        const ArchetypeTable& archetypes = resources.getArchetypes();
+        if (archetypes.getMonsterCount() == 0) return 1;
+       
+        int fireball = -1;
+        for (int i = 0; i < archetypes.getSpellCount(); i++) {
+            if (std::string(archetypes.getString(archetypes.getSpell(i).name)) == "Fireball") fireball = i;
+        }
+        if (fireball < 0) {
+            std::cerr << "No Fireball in the spell data" << std::endl;
+            return 1;
+        }
+        const GameData::SpellRecord& record = archetypes.getSpell(fireball);
+       
+        GameUtils::rng.seed(7);
+        TimerWheel timers;
+        Animator animator(resources.getArchetypes());
+        CombatSystem combat(7);
+        StatusEffects effects(timers, combat);
+        ParticleSystem particles;
+        LightMap lights;
+        SpellSystem spellSystem(resources, combat, effects, particles, lights, timers);
+        sf::View view;
+        Player caster("Bench", resources, sounds, timers, animator, view);
+       
+        const int size = 256;
+        const float centre = size * TILE_SIZE / 2.0f;
+        Dungeon dungeon(resources, sounds, combat, timers, animator, lights, &caster, size, size);
+        std::normal_distribution<float> spread(0.0f, 6.0f * TILE_SIZE);
+        for (int i = 0; i < enemyCount; i++) {
+            dungeon.addEnemy(i % archetypes.getMonsterCount(), 0, 0);
+            dungeon.getEnemies().back()->setPosition(centre + spread(GameUtils::rng), centre + spread(GameUtils::rng));
+        }
+        caster.setPosition(centre, centre - record.range / 2.0f);
+       
+        double gridSeconds = 0.0, querySeconds = 0.0, resolveSeconds = 0.0, scanSeconds = 0.0;
+        size_t targetsTotal = 0;
+        int mismatches = 0;
+        std::vector<int> expected;
+        std::vector<int> found;
+        const auto& enemies = dungeon.getEnemies();
+        sf::Clock clock;
+       
+        for (int cast = 0; cast < casts; cast++) {
+            float x = centre + spread(GameUtils::rng);
+            float y = centre + spread(GameUtils::rng);
+           
+            clock.restart();
+            dungeon.rebuildEnemyGrid();
+            gridSeconds += clock.restart().asSeconds();
+            spellSystem.burst(caster, fireball, x, y, dungeon);
+            querySeconds += clock.restart().asSeconds();
+            combat.resolve();
+            resolveSeconds += clock.restart().asSeconds();
+           
+            // The slow way: every enemy, every time
+            float reach = record.area + SpellSystem::BODY_RADIUS;
+            expected.clear();
+            for (size_t i = 0; i < enemies.size(); i++) {
+                float dx = enemies[i]->getPosition().x - x;
+                float dy = enemies[i]->getPosition().y - y;
+                if (dx * dx + dy * dy <= reach * reach) expected.push_back(static_cast<int>(i));
+            }
+            scanSeconds += clock.restart().asSeconds();
+           
+            found = spellSystem.getLastTargets();
+            std::sort(found.begin(), found.end());
+            if (found != expected) mismatches++;
+            targetsTotal += found.size();
+           
+            for (const auto& enemy : enemies) enemy->heal(enemy->getMaxHealth());
         }
+       
+        std::cout << "Spells: " << casts << " fireballs into " << enemyCount << " clustered enemies, "
+                  << static_cast<double>(targetsTotal) / casts << " caught per blast\n"
+                  << "  per cast: grid rebuild " << gridSeconds * 1.0e6 / casts << " us, area query "
+                  << querySeconds * 1.0e6 / casts << " us, damage resolve " << resolveSeconds * 1.0e6 / casts
+                  << " us (full scan would be " << scanSeconds * 1.0e6 / casts << " us)\n"
+                  << "  targets matching the full scan: " << (mismatches == 0 ? "all" : "NOT ALL") << std::endl;
+        return mismatches == 0 ? 0 : 1;
     }
    
-private:
-    void setupMainMenu() {
-        titleText.setFont(resources.getFont("main"));
-        titleText.setString("Dragonlance: Chronicles of the Lance");
-        titleText.setCharacterSize(32);
-        titleText.setFillColor(sf::Color::White);
-        titleText.setPosition(
-            WINDOW_WIDTH / 2 - titleText.getGlobalBounds().width / 2,
-            100
-        );
+    // Bodies bouncing around sealed rooms full of pillars, fast enough to cross
+    // several tiles a tick. After every tick no body may overlap a solid tile or
+    // have left the room it started in - a body that tunnelled through a wall
+    // would show up in the wrong room.
+    int collision(int bodyCount, int ticks) {
+        const int size = 512;
+        const int room = 16;  // Wall every 16 tiles
+        GameUtils::rng.seed(11);
+        TileCollider collider;
+        collider.reset(size, size);
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                bool wall = x % room == 0 || y % room == 0;
+                collider.setSolid(x, y, wall || GameUtils::getRandomInt(1, 100) <= 8);
+            }
+        }
        
-        startText.setFont(resources.getFont("main"));
-        startText.setString("Start Game");
-        startText.setCharacterSize(24);
-        startText.setFillColor(sf::Color::White);
-        startText.setPosition(
-            WINDOW_WIDTH / 2 - startText.getGlobalBounds().width / 2,
-            300
-        );
+        std::vector<float> xs(bodyCount), ys(bodyCount), vxs(bodyCount), vys(bodyCount);
+        std::vector<int> rooms(bodyCount);
+        for (int i = 0; i < bodyCount; i++) {
+            int tileX, tileY;
+            do {
+                tileX = GameUtils::getRandomInt(0, size - 1);
+                tileY = GameUtils::getRandomInt(0, size - 1);
+            } while (collider.isSolid(tileX, tileY));
+            xs[i] = (tileX + 0.5f) * TILE_SIZE;
+            ys[i] = (tileY + 0.5f) * TILE_SIZE;
+            rooms[i] = (tileY / room) * size + tileX / room;
+           
+            float angle = GameUtils::getRandomFloat(0.0f, 2.0f * 3.14159f);
+            float speed = GameUtils::getRandomFloat(50.0f, 6000.0f);  // Up to three tiles a tick
+            vxs[i] = std::cos(angle) * speed;
+            vys[i] = std::sin(angle) * speed;
+        }
        
-        quitText.setFont(resources.getFont("main"));
-        quitText.setString("Quit");
-        quitText.setCharacterSize(24);
-        quitText.setFillColor(sf::Color::White);
-        quitText.setPosition(
-            WINDOW_WIDTH / 2 - quitText.getGlobalBounds().width / 2,
-            350
-        );
+        const float dt = 1.0f / 60.0f;
+        const float half = Character::BODY_HALF_SIZE;
+        double moveSeconds = 0.0;
+        double worstMs = 0.0;
+        int overlaps = 0;
+        int escapes = 0;
+        long long blocked = 0;
+        sf::Clock clock;
+       
+        for (int tick = 0; tick < ticks; tick++) {
+            clock.restart();
+            for (int i = 0; i < bodyCount; i++) {
+                TileCollider::Move result = collider.move(xs[i], ys[i], half, half, vxs[i] * dt, vys[i] * dt);
+                xs[i] = result.x;
+                ys[i] = result.y;
+                if (result.blockedX) vxs[i] = -vxs[i];
+                if (result.blockedY) vys[i] = -vys[i];
+                blocked += result.blockedX + result.blockedY;
+            }
+            double seconds = clock.getElapsedTime().asSeconds();
+            moveSeconds += seconds;
+            worstMs = std::max(worstMs, seconds * 1000.0);
+           
+            for (int i = 0; i < bodyCount; i++) {
+                if (collider.overlaps(xs[i], ys[i], half, half)) overlaps++;
+                int tileX = static_cast<int>(xs[i] / TILE_SIZE);
+                int tileY = static_cast<int>(ys[i] / TILE_SIZE);
+                if ((tileY / room) * size + tileX / room != rooms[i]) escapes++;
+            }
+        }
+       
+        std::cout << "Collision: " << bodyCount << " bodies for " << ticks << " ticks on a "
+                  << size << "x" << size << " tile map\n"
+                  << "  " << moveSeconds * 1000.0 / ticks << " ms per tick avg, " << worstMs << " ms worst ("
+                  << static_cast<double>(bodyCount) * ticks / moveSeconds / 1.0e6 << " M moves/s), "
+                  << static_cast<double>(blocked) / ticks << " wall hits per tick\n"
+                  << "  " << overlaps << " overlapping a wall, " << escapes << " tunnelled out of their room" << std::endl;
+        return overlaps == 0 && escapes == 0 ? 0 : 1;
     }
    
-    void setupCharacterCreation() {
-        creationTitle.setFont(resources.getFont("main"));
-        creationTitle.setString("Character Creation");
-        creationTitle.setCharacterSize(24);
-        creationTitle.setFillColor(sf::Color::White);
-        creationTitle.setPosition(
-            WINDOW_WIDTH / 2 - creationTitle.getGlobalBounds().width / 2,
-            50
-        );
+    // Path queries on a big map of walled rooms with doorways and scattered
+    // pillars. The same random start/goal pairs go through flat A* and through
+    // the portal graph with every leg refined; HPA* paths are checked step by step
+    // and compared with the optimal length. Then the cache and tile changes.
+    int paths(int size, int queries, int flatQueries) {
+        GameUtils::rng.seed(5);
+        const int room = 32;
+        TileCollider collider;
+        collider.reset(size, size);
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                bool wall = x % room == 0 || y % room == 0;
+                collider.setSolid(x, y, wall || GameUtils::getRandomInt(1, 100) <= 15);
+            }
+        }
+        // Two doorways through every wall between neighbouring rooms
+        for (int y = 0; y < size; y += room) {
+            for (int x = 0; x < size; x += room) {
+                for (int door = 0; door < 2; door++) {
+                    int along = GameUtils::getRandomInt(2, room - 3);
+                    for (int d = -1; d <= 1; d++) {
+                        for (int step = 0; step < 2; step++) {
+                            collider.setSolid(x + along + step, y + d, false);  // Through the north wall
+                            collider.setSolid(x + d, y + along + step, false);  // Through the west wall
+                        }
+                    }
+                }
+            }
+        }
        
-        attributePoints = 10;
-        attributes = {10, 10, 10, 10, 10, 10}; // STR, DEX, CON, INT, WIS, CHA
+        sf::Clock clock;
+        PathFinder finder;
+        finder.build(collider);
+        float buildMs = clock.getElapsedTime().asSeconds() * 1000.0f;
        
-        std::vector<std::string> attrNames = {
-            "Strength", "Dexterity", "Constitution",
-            "Intelligence", "Wisdom", "Charisma"
+        auto randomOpenTile = [&]() {
+            sf::Vector2i tile;
+            do {
+                tile = sf::Vector2i(GameUtils::getRandomInt(0, size - 1), GameUtils::getRandomInt(0, size - 1));
+            } while (collider.isSolid(tile.x, tile.y));
+            return tile;
+        };
+        std::vector<std::pair<sf::Vector2i, sf::Vector2i>> pairs(queries);
+        for (auto& pair : pairs) pair = {randomOpenTile(), randomOpenTile()};
+       
+        // Cost of a tile path, or -1 if any step is illegal
+        auto pathCost = [&](sf::Vector2i start, const std::vector<sf::Vector2i>& path) {
+            int cost = 0;
+            sf::Vector2i at = start;
+            for (const sf::Vector2i& next : path) {
+                int dx = next.x - at.x;
+                int dy = next.y - at.y;
+                if (std::abs(dx) > 1 || std::abs(dy) > 1 || (dx == 0 && dy == 0) || collider.isSolid(next.x, next.y)) return -1;
+                if (dx != 0 && dy != 0 && (collider.isSolid(at.x + dx, at.y) || collider.isSolid(at.x, at.y + dy))) return -1;
+                cost += dx != 0 && dy != 0 ? 14 : 10;
+                at = next;
+            }
+            return cost;
         };
        
-        for (int i = 0; i < 6; i++) {
-            sf::Text name;
-            name.setFont(resources.getFont("main"));
-            name.setString(attrNames[i]);
-            name.setCharacterSize(18);
-            name.setFillColor(sf::Color::White);
-            name.setPosition(WINDOW_WIDTH / 2 - 100, 150 + i * 40);
-            attributeNames.push_back(name);
-           
-            sf::Text value;
-            value.setFont(resources.getFont("main"));
-            value.setString(std::to_string(attributes[i]));
-            value.setCharacterSize(18);
-            value.setFillColor(sf::Color::White);
-            value.setPosition(WINDOW_WIDTH / 2 + 50, 150 + i * 40);
-            attributeValues.push_back(value);
-           
-            sf::RectangleShape increase;
-            increase.setSize(sf::Vector2f(20, 20));
-            increase.setFillColor(sf::Color(80, 80, 80));
-            increase.setPosition(WINDOW_WIDTH / 2 + 80, 150 + i * 40);
-            increaseButtons.push_back(increase);
+        std::vector<sf::Vector2i> waypoints, leg, full;
+        auto walk = [&](sf::Vector2i start, sf::Vector2i goal) {
+            full.clear();
+            if (!finder.findPath(start, goal, waypoints)) return false;
+            sf::Vector2i from = start;
+            for (const sf::Vector2i& waypoint : waypoints) {
+                if (!finder.refine(from, waypoint, leg)) return false;
+                full.insert(full.end(), leg.begin(), leg.end());
+                from = waypoint;
+            }
+            return true;
+        };
+       
+        int bad = 0;
+        int disagreements = 0;
+        double ratioTotal = 0.0;
+        int compared = 0;
+        double flatSeconds = 0.0, hierarchicalSeconds = 0.0;
+        std::vector<sf::Vector2i> flat;
+        for (int q = 0; q < flatQueries && q < queries; q++) {
+            clock.restart();
+            bool flatFound = finder.findPathFlat(pairs[q].first, pairs[q].second, flat);
+            flatSeconds += clock.restart().asSeconds();
+            bool found = walk(pairs[q].first, pairs[q].second);
+            hierarchicalSeconds += clock.restart().asSeconds();
            
-            sf::RectangleShape decrease;
-            decrease.setSize(sf::Vector2f(20, 20));
-            decrease.setFillColor(sf::Color(80, 80, 80));
-            decrease.setPosition(WINDOW_WIDTH / 2 + 20, 150 + i * 40);
-            decreaseButtons.push_back(decrease);
+            if (flatFound != found) disagreements++;
+            if (!flatFound || !found) continue;
+            int optimal = pathCost(pairs[q].first, flat);
+            int cost = pathCost(pairs[q].first, full);
+            if (cost < 0 || full.back() != pairs[q].second) {
+                bad++;
+            } else if (optimal > 0) {
+                ratioTotal += static_cast<double>(cost) / optimal;
+                compared++;
+            }
         }
        
-        confirmButton.setSize(sf::Vector2f(120, 30));
-        confirmButton.setFillColor(sf::Color(80, 80, 80));
-        confirmButton.setPosition(
-            WINDOW_WIDTH / 2 - 60,
-            400
-        );
+        // Throughput over all the pairs, coarse paths only; then the last few again
+        int found = 0;
+        clock.restart();
+        for (const auto& pair : pairs) found += finder.findPath(pair.first, pair.second, waypoints) ? 1 : 0;
+        double coarseSeconds = clock.restart().asSeconds();
+        const int repeats = std::min(queries, PathFinder::CACHE_SIZE / 2);
+        uint64_t hitsBefore = finder.getCacheHits();
+        for (int q = queries - repeats; q < queries; q++) {
+            finder.findPath(pairs[q].first, pairs[q].second, waypoints);
+        }
+        double repeatSeconds = clock.restart().asSeconds();
+        uint64_t repeatHits = finder.getCacheHits() - hitsBefore;
+       
+        // Flip tiles and keep querying; every path must still be legal
+        double invalidateSeconds = 0.0;
+        const int changes = 2000;
+        for (int i = 0; i < changes; i++) {
+            sf::Vector2i tile(GameUtils::getRandomInt(0, size - 1), GameUtils::getRandomInt(0, size - 1));
+            collider.setSolid(tile.x, tile.y, !collider.isSolid(tile.x, tile.y));
+            clock.restart();
+            finder.invalidate(tile.x, tile.y);
+            invalidateSeconds += clock.restart().asSeconds();
+           
+            const auto& pair = pairs[i % queries];
+            if (walk(pair.first, pair.second) && (pathCost(pair.first, full) < 0 || full.back() != pair.second)) bad++;
+        }
        
-        confirmText.setFont(resources.getFont("main"));
-        confirmText.setString("Start Adventure");
-        confirmText.setCharacterSize(16);
-        confirmText.setFillColor(sf::Color::White);
-        confirmText.setPosition(
-            confirmButton.getPosition().x + confirmButton.getSize().x / 2 - confirmText.getGlobalBounds().width / 2,
-            confirmButton.getPosition().y + 5
-        );
+        int flatRun = std::min(flatQueries, queries);
+        std::cout << "Paths: " << size << "x" << size << " map, " << finder.getNodeCount() << " portals in "
+                  << size / PathFinder::CLUSTER_SIZE << "x" << size / PathFinder::CLUSTER_SIZE
+                  << " clusters, built in " << buildMs << " ms\n"
+                  << "  flat A*:  " << flatRun / flatSeconds << " queries/s over " << flatRun << " pairs\n"
+                  << "  HPA*:     " << flatRun / hierarchicalSeconds << " queries/s on the same pairs, refined to tiles, "
+                  << (compared ? ratioTotal / compared : 0.0) << "x optimal length on average\n"
+                  << "  HPA*:     " << queries / coarseSeconds << " queries/s coarse over " << queries << " pairs ("
+                  << found << " reachable); " << repeatHits << " of " << repeats << " repeats from the cache at "
+                  << repeats / repeatSeconds << " queries/s\n"
+                  << "  tile change: " << invalidateSeconds * 1.0e6 / changes << " us to rebuild a cluster\n"
+                  << "  " << disagreements << " reachability disagreements, " << bad << " illegal paths" << std::endl;
+        return disagreements == 0 && bad == 0 ? 0 : 1;
     }
    
-    void startGame() {
-        // Create player
-        player = std::make_unique<Player>("Hero", resources, sounds, gameView,
-                                        attributes[0], attributes[1], attributes[2],
-                                        attributes[3], attributes[4], attributes[5]);
+    // Drop a file's pages from the OS cache so the next read goes to the disk
+    void evictFromCache(const std::string& filepath) {
+#ifndef _WIN32
+        int fd = ::open(filepath.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        ::fdatasync(fd);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+#endif
+    }
+   
+    // Startup media load from loose files against the asset pack, cold (pages
+    // evicted first, POSIX only) and warm, plus an LZ4 round trip of every
+    // compressed entry and of some synthetic buffers
+    int assets(const std::string& packPath, int rounds) {
+        if (!AssetPack::build(packPath, true)) return 1;
+        AssetPack pack;
+        if (!pack.open(packPath)) return 1;
+       
+        int failures = 0;
+        std::vector<uint8_t> extracted;
+        for (const AssetPack::AssetFile& asset : AssetPack::MANIFEST) {
+            const PackData::Entry* entry = pack.find(asset.kind, asset.id);
+            if (entry && !pack.extract(*entry, extracted)) failures++;
+        }
        
-        // Set player position
-        player->setPosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
+        // Synthetic buffers: incompressible, long runs, short repeats and a mix
+        std::vector<std::vector<uint8_t>> samples(4);
+        for (int i = 0; i < 200000; i++) {
+            samples[0].push_back(static_cast<uint8_t>(GameUtils::getRandomInt(0, 255)));
+            samples[1].push_back(static_cast<uint8_t>(i / 5000));
+            samples[2].push_back(static_cast<uint8_t>("abcab"[i % 5]));
+            samples[3].push_back(static_cast<uint8_t>(i % 97 < 60 ? i % 7 : GameUtils::getRandomInt(0, 255)));
+        }
+        samples.push_back({});
+        samples.push_back({1, 2, 3});
+        for (const auto& sample : samples) {
+            std::vector<uint8_t> packed(LZ4::maxCompressedSize(sample.size()));
+            size_t packedSize = LZ4::compress(sample.data(), sample.size(), packed.data());
+            std::vector<uint8_t> unpacked(sample.size());
+            if (!LZ4::decompress(packed.data(), packedSize, unpacked.data(), unpacked.size()) || unpacked != sample) failures++;
+            // A truncated block has to be rejected, never read or written past
+            if (packedSize > 1 && LZ4::decompress(packed.data(), packedSize - 1, unpacked.data(), unpacked.size())) failures++;
+        }
        
-        // Create UI manager
-        ui = new UIManager(resources, window, *player);
+        std::vector<std::string> looseFiles;
+        for (const AssetPack::AssetFile& asset : AssetPack::MANIFEST) {
+            if (asset.kind != PackData::ENTRY_MUSIC) looseFiles.push_back(asset.path);
+        }
+        ResourceManager resources(false);
+        float looseCold = 0.0f, packCold = 0.0f, looseWarm = 0.0f, packWarm = 0.0f;
+        int fromPack = 0;
+        for (int round = 0; round < rounds; round++) {
+            for (const auto& path : looseFiles) evictFromCache(path);
+            resources.loadAssets("");
+            looseCold += resources.getMediaLoadTimeMs();
+            resources.loadAssets("");
+            looseWarm += resources.getMediaLoadTimeMs();
+           
+            evictFromCache(packPath);
+            fromPack = resources.loadAssets(packPath);
+            packCold += resources.getMediaLoadTimeMs();
+            resources.loadAssets(packPath);
+            packWarm += resources.getMediaLoadTimeMs();
+        }
        
-        // Create and generate dungeon
-        currentDungeon = std::make_unique<Dungeon>(resources, sounds, player.get(), 50, 50);
-        currentDungeon->generateDungeon();
-        currentDungeon->populateEnemies();
-        currentDungeon->populateItems();
+        std::cout << "Assets: " << pack.getEntryCount() << " entries, " << pack.getSize() << " byte pack, "
+                  << fromPack << " loaded from it\n"
+#ifdef _WIN32
+                  << "  (cold numbers need page cache eviction, which is POSIX only)\n"
+#endif
+                  << "  loose files: " << looseCold / rounds << " ms cold, " << looseWarm / rounds << " ms warm\n"
+                  << "  asset pack:  " << packCold / rounds << " ms cold, " << packWarm / rounds << " ms warm (avg over "
+                  << rounds << " rounds)\n"
+                  << "  " << failures << " LZ4 round trip failures" << std::endl;
+        return failures == 0 ? 0 : 1;
+    }
+   
+    // A 16-bit PCM WAV file in memory, so streamed voices can be tested without assets
+    std::vector<uint8_t> makeWav(unsigned int sampleRate, unsigned int channels, float seconds, float frequency) {
+        uint32_t frames = static_cast<uint32_t>(sampleRate * seconds);
+        uint32_t dataBytes = frames * channels * 2;
+        std::vector<uint8_t> wav(44 + dataBytes);
+        auto put32 = [&wav](size_t at, uint32_t value) { std::memcpy(&wav[at], &value, 4); };
+        auto put16 = [&wav](size_t at, uint16_t value) { std::memcpy(&wav[at], &value, 2); };
+        std::memcpy(&wav[0], "RIFF", 4);
+        put32(4, 36 + dataBytes);
+        std::memcpy(&wav[8], "WAVEfmt ", 8);
+        put32(16, 16);
+        put16(20, 1);
+        put16(22, static_cast<uint16_t>(channels));
+        put32(24, sampleRate);
+        put32(28, sampleRate * channels * 2);
+        put16(32, static_cast<uint16_t>(channels * 2));
+        put16(34, 16);
+        std::memcpy(&wav[36], "data", 4);
+        put32(40, dataBytes);
+        for (uint32_t i = 0; i < frames * channels; i++) {
+            float t = static_cast<float>(i / channels) / sampleRate;
+            put16(44 + i * 2, static_cast<uint16_t>(static_cast<int16_t>(8000.0f * std::sin(6.2831853f * frequency * t))));
+        }
+        return wav;
+    }
+   
+    std::shared_ptr<SoundData> makeTone(unsigned int sampleRate, unsigned int channels, float seconds, float frequency) {
+        auto data = std::make_shared<SoundData>();
+        data->sampleRate = sampleRate;
+        data->channels = channels;
+        data->frames = static_cast<size_t>(sampleRate * seconds);
+        data->owned.resize(data->frames * channels);
+        for (size_t i = 0; i < data->owned.size(); i++) {
+            float t = static_cast<float>(i / channels) / sampleRate;
+            data->owned[i] = static_cast<sf::Int16>(8000.0f * std::sin(6.2831853f * frequency * t));
+        }
+        data->samples = data->owned.data();
+        return data;
+    }
+   
+    // Mixer cost per voice at several voice counts, a music crossfade, voice
+    // stealing, the effect cache budget, and the null device's pacing. Streams
+    // decode WAVs built in memory; mono 22 kHz effects exercise resampling.
+    int audio(int chunksPerRun) {
+        std::vector<uint8_t> track = makeWav(44100, 2, 8.0f, 220.0f);
+        auto openTrack = [&track]() {
+            auto stream = std::make_unique<sf::InputSoundFile>();
+            return stream->openFromMemory(track.data(), track.size()) ? std::move(stream) : nullptr;
+        };
+        std::shared_ptr<const SoundData> effects[2] = {makeTone(22050, 1, 1.0f, 440.0f), makeTone(44100, 2, 1.0f, 660.0f)};
+        std::vector<sf::Int16> out(AudioMixer::CHUNK_FRAMES * 2);
+        int failures = 0;
+       
+        std::cout << "Audio: " << AudioMixer::CHUNK_FRAMES << "-frame chunks at " << AudioMixer::SAMPLE_RATE
+                  << " Hz, " << 1000.0 * AudioMixer::CHUNK_FRAMES / AudioMixer::SAMPLE_RATE << " ms each\n";
+        const int voiceCounts[] = {1, 8, 32, AudioMixer::MAX_VOICES};
+        for (int count : voiceCounts) {
+            AudioMixer mixer;
+            int streams = 0;
+            for (int v = 0; v < count; v++) {
+                if (v % 4 == 3 && mixer.playStream(openTrack(), AudioMixer::BUS_AMBIENCE, 0.3f, true, 0.0f)) {
+                    streams++;
+                } else {
+                    mixer.play(effects[v % 2], AudioMixer::BUS_EFFECTS, 0.3f, true);
+                }
+            }
+            for (int c = 0; c < chunksPerRun; c++) mixer.mix(out.data(), AudioMixer::CHUNK_FRAMES);
+            AudioMixer::Stats stats = mixer.getStats();
+            if (stats.voices != count) failures++;
+            std::cout << "  " << std::setw(2) << count << " voices (" << streams << " streamed): "
+                      << stats.mixUs << " us/chunk, " << stats.voiceUs << " us/voice, "
+                      << stats.streamVoiceUs << " us/streamed voice, " << 100.0 * stats.load << "% of real time\n";
+        }
        
-        // Set player position to a valid spot
-        for (int y = 0; y < 50; y++) {
-            for (int x = 0; x < 50; x++) {
-                if (currentDungeon->isWalkable(x * TILE_SIZE, y * TILE_SIZE)) {
-                    player->setPosition(x * TILE_SIZE + TILE_SIZE / 2, y * TILE_SIZE + TILE_SIZE / 2);
-                    break;
+        // Crossfade: the old track must be gone once its fade ends, the new one playing
+        AudioMixer mixer;
+        uint32_t first = mixer.playStream(openTrack(), AudioMixer::BUS_MUSIC, 1.0f, true, 0.0f);
+        for (int c = 0; c < 10; c++) mixer.mix(out.data(), AudioMixer::CHUNK_FRAMES);
+        mixer.fade(first, 0.0f, 0.5f, true);
+        mixer.playStream(openTrack(), AudioMixer::BUS_MUSIC, 1.0f, true, 0.5f);
+        int duringFade = 0;
+        for (int c = 0; c < 40; c++) {
+            mixer.mix(out.data(), AudioMixer::CHUNK_FRAMES);
+            if (c == 5) duringFade = mixer.getStats().voices;
+        }
+        int afterFade = mixer.getStats().voices;
+        if (first == 0 || duringFade != 2 || afterFade != 1) failures++;
+       
+        // Stealing: past MAX_VOICES the quietest effects make way, music is kept
+        for (int v = 0; v < AudioMixer::MAX_VOICES + 12; v++) {
+            mixer.play(effects[0], AudioMixer::BUS_EFFECTS, 0.1f + 0.01f * (v % 10));
+        }
+        mixer.resetStats();
+        mixer.mix(out.data(), AudioMixer::CHUNK_FRAMES);
+        AudioMixer::Stats stolen = mixer.getStats();
+        if (stolen.voices != AudioMixer::MAX_VOICES || stolen.stolen != static_cast<uint64_t>(12 + afterFade)) failures++;
+       
+        // Cache: 40 sounds of 200 KB against a 1 MB budget, three of them kept playing
+        ResourceManager resources(false);
+        SoundCache cache(resources, 1024 * 1024);
+        std::vector<std::shared_ptr<const SoundData>> playing;
+        for (int i = 0; i < 40; i++) {
+            std::string id = "tone" + std::to_string(i);
+            cache.insert(id, makeTone(44100, 1, 100000.0f / 44100, 200.0f + i));
+            if (i < 3) playing.push_back(cache.get(id));
+            if (cache.getUsedBytes() > cache.getBudget()) failures++;
+        }
+        for (int i = 0; i < 3; i++) {
+            if (cache.get("tone" + std::to_string(i)) != playing[i]) failures++;
+        }
+       
+        // Null device: a paced thread should mix in real time
+        AudioMixer paced;
+        for (int v = 0; v < 8; v++) paced.play(effects[v % 2], AudioMixer::BUS_EFFECTS, 0.3f, true);
+        NullAudioDevice device(paced);
+        sf::Clock clock;
+        device.start();
+        sf::sleep(sf::seconds(0.5f));
+        device.stop();
+        double expected = clock.getElapsedTime().asSeconds() * AudioMixer::SAMPLE_RATE / AudioMixer::CHUNK_FRAMES;
+        AudioMixer::Stats pacedStats = paced.getStats();
+        if (std::abs(static_cast<double>(pacedStats.chunks) - expected) > 3.0) failures++;
+       
+        std::cout << "  crossfade: " << duringFade << " voices during, " << afterFade << " after\n"
+                  << "  " << stolen.stolen << " voices stolen past " << AudioMixer::MAX_VOICES << "\n"
+                  << "  cache: " << cache.getCount() << " sounds, " << cache.getUsedBytes() << " of "
+                  << cache.getBudget() << " bytes, " << cache.getEvictions() << " evictions\n"
+                  << "  null device: " << pacedStats.chunks << " chunks in " << clock.getElapsedTime().asSeconds()
+                  << " s (" << expected << " expected)\n"
+                  << "  " << failures << " failures" << std::endl;
+        return failures == 0 ? 0 : 1;
+    }
+   
+    // Edit textures, sounds and data files under a scratch asset tree while a
+    // simulated 60 Hz frame loop runs, and time each edit until it is swapped in.
+    // Also checks that data losing a record is refused rather than applied.
+    int hotReload(int rounds) {
+        namespace fs = std::filesystem;
+        std::error_code error;
+        std::string root = (fs::temp_directory_path(error) / "lance_hot_reload").generic_string();
+        fs::remove_all(root, error);
+        fs::create_directories(root + "/data", error);
+        fs::create_directories(root + "/sprites", error);
+        fs::create_directories(root + "/sounds", error);
+        for (const auto& entry : fs::directory_iterator("assets/data", error)) {
+            if (entry.path().extension() == ".txt") fs::copy_file(entry.path(), root + "/data/" + entry.path().filename().string(), error);
+        }
+        auto readText = [](const std::string& path) {
+            std::ifstream in(path, std::ios::binary);
+            return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        };
+        auto writeText = [](const std::string& path, const std::string& text) {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out << text;
+        };
+        const std::string monstersPath = root + "/data/monsters.txt";
+        const std::string monsters = readText(monstersPath);
+        size_t experienceAt = monsters.find("experience = ");
+        if (experienceAt == std::string::npos) return 1;
+        experienceAt += std::strlen("experience = ");
+        size_t experienceEnd = monsters.find('\n', experienceAt);
+       
+        ResourceManager resources(false);
+        if (!resources.loadArchetypes(root + "/data", root + "/data/archetypes.bin")) return 1;
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        HotReloader reloader(resources, sounds);
+        if (!reloader.start(root)) return 1;
+       
+        // Run frames until a reload lands; returns the ms from the edit, or -1 on timeout
+        float worstFrameMs = 0.0f;
+        auto waitForReload = [&]() {
+            sf::Clock sinceEdit;
+            while (sinceEdit.getElapsedTime() < sf::seconds(3.0f)) {
+                sf::sleep(sf::milliseconds(16));
+                sf::Clock frame;
+                int before = reloader.getAppliedCount() + reloader.getRejectedCount();
+                reloader.update();
+                worstFrameMs = std::max(worstFrameMs, frame.getElapsedTime().asSeconds() * 1000.0f);
+                if (reloader.getAppliedCount() + reloader.getRejectedCount() > before) {
+                    return sinceEdit.getElapsedTime().asSeconds() * 1000.0f;
                 }
             }
+            return -1.0f;
+        };
+       
+        int failures = 0;
+        float latencies[3] = {};
+        int counts[3] = {};
+        const char* kinds[3] = {"texture", "sound", "data"};
+        for (int round = 0; round < rounds; round++) {
+            int kind = round % 3;
+            int experience = 1000 + round;
+            if (kind == 0) {
+                sf::Image image;
+                unsigned int size = round % 2 ? 64 : 128;
+                image.create(size, size, sf::Color(static_cast<sf::Uint8>(round * 40), 100, 200));
+                image.saveToFile(root + "/sprites/player.png");
+            } else if (kind == 1) {
+                std::vector<uint8_t> wav = makeWav(22050, 1, 0.5f, 200.0f + round * 50.0f);
+                writeText(root + "/sounds/attack.wav", std::string(wav.begin(), wav.end()));
+            } else {
+                writeText(monstersPath, monsters.substr(0, experienceAt) + std::to_string(experience) + monsters.substr(experienceEnd));
+            }
+           
+            float latency = waitForReload();
+            if (latency < 0.0f) {
+                failures++;
+                continue;
+            }
+            latencies[kind] += latency;
+            counts[kind]++;
+            if (kind == 2 && resources.getArchetypes().getMonster(0).experience != experience) failures++;
         }
        
-        // Switch to playing state
-        gameState.setState(GameState::State::Playing);
+        // Dropping a monster must be refused and leave the live table alone; the
+        // second one goes, since loot tables name the first and the last
+        int monsterCount = resources.getArchetypes().getMonsterCount();
+        size_t second = monsters.find("[monster]", monsters.find("[monster]") + 1);
+        size_t third = monsters.find("[monster]", second + 1);
+        writeText(monstersPath, monsters.substr(0, second) + monsters.substr(third));
+        int rejectedBefore = reloader.getRejectedCount();
+        if (waitForReload() < 0.0f || reloader.getRejectedCount() != rejectedBefore + 1 ||
+            resources.getArchetypes().getMonsterCount() != monsterCount) {
+            failures++;
+        }
+        reloader.stop();
+        fs::remove_all(root, error);
+       
+        std::cout << "Hot reload: " << reloader.getAppliedCount() << " applied, " << reloader.getRejectedCount()
+                  << " rejected over " << rounds << " edits\n";
+        for (int kind = 0; kind < 3; kind++) {
+            std::cout << "  " << kinds[kind] << ": " << (counts[kind] ? latencies[kind] / counts[kind] : 0.0f)
+                      << " ms from write to swap\n";
+        }
+        std::cout << "  " << reloader.getAverageLatencyMs() << " ms avg, " << reloader.getMaxLatencyMs()
+                  << " ms max from detection to swap (" << HotReloader::DEBOUNCE_MS << " ms of it debounce)\n"
+                  << "  game thread: " << reloader.getMaxApplyMs() << " ms worst swap, " << worstFrameMs
+                  << " ms worst update()\n"
+                  << "  " << failures << " failures" << std::endl;
+        return failures == 0 ? 0 : 1;
+    }
+   
+    // Cost of new/delete with the tracker as built, then a level's memory by tag:
+    // generated, run for some frames, and torn down again. Build once with and
+    // once without -DLANCE_MEMORY_TRACKING to compare the allocation cost.
+    int memory(int enemyCount, int frames) {
+        const int batch = 1000;
+        const int rounds = 2000;
+        std::vector<void*> blocks(batch);
+        sf::Clock clock;
+        for (int r = 0; r < rounds; r++) {
+            for (int i = 0; i < batch; i++) blocks[i] = ::operator new(16 + (i % 8) * 16);
+            for (int i = 0; i < batch; i++) ::operator delete(blocks[i]);
+        }
+        double pairNs = clock.getElapsedTime().asSeconds() * 1.0e9 / (batch * rounds);
+       
+        std::cout << "Memory: tracking " << (MemoryTracker::ENABLED ? "on" : "compiled out") << ", "
+                  << pairNs << " ns per new + delete" << std::endl;
+        if (!MemoryTracker::ENABLED) return 0;
+       
+        ResourceManager resources(false);
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        if (resources.getArchetypes().getMonsterCount() == 0) return 1;
+        GameUtils::rng.seed(5);
+        TimerWheel timers;
+        Animator animator(resources.getArchetypes());
+        CombatSystem combat(5);
+        LightMap lights;
+        sf::View view;
+        Player player("Bench", resources, sounds, timers, animator, view);
+       
+        MemoryTracker::TagReport before[MemoryTracker::TAG_COUNT];
+        for (int t = 0; t < MemoryTracker::TAG_COUNT; t++) before[t] = MemoryTracker::getReport(static_cast<MemoryTracker::Tag>(t));
+        {
+            Dungeon dungeon(resources, sounds, combat, timers, animator, lights, &player, 128, 128);
+            dungeon.generateDungeon();
+            player.setCollider(&dungeon.getCollider());
+            dungeon.populateEnemies();
+            dungeon.populateItems();
+            for (int i = 0; i < enemyCount; i++) {
+                sf::Vector2i tile = dungeon.findWalkableTile(1, 1, 126, 126);
+                dungeon.addEnemy(i % resources.getArchetypes().getMonsterCount(), tile.x, tile.y);
+            }
+            for (int frame = 0; frame < frames; frame++) {
+                timers.advance(1.0f / 60.0f);
+                animator.advance(1.0f / 60.0f);
+                dungeon.update(1.0f / 60.0f);
+                MemoryTracker::endFrame();
+            }
+           
+            std::stringstream overlay;
+            overlay << std::fixed << std::setprecision(2);
+            MemoryTracker::appendOverlay(overlay);
+            std::cout << "With a 128x128 level and " << dungeon.getEnemies().size() << " enemies after "
+                      << frames << " frames:\n" << overlay.str();
+            MemoryTracker::writeJson(std::cout);
+        }
+        player.setCollider(nullptr);
        
-        // Show intro if enabled
-        if (showIntro) {
-            ui->showDialog("Welcome to Krynn",
-                          "In the world of Krynn, the evil forces of Queen Takhisis threaten to engulf the land. "
-                          "You are a hero who has been called upon by the gods to defend the realm against "
-                          "her draconian armies.\n\n"
-                          "Your journey begins in the ancient ruins beneath the city of Xak Tsaroth, "
-                          "where rumors speak of a powerful artifact that could turn the tide of war...");
-            showIntro = false;
+        std::cout << "Left after the level is destroyed:\n";
+        for (int t = 0; t < MemoryTracker::TAG_COUNT; t++) {
+            MemoryTracker::TagReport after = MemoryTracker::getReport(static_cast<MemoryTracker::Tag>(t));
+            std::cout << "  " << MemoryTracker::TAG_NAMES[t] << ": " << after.liveBytes - before[t].liveBytes << " bytes in "
+                      << after.liveAllocations - before[t].liveAllocations << " allocations\n";
+        }
+        std::cout << std::flush;
+        return 0;
+    }
+   
+    // A level played headless: the game loop's updates, a fight the player keeps
+    // picking with whatever is in reach, and the frame recorded as renderGame
+    // records it, combat text, sounds and profiler overlay included, with the
+    // frame arena reset after every frame. There is no window, so no events are
+    // handled. Once warmed up, frames should not touch the heap; the exceptions
+    // are those clearing a body away, where loot is made on the heap and decal
+    // buckets may grow, and those where loot is picked up. Those are counted
+    // apart. Build with -DLANCE_MEMORY_TRACKING to have that counted. Also
+    // times building the stats line with a stringstream and a TextBuilder.
+    int frame(int enemyCount, int frames) {
+        ResourceManager resources(false);
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        const ArchetypeTable& archetypes = resources.getArchetypes();
+        if (archetypes.getMonsterCount() == 0) return 1;
+       
+        GameUtils::rng.seed(11);
+        TimerWheel timers;
+        Animator animator(resources.getArchetypes());
+        CombatSystem combat(11);
+        StatusEffects effects(timers, combat);
+        ParticleSystem particles;
+        LightMap lights;
+        SpellSystem spells(resources, combat, effects, particles, lights, timers);
+        sf::View view;
+        view.setSize(sf::Vector2f(WINDOW_WIDTH, WINDOW_HEIGHT));
+        sf::RenderWindow window;  // Never opened; the UI only reads its view
+       
+        // Hit and death sounds that always decode, so every hit starts a voice
+        sounds.replaceSound("hurt", makeTone(22050, 1, 0.2f, 440.0f));
+        sounds.replaceSound("death", makeTone(22050, 1, 0.4f, 220.0f));
+        Player player("Bench", resources, sounds, timers, animator, view);
+        player.addItem(std::make_shared<Weapon>(0, resources, 1));
+        player.addItem(std::make_shared<Armor>(0, resources, 1));
+        player.addItem(std::make_shared<Potion>(0, resources, 1));
+        for (int i = 0; i < archetypes.getSpellCount(); i++) {
+            player.learnSpell(std::make_shared<Spell>(i, archetypes));
+        }
+       
+        Dungeon dungeon(resources, sounds, combat, timers, animator, lights, &player, 96, 96);
+        dungeon.generateDungeon();
+        player.setCollider(&dungeon.getCollider());
+        dungeon.populateEnemies();
+        for (int i = 0; i < enemyCount; i++) {
+            sf::Vector2i tile = dungeon.findWalkableTile(1, 1, 94, 94);
+            dungeon.addEnemy(i % archetypes.getMonsterCount(), tile.x, tile.y);
         }
-    }
-   
-    void processEvents() {
-        sf::Event event;
-        while (window.pollEvent(event)) {
-            if (event.type == sf::Event::Closed) {
-                window.close();
+        sf::Vector2i start = dungeon.findWalkableTile(1, 1, 94, 94);
+        player.setPosition((start.x + 0.5f) * TILE_SIZE, (start.y + 0.5f) * TILE_SIZE);
+       
+        FramePacer pacer;
+        RenderThread renderer(window, false);
+        UIManager ui(resources, window, pacer, renderer, player);
+        ui.toggleInventory();
+        renderer.start();
+       
+        // The overlay shown, with sections and counters like the game's
+        FrameProfiler profiler;
+        int updateSection = profiler.section("Update");
+        int renderSection = profiler.section("Render");
+        int enemyCounter = profiler.counter("Enemies");
+        int particleCounter = profiler.counter("Particles live");
+        profiler.toggle();
+       
+        FrameArena& arena = FrameArena::local();
+        const float deltaTime = 1.0f / 60.0f;
+        int warmup = frames / 2;
+        uint64_t steadyAllocations = 0, bodyAllocations = 0;
+        int bodyFrames = 0, hits = 0, kills = 0;
+        float worstMs = 0.0f;
+        sf::Clock clock;
+        for (int frame = 0; frame < frames; frame++) {
+            uint64_t allocationsBefore = MemoryTracker::getThreadAllocations();
+            size_t enemiesBefore = dungeon.getEnemies().size();
+            size_t itemsBefore = dungeon.getItems().size();
+            size_t inventoryBefore = player.getInventory().size();
+            sf::Clock frameClock;
+           
+            profiler.begin(updateSection);
+            timers.advance(deltaTime);
+            for (const TimerWheel::Expired& timer : timers.getExpired()) {
+                if (timer.kind == TIMER_EFFECT_EXPIRE || timer.kind == TIMER_EFFECT_TICK) {
+                    effects.onTimer(timer);
+                } else {
+                    static_cast<Character*>(timer.owner)->onTimer(timer);
+                }
             }
+            animator.advance(deltaTime);
+            player.update(deltaTime);
+            dungeon.update(deltaTime);
+            spells.update(deltaTime, dungeon);
+            particles.update(deltaTime);
+            ui.update(deltaTime);
            
-            if (event.type == sf::Event::KeyPressed) {
-                if (event.key.code == sf::Keyboard::Escape) {
-                    if (gameState.getState() == GameState::State::Playing) {
-                        window.close();
+            // Swing at the first enemy in reach, as a click does
+            if (frame % 10 == 0) {
+                for (const auto& enemy : dungeon.getEnemies()) {
+                    if (player.distanceTo(*enemy) < 50.0f) {
+                        combat.queueAttack(player, *enemy);
+                        break;
                     }
                 }
-               
-                if (event.key.code == sf::Keyboard::I &&
-                    gameState.getState() == GameState::State::Playing) {
-                    ui->toggleInventory();
+            }
+            combat.resolve();
+           
+            // What presentCombatEvents makes of it
+            for (const CombatSystem::Event& event : combat.getEvents()) {
+                switch (event.type) {
+                    case CombatSystem::EventType::Miss:
+                        ui.addCombatText(event.x, event.y, "Miss", sf::Color(180, 180, 180));
+                        break;
+                    case CombatSystem::EventType::Hit: {
+                        hits++;
+                        effects.remove(*event.target, GameData::EFFECT_SLEEP);
+                        if (event.melee && event.attacker->getOnHitEffect() != GameData::EFFECT_NONE &&
+                            GameUtils::getRandomInt(1, 100) <= event.attacker->getOnHitChance() &&
+                            effects.apply(*event.target, event.attacker->getOnHitEffect())) {
+                            const StatusEffects::Rule& rule = StatusEffects::getRule(event.attacker->getOnHitEffect());
+                            ui.addCombatText(event.x, event.y - 16, rule.name, rule.color);
+                        }
+                        event.target->showHit();
+                        sounds.playSound("hurt");
+                        particles.emit(ParticleSystem::EmitterType::Hit, event.x, event.y, event.critical ? 24 : 12);
+                        TextBuilder amount(16);
+                        amount << event.amount;
+                        if (event.critical) amount << '!';
+                        ui.addCombatText(event.x, event.y, amount.view(),
+                                         event.critical ? sf::Color(255, 220, 60) : sf::Color(255, 90, 90));
+                        break;
+                    }
+                    case CombatSystem::EventType::Death:
+                        kills++;
+                        effects.clear(*event.target);
+                        sounds.playSound("death");
+                        particles.emit(ParticleSystem::EmitterType::Death, event.x, event.y, 40);
+                        break;
                 }
             }
+            player.heal(player.getMaxHealth());  // Keep the enemies coming
+            profiler.end(updateSection);
+           
+            // Record the frame as renderGame does
+            profiler.begin(renderSection);
+            DrawList& list = renderer.begin();
+            list.clear(sf::Color(20, 20, 20));
+            list.setView(view);
+            dungeon.draw(list);
+            spells.draw(list);
+            player.draw(list);
+            lights.update();
+            lights.draw(list);
+            particles.draw(list);
+            ui.draw(list);
+            profiler.end(renderSection);
+            profiler.setCounter(enemyCounter, static_cast<long long>(dungeon.getEnemies().size()));
+            profiler.setCounter(particleCounter, static_cast<long long>(particles.getLiveCount()));
+            profiler.draw(list, resources.getFont("main"));
+            renderer.submit();
            
-            if (event.type == sf::Event::MouseButtonPressed) {
-                handleMouseClick(event.mouseButton.x, event.mouseButton.y);
+            profiler.endFrame();
+            MemoryTracker::endFrame();
+            arena.reset();
+            if (frame >= warmup) {
+                uint64_t allocations = MemoryTracker::getThreadAllocations() - allocationsBefore;
+                if (dungeon.getEnemies().size() < enemiesBefore || dungeon.getItems().size() != itemsBefore ||
+                    player.getInventory().size() != inventoryBefore) {
+                    bodyAllocations += allocations;
+                    bodyFrames++;
+                } else {
+                    steadyAllocations += allocations;
+                }
+                worstMs = std::max(worstMs, frameClock.getElapsedTime().asSeconds() * 1000.0f);
             }
         }
+        renderer.stop();
+        float totalMs = clock.getElapsedTime().asSeconds() * 1000.0f;
+       
+        // The stats panel's line, built both ways
+        const int builds = 100000;
+        size_t checksum = 0;
+        clock.restart();
+        for (int i = 0; i < builds; i++) {
+            std::stringstream stream;
+            stream << player.getName() << " | Level " << player.getLevel() << " | HP: " << player.getHealth()
+                   << "/" << player.getMaxHealth() << " | Mana: " << player.getMana() << "/" << player.getMaxMana()
+                   << " | Gold: " << player.getGold() << " | XP: " << player.getExperience() << "/" << i;
+            checksum += stream.str().size();
+        }
+        double streamNs = clock.getElapsedTime().asSeconds() * 1.0e9 / builds;
+        clock.restart();
+        for (int i = 0; i < builds; i++) {
+            TextBuilder text;
+            player.appendName(text);
+            text << " | Level " << player.getLevel() << " | HP: " << player.getHealth()
+                 << "/" << player.getMaxHealth() << " | Mana: " << player.getMana() << "/" << player.getMaxMana()
+                 << " | Gold: " << player.getGold() << " | XP: " << player.getExperience() << "/" << i;
+            checksum -= text.size();
+            arena.reset();
+        }
+        double builderNs = clock.getElapsedTime().asSeconds() * 1.0e9 / builds;
+       
+        std::cout << "Frame: " << frames << " frames, " << dungeon.getEnemies().size() << " enemies left, "
+                  << totalMs / frames << " ms avg, " << worstMs << " ms worst after warm-up\n"
+                  << "  combat: " << hits << " hits, " << kills << " kills\n"
+                  << "  frame arena: " << arena.getPeakBytes() << " bytes peak per frame, "
+                  << arena.getCapacity() << " bytes reserved\n";
+        if (MemoryTracker::ENABLED) {
+            std::cout << "  heap allocations in the last " << frames - warmup - bodyFrames << " frames: "
+                      << steadyAllocations << " (and " << bodyAllocations << " in " << bodyFrames
+                      << " frames clearing a body or picking up loot)\n";
+        } else {
+            std::cout << "  heap allocations not counted (build with -DLANCE_MEMORY_TRACKING)\n";
+        }
+        std::cout << "  stats line: " << streamNs << " ns with a stringstream, " << builderNs
+                  << " ns with a TextBuilder" << (checksum == 0 ? "" : " (MISMATCH)") << std::endl;
+        player.setCollider(nullptr);
+        return checksum == 0 && steadyAllocations == 0 && hits > 0 && kills > 0 ? 0 : 1;
     }
    
-    void handleMouseClick(int x, int y) {
-        switch (gameState.getState()) {
-            case GameState::State::MainMenu:
-                handleMainMenuClick(x, y);
-                break;
-               
-            case GameState::State::CharacterCreation:
-                handleCharacterCreationClick(x, y);
-                break;
-               
-            case GameState::State::Playing:
-                // Game clicks handled in update
-                break;
-               
-            default:
-                break;
+    // View culling on a crowded level: a screen-sized view pans across it, and
+    // what cullEntities() picks each frame is checked against a scan of every
+    // enemy and item with the same margin.
+    int culling(int enemyCount, int itemCount, int frames) {
+        ResourceManager resources(false);
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        const ArchetypeTable& archetypes = resources.getArchetypes();
+        if (archetypes.getMonsterCount() == 0 || archetypes.getPotionCount() == 0) return 1;
+       
+        GameUtils::rng.seed(13);
+        TimerWheel timers;
+        Animator animator(resources.getArchetypes());
+        CombatSystem combat(13);
+        LightMap lights;
+        sf::View view;
+        Player player("Bench", resources, sounds, timers, animator, view);
+       
+        const int size = 256;
+        Dungeon dungeon(resources, sounds, combat, timers, animator, lights, &player, size, size);
+        dungeon.generateDungeon();
+        for (int i = 0; i < enemyCount; i++) {
+            sf::Vector2i tile = dungeon.findWalkableTile(1, 1, size - 2, size - 2);
+            dungeon.addEnemy(i % archetypes.getMonsterCount(), tile.x, tile.y);
+        }
+        for (int i = 0; i < itemCount; i++) {
+            sf::Vector2i tile = dungeon.findWalkableTile(1, 1, size - 2, size - 2);
+            dungeon.addItem<Potion>(tile.x, tile.y, i % archetypes.getPotionCount(), resources, 1);
+        }
+        dungeon.rebuildEnemyGrid();
+       
+        const auto& enemies = dungeon.getEnemies();
+        const auto& items = dungeon.getItems();
+        const float margin = Dungeon::DRAW_MARGIN;
+        const float worldSize = static_cast<float>(size * TILE_SIZE);
+        double cullSeconds = 0.0, scanSeconds = 0.0;
+        long long visibleTotal = 0;
+        int mismatches = 0;
+        std::vector<int> expected;
+        sf::Clock clock;
+        for (int frame = 0; frame < frames; frame++) {
+            // Sweep diagonally, wrapping at the edges
+            float t = static_cast<float>(frame) / frames;
+            sf::FloatRect viewBounds(std::fmod(t * 3.0f * worldSize, worldSize - WINDOW_WIDTH),
+                                     std::fmod(t * 2.0f * worldSize, worldSize - WINDOW_HEIGHT),
+                                     WINDOW_WIDTH, WINDOW_HEIGHT);
+           
+            clock.restart();
+            dungeon.cullEntities(viewBounds);
+            cullSeconds += clock.getElapsedTime().asSeconds();
+            visibleTotal += dungeon.getVisibleEntityCount();
+           
+            // Brute force: every enemy, then every ground item, by position
+            clock.restart();
+            expected.clear();
+            auto inside = [&](sf::Vector2f p) {
+                return p.x >= viewBounds.left - margin && p.x <= viewBounds.left + viewBounds.width + margin &&
+                       p.y >= viewBounds.top - margin && p.y <= viewBounds.top + viewBounds.height + margin;
+            };
+            for (size_t i = 0; i < enemies.size(); i++) {
+                if (inside(enemies[i]->getPosition())) expected.push_back(static_cast<int>(i));
+            }
+            size_t enemiesSeen = expected.size();
+            for (size_t i = 0; i < items.size(); i++) {
+                if (inside(items[i]->getPosition()) && items[i]->isOnGround()) expected.push_back(static_cast<int>(i));
+            }
+            scanSeconds += clock.getElapsedTime().asSeconds();
+           
+            if (static_cast<int>(expected.size()) != dungeon.getVisibleEntityCount() ||
+                !std::equal(expected.begin(), expected.begin() + enemiesSeen, dungeon.getVisibleEnemies().begin()) ||
+                !std::equal(expected.begin() + enemiesSeen, expected.end(), dungeon.getVisibleItems().begin())) {
+                mismatches++;
+            }
         }
+       
+        int total = dungeon.getEntityCount();
+        double averageVisible = static_cast<double>(visibleTotal) / frames;
+        std::cout << "Culling: " << enemies.size() << " enemies and " << items.size() << " items on a " << size
+                  << "x" << size << " level, " << frames << " views\n"
+                  << "  " << averageVisible << " of " << total << " entities drawn per frame on average ("
+                  << 100.0 * averageVisible / total << "%)\n"
+                  << "  grid cull: " << cullSeconds * 1.0e6 / frames << " us/frame, full scan: "
+                  << scanSeconds * 1.0e6 / frames << " us/frame\n"
+                  << "  " << mismatches << " frames differing from the full scan" << std::endl;
+        return mismatches == 0 ? 0 : 1;
     }
    
-    void handleMainMenuClick(int x, int y) {
-        if (startText.getGlobalBounds().contains(sf::Vector2f(x, y))) {
-            gameState.setState(GameState::State::CharacterCreation);
-            sounds.playSound("item");
-        }
+    // Dungeon tile drawing on the same level with no lava and with half its floor
+    // turned to lava, through the chunk cache and as one sprite per tile. Lava is
+    // an 8-frame strip here, animated by the CPU fallback since benches have no
+    // shader; no chunk should be rebuilt while it plays.
+    int tiles(int size, int frames) {
+        ResourceManager resources(false);
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        sf::Image strip;
+        strip.create(TILE_SIZE * 8, TILE_SIZE, sf::Color(255, 100, 50));
+        for (const char* id : {"water", "lava", "torch"}) resources.reloadTexture(id, strip);
+       
+        GameUtils::rng.seed(17);
+        TimerWheel timers;
+        Animator animator(resources.getArchetypes());
+        CombatSystem combat(17);
+        LightMap lights;
+        sf::View view;
+        Player player("Bench", resources, sounds, timers, animator, view);
+        Dungeon dungeon(resources, sounds, combat, timers, animator, lights, &player, size, size);
+        dungeon.generateDungeon();
+       
+        struct Result {
+            double meshUs = 0.0;
+            double spriteUs = 0.0;
+            double quads = 0.0;
+            double animatedQuads = 0.0;
+            double drawCalls = 0.0;
+            long long rebuilt = 0;
+        };
+        DrawList list;
+        const float worldSize = static_cast<float>(size * TILE_SIZE);
+        auto run = [&]() {
+            Result result;
+            sf::Clock clock;
+            for (int pass = 0; pass < 2; pass++) {
+                for (int frame = -1; frame < frames; frame++) {
+                    float t = static_cast<float>(std::max(frame, 0)) / frames;
+                    view.setSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+                    view.setCenter(WINDOW_WIDTH / 2.0f + std::fmod(t * 3.0f * worldSize, worldSize - WINDOW_WIDTH),
+                                   WINDOW_HEIGHT / 2.0f + std::fmod(t * 2.0f * worldSize, worldSize - WINDOW_HEIGHT));
+                    timers.advance(1.0f / 60.0f);
+                    list.reset(sf::Vector2u(WINDOW_WIDTH, WINDOW_HEIGHT));
+                    list.setView(view);
+                    long long rebuiltBefore = dungeon.getTileMesh().getStats().chunksRebuilt;
+                   
+                    // Frame -1 draws the first view untimed
+                    clock.restart();
+                    if (pass == 0) {
+                        dungeon.draw(list);
+                    } else {
+                        // As Dungeon::draw did before the cache
+                        sf::Vector2f corner = view.getCenter() - view.getSize() / 2.0f;
+                        int startX = std::max(0, static_cast<int>(corner.x) / TILE_SIZE);
+                        int startY = std::max(0, static_cast<int>(corner.y) / TILE_SIZE);
+                        int endX = std::min(size, static_cast<int>(corner.x + view.getSize().x) / TILE_SIZE + 1);
+                        int endY = std::min(size, static_cast<int>(corner.y + view.getSize().y) / TILE_SIZE + 1);
+                        for (int y = startY; y < endY; y++) {
+                            for (int x = startX; x < endX; x++) {
+                                const Tile* tile = dungeon.getTileAtPosition(x * TILE_SIZE, y * TILE_SIZE);
+                                list.draw(tile->getSprite(), tile->getMaterial());
+                            }
+                        }
+                    }
+                    double us = clock.getElapsedTime().asMicroseconds();
+                    if (frame < 0) continue;
+                   
+                    if (pass == 0) {
+                        const TileMesh::Stats& stats = dungeon.getTileMesh().getStats();
+                        result.meshUs += us;
+                        result.quads += stats.quadsDrawn;
+                        result.animatedQuads += stats.quadsAnimated;
+                        result.drawCalls += list.getDrawCallCount();
+                        result.rebuilt += stats.chunksRebuilt - rebuiltBefore;
+                    } else {
+                        result.spriteUs += us;
+                    }
+                }
+            }
+            result.meshUs /= frames;
+            result.spriteUs /= frames;
+            result.quads /= frames;
+            result.animatedQuads /= frames;
+            result.drawCalls /= frames;
+            return result;
+        };
        
-        if (quitText.getGlobalBounds().contains(sf::Vector2f(x, y))) {
-            window.close();
+        Result still = run();
+        int lava = 0;
+        for (int y = 1; y < size - 1; y++) {
+            for (int x = 1; x < size - 1; x++) {
+                Tile* tile = dungeon.getTileAtPosition((x + 0.5f) * TILE_SIZE, (y + 0.5f) * TILE_SIZE);
+                if (tile->getType() == Tile::Type::Floor && GameUtils::getRandomInt(0, 1) == 0) {
+                    dungeon.setTile(x, y, Tile::Type::Lava);
+                    lava++;
+                }
+            }
         }
+        dungeon.rebuildTileMesh();
+        Result molten = run();
+       
+        auto print = [](const char* label, const Result& result) {
+            std::cout << "  " << label << result.meshUs << " us/frame cached (" << result.quads << " quads in "
+                      << result.drawCalls << " draw calls, " << result.animatedQuads
+                      << " moved to a new frame), " << result.spriteUs << " us/frame as sprites\n";
+        };
+        std::cout << std::fixed << std::setprecision(2) << "Tiles: " << size << "x" << size << " level, "
+                  << frames << " views, chunks of " << TileMesh::CHUNK_TILES << "x" << TileMesh::CHUNK_TILES << "\n";
+        print("no lava:    ", still);
+        print("50% lava:   ", molten);
+        std::cout << "  " << lava << " floor tiles turned to lava, " << still.rebuilt + molten.rebuilt
+                  << " chunks rebuilt while drawing after warm-up" << std::endl;
+        return still.rebuilt + molten.rebuilt == 0 ? 0 : 1;
     }
    
-    void handleCharacterCreationClick(int x, int y) {
-        for (int i = 0; i < 6; i++) {
-            if (increaseButtons[i].getGlobalBounds().contains(sf::Vector2f(x, y))) {
-                if (attributePoints > 0 && attributes[i] < 18) {
-                    attributes[i]++;
-                    attributePoints--;
-                    attributeValues[i].setString(std::to_string(attributes[i]));
-                    sounds.playSound("item");
+    // The same crowded level played top-down and isometric, from the same seed with
+    // the player walking the same path: the game's updates, the dungeon and the
+    // light map. The two games take turns a frame at a time, each with its own copy
+    // of the shared random engine, so both meet the machine in the same state and
+    // their times compare directly. The times are only reported: one run's share
+    // of the machine is too noisy to gate on. Fails if isometric frames copy more
+    // than 10% more vertices or make half as many draw calls again as top-down, if
+    // a click through the views on an enemy's drawn sprite misses it or one beside
+    // it hits, or if the bucket sort's order differs from a stable comparison sort's.
+    int isometric(int enemyCount, int itemCount, int frames) {
+        ResourceManager resources(false);
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        const ArchetypeTable& archetypes = resources.getArchetypes();
+        if (archetypes.getMonsterCount() == 0 || archetypes.getPotionCount() == 0) return 1;
+       
+        struct Result {
+            double frameUs = 0.0;
+            double drawUs = 0.0;
+            double drawCalls = 0.0;
+            double vertices = 0.0;
+            double drawn = 0.0;
+            double standing = 0.0;
+            long long picks = 0;
+            int missedPicks = 0;
+        };
+        struct Play {
+            bool isometric;
+            std::mt19937 rng;
+            TimerWheel timers;
+            Animator animator;
+            CombatSystem combat;
+            StatusEffects effects;
+            LightMap lights;
+            sf::View view;
+            Player player;
+            Dungeon dungeon;
+            DrawList list;
+            Result result;
+           
+            Play(bool isometric, ResourceManager& resources, SoundManager& sounds, int size)
+                : isometric(isometric), animator(resources.getArchetypes()), combat(29), effects(timers, combat),
+                  player("Bench", resources, sounds, timers, animator, view),
+                  dungeon(resources, sounds, combat, timers, animator, lights, &player, size, size) {
+                view.setSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+            }
+            ~Play() { player.setCollider(nullptr); }
+        };
+        const int size = 128;
+        const float worldSize = static_cast<float>(size * TILE_SIZE);
+        const float margin = WINDOW_WIDTH;
+        const float deltaTime = 1.0f / 60.0f;
+        auto setUp = [&](bool isometric) {
+            GameUtils::rng.seed(29);
+            auto play = std::make_unique<Play>(isometric, resources, sounds, size);
+            Dungeon& dungeon = play->dungeon;
+            dungeon.generateDungeon();
+            play->player.setCollider(&dungeon.getCollider());
+            for (int i = 0; i < enemyCount; i++) {
+                sf::Vector2i tile = dungeon.findWalkableTile(1, 1, size - 2, size - 2);
+                dungeon.addEnemy(i % archetypes.getMonsterCount(), tile.x, tile.y);
+            }
+            for (int i = 0; i < itemCount; i++) {
+                sf::Vector2i tile = dungeon.findWalkableTile(1, 1, size - 2, size - 2);
+                dungeon.addItem<Potion>(tile.x, tile.y, i % archetypes.getPotionCount(), resources, 1);
+            }
+            dungeon.rebuildEnemyGrid();
+            dungeon.rebuildTileMesh();
+            play->rng = GameUtils::rng;
+            return play;
+        };
+       
+        // The window pixel a point shows at through a view, and the point under a
+        // pixel: RenderTarget's mapCoordsToPixel and mapPixelToCoords, with no window
+        auto toPixel = [](sf::Vector2f point, const sf::View& view) {
+            sf::Vector2f normalized = view.getTransform().transformPoint(point);
+            return sf::Vector2i(static_cast<int>(std::floor((normalized.x + 1.0f) / 2.0f * WINDOW_WIDTH + 0.5f)),
+                                static_cast<int>(std::floor((1.0f - normalized.y) / 2.0f * WINDOW_HEIGHT + 0.5f)));
+        };
+        auto toCoords = [](sf::Vector2i pixel, const sf::View& view) {
+            sf::Vector2f normalized(-1.0f + 2.0f * pixel.x / WINDOW_WIDTH, 1.0f - 2.0f * pixel.y / WINDOW_HEIGHT);
+            return view.getInverseTransform().transformPoint(normalized);
+        };
+       
+        // Walk diagonally, wrapping inside the walls; frame -1 warms up untimed
+        auto step = [&](Play& play, int frame) {
+            GameUtils::rng = play.rng;
+            Player& player = play.player;
+            Dungeon& dungeon = play.dungeon;
+            Result& result = play.result;
+            float t = static_cast<float>(std::max(frame, 0)) / frames;
+            sf::Clock frameClock;
+            player.setPosition(margin / 2 + std::fmod(t * 3.0f * worldSize, worldSize - margin),
+                               margin / 2 + std::fmod(t * 2.0f * worldSize, worldSize - margin));
+            play.timers.advance(deltaTime);
+            for (const TimerWheel::Expired& timer : play.timers.getExpired()) {
+                if (timer.kind == TIMER_EFFECT_EXPIRE || timer.kind == TIMER_EFFECT_TICK) {
+                    play.effects.onTimer(timer);
+                } else {
+                    static_cast<Character*>(timer.owner)->onTimer(timer);
                 }
             }
+            play.animator.advance(deltaTime);
+            player.update(deltaTime);
+            dungeon.update(deltaTime);
+            play.combat.resolve();
+            player.heal(player.getMaxHealth());
+            play.lights.update();
            
-            if (decreaseButtons[i].getGlobalBounds().contains(sf::Vector2f(x, y))) {
-                if (attributes[i] > 8) {
-                    attributes[i]--;
-                    attributePoints++;
-                    attributeValues[i].setString(std::to_string(attributes[i]));
-                    sounds.playSound("item");
+            sf::Clock drawClock;
+            DrawList& list = play.list;
+            list.reset(sf::Vector2u(WINDOW_WIDTH, WINDOW_HEIGHT));
+            if (play.isometric) {
+                dungeon.drawIsometric(list, play.view);
+            } else {
+                list.setView(play.view);
+                dungeon.draw(list);
+                player.draw(list);
+                play.lights.draw(list);
+            }
+            double drawUs = drawClock.getElapsedTime().asMicroseconds();
+            double frameUs = frameClock.getElapsedTime().asMicroseconds();
+            play.rng = GameUtils::rng;
+            if (frame < 0) return;
+           
+            result.frameUs += frameUs;
+            result.drawUs += drawUs;
+            result.drawCalls += list.getDrawCallCount();
+            result.vertices += list.getVertexCount();
+            result.drawn += dungeon.getVisibleEntityCount();
+            if (!play.isometric) return;
+            result.standing += dungeon.getStandingCount();
+           
+            // Clicks go through the views as the game takes them: the pixel where an
+            // enemy's sprite centre was drawn must pick it, one just past its right
+            // edge must not, and the pixel under its feet must aim at its feet
+            sf::View upright = IsoProjection::uprightView(play.view);
+            sf::View ground = IsoProjection::groundView(play.view);
+            const auto& enemies = dungeon.getEnemies();
+            for (int id : dungeon.getVisibleEnemies()) {
+                sf::Vector2f feet = enemies[id]->getPosition();
+                sf::FloatRect bounds = enemies[id]->getBounds();
+                sf::Vector2f offset = IsoProjection::standingOffset(feet);
+                sf::Vector2f centre(bounds.left + bounds.width / 2.0f, bounds.top + bounds.height / 2.0f);
+                sf::Vector2f outside(bounds.left + bounds.width + 1.0f, centre.y);
+                sf::Vector2f hit = IsoProjection::pick(toCoords(toPixel(centre + offset, upright), upright), feet);
+                sf::Vector2f miss = IsoProjection::pick(toCoords(toPixel(outside + offset, upright), upright), feet);
+                sf::Vector2f aim = toCoords(toPixel(IsoProjection::project(feet), upright), ground);
+                if (!bounds.contains(hit) || bounds.contains(miss) || std::abs(aim.x - feet.x) > 1.0f ||
+                    std::abs(aim.y - feet.y) > 1.0f) {
+                    result.missedPicks++;
                 }
+                result.picks++;
             }
+        };
+        std::unique_ptr<Play> topDownPlay = setUp(false);
+        std::unique_ptr<Play> isoPlay = setUp(true);
+        for (int frame = -1; frame < frames; frame++) {
+            step(*topDownPlay, frame);
+            step(*isoPlay, frame);
         }
-       
-        if (confirmButton.getGlobalBounds().contains(sf::Vector2f(x, y))) {
-            startGame();
-            sounds.playSound("level_up");
+        for (Play* play : {topDownPlay.get(), isoPlay.get()}) {
+            play->result.frameUs /= frames;
+            play->result.drawUs /= frames;
+            play->result.drawCalls /= frames;
+            play->result.vertices /= frames;
+            play->result.drawn /= frames;
+            play->result.standing /= frames;
         }
-    }
-   
-    void update(float deltaTime) {
-        switch (gameState.getState()) {
-            case GameState::State::MainMenu:
-                // No updates needed for main menu
-                break;
-               
-            case GameState::State::CharacterCreation:
-                // Update character creation display
-                break;
-               
-            case GameState::State::Playing:
-                updateGame(deltaTime);
-                break;
-               
-            default:
-                break;
+        const Result& topDown = topDownPlay->result;
+        const Result& iso = isoPlay->result;
+       
+        // Bucket sort against std::stable_sort on a frame's worth of rows
+        const int rowCount = WINDOW_HEIGHT + 3 * TILE_SIZE;
+        const int things = 2000;
+        std::vector<std::pair<int, uint32_t>> reference;
+        DepthBuckets buckets;
+        double bucketUs = 0.0, stableUs = 0.0;
+        int misordered = 0;
+        sf::Clock clock;
+        for (int frame = 0; frame < frames; frame++) {
+            reference.clear();
+            for (int i = 0; i < things; i++) {
+                reference.push_back({GameUtils::getRandomInt(0, rowCount - 1), static_cast<uint32_t>(i)});
+            }
+           
+            clock.restart();
+            buckets.reset(rowCount);
+            for (const auto& thing : reference) buckets.add(thing.first, thing.second);
+            const std::vector<uint32_t>& sorted = buckets.sort();
+            bucketUs += clock.getElapsedTime().asMicroseconds();
+           
+            clock.restart();
+            std::stable_sort(reference.begin(), reference.end(),
+                             [](const auto& a, const auto& b) { return a.first < b.first; });
+            stableUs += clock.getElapsedTime().asMicroseconds();
+           
+            for (int i = 0; i < things; i++) misordered += sorted[i] == reference[i].second ? 0 : 1;
         }
+       
+        auto print = [](const char* label, const Result& result) {
+            std::cout << "  " << label << result.frameUs << " us/frame, " << result.drawUs << " us drawing, "
+                      << result.drawCalls << " draw calls, " << result.vertices << " vertices, " << result.drawn
+                      << " entities drawn\n";
+        };
+        std::cout << std::fixed << std::setprecision(2) << "Isometric: " << size << "x" << size << " level, "
+                  << enemyCount << " enemies, " << itemCount << " items, " << frames << " frames\n";
+        print("top-down:  ", topDown);
+        print("isometric: ", iso);
+        std::cout << "  isometric frames take " << 100.0 * iso.frameUs / topDown.frameUs << "% of top-down ("
+                  << 100.0 * iso.drawUs / topDown.drawUs << "% drawing), " << 100.0 * iso.vertices / topDown.vertices
+                  << "% of its vertices (at most 110%) and " << 100.0 * iso.drawCalls / topDown.drawCalls
+                  << "% of its draw calls (at most 150%), " << iso.standing << " things depth-sorted\n"
+                  << "  " << iso.picks << " enemy clicks, " << iso.missedPicks << " missed\n"
+                  << "  depth order of " << things << " things: buckets " << bucketUs / frames
+                  << " us, stable_sort " << stableUs / frames << " us, " << misordered << " out of place"
+                  << std::endl;
+        bool cheap = iso.vertices <= topDown.vertices * 1.1 && iso.drawCalls <= topDown.drawCalls * 1.5;
+        return cheap && iso.missedPicks == 0 && iso.picks > 0 && misordered == 0 ? 0 : 1;
     }
    
-    void updateGame(float deltaTime) {
-        // Update player movement from keyboard
-        float moveX = 0, moveY = 0;
-       
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::W) || sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) {
-            moveY = -1;
-        }
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::S) || sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) {
-            moveY = 1;
-        }
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::A) || sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) {
-            moveX = -1;
+    // Stamp decalCount decals over a level with room for capacity of them, then
+    // time drawing a sweep of views with them and with none, check the survivors
+    // are the newest in stamp order, and round-trip them through a save file.
+    int decals(int decalCount, int capacity, int frames) {
+        ResourceManager resources(false);
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        const ArchetypeTable& archetypes = resources.getArchetypes();
+        if (archetypes.getMonsterCount() == 0) return 1;
+       
+        GameUtils::rng.seed(23);
+        TimerWheel timers;
+        Animator animator(resources.getArchetypes());
+        CombatSystem combat(23);
+        LightMap lights;
+        sf::View view;
+        Player player("Bench", resources, sounds, timers, animator, view);
+        const int size = 256;
+        Dungeon dungeon(resources, sounds, combat, timers, animator, lights, &player, size, size);
+        dungeon.generateDungeon();
+        DecalLayer& layer = dungeon.getDecals();
+        layer.setCapacity(capacity);
+       
+        DrawList list;
+        const float worldSize = static_cast<float>(size * TILE_SIZE);
+        auto sweep = [&](double& quads) {
+            sf::Clock clock;
+            double seconds = 0.0;
+            quads = 0.0;
+            for (int frame = 0; frame < frames; frame++) {
+                float t = static_cast<float>(frame) / frames;
+                view.setSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+                view.setCenter(WINDOW_WIDTH / 2.0f + std::fmod(t * 3.0f * worldSize, worldSize - WINDOW_WIDTH),
+                               WINDOW_HEIGHT / 2.0f + std::fmod(t * 2.0f * worldSize, worldSize - WINDOW_HEIGHT));
+                list.reset(sf::Vector2u(WINDOW_WIDTH, WINDOW_HEIGHT));
+                list.setView(view);
+                clock.restart();
+                dungeon.draw(list);
+                seconds += clock.getElapsedTime().asSeconds();
+                quads += layer.getQuadsDrawn();
+            }
+            quads /= frames;
+            return seconds * 1.0e6 / frames;
+        };
+        double unused;
+        double bareUs = sweep(unused);
+       
+        std::vector<sf::Vector2f> positions(decalCount);
+        sf::Clock clock;
+        for (int i = 0; i < decalCount; i++) {
+            auto kind = static_cast<DecalData::Kind>(GameUtils::getRandomInt(0, DecalData::KIND_COUNT - 1));
+            uint16_t variant = static_cast<uint16_t>(kind == DecalData::KIND_CORPSE ?
+                                                     GameUtils::getRandomInt(0, archetypes.getMonsterCount() - 1) :
+                                                     GameUtils::getRandomInt(0, 3));
+            float x = GameUtils::getRandomFloat(0.0f, worldSize - 1.0f);
+            float y = GameUtils::getRandomFloat(0.0f, worldSize - 1.0f);
+            dungeon.addDecal(kind, x, y, variant, GameUtils::getRandomInt(6, 16));
+            positions[i] = sf::Vector2f(x, y);
         }
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::D) || sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) {
-            moveX = 1;
+        double stampUs = clock.getElapsedTime().asSeconds() * 1.0e6 / decalCount;
+       
+        double decalQuads = 0.0;
+        double decalUs = sweep(decalQuads);
+       
+        // Survivors must be the newest, oldest first
+        int failures = 0;
+        std::vector<DecalData::Record> kept = layer.getDecals();
+        if (static_cast<int>(kept.size()) != std::min(capacity, decalCount)) failures++;
+        if (layer.getEvictedCount() != static_cast<uint64_t>(std::max(0, decalCount - capacity))) failures++;
+        for (size_t i = 0; i < kept.size() && failures == 0; i++) {
+            const sf::Vector2f& stamped = positions[decalCount - kept.size() + i];
+            if (kept[i].x != stamped.x || kept[i].y != stamped.y) failures++;
         }
        
-        player->move(moveX, moveY);
-       
-        // Update player
-        player->update(deltaTime);
-       
-        // Collision detection with walls
-        sf::Vector2f pos = player->getPosition();
-        sf::FloatRect bounds = player->getBounds();
-        float halfWidth = bounds.width / 2;
-        float halfHeight = bounds.height / 2;
-       
-        // Check if player position is valid
-        if (!currentDungeon->isWalkable(pos.x - halfWidth, pos.y - halfHeight) ||
-            !currentDungeon->isWalkable(pos.x + halfWidth, pos.y - halfHeight) ||
-            !currentDungeon->isWalkable(pos.x - halfWidth, pos.y + halfHeight) ||
-            !currentDungeon->isWalkable(pos.x + halfWidth, pos.y + halfHeight)) {
-            // Move player back if colliding with wall
-            player->setPosition(pos.x - player->getPosition().x + pos.x,
-                              pos.y - player->getPosition().y + pos.y);
+        std::string path = (std::filesystem::temp_directory_path() / "lance_decals.bin").string();
+        bool saved = layer.save(path);
+        layer.clear();
+        bool loaded = saved && layer.load(path);
+        std::vector<DecalData::Record> reloaded = layer.getDecals();
+       
+        // A header claiming more decals than the file holds is refused before
+        // anything is allocated for them, and the layer keeps what it had
+        DecalData::Header bogus = {DecalData::MAGIC, DecalData::VERSION, 0xFFFFFFFFu, 0};
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(&bogus), sizeof(bogus));
+        bool refused = !layer.load(path) && layer.getCount() == static_cast<int>(kept.size());
+        std::filesystem::remove(path);
+        if (!refused) failures++;
+        if (!loaded || reloaded.size() != kept.size() ||
+            !std::equal(kept.begin(), kept.end(), reloaded.begin(), [](const auto& a, const auto& b) {
+                return std::memcmp(&a, &b, sizeof(DecalData::Record)) == 0;
+            })) {
+            failures++;
         }
        
-        // Update dungeon
-        currentDungeon->update(deltaTime);
-       
-        // Update UI
-        ui->update();
+        std::cout << "Decals: " << decalCount << " stamped on a " << size << "x" << size << " level with room for "
+                  << capacity << ", " << frames << " views\n"
+                  << "  stamp: " << stampUs << " us each, " << layer.getEvictedCount() << " evicted oldest first\n"
+                  << "  draw: " << decalUs << " us/frame with " << decalQuads << " decals in view, " << bareUs
+                  << " us/frame with none; no per-frame update\n"
+                  << "  save and load of " << kept.size() << " decals: " << (loaded ? "ok" : "failed")
+                  << ", oversized count " << (refused ? "refused" : "accepted") << "\n"
+                  << "  " << failures << " failures" << std::endl;
+        return failures == 0 ? 0 : 1;
+    }
+   
+    // The autotiler's full pass over a size x size map of random walls, on one
+    // thread and on every core, checked against a per-cell lookup; then edits
+    // patched in with update() checked against a fresh full pass.
+    int autotile(int size, int repeats, int edits) {
+        GameUtils::rng.seed(19);
+        std::vector<TileRecord> records(static_cast<size_t>(size) * size, TileRecord{Tile::Type::Floor, 0});
+        for (TileRecord& record : records) {
+            if (GameUtils::getRandomInt(1, 100) <= 40) record.type = Tile::Type::Wall;
+        }
+        int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
        
-        // Check for combat
-        const auto& enemies = currentDungeon->getEnemies();
-        for (const auto& enemy : enemies) {
-            float dist = player->distanceTo(*enemy);
-            if (dist < 50.0f) {
-                // Close enough to attack if clicked
-                if (sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
-                    sf::Vector2i mousePos = sf::Mouse::getPosition(window);
-                    sf::Vector2f worldPos = window.mapPixelToCoords(mousePos, gameView);
-                   
-                    if (enemy->getBounds().contains(worldPos)) {
-                        player->attack(*enemy);
-                    }
-                }
+        auto time = [&](int threads) {
+            sf::Clock clock;
+            for (int r = 0; r < repeats; r++) Autotiler::run(records.data(), size, size, threads);
+            return clock.getElapsedTime().asSeconds() * 1000.0 / repeats;
+        };
+        double oneMs = time(1);
+        double allMs = time(cores);
+       
+        sf::Clock clock;
+        long long mismatches = 0;
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                const TileRecord& record = records[static_cast<size_t>(y) * size + x];
+                uint8_t mask = Autotiler::maskAt(records.data(), size, size, x, y);
+                uint8_t expected = Autotiler::joins(record.type) ? Autotiler::PIECES[mask] : 0;
+                if (record.shape != expected) mismatches++;
             }
         }
+        double lookupMs = clock.getElapsedTime().asSeconds() * 1000.0;
+       
+        clock.restart();
+        for (int i = 0; i < edits; i++) {
+            int x = GameUtils::getRandomInt(0, size - 1);
+            int y = GameUtils::getRandomInt(0, size - 1);
+            TileRecord& record = records[static_cast<size_t>(y) * size + x];
+            record.type = record.type == Tile::Type::Wall ? Tile::Type::Floor : Tile::Type::Wall;
+            Autotiler::update(records.data(), size, size, x, y);
+        }
+        double editUs = clock.getElapsedTime().asSeconds() * 1.0e6 / edits;
+        std::vector<TileRecord> patched = records;
+        Autotiler::run(records.data(), size, size, cores);
+        long long editMismatches = 0;
+        for (size_t i = 0; i < records.size(); i++) {
+            if (records[i].shape != patched[i].shape) editMismatches++;
+        }
        
-        // Check for victory (all enemies defeated)
-        if (enemies.empty()) {
-            ui->showDialog("Victory!",
-                          "You have cleared this dungeon of all enemies and recovered the Dragon Orb, "
-                          "a powerful artifact that will help in the fight against Takhisis. "
-                          "The heroes of Krynn thank you for your bravery!\n\n"
-                          "Continue your journey in the full game...");
+        std::cout << "Autotile: " << size << "x" << size << " map, " << Autotiler::PIECE_COUNT << " blob pieces, "
+                  << sizeof(TileRecord) << " bytes per tile record\n"
+                  << "  full pass: " << oneMs << " ms on 1 thread, " << allMs << " ms on " << cores << " ("
+                  << oneMs * 1.0e6 / (static_cast<double>(size) * size) << " ns per tile on 1)\n"
+                  << "  per-cell neighbour lookups: " << lookupMs << " ms, " << mismatches << " tiles differing\n"
+                  << "  " << edits << " edits: " << editUs << " us each, " << editMismatches
+                  << " tiles differing from a full pass" << std::endl;
+        return mismatches == 0 && editMismatches == 0 ? 0 : 1;
+    }
+   
+    // How late sleep_for and FramePacer::sleepUntil wake for a frame-sized wait,
+    // then the frame rate and CPU use of a loop doing workMs of work per frame
+    // uncapped, capped at 60 frames/s, and idling as a waiting menu does.
+    int pacing(int frames, double workMs) {
+        using Clock = std::chrono::steady_clock;
+        const std::chrono::microseconds wait(4000);
+       
+        double sleepForLate = 0.0, sleepUntilLate = 0.0;
+        double sleepForWorst = 0.0, sleepUntilWorst = 0.0;
+        for (int i = 0; i < 200; i++) {
+            Clock::time_point start = Clock::now();
+            std::this_thread::sleep_for(wait);
+            double late = std::chrono::duration<double, std::micro>(Clock::now() - start - wait).count();
+            sleepForLate += late;
+            sleepForWorst = std::max(sleepForWorst, late);
            
-            gameState.setState(GameState::State::MainMenu);
+            start = Clock::now();
+            FramePacer::sleepUntil(start + wait);
+            late = std::chrono::duration<double, std::micro>(Clock::now() - start - wait).count();
+            sleepUntilLate += late;
+            sleepUntilWorst = std::max(sleepUntilWorst, late);
         }
        
-        // Check for game over
-        if (!player->isAlive()) {
-            ui->showDialog("Game Over",
-                          "You have fallen in battle. The forces of Takhisis grow stronger without "
-                          "your opposition. Perhaps another hero will rise to take your place...\n\n"
-                          "Try again?");
-           
-            gameState.setState(GameState::State::MainMenu);
+        // Spin for workMs, standing in for update and render
+        auto work = [workMs]() {
+            Clock::time_point end = Clock::now() +
+                std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(workMs));
+            volatile unsigned spin = 0;
+            while (Clock::now() < end) spin = spin + 1;
+        };
+       
+        std::cout << std::fixed << std::setprecision(1)
+                  << "Pacing: " << wait.count() << " us sleeps, " << workMs << " ms of work per frame\n"
+                  << "  sleep_for late by " << sleepForLate / 200 << " us on average, " << sleepForWorst
+                  << " us worst\n"
+                  << "  sleepUntil late by " << sleepUntilLate / 200 << " us on average, " << sleepUntilWorst
+                  << " us worst\n";
+       
+        FramePacer::Settings uncapped;
+        uncapped.uncapped = true;
+        FramePacer::Settings capped;
+        capped.frameCap = 60;
+        struct Case { const char* name; FramePacer::Settings settings; };
+        const Case cases[] = { { "uncapped", uncapped }, { "60 frames/s cap", capped } };
+        for (const Case& test : cases) {
+            FramePacer pacer(test.settings);
+            FramePacer::Mode mode = pacer.modeFor(false);
+            pacer.account(-1);
+            for (int frame = 0; frame < frames; frame++) {
+                work();
+                pacer.frameRendered();
+                pacer.endFrame(mode);
+            }
+            pacer.account(0);
+            const FramePacer::StateStats& stats = pacer.getStats(0);
+            std::cout << "  " << std::left << std::setw(16) << test.name << std::right << std::setw(9)
+                      << stats.frames / stats.wallSeconds << " frames/s " << std::setw(6)
+                      << 100.0 * stats.cpuSeconds / stats.wallSeconds << "% CPU" << std::endl;
         }
+       
+        // A waiting menu: one redraw, then asleep until input that never comes
+        FramePacer idle;
+        idle.account(-1);
+        work();
+        idle.frameRendered();
+        FramePacer::sleepUntil(Clock::now() + std::chrono::milliseconds(500));
+        idle.account(0);
+        const FramePacer::StateStats& stats = idle.getStats(0);
+        std::cout << "  " << std::left << std::setw(16) << "idle menu" << std::right << std::setw(9)
+                  << stats.frames / stats.wallSeconds << " frames/s " << std::setw(6)
+                  << 100.0 * stats.cpuSeconds / stats.wallSeconds << "% CPU" << std::endl;
+        return 0;
     }
    
-    void render() {
-        window.clear(sf::Color(20, 20, 20));
+    // Drawing on the render thread against drawing between updates. Each frame a
+    // level is updated and recorded into a draw list as the game does it; the
+    // window is never opened, so drawing is modelled as a fixed CPU cost per draw
+    // call and per vertex on top of the replay. With the render thread, a frame
+    // should take about the longer of the two sides instead of their sum.
+    int renderThread(int enemyCount, int frames) {
+        static const long long DRAW_CALL_NS = 5000;
+        static const long long VERTEX_NS = 25;
+       
+        struct ModelledRenderer : RenderThread {
+            ModelledRenderer(sf::RenderWindow& window, bool threaded) : RenderThread(window, threaded) {}
+           
+            void present(const DrawList& list) override {
+                RenderThread::present(list);
+                long long costNs = static_cast<long long>(list.getDrawCallCount()) * DRAW_CALL_NS +
+                                   static_cast<long long>(list.getVertexCount()) * VERTEX_NS;
+                auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(costNs);
+                while (std::chrono::steady_clock::now() < end) {}
+            }
+        };
        
-        switch (gameState.getState()) {
-            case GameState::State::MainMenu:
-                renderMainMenu();
-                break;
+        ResourceManager resources(false);
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        const ArchetypeTable& archetypes = resources.getArchetypes();
+        if (archetypes.getMonsterCount() == 0) return 1;
+       
+        std::cout << std::fixed << std::setprecision(3) << "Render thread: " << frames << " frames, drawing modelled at "
+                  << DRAW_CALL_NS / 1000.0 << " us per draw call and " << VERTEX_NS << " ns per vertex\n";
+        for (int threaded = 0; threaded < 2; threaded++) {
+            GameUtils::rng.seed(11);
+            TimerWheel timers;
+            Animator animator(resources.getArchetypes());
+            CombatSystem combat(11);
+            StatusEffects effects(timers, combat);
+            ParticleSystem particles;
+            LightMap lights;
+            SpellSystem spells(resources, combat, effects, particles, lights, timers);
+            sf::View view;
+            view.setSize(sf::Vector2f(WINDOW_WIDTH, WINDOW_HEIGHT));
+            sf::RenderWindow window;
+            Player player("Bench", resources, sounds, timers, animator, view);
+           
+            Dungeon dungeon(resources, sounds, combat, timers, animator, lights, &player, 64, 64);
+            dungeon.generateDungeon();
+            player.setCollider(&dungeon.getCollider());
+            dungeon.populateEnemies();
+            for (int i = 0; i < enemyCount; i++) {
+                sf::Vector2i tile = dungeon.findWalkableTile(1, 1, 62, 62);
+                dungeon.addEnemy(i % archetypes.getMonsterCount(), tile.x, tile.y);
+            }
+            sf::Vector2i start = dungeon.findWalkableTile(1, 1, 62, 62);
+            player.setPosition((start.x + 0.5f) * TILE_SIZE, (start.y + 0.5f) * TILE_SIZE);
+           
+            FramePacer pacer;
+            ModelledRenderer renderer(window, threaded != 0);
+            UIManager ui(resources, window, pacer, renderer, player);
+            renderer.start();
+           
+            const float deltaTime = 1.0f / 60.0f;
+            int warmup = frames / 4;
+            uint64_t steadyStart = 0;
+            double simSeconds = 0.0;
+            long long drawMicros = 0, waitMicros = 0;
+            size_t drawCalls = 0, drawnObjects = 0;
+            sf::Clock total;
+            for (int frame = 0; frame < frames; frame++) {
+                if (frame == warmup) {
+                    steadyStart = MemoryTracker::getThreadAllocations();
+                    total.restart();
+                }
+                sf::Clock clock;
                
-            case GameState::State::CharacterCreation:
-                renderCharacterCreation();
-                break;
+                timers.advance(deltaTime);
+                for (const TimerWheel::Expired& timer : timers.getExpired()) {
+                    if (timer.kind == TIMER_EFFECT_EXPIRE || timer.kind == TIMER_EFFECT_TICK) {
+                        effects.onTimer(timer);
+                    } else {
+                        static_cast<Character*>(timer.owner)->onTimer(timer);
+                    }
+                }
+                animator.advance(deltaTime);
+                player.update(deltaTime);
+                dungeon.update(deltaTime);
+                spells.update(deltaTime, dungeon);
+                particles.update(deltaTime);
+                ui.update(deltaTime);
+                combat.resolve();
+                player.heal(player.getMaxHealth());
                
-            case GameState::State::Playing:
-                renderGame();
-                break;
+                DrawList& list = renderer.begin();
+                list.clear(sf::Color(20, 20, 20));
+                list.setView(view);
+                dungeon.draw(list);
+                spells.draw(list);
+                player.draw(list);
+                lights.update();
+                lights.draw(list);
+                particles.draw(list);
+                ui.draw(list);
+                float simTime = clock.getElapsedTime().asSeconds();
+                if (frame >= warmup) {
+                    drawCalls += list.getDrawCallCount();
+                    drawnObjects += list.getDrawnObjectCount();
+                }
                
-            default:
-                break;
+                renderer.submit();
+                MemoryTracker::endFrame();
+                FrameArena::local().reset();
+                if (frame >= warmup) {
+                    simSeconds += simTime;
+                    drawMicros += renderer.getDrawMicros();
+                    waitMicros += renderer.getWaitMicros();
+                }
+            }
+            renderer.stop();
+            int measured = frames - warmup;
+            double frameMs = total.getElapsedTime().asSeconds() * 1000.0 / measured;
+            uint64_t steadyAllocations = MemoryTracker::getThreadAllocations() - steadyStart;
+           
+            std::cout << (threaded ? "  render thread: " : "  one thread:    ") << frameMs << " ms/frame ("
+                      << 1000.0 / frameMs << " frames/s); update and record " << simSeconds * 1000.0 / measured
+                      << " ms, draw " << drawMicros / 1000.0 / measured << " ms, waiting for the render thread "
+                      << waitMicros / 1000.0 / measured << " ms\n";
+            if (!threaded) {
+                std::cout << "  " << drawnObjects / measured << " sprites, texts and shapes per frame in "
+                          << drawCalls / measured << " draw calls\n";
+            }
+            if (MemoryTracker::ENABLED && threaded) {
+                std::cout << "  heap allocations on the game thread after warm-up: " << steadyAllocations << "\n";
+            }
+            player.setCollider(nullptr);
         }
-       
-        window.display();
-    }
-   
-    void renderMainMenu() {
-        window.draw(titleText);
-        window.draw(startText);
-        window.draw(quitText);
+        std::cout << std::flush;
+        return 0;
     }
    
-    void renderCharacterCreation() {
-        window.draw(creationTitle);
-       
-        for (int i = 0; i < 6; i++) {
-            window.draw(attributeNames[i]);
-            window.draw(attributeValues[i]);
-            window.draw(increaseButtons[i]);
-            window.draw(decreaseButtons[i]);
+    // Load a frame captured with F5 and replay it repeats times into an offscreen
+    // target: what it submits, by the code that drew it, and how long that takes
+    int replayCapture(const std::string& path, int repeats) {
+        ResourceManager resources;
+        DrawList list;
+        if (!list.load(path, resources)) return 1;
+       
+        DrawList::Stats stats = list.analyse();
+        std::cout << std::fixed << std::setprecision(3)
+                  << "Capture " << path << ": " << list.getSize().x << "x" << list.getSize().y << ", "
+                  << stats.drawCalls << " draw calls, " << stats.textureBinds << " texture binds, "
+                  << stats.vertices << " vertices, " << stats.views << " view changes, " << stats.texts
+                  << " texts (" << stats.codePoints << " characters)\n";
+        for (int s = 0; s < DrawList::SOURCE_COUNT; s++) {
+            if (stats.sourceDrawCalls[s] == 0) continue;
+            std::cout << "  " << std::left << std::setw(8) << DrawList::SOURCE_NAMES[s] << std::right << std::setw(6)
+                      << stats.sourceDrawCalls[s] << " draw calls " << std::setw(8) << stats.sourceVertices[s]
+                      << " vertices\n";
         }
+        std::cout << "  text layout: " << list.timeTextLayout(repeats) << " ms per frame" << std::endl;
        
-        window.draw(confirmButton);
-        window.draw(confirmText);
+        sf::RenderTexture target;
+        if (!target.create(list.getSize().x, list.getSize().y)) {
+            std::cerr << "No offscreen context to replay into; counts only" << std::endl;
+            return 0;
+        }
        
-        // Draw points remaining
-        sf::Text pointsText;
-        pointsText.setFont(resources.getFont("main"));
-        pointsText.setString("Points remaining: " + std::to_string(attributePoints));
-        pointsText.setCharacterSize(18);
-        pointsText.setFillColor(sf::Color::White);
-        pointsText.setPosition(WINDOW_WIDTH / 2 - 80, 350);
-        window.draw(pointsText);
+        // Submission is timed per frame; reading a pixel back at the end waits for the GPU
+        double totalMs = 0.0;
+        double bestMs = std::numeric_limits<double>::max();
+        sf::Clock wall;
+        for (int r = 0; r < repeats; r++) {
+            sf::Clock clock;
+            list.replay(target);
+            target.display();
+            double ms = clock.getElapsedTime().asSeconds() * 1000.0;
+            totalMs += ms;
+            bestMs = std::min(bestMs, ms);
+        }
+        target.getTexture().copyToImage();
+        double wallMs = wall.getElapsedTime().asSeconds() * 1000.0;
+        std::cout << "  replay: " << totalMs / repeats << " ms to submit on average, " << bestMs << " ms best; "
+                  << wallMs / repeats << " ms per frame including the GPU over " << repeats << " repeats" << std::endl;
+        return 0;
     }
    
-    void renderGame() {
-        // Set game view
-        window.setView(gameView);
+    // A crowd of enemies walking, with one in sixty starting an attack each frame.
+    // The Animator's single pass is timed against the scheme it replaced: a timer
+    // per character, the sheet row found by comparing clip names and the frame
+    // size divided out of the texture on every frame change. Each attack must
+    // raise exactly one hit event and every enemy must end up walking again.
+    int animation(int enemyCount, int frames) {
+        ResourceManager resources(false);
+        SoundManager sounds(resources, SoundManager::Output::Null);
+        const ArchetypeTable& table = resources.getArchetypes();
+        if (table.getMonsterCount() == 0 || table.getAnimationSetCount() == 0) return 1;
+       
+        TimerWheel timers;
+        Animator animator(table);
+        std::vector<std::unique_ptr<Enemy>> enemies;
+        for (int i = 0; i < enemyCount; i++) {
+            enemies.push_back(std::make_unique<Enemy>(i % table.getMonsterCount(), resources, sounds, timers, animator));
+        }
        
-        // Draw dungeon
-        currentDungeon->draw(window);
+        // The old per-character state, driven by its own wheel
+        struct Legacy {
+            std::string currentAnimation;
+            int frame;
+            TimerWheel::Handle timer;
+            const sf::Texture* texture;
+            sf::IntRect rect;
+        };
+        const float legacyFrameTime = 0.15f;
+        const uint16_t LEGACY_TIMER = 1;  // Any kind that fires; the wheel only reports those
+        TimerWheel legacyTimers;
+        std::vector<Legacy> legacy(enemyCount);
+        for (int i = 0; i < enemyCount; i++) {
+            legacy[i].frame = 0;
+            legacy[i].texture = &resources.getTexture(table.getString(table.getMonster(i % table.getMonsterCount()).texture));
+            legacy[i].timer = legacyTimers.schedule(legacyFrameTime, LEGACY_TIMER, &legacy[i]);
+        }
+        auto legacyPlay = [&](Legacy& state, const std::string& animation) {
+            if (state.currentAnimation == animation) return;
+            state.currentAnimation = animation;
+            state.frame = 0;
+            legacyTimers.cancel(state.timer);
+            state.timer = legacyTimers.schedule(legacyFrameTime, LEGACY_TIMER, &state);
+        };
        
-        // Draw player
-        player->draw(window);
+        const float frameTime = 1.0f / 60.0f;
+        const int settleFrames = 60;  // Long enough for the slowest attack to finish
+        long long attacks = 0, hits = 0, frameChanges = 0;
+        double playMs = 0.0, advanceMs = 0.0, legacyPlayMs = 0.0, legacyAdvanceMs = 0.0;
+        sf::Clock clock;
+        for (int frame = 0; frame < frames + settleFrames; frame++) {
+            bool attacking = frame < frames;
+           
+            clock.restart();
+            for (int i = 0; i < enemyCount; i++) {
+                bool attack = attacking && i % 60 == frame % 60;
+                enemies[i]->setAnimation(attack ? GameData::CLIP_ATTACK : GameData::CLIP_WALK);
+                attacks += attack ? 1 : 0;
+            }
+            playMs += clock.restart().asSeconds() * 1000.0;
+            animator.advance(frameTime);
+            for (int i = 0; i < enemyCount; i++) {  // Slots were handed out in creation order
+                sf::IntRect rect;
+                if (animator.takeFrame(i, rect)) frameChanges++;
+            }
+            advanceMs += clock.getElapsedTime().asSeconds() * 1000.0;
+            hits += static_cast<long long>(animator.getEvents().size());
+           
+            clock.restart();
+            for (int i = 0; i < enemyCount; i++) {
+                legacyPlay(legacy[i], attacking && i % 60 == frame % 60 ? "attack" : "walk");
+            }
+            legacyPlayMs += clock.restart().asSeconds() * 1000.0;
+            legacyTimers.advance(frameTime);
+            for (const TimerWheel::Expired& timer : legacyTimers.getExpired()) {
+                Legacy& state = *static_cast<Legacy*>(timer.owner);
+                state.timer = legacyTimers.schedule(legacyFrameTime, LEGACY_TIMER, &state);
+                state.frame = (state.frame + 1) % 4;
+                int frameWidth = state.texture->getSize().x / 4;
+                int frameHeight = state.texture->getSize().y / 4;
+                int row = 0;
+                if (state.currentAnimation == "walk") row = 1;
+                else if (state.currentAnimation == "attack") row = 2;
+                else if (state.currentAnimation == "hurt") row = 3;
+                state.rect = sf::IntRect(state.frame * frameWidth, row * frameHeight, frameWidth, frameHeight);
+            }
+            legacyAdvanceMs += clock.getElapsedTime().asSeconds() * 1000.0;
+        }
        
-        // Draw UI
-        ui->draw();
+        int walking = 0;
+        for (const auto& enemy : enemies) walking += enemy->getAnimation() == GameData::CLIP_WALK ? 1 : 0;
+       
+        int totalFrames = frames + settleFrames;
+        std::cout << "Animation: " << enemyCount << " enemies, " << table.getAnimationSetCount() << " sets, "
+                  << table.getClipCount() << " clips, " << table.getFrameCount() << " frames baked\n"
+                  << "  animator: advance + rects " << advanceMs / totalFrames << " ms per frame ("
+                  << advanceMs * 1.0e6 / totalFrames / enemyCount << " ns per enemy), clip requests "
+                  << playMs / totalFrames << " ms; " << static_cast<double>(frameChanges) / totalFrames
+                  << " frame changes per frame\n"
+                  << "  per-character timers and names: advance + rects " << legacyAdvanceMs / totalFrames
+                  << " ms per frame (" << legacyAdvanceMs * 1.0e6 / totalFrames / enemyCount
+                  << " ns per enemy), clip requests " << legacyPlayMs / totalFrames << " ms\n"
+                  << "  " << attacks << " attacks, " << hits << " hit events, " << walking << " of "
+                  << enemyCount << " walking at the end" << std::endl;
+        return hits == attacks && walking == enemyCount ? 0 : 1;
     }
-};
+}
 
 // Entry point
-int main() {
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "--bench-particles") {
+        return Benchmarks::particles(600);
+    }
+    if (mode == "--pack-assets") {
+        // Build step: every asset in AssetPack::MANIFEST -> assets/assets.pack
+        std::string packPath = argc > 2 && argv[2][0] != '-' ? argv[2] : "assets/assets.pack";
+        bool compress = std::string(argv[argc - 1]) != "--no-compress";
+        return AssetPack::build(packPath, compress) ? 0 : 1;
+    }
+    if (mode == "--compile-data") {
+        // Build step: assets/data/*.txt -> assets/data/archetypes.bin
+        std::string dataDir = argc > 2 ? argv[2] : "assets/data";
+        std::string blobPath = argc > 3 ? argv[3] : dataDir + "/archetypes.bin";
+        return ArchetypeTable::compile(dataDir, blobPath) ? 0 : 1;
+    }
+    if (mode == "--bench-data") {
+        return Benchmarks::archetypeData("assets/data", "assets/data/archetypes.bin", 1000);
+    }
+    if (mode == "--bench-combat") {
+        return Benchmarks::combat(10000, 500);
+    }
+    if (mode == "--bench-effects") {
+        return Benchmarks::statusEffects(100000, 3600);
+    }
+    if (mode == "--bench-spells") {
+        return Benchmarks::spells(5000, 2000);
+    }
+    if (mode == "--bench-collision") {
+        return Benchmarks::collision(100000, 600);
+    }
+    if (mode == "--bench-paths") {
+        return Benchmarks::paths(2048, 5000, 200);
+    }
+    if (mode == "--bench-assets") {
+        return Benchmarks::assets("assets/assets.pack", 20);
+    }
+    if (mode == "--bench-audio") {
+        return Benchmarks::audio(2000);
+    }
+    if (mode == "--bench-reload") {
+        return Benchmarks::hotReload(30);
+    }
+    if (mode == "--bench-memory") {
+        return Benchmarks::memory(500, 600);
+    }
+    if (mode == "--bench-frame") {
+        return Benchmarks::frame(300, 1200);
+    }
+    if (mode == "--bench-decals") {
+        return Benchmarks::decals(100000, 65536, 2000);
+    }
+    if (mode == "--bench-autotile") {
+        return Benchmarks::autotile(4096, 10, 100000);
+    }
+    if (mode == "--bench-isometric") {
+        return Benchmarks::isometric(2000, 500, 2000);
+    }
+    if (mode == "--bench-tiles") {
+        return Benchmarks::tiles(256, 2000);
+    }
+    if (mode == "--bench-culling") {
+        return Benchmarks::culling(20000, 5000, 2000);
+    }
+    if (mode == "--bench-pacing") {
+        return Benchmarks::pacing(300, 0.3);
+    }
+    if (mode == "--bench-render-thread") {
+        return Benchmarks::renderThread(300, 600);
+    }
+    if (mode == "--bench-animation") {
+        return Benchmarks::animation(10000, 600);
+    }
+    if (mode == "--replay-capture") {
+        // Time a frame saved with F5: --replay-capture [capture file] [repeats]
+        std::string path = argc > 2 ? argv[2] : "frame_capture.lcap";
+        int repeats = argc > 3 ? std::max(1, std::atoi(argv[3])) : 200;
+        return Benchmarks::replayCapture(path, repeats);
+    }
+    if (mode == "--loot-sim") {
+        // Monte Carlo check of drop rates: --loot-sim [kills per monster] [player level]
+        int kills = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5000000;
+        int level = argc > 3 ? std::atoi(argv[3]) : 1;
+        return Benchmarks::lootSimulation("assets/data", "assets/data/archetypes.bin", kills, level);
+    }
+   
+    // Game options: --hot-reload, --fps-cap <frames per second>, --uncapped, --single-thread-render,
+    // --max-decals <count>, --isometric
+    bool hotReload = false;
+    bool threadedRendering = true;
+    int maxDecals = DecalLayer::DEFAULT_CAPACITY;
+    bool isometric = false;
+    FramePacer::Settings pacing;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--hot-reload") {
+            hotReload = true;
+        } else if (option == "--fps-cap" && i + 1 < argc) {
+            pacing.frameCap = std::max(0, std::atoi(argv[++i]));
+        } else if (option == "--uncapped") {
+            pacing.uncapped = true;
+        } else if (option == "--single-thread-render") {
+            threadedRendering = false;
+        } else if (option == "--max-decals" && i + 1 < argc) {
+            maxDecals = std::max(0, std::atoi(argv[++i]));
+        } else if (option == "--isometric") {
+            isometric = true;
+        }
+    }
+   
     try {
-        Game game;
+        Game game(hotReload, pacing, threadedRendering, maxDecals, isometric);
         game.run();
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
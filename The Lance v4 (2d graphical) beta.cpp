@@ -1,11 +1,17 @@
 #include <iostream>
+#include <iomanip>
 #include <vector>
 #include <string>
 #include <cstdlib>
-#include <ctime>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 using namespace std;
 
+// Combatant archetype; battles copy its stats into flat arrays
 class Character {
 public:
     string name;
@@ -14,52 +20,296 @@ public:
     int defense;
 
     Character(string n, int h, int a, int d) : name(n), health(h), attackPower(a), defense(d) {}
+};
+
+// A side in the battle: how many of each archetype it fields
+struct Team {
+    string name;
+    vector<pair<int, int>> roster; // archetype index, count
+};
+
+// PCG32 generator. Each worker thread owns one and reseeds it per battle, so
+// results depend only on the seed and never on thread count or scheduling.
+class RandomStream {
+    uint64_t state;
+    uint64_t increment;
+
+public:
+    RandomStream() : state(0), increment(1) {}
+
+    void seed(uint64_t seed, uint64_t stream) {
+        state = 0;
+        increment = (stream << 1) | 1;
+        next();
+        state += seed;
+        next();
+    }
+
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + increment;
+        uint32_t shifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+        uint32_t rotation = static_cast<uint32_t>(old >> 59);
+        return (shifted >> rotation) | (shifted << ((32 - rotation) & 31));
+    }
+
+    // Uniform in [0, bound) by multiply-shift instead of rand() % size
+    uint32_t below(uint32_t bound) {
+        return static_cast<uint32_t>((static_cast<uint64_t>(next()) * bound) >> 32);
+    }
+};
+
+// Totals over many battles; every worker fills its own and they are merged at the end
+struct BattleStats {
+    static const int TTK_BINS = 32;
+
+    vector<long long> wins;                 // Per team, plus draws in the last slot
+    vector<vector<long long>> timeToKill;   // Per team: deaths by round, last bin is "or later"
+    long long battles;
+    long long rounds;
+    long long attacks;
 
-    void attack(Character &target) {
-        int damage = attackPower - target.defense;
-        if (damage < 0) {
-            damage = 0; // Ensure damage is not negative
+    BattleStats(int teams = 0)
+        : wins(teams + 1, 0), timeToKill(teams, vector<long long>(TTK_BINS, 0)),
+          battles(0), rounds(0), attacks(0) {}
+
+    void merge(const BattleStats &other) {
+        for (size_t i = 0; i < wins.size(); i++) wins[i] += other.wins[i];
+        for (size_t t = 0; t < timeToKill.size(); t++) {
+            for (int b = 0; b < TTK_BINS; b++) timeToKill[t][b] += other.timeToKill[t][b];
+        }
+        battles += other.battles;
+        rounds += other.rounds;
+        attacks += other.attacks;
+    }
+};
+
+// One battle with stats in parallel arrays. The living are kept in one packed
+// list per team; a death swaps the last member into the hole, so nothing is
+// ever erased from the middle and picking a random enemy is O(teams).
+class Battle {
+    static const int MAX_ROUNDS = 1000;
+
+    vector<int> health;
+    vector<int> attackPower;
+    vector<int> defense;
+    vector<int> team;
+    vector<int> slot;                 // Index of each combatant in its team's alive list
+    vector<vector<int>> alive;        // Per team, indices of living combatants
+    vector<int> order;                // Turn order for the current round
+    int aliveTotal;
+    int teamsStanding;
+
+public:
+    void reset(const vector<Character> &archetypes, const vector<Team> &teams) {
+        health.clear();
+        attackPower.clear();
+        defense.clear();
+        team.clear();
+        slot.clear();
+        alive.assign(teams.size(), vector<int>());
+
+        for (size_t t = 0; t < teams.size(); t++) {
+            for (const auto &entry : teams[t].roster) {
+                const Character &archetype = archetypes[entry.first];
+                for (int i = 0; i < entry.second; i++) {
+                    slot.push_back(static_cast<int>(alive[t].size()));
+                    alive[t].push_back(static_cast<int>(health.size()));
+                    health.push_back(archetype.health);
+                    attackPower.push_back(archetype.attackPower);
+                    defense.push_back(archetype.defense);
+                    team.push_back(static_cast<int>(t));
+                }
+            }
+        }
+
+        aliveTotal = static_cast<int>(health.size());
+        teamsStanding = 0;
+        for (const auto &members : alive) {
+            if (!members.empty()) teamsStanding++;
         }
-        target.health -= damage;
-        cout << name << " attacks " << target.name << " for " << damage << " damage!" << endl;
     }
+
+    // Fight until one team is left or the round limit is hit. Every combatant alive
+    // at the start of a round attacks once, in a shuffled order, a random living
+    // enemy. Returns the winning team, or -1 for a draw.
+    int run(RandomStream &rng, BattleStats &stats) {
+        int round = 0;
+        while (teamsStanding > 1 && round < MAX_ROUNDS) {
+            round++;
+
+            order.clear();
+            for (const auto &members : alive) order.insert(order.end(), members.begin(), members.end());
+            for (size_t i = order.size(); i > 1; i--) {
+                swap(order[i - 1], order[rng.below(static_cast<uint32_t>(i))]);
+            }
+
+            for (int attacker : order) {
+                if (health[attacker] <= 0) continue;
+                int ownTeam = team[attacker];
+                int enemies = aliveTotal - static_cast<int>(alive[ownTeam].size());
+                if (enemies == 0) break;
+
+                // Pick among all living enemies, then find which team's list holds it
+                int pick = static_cast<int>(rng.below(static_cast<uint32_t>(enemies)));
+                int targetTeam = 0;
+                for (;; targetTeam++) {
+                    if (targetTeam == ownTeam) continue;
+                    int size = static_cast<int>(alive[targetTeam].size());
+                    if (pick < size) break;
+                    pick -= size;
+                }
+                int target = alive[targetTeam][pick];
+
+                stats.attacks++;
+                int damage = attackPower[attacker] - defense[target];
+                if (damage > 0) { // Ensure damage is not negative
+                    health[target] -= damage;
+                    if (health[target] <= 0) kill(target, round, stats);
+                }
+            }
+        }
+
+        stats.battles++;
+        stats.rounds += round;
+        int winner = -1;
+        if (teamsStanding == 1) {
+            for (size_t t = 0; t < alive.size(); t++) {
+                if (!alive[t].empty()) winner = static_cast<int>(t);
+            }
+        }
+        stats.wins[winner < 0 ? alive.size() : winner]++;
+        return winner;
     }
 
-    bool isAlive() {
-        return health > 0;
+    int getCombatantCount() const { return static_cast<int>(health.size()); }
+
+private:
+    void kill(int index, int round, BattleStats &stats) {
+        int t = team[index];
+        vector<int> &members = alive[t];
+        int last = members.back();
+        members[slot[index]] = last;
+        slot[last] = slot[index];
+        members.pop_back();
+
+        aliveTotal--;
+        if (members.empty()) teamsStanding--;
+        stats.timeToKill[t][min(round, BattleStats::TTK_BINS) - 1]++;
     }
 };
 
 class Game {
 public:
     vector<Character> characters;
+    vector<Team> teams;
 
     void addCharacter(Character c) {
         characters.push_back(c);
     }
 
-    void startBattle() {
-        srand(time(0));
-        while (characters.size() > 1) {
-            int attackerIndex = rand() % characters.size();
-            int targetIndex = rand() % characters.size();
-            if (attackerIndex != targetIndex) {
-                characters[attackerIndex].attack(characters[targetIndex]);
-                if (!characters[targetIndex].isAlive()) {
-                    cout << characters[targetIndex].name << " has been defeated!" << endl;
-                    characters.erase(characters.begin() + targetIndex);
+    int addTeam(string name) {
+        teams.push_back(Team{name, {}});
+        return static_cast<int>(teams.size()) - 1;
+    }
+
+    void addToTeam(int teamIndex, const string &characterName, int count) {
+        for (size_t i = 0; i < characters.size(); i++) {
+            if (characters[i].name == characterName) {
+                teams[teamIndex].roster.push_back({static_cast<int>(i), count});
+                return;
+            }
+        }
+        cerr << "Unknown character: " << characterName << endl;
+    }
+
+    // Run independent battles on a pool of threads and print balance statistics
+    void simulate(int battles, int threads, uint64_t seed) {
+        vector<BattleStats> perThread(threads, BattleStats(static_cast<int>(teams.size())));
+        atomic<int> nextBattle(0);
+        int combatants = 0;
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> pool;
+        for (int id = 0; id < threads; id++) {
+            pool.emplace_back([&, id]() {
+                Battle battle;
+                RandomStream rng;
+                for (int b = nextBattle++; b < battles; b = nextBattle++) {
+                    rng.seed(seed, static_cast<uint64_t>(b));
+                    battle.reset(characters, teams);
+                    battle.run(rng, perThread[id]);
+                    if (b == 0) combatants = battle.getCombatantCount();
                 }
+            });
+        }
+        for (auto &worker : pool) worker.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        BattleStats total(static_cast<int>(teams.size()));
+        for (const auto &stats : perThread) total.merge(stats);
+        printReport(total, combatants, threads, seconds);
+    }
+
+private:
+    void printReport(const BattleStats &stats, int combatants, int threads, double seconds) {
+        cout << fixed << setprecision(2);
+        cout << stats.battles << " battles of " << combatants << " combatants on " << threads << " threads in "
+             << seconds << " s (" << stats.battles / seconds << " battles/s, "
+             << stats.attacks / seconds / 1.0e6 << " M attacks/s)" << endl;
+        cout << "Average battle length: " << static_cast<double>(stats.rounds) / stats.battles << " rounds" << endl;
+
+        cout << endl << "Win rates:" << endl;
+        for (size_t t = 0; t <= teams.size(); t++) {
+            string label = t < teams.size() ? teams[t].name : "Draw";
+            cout << "  " << left << setw(14) << label << right << setw(7)
+                 << 100.0 * stats.wins[t] / stats.battles << "%" << endl;
+        }
+
+        // Share of each team's deaths by the round they fell in
+        cout << endl << "Time to kill (round of death):" << endl;
+        for (size_t t = 0; t < teams.size(); t++) {
+            long long deaths = 0;
+            int lastBin = 0;
+            for (int b = 0; b < BattleStats::TTK_BINS; b++) {
+                deaths += stats.timeToKill[t][b];
+                if (stats.timeToKill[t][b] > 0) lastBin = b;
+            }
+            cout << "  " << teams[t].name << " (" << deaths << " deaths)" << endl;
+            if (deaths == 0) continue;
+
+            for (int b = 0; b <= lastBin; b++) {
+                double share = static_cast<double>(stats.timeToKill[t][b]) / deaths;
+                string label = to_string(b + 1) + (b == BattleStats::TTK_BINS - 1 ? "+" : "");
+                cout << "    " << setw(4) << label << " " << setw(6) << 100.0 * share << "% "
+                     << string(static_cast<size_t>(share * 60.0 + 0.5), '#') << endl;
             }
         }
-        cout << characters[0].name << " is the winner!" << endl;
     }
 };
 
-int main() {
+// Usage: beta [battles] [scale] [threads] [seed]
+// scale multiplies every roster; scale 100 puts 22,000 combatants in each battle
+int main(int argc, char *argv[]) {
+    int battles = argc > 1 ? max(1, atoi(argv[1])) : 2000;
+    int scale = argc > 2 ? max(1, atoi(argv[2])) : 10;
+    int threads = argc > 3 ? max(1, atoi(argv[3])) : max(1u, thread::hardware_concurrency());
+    uint64_t seed = argc > 4 ? strtoull(argv[4], nullptr, 10) : 2024;
+
     Game game;
     game.addCharacter(Character("Knight", 100, 20, 10));
     game.addCharacter(Character("Dragon", 150, 25, 5));
     game.addCharacter(Character("Wizard", 80, 30, 5));
-    game.startBattle();
+    game.addCharacter(Character("Draconian", 60, 22, 8));
+
+    int solamnia = game.addTeam("Solamnia");
+    game.addToTeam(solamnia, "Knight", 70 * scale);
+    game.addToTeam(solamnia, "Wizard", 30 * scale);
+
+    int dragonarmy = game.addTeam("Dragonarmy");
+    game.addToTeam(dragonarmy, "Dragon", 20 * scale);
+    game.addToTeam(dragonarmy, "Draconian", 100 * scale);
+
+    game.simulate(battles, threads, seed);
     return 0;
 }